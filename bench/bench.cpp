@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include "bench.h"
+#include "sdt_alloc.h"
+
+static const Benchmark benchmarks[] = {
+     {"weights", benchWeights, "weights WEIGHTS_FILE...    cold/warm load time of text and binary weights"},
+     {"gemm", benchGemm, "gemm [REPS]                GFLOP/s of the fire 1x1 convolutions per gemm kernel"},
+     {"winograd", benchWinograd, "winograd [REPS]            direct vs. Winograd time of the 3x3 convolutions"},
+     {"fire", benchFire, "fire [REPS]                time and memory traffic of layer by layer and fused fire modules"},
+     {"topk", benchTopK, "topk [BATCH] [REPS]        host top-k selection of the anchor scores vs. their full sort"},
+     {"nms", benchNms, "nms [REPS]                 pairwise vs. bucketed bitmask NMS of 64 to 8192 detections"},
+     {"transpose", benchTranspose, "transpose [REPS]           index vector vs. planned strided transposes of the sqdtrt tensors"},
+     {"host", benchHost, "host [OPTIONS] [CASE...]   every host step of a detection, see host --help"},
+     {NULL, NULL, NULL}
+};
+
+/* monotonic wall time in milliseconds */
+double benchNow(void)
+{
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* evict the file from the page cache, so the next read is a cold one */
+void dropFileCache(const char *path)
+{
+     int fd;
+     if ((fd = open(path, O_RDONLY)) == -1)
+          return;
+     fdatasync(fd);
+     posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+     close(fd);
+}
+
+/* runs func warmup times untimed, then reps times timed one by one */
+void timeCase(CaseFunc func, void *arg, int warmup, int reps, BenchTimes *times)
+{
+     assert(func && reps > 0 && times);
+     double *ms = (double *)sdt_alloc(sizeof(double) * reps), start, sum = 0;
+     int r;
+
+     for (r = 0; r < warmup; r++)
+          func(arg);
+     for (r = 0; r < reps; r++) {
+          start = benchNow();
+          func(arg);
+          ms[r] = benchNow() - start;
+          sum += ms[r];
+     }
+     std::sort(ms, ms + reps);
+     times->reps = reps;
+     times->min = ms[0];
+     times->median = reps % 2 ? ms[reps / 2] : (ms[reps / 2 - 1] + ms[reps / 2]) / 2;
+     times->mean = sum / reps;
+     times->max = ms[reps - 1];
+     sdt_free(ms);
+}
+
+/* the comma separated thread counts of list into threads[max], returns how many, 0 if
+   one isn't a positive number */
+int parseThreadList(const char *list, int *threads, int max)
+{
+     assert(list && threads);
+     int n = 0;
+     char *end;
+
+     while (n < max) {
+          long t = strtol(list, &end, 10);
+          if (end == list || t <= 0 || (*end && *end != ','))
+               return 0;
+          threads[n++] = (int)t;
+          if (!*end)
+               return n;
+          list = end + 1;
+     }
+     return 0;
+}
+
+static void print_usage_and_exit()
+{
+     const Benchmark *b;
+     fprintf(stderr, "Usage: sqdtrt-bench BENCHMARK [args]\n\nBenchmarks:\n");
+     for (b = benchmarks; b->name; b++)
+          fprintf(stderr, "       %s\n", b->usage);
+     exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+     const Benchmark *b;
+
+     if (argc < 2)
+          print_usage_and_exit();
+     for (b = benchmarks; b->name; b++)
+          if (!strcmp(b->name, argv[1]))
+               return b->func(argc - 1, argv + 1);
+     print_usage_and_exit();
+     return EXIT_FAILURE;
+}
@@ -0,0 +1,34 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+typedef int (*BenchFunc)(int argc, char *argv[]);
+
+typedef struct {
+     const char *name;
+     BenchFunc func;
+     const char *usage;
+} Benchmark;
+
+/* the times of a case over its repetitions after the warm-up ones, in ms */
+typedef struct {
+     int reps;
+     double min, median, mean, max;
+} BenchTimes;
+
+typedef void (*CaseFunc)(void *arg);
+
+double benchNow(void);
+void dropFileCache(const char *path);
+void timeCase(CaseFunc func, void *arg, int warmup, int reps, BenchTimes *times);
+int parseThreadList(const char *list, int *threads, int max);
+
+int benchWeights(int argc, char *argv[]);
+int benchGemm(int argc, char *argv[]);
+int benchWinograd(int argc, char *argv[]);
+int benchFire(int argc, char *argv[]);
+int benchTopK(int argc, char *argv[]);
+int benchNms(int argc, char *argv[]);
+int benchTranspose(int argc, char *argv[]);
+int benchHost(int argc, char *argv[]);
+
+#endif  /* _BENCH_H_ */
@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "bench.h"
+#include "cpuEngine.h"
+#include "cpuFused.h"
+#include "sdt_alloc.h"
+
+/* squeeze and expand widths of fire2 ~ fire11 */
+typedef struct {
+     const char *name;
+     int s1x1, e1x1, e3x3;
+} FireShape;
+
+static const FireShape FIRES[] = {
+     {"fire2", 16, 64, 64},
+     {"fire3", 16, 64, 64},
+     {"fire4", 32, 128, 128},
+     {"fire5", 32, 128, 128},
+     {"fire6", 48, 192, 192},
+     {"fire7", 48, 192, 192},
+     {"fire8", 64, 256, 256},
+     {"fire9", 64, 256, 256},
+     {"fire10", 96, 384, 384},
+     {"fire11", 96, 384, 384},
+     {NULL, 0, 0, 0}
+};
+
+/* runs of fire modules at one resolution at the default 384x1248 input, as the
+   engine groups them */
+typedef struct {
+     int first, last;           /* indices into FIRES */
+     int c, h, w;               /* input of the first module */
+} FireRun;
+
+static const FireRun RUNS[] = {
+     {0, 1, 64, 96, 312},
+     {2, 3, 128, 48, 156},
+     {4, 7, 256, 24, 78},
+     {8, 9, 512, 24, 78},
+     {-1, -1, 0, 0, 0}
+};
+
+static void addRandomWeights(WeightMap &weightMap, const std::string &name, long count)
+{
+     float *values = (float *)sdt_alloc(sizeof(float) * count);
+     for (long i = 0; i < count; i++)
+          values[i] = ((float)rand() / RAND_MAX - 0.5f) * 0.2f;
+     weightMap[name] = HostWeights{WEIGHTS_FLOAT, values, count};
+}
+
+/* an engine of the run, so the modules go through cpuEngineInfer() as in the network */
+static CpuEngine *createRunEngine(const FireRun *run)
+{
+     WeightMap weightMap;
+     CpuEngine *engine;
+     int c = run->c, i;
+
+     for (i = run->first; i <= run->last; i++) {
+          const FireShape *f = &FIRES[i];
+          std::string prefix(f->name);
+          addRandomWeights(weightMap, prefix + "_squeeze1x1_kernels", (long)f->s1x1 * c);
+          addRandomWeights(weightMap, prefix + "_squeeze1x1_biases", f->s1x1);
+          addRandomWeights(weightMap, prefix + "_expand1x1_kernels", (long)f->e1x1 * f->s1x1);
+          addRandomWeights(weightMap, prefix + "_expand1x1_biases", f->e1x1);
+          addRandomWeights(weightMap, prefix + "_expand3x3_kernels", (long)f->e3x3 * f->s1x1 * 9);
+          addRandomWeights(weightMap, prefix + "_expand3x3_biases", f->e3x3);
+          c = f->e1x1 + f->e3x3;
+     }
+     engine = createCpuFireEngine(weightMap, FIRES[run->first].name, FIRES[run->last].name,
+                                  run->c, run->h, run->w);
+     for (auto &mem : weightMap)
+          sdt_free(const_cast<void *>(mem.second.values));
+     return engine;
+}
+
+static double timeInfer(CpuEngine *engine, CpuFusion fusion, const float *src, float *dst, int reps)
+{
+     double start;
+     int r;
+
+     engine->fusion = fusion;
+     cpuEngineInfer(engine, src, dst, 1);
+     start = benchNow();
+     for (r = 0; r < reps; r++)
+          cpuEngineInfer(engine, src, dst, 1);
+     return (benchNow() - start) / reps;
+}
+
+static float maxAbsDiff(const float *a, const float *b, long len)
+{
+     float diff = 0;
+     for (long i = 0; i < len; i++)
+          diff = fmaxf(diff, fabsf(a[i] - b[i]));
+     return diff;
+}
+
+int benchFire(int argc, char *argv[])
+{
+     int reps = argc > 1 ? atoi(argv[1]) : 10;
+     const FireRun *run;
+     double none_ms, fire_ms, group_ms, unfused_bytes, fused_bytes, module_bytes;
+     int i;
+
+     if (reps <= 0) {
+          fprintf(stderr, "usage: sqdtrt-bench fire [REPS]\n");
+          return EXIT_FAILURE;
+     }
+     printf("time (ms) and activation traffic (MB) of fire modules layer by layer, fused per module,\n"
+            "and fused depth first across the modules of a group\n");
+     printf("%-16s %9s %9s %9s %10s %10s %10s %10s\n", "modules", "layer", "module", "group",
+            "layer(MB)", "module(MB)", "group(MB)", "max_diff");
+     for (run = RUNS; run->first >= 0; run++) {
+          CpuEngine *engine = createRunEngine(run);
+          long in_size = (long)run->c * run->h * run->w;
+          long out_size = (long)engine->oc * engine->oh * engine->ow;
+          float *src = (float *)sdt_alloc(sizeof(float) * in_size);
+          float *ref = (float *)sdt_alloc(sizeof(float) * out_size);
+          float *dst = (float *)sdt_alloc(sizeof(float) * out_size);
+          char name[32];
+          for (long j = 0; j < in_size; j++)
+               src[j] = (float)rand() / RAND_MAX;
+
+          none_ms = timeInfer(engine, CPU_FUSION_NONE, src, ref, reps);
+          fire_ms = timeInfer(engine, CPU_FUSION_FIRE, src, dst, reps);
+          float diff = maxAbsDiff(ref, dst, out_size);
+          group_ms = timeInfer(engine, CPU_FUSION_GROUP, src, dst, reps);
+          diff = fmaxf(diff, maxAbsDiff(ref, dst, out_size));
+
+          module_bytes = 0;
+          for (i = 0; i < engine->nlayers; i++) {
+               fireGroupTraffic(&engine->layers[i], 1, &unfused_bytes, &fused_bytes);
+               module_bytes += fused_bytes;
+          }
+          fireGroupTraffic(engine->layers, engine->nlayers, &unfused_bytes, &fused_bytes);
+          snprintf(name, sizeof(name), "%s-%s", FIRES[run->first].name, FIRES[run->last].name);
+          printf("%-16s %9.3f %9.3f %9.3f %10.2f %10.2f %10.2f %10.2e\n", name, none_ms, fire_ms, group_ms,
+                 unfused_bytes / 1e6, module_bytes / 1e6, fused_bytes / 1e6, diff);
+          destroyCpuEngine(engine);
+          sdt_free(src);
+          sdt_free(ref);
+          sdt_free(dst);
+     }
+     return EXIT_SUCCESS;
+}
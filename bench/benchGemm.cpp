@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "bench.h"
+#include "cpuGemm.h"
+#include "cpuOps.h"
+#include "sdt_alloc.h"
+
+/* the 1x1 convolutions of fire2 ~ fire11 at the default 384x1248 input */
+typedef struct {
+     const char *name;
+     int ic, oc, h, w;
+} GemmShape;
+
+static const GemmShape SHAPES[] = {
+     {"fire2_squeeze1x1", 64, 16, 96, 312},
+     {"fire2_expand1x1", 16, 64, 96, 312},
+     {"fire3_squeeze1x1", 128, 16, 96, 312},
+     {"fire4_squeeze1x1", 128, 32, 48, 156},
+     {"fire4_expand1x1", 32, 128, 48, 156},
+     {"fire5_squeeze1x1", 256, 32, 48, 156},
+     {"fire6_squeeze1x1", 256, 48, 24, 78},
+     {"fire6_expand1x1", 48, 192, 24, 78},
+     {"fire7_squeeze1x1", 384, 48, 24, 78},
+     {"fire8_squeeze1x1", 384, 64, 24, 78},
+     {"fire8_expand1x1", 64, 256, 24, 78},
+     {"fire9_squeeze1x1", 512, 64, 24, 78},
+     {"fire10_squeeze1x1", 512, 96, 24, 78},
+     {"fire10_expand1x1", 96, 384, 24, 78},
+     {"fire11_squeeze1x1", 768, 96, 24, 78},
+     {NULL, 0, 0, 0, 0}
+};
+
+static const GemmKernelKind KINDS[] = {
+     GEMM_KERNEL_SCALAR, GEMM_KERNEL_AVX2, GEMM_KERNEL_AVX512
+};
+
+static void fillRandom(float *data, long len)
+{
+     for (long i = 0; i < len; i++)
+          data[i] = (float)rand() / RAND_MAX - 0.5f;
+}
+
+static float maxAbsDiff(const float *a, const float *b, long len)
+{
+     float diff = 0;
+     for (long i = 0; i < len; i++)
+          diff = fmaxf(diff, fabsf(a[i] - b[i]));
+     return diff;
+}
+
+int benchGemm(int argc, char *argv[])
+{
+     int reps = argc > 1 ? atoi(argv[1]) : 20;
+     const GemmShape *s;
+     double start, ms, direct_ms;
+     int r;
+
+     if (reps <= 0) {
+          fprintf(stderr, "usage: sqdtrt-bench gemm [REPS]\n");
+          return EXIT_FAILURE;
+     }
+     printf("default kernel: %s\n", gemmKernelName(gemmKernel()));
+     printf("%-18s %5s %5s %6s %-7s %10s %9s %8s %10s\n",
+            "layer", "ic", "oc", "hw", "kernel", "time(ms)", "GFLOP/s", "speedup", "max_diff");
+     for (s = SHAPES; s->name; s++) {
+          long vol = (long)s->h * s->w;
+          double flops = 2.0 * s->oc * s->ic * vol;
+          float *kernel = (float *)sdt_alloc(sizeof(float) * s->oc * s->ic);
+          float *bias = (float *)sdt_alloc(sizeof(float) * s->oc);
+          float *src = (float *)sdt_alloc(sizeof(float) * s->ic * vol);
+          float *ref = (float *)sdt_alloc(sizeof(float) * s->oc * vol);
+          float *dst = (float *)sdt_alloc(sizeof(float) * s->oc * vol);
+          fillRandom(kernel, (long)s->oc * s->ic);
+          fillRandom(bias, s->oc);
+          fillRandom(src, s->ic * vol);
+
+          start = benchNow();
+          for (r = 0; r < reps; r++)
+               conv2dDirect(src, ref, kernel, bias, s->ic, s->h, s->w, s->oc, 1, 1, 0, 1);
+          direct_ms = (benchNow() - start) / reps;
+          printf("%-18s %5d %5d %6ld %-7s %10.3f %9.2f %8.2f %10s\n", s->name, s->ic, s->oc, vol,
+                 "direct", direct_ms, flops / direct_ms / 1e6, 1.0, "-");
+
+          PackedMatrix *packed = packMatrix(kernel, s->oc, s->ic, bias);
+          for (size_t k = 0; k < sizeof(KINDS) / sizeof(KINDS[0]); k++) {
+               GemmKernelKind saved = gemmKernel();
+               setGemmKernel(KINDS[k]);
+               if (gemmKernel() != KINDS[k])
+                    continue;
+               gemmPacked(packed, src, vol, dst, vol, vol, GEMM_RELU);
+               start = benchNow();
+               for (r = 0; r < reps; r++)
+                    gemmPacked(packed, src, vol, dst, vol, vol, GEMM_RELU);
+               ms = (benchNow() - start) / reps;
+               printf("%-18s %5d %5d %6ld %-7s %10.3f %9.2f %8.2f %10.2e\n", s->name, s->ic, s->oc, vol,
+                      gemmKernelName(KINDS[k]), ms, flops / ms / 1e6, direct_ms / ms,
+                      maxAbsDiff(ref, dst, s->oc * vol));
+               setGemmKernel(saved);
+          }
+          freePackedMatrix(packed);
+          sdt_free(kernel);
+          sdt_free(bias);
+          sdt_free(src);
+          sdt_free(ref);
+          sdt_free(dst);
+     }
+     return EXIT_SUCCESS;
+}
@@ -0,0 +1,591 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <getopt.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "bench.h"
+#include "detection.h"
+#include "resultWriter.h"
+#include "tensorHost.h"
+#include "weightsFile.h"
+#include "sdt_alloc.h"
+#ifdef BENCH_OPENCV
+#include "trtUtil.h"
+#endif
+
+/* the shapes of sqdtrt at its default 1248x384 input, from a KITTI image */
+#define IMAGE_W 1242
+#define IMAGE_H 375
+#define INPUT_W 1248
+#define INPUT_H 384
+#define GRID_W 78
+#define GRID_H 24
+#define ANCHORS 9
+#define NCLASS 3
+#define CONVOUT_C (ANCHORS * (NCLASS + 1 + 4))
+#define TOP_N 64
+#define MAX_THREAD_COUNTS 16
+
+static const float PIXEL_MEAN[3] = {103.939f, 116.779f, 123.68f};
+static const float ANCHOR_SHAPE[ANCHORS * 2] = {36, 37, 366, 174, 115, 59, 162, 87, 38, 90, 258, 173,
+                                                224, 108, 78, 170, 72, 43};
+static const char *CLASS_NAMES[NCLASS] = {"car", "pedestrian", "cyclist"};
+static const int TRANS_AXES[] = {0, 3, 4, 1, 2};
+
+/* squeeze and expand widths of fire2 ~ fire11, for the synthetic weights */
+static const int FIRES[][3] = {{16, 64, 64}, {16, 64, 64}, {32, 128, 128}, {32, 128, 128}, {48, 192, 192},
+                               {48, 192, 192}, {64, 256, 256}, {64, 256, 256}, {96, 384, 384}, {96, 384, 384}};
+
+/* the synthetic inputs of every case, for a batch of images */
+typedef struct {
+     int batch;
+     unsigned char *frame;      /* [batch][INPUT_H][INPUT_W][3] BGR */
+     unsigned char *image;      /* [IMAGE_H][IMAGE_W][3] BGR, before the resize */
+     float *input;              /* [batch][3][INPUT_H][INPUT_W] */
+     Tensor *convout, *grid, *anchor, *class_in, *class5, *class_t, *conf_t, *bbox_t;
+     Tensor *max, *arg, *score, *klass, *bbox;
+     float *img_sizes, *top_val, *top_bbox;
+     int *top_idx;
+     struct predictions preds;  /* TOP_N per image */
+     NmsContext *nms;           /* of TOP_N detections, reused by every image */
+     int *keep_all;
+     FILE *devnull;
+     char *lines;               /* room for the lines of TOP_N detections */
+     const char *weights;
+#ifdef BENCH_OPENCV
+     cv::Mat origin, resized;
+#endif
+} HostInputs;
+
+typedef struct {
+     const char *name;
+     const char *shape;         /* of one image */
+     int max_reps;              /* 0 for --reps, fewer for a slow case */
+     CaseFunc run;
+} HostCase;
+
+static float randf(float lo, float hi)
+{
+     return lo + (hi - lo) * rand() / RAND_MAX;
+}
+
+static Tensor *hostTensor(int ndim, const int *dims)
+{
+     Tensor *t = createTensor(NULL, ndim, dims);
+     t->data = (float *)sdt_alloc(sizeof(float) * t->len);
+     return t;
+}
+
+static void freeHostTensor(Tensor *t, int do_free_data)
+{
+     if (do_free_data)
+          sdt_free(t->data);
+     sdt_free(t->dims);
+     sdt_free(t->strides);
+     sdt_free(t);
+}
+
+static void runPrepareData(void *arg)
+{
+     HostInputs *in = (HostInputs *)arg;
+     long vol = (long)INPUT_H * INPUT_W;
+     for (int i = 0; i < in->batch; i++)
+          packInput(in->input + i * vol * 3, in->frame + i * vol * 3, INPUT_H, INPUT_W, PIXEL_MEAN);
+}
+
+static void runResizeInput(void *arg)
+{
+     HostInputs *in = (HostInputs *)arg;
+     long vol = (long)INPUT_H * INPUT_W * 3;
+     for (int i = 0; i < in->batch; i++)
+          resizeInput(in->input + i * vol, in->image, IMAGE_H, IMAGE_W, IMAGE_W * 3, INPUT_H, INPUT_W, PIXEL_MEAN,
+                      RESIZE_PARALLEL);
+}
+
+static void runResizeInputScalar(void *arg)
+{
+     HostInputs *in = (HostInputs *)arg;
+     long vol = (long)INPUT_H * INPUT_W * 3;
+     for (int i = 0; i < in->batch; i++)
+          resizeInput(in->input + i * vol, in->image, IMAGE_H, IMAGE_W, IMAGE_W * 3, INPUT_H, INPUT_W, PIXEL_MEAN,
+                      RESIZE_PARALLEL | RESIZE_SCALAR);
+}
+
+#ifdef BENCH_OPENCV
+static void runPreprocessFrame(void *arg)
+{
+     HostInputs *in = (HostInputs *)arg;
+     float w, h;
+     for (int i = 0; i < in->batch; i++)
+          preprocessFrame(in->resized, in->origin, INPUT_W, INPUT_H, &w, &h);
+}
+
+/* cv::resize() then packInput(), what resizeInput() replaces */
+static void runResizeTwoPass(void *arg)
+{
+     HostInputs *in = (HostInputs *)arg;
+     long vol = (long)INPUT_H * INPUT_W * 3;
+     float w, h;
+     for (int i = 0; i < in->batch; i++) {
+          preprocessFrame(in->resized, in->origin, INPUT_W, INPUT_H, &w, &h);
+          packInput(in->input + i * vol, in->resized.data, INPUT_H, INPUT_W, PIXEL_MEAN);
+     }
+}
+#endif
+
+static void runPrepareAnchors(void *arg)
+{
+     sdt_free(prepareAnchors(ANCHOR_SHAPE, INPUT_W, INPUT_H, 1, GRID_H, GRID_W, ANCHORS));
+}
+
+static void runDetectionFilter(void *arg)
+{
+     HostInputs *in = (HostInputs *)arg;
+     for (int i = 0; i < in->batch; i++) {
+          struct predictions image = imagePredictions(&in->preds, i);
+          detectionFilter(in->nms, &image, 0.4, 0);
+     }
+}
+
+static void runComputeIou(void *arg)
+{
+     HostInputs *in = (HostInputs *)arg;
+     volatile float sink = 0;
+     for (int b = 0; b < in->batch; b++) {
+          float *bbox = in->preds.bbox + b * TOP_N * 4;
+          for (int i = 0; i < TOP_N; i++)
+               for (int j = i + 1; j < TOP_N; j++)
+                    sink = sink + computeIou(&bbox[i*4], &bbox[j*4]);
+     }
+}
+
+static void runFprintResult(void *arg)
+{
+     HostInputs *in = (HostInputs *)arg;
+     for (int i = 0; i < in->batch; i++) {
+          struct predictions image = imagePredictions(&in->preds, i);
+          image.keep = in->keep_all;
+          fprintResult(in->devnull, &image, CLASS_NAMES);
+     }
+     fflush(in->devnull);
+}
+
+static void runFormatResult(void *arg)
+{
+     HostInputs *in = (HostInputs *)arg;
+     for (int i = 0; i < in->batch; i++) {
+          struct predictions image = imagePredictions(&in->preds, i);
+          image.keep = in->keep_all;
+          volatile char *end = formatResult(in->lines, &image, CLASS_NAMES, "000042");
+          (void)end;
+     }
+}
+
+static void runLoadWeights(void *arg)
+{
+     HostInputs *in = (HostInputs *)arg;
+     WeightMap weightMap = loadWeights(in->weights);
+     freeWeights(weightMap);
+}
+
+static void runSliceTensor(void *arg)
+{
+     HostInputs *in = (HostInputs *)arg;
+     sliceTensorHost(in->convout, in->class_in, 1, 0, ANCHORS * NCLASS);
+}
+
+static void runTransposeTensor(void *arg)
+{
+     HostInputs *in = (HostInputs *)arg;
+     transposeTensorHost(in->class5, in->class_t, TRANS_AXES);
+}
+
+static void runReduceArgMax(void *arg)
+{
+     HostInputs *in = (HostInputs *)arg;
+     reduceArgMaxHost(in->class_t, in->max, in->arg, 4);
+}
+
+static void runMultiplyElement(void *arg)
+{
+     HostInputs *in = (HostInputs *)arg;
+     multiplyElementHost(in->max, in->conf_t, in->score);
+}
+
+static void runTransformBbox(void *arg)
+{
+     HostInputs *in = (HostInputs *)arg;
+     transformBboxSQDHost(in->bbox_t, in->anchor, in->bbox, INPUT_W, INPUT_H, in->img_sizes, 0, 0);
+}
+
+static void runInterpretConvout(void *arg)
+{
+     HostInputs *in = (HostInputs *)arg;
+     interpretConvoutHost(in->convout, in->anchor, in->score, in->klass, in->bbox, INPUT_W, INPUT_H, in->img_sizes,
+                          0, 0);
+}
+
+static void runTopK(void *arg)
+{
+     HostInputs *in = (HostInputs *)arg;
+     tensorTopKBatchHost(in->score, in->top_val, in->top_idx, TOP_N, -INFINITY, NULL);
+}
+
+static void runPickElements(void *arg)
+{
+     HostInputs *in = (HostInputs *)arg;
+     pickElementsHost(in->bbox->data, in->top_bbox, 4, in->top_idx, in->batch * TOP_N);
+}
+
+static const HostCase CASES[] = {
+     {"prepareData", "384x1248x3 u8 to 3x384x1248", 0, runPrepareData},
+     {"resizeInput", "1242x375 u8 to 3x384x1248", 0, runResizeInput},
+     {"resizeInputScalar", "1242x375 u8 to 3x384x1248", 0, runResizeInputScalar},
+#ifdef BENCH_OPENCV
+     {"preprocessFrame", "1242x375 to 1248x384", 0, runPreprocessFrame},
+     {"resizeTwoPass", "1242x375 u8 to 3x384x1248", 0, runResizeTwoPass},
+#endif
+     {"prepareAnchors", "24x78x9", 0, runPrepareAnchors},
+     {"detectionFilter", "64 detections", 0, runDetectionFilter},
+     {"computeIou", "64x63/2 pairs", 0, runComputeIou},
+     {"fprintResult", "64 detections", 0, runFprintResult},
+     {"formatResult", "64 detections", 0, runFormatResult},
+     {"loadWeights", "SqueezeDet weights", 3, runLoadWeights},
+     {"sliceTensor", "72x24x78 to 27x24x78", 0, runSliceTensor},
+     {"transposeTensor", "9x3x24x78 to 24x78x9x3", 0, runTransposeTensor},
+     {"reduceArgMax", "24x78x9x3 to 24x78x9", 0, runReduceArgMax},
+     {"multiplyElement", "24x78x9", 0, runMultiplyElement},
+     {"transformBboxSQD", "24x78x9x4", 0, runTransformBbox},
+     {"interpretConvout", "72x24x78 to 24x78x9", 0, runInterpretConvout},
+     {"tensorTopK", "16848 to 64", 0, runTopK},
+     {"pickElements", "64x4", 0, runPickElements},
+     {NULL, NULL, 0, NULL}
+};
+
+/* The weights of SqueezeDet's convolutions with random values, in the text format, to
+   path. The same size as the real sqdtrt.wts. */
+static void writeSyntheticWeights(const char *path)
+{
+     FILE *fp = fopen(path, "w");
+     int ntensors = 2 + 6 * 10 + 2, in = 64, i;
+     char name[64];
+
+     if (!fp) {
+          perror(path);
+          exit(EXIT_FAILURE);
+     }
+     fprintf(fp, "%d\n", ntensors);
+     auto write = [fp](const char *name, long count) {
+          fprintf(fp, "%s 0 %ld", name, count);
+          for (long j = 0; j < count; j++) {
+               float v = randf(-0.1, 0.1);
+               unsigned bits;
+               memcpy(&bits, &v, sizeof(bits));
+               fprintf(fp, " %x", bits);
+          }
+          fprintf(fp, "\n");
+     };
+     write("conv1_kernels", 64 * 3 * 9);
+     write("conv1_bias", 64);
+     for (i = 0; i < 10; i++) {
+          const int *f = FIRES[i];
+          snprintf(name, sizeof(name), "fire%d_squeeze1x1_kernels", i + 2);
+          write(name, (long)f[0] * in);
+          snprintf(name, sizeof(name), "fire%d_squeeze1x1_biases", i + 2);
+          write(name, f[0]);
+          snprintf(name, sizeof(name), "fire%d_expand1x1_kernels", i + 2);
+          write(name, (long)f[1] * f[0]);
+          snprintf(name, sizeof(name), "fire%d_expand1x1_biases", i + 2);
+          write(name, f[1]);
+          snprintf(name, sizeof(name), "fire%d_expand3x3_kernels", i + 2);
+          write(name, (long)f[2] * f[0] * 9);
+          snprintf(name, sizeof(name), "fire%d_expand3x3_biases", i + 2);
+          write(name, f[2]);
+          in = f[1] + f[2];
+     }
+     write("conv12_kernels", (long)CONVOUT_C * in * 9);
+     write("conv12_biases", CONVOUT_C);
+     fclose(fp);
+}
+
+/* everything the cases read, filled with values like those of a detection */
+static void createInputs(HostInputs *in, int batch)
+{
+     int convout_dims[] = {batch, CONVOUT_C, GRID_H, GRID_W};
+     int class_in_dims[] = {batch, ANCHORS * NCLASS, GRID_H, GRID_W};
+     int class5_dims[] = {batch, ANCHORS, NCLASS, GRID_H, GRID_W};
+     int class_t_dims[] = {batch, GRID_H, GRID_W, ANCHORS, NCLASS};
+     int score_dims[] = {batch, GRID_H, GRID_W, ANCHORS, 1};
+     int bbox_dims[] = {batch, GRID_H, GRID_W, ANCHORS, 4};
+     int grid_dims[] = {1, GRID_H, GRID_W, ANCHORS, 4};
+     long vol = (long)INPUT_H * INPUT_W * 3, i;
+
+     *in = HostInputs();
+     in->batch = batch;
+     in->frame = (unsigned char *)sdt_alloc(vol * batch);
+     for (i = 0; i < vol * batch; i++)
+          in->frame[i] = rand() & 0xff;
+     in->input = (float *)sdt_alloc(sizeof(float) * vol * batch);
+     in->image = (unsigned char *)sdt_alloc((long)IMAGE_H * IMAGE_W * 3);
+     for (i = 0; i < (long)IMAGE_H * IMAGE_W * 3; i++)
+          in->image[i] = rand() & 0xff;
+#ifdef BENCH_OPENCV
+     in->origin = cv::Mat(IMAGE_H, IMAGE_W, CV_8UC3, in->image);
+#endif
+
+     in->convout = hostTensor(4, convout_dims);
+     for (i = 0; i < in->convout->len; i++)
+          in->convout->data[i] = randf(-2, 2);
+     in->grid = createTensor(prepareAnchors(ANCHOR_SHAPE, INPUT_W, INPUT_H, 1, GRID_H, GRID_W, ANCHORS), 5,
+                             grid_dims);
+     in->anchor = broadcastTensorView(in->grid, 5, bbox_dims);
+     in->class_in = hostTensor(4, class_in_dims);
+     in->class5 = reshapeTensor(in->class_in, 5, class5_dims);
+     in->class_t = hostTensor(5, class_t_dims);
+     in->conf_t = hostTensor(5, score_dims);
+     in->bbox_t = hostTensor(5, bbox_dims);
+     sliceTensorHost(in->convout, in->class_in, 1, 0, ANCHORS * NCLASS);
+     transposeTensorHost(in->class5, in->class_t, TRANS_AXES);
+     for (i = 0; i < in->conf_t->len; i++)
+          in->conf_t->data[i] = randf(0, 1);
+     for (i = 0; i < in->bbox_t->len; i++)
+          in->bbox_t->data[i] = randf(-0.5, 0.5);
+     in->max = hostTensor(5, score_dims);
+     in->arg = hostTensor(5, score_dims);
+     in->score = hostTensor(5, score_dims);
+     in->klass = hostTensor(5, score_dims);
+     in->bbox = hostTensor(5, bbox_dims);
+     in->img_sizes = (float *)sdt_alloc(sizeof(float) * 2 * batch);
+     for (i = 0; i < batch; i++) {
+          in->img_sizes[i*2] = IMAGE_W;
+          in->img_sizes[i*2+1] = IMAGE_H;
+     }
+     interpretConvoutHost(in->convout, in->anchor, in->score, in->klass, in->bbox, INPUT_W, INPUT_H, in->img_sizes,
+                          0, 0);
+     in->top_val = (float *)sdt_alloc(sizeof(float) * batch * TOP_N);
+     in->top_idx = (int *)sdt_alloc(sizeof(int) * batch * TOP_N);
+     in->top_bbox = (float *)sdt_alloc(sizeof(float) * batch * TOP_N * 4);
+     tensorTopKBatchHost(in->score, in->top_val, in->top_idx, TOP_N, -INFINITY, NULL);
+
+     // the top detections of every image, in descending score order as detectionFilter() gets them
+     in->preds.num = TOP_N;
+     in->preds.prob = in->top_val;
+     in->preds.bbox = in->top_bbox;
+     in->preds.klass = (float *)sdt_alloc(sizeof(float) * batch * TOP_N);
+     in->preds.keep = (int *)sdt_alloc(sizeof(int) * batch * TOP_N);
+     in->nms = createNms(TOP_N, NCLASS);
+     pickElementsHost(in->bbox->data, in->top_bbox, 4, in->top_idx, batch * TOP_N);
+     pickElementsHost(in->klass->data, in->preds.klass, 1, in->top_idx, batch * TOP_N);
+     in->keep_all = (int *)sdt_alloc(sizeof(int) * TOP_N);
+     for (i = 0; i < TOP_N; i++)
+          in->keep_all[i] = 1;
+     in->devnull = fopen("/dev/null", "w");
+     in->lines = (char *)sdt_alloc((size_t)TOP_N * RESULT_LINE_MAX);
+}
+
+static void destroyInputs(HostInputs *in)
+{
+     Tensor *tensors[] = {in->convout, in->grid, in->class_in, in->class_t, in->conf_t, in->bbox_t, in->max,
+                          in->arg, in->score, in->klass, in->bbox};
+     for (size_t i = 0; i < sizeof(tensors) / sizeof(tensors[0]); i++)
+          freeHostTensor(tensors[i], 1);
+     freeHostTensor(in->anchor, 0);
+     freeHostTensor(in->class5, 0);
+     sdt_free(in->frame);
+     sdt_free(in->image);
+     sdt_free(in->input);
+     sdt_free(in->img_sizes);
+     sdt_free(in->top_val);
+     sdt_free(in->top_idx);
+     sdt_free(in->top_bbox);
+     sdt_free(in->preds.klass);
+     sdt_free(in->preds.keep);
+     destroyNms(in->nms);
+     sdt_free(in->keep_all);
+     fclose(in->devnull);
+     sdt_free(in->lines);
+}
+
+static int isSelected(const HostCase *c, char **names, int nnames)
+{
+     if (nnames == 0)
+          return 1;
+     for (int i = 0; i < nnames; i++)
+          if (!strcmp(c->name, names[i]))
+               return 1;
+     return 0;
+}
+
+static const char *usage = "Usage: sqdtrt-bench host [OPTIONS] [CASE...]\n\
+Time the host steps of a detection on synthetic inputs of the default 1248x384 shapes,\n\
+all of them or the CASEs named.\n\
+\n\
+Options:\n\
+       --warmup=N          Run every case N times before timing it (default: 3).\n\
+       --reps=N            Time every case N times (default: 20), and print the min,\n\
+                           median, mean and max in ms.\n\
+       --threads=LIST      Run every case with each of the comma separated OpenMP thread\n\
+                           counts (default: 1 and all the cpus).\n\
+       --batch=N           Images per case (default: 1).\n\
+       --weights=FILE      Load FILE in the loadWeights case, instead of synthetic text\n\
+                           weights of the size of SqueezeDet's.\n\
+       --json=FILE         Also write the results to FILE as JSON, one case per line so two\n\
+                           runs diff line by line, - for stdout.\n\
+       --list              Print the cases and exit.\n";
+
+enum {
+     OPT_WARMUP = 256,
+     OPT_REPS,
+     OPT_THREADS,
+     OPT_BATCH,
+     OPT_WEIGHTS,
+     OPT_JSON,
+     OPT_LIST
+};
+
+static const struct option longopts[] = {
+     {"warmup", 1, NULL, OPT_WARMUP},
+     {"reps", 1, NULL, OPT_REPS},
+     {"threads", 1, NULL, OPT_THREADS},
+     {"batch", 1, NULL, OPT_BATCH},
+     {"weights", 1, NULL, OPT_WEIGHTS},
+     {"json", 1, NULL, OPT_JSON},
+     {"list", 0, NULL, OPT_LIST},
+     {"help", 0, NULL, 'h'},
+     {0, 0, 0, 0}
+};
+
+int benchHost(int argc, char *argv[])
+{
+     int warmup = 3, reps = 20, batch = 1, nthreads = 0, threads[MAX_THREAD_COUNTS], opt, t;
+     const char *json_path = NULL;
+     char synthetic[] = "/tmp/sqdtrt-bench-XXXXXX";
+     const HostCase *c;
+     HostInputs in;
+     BenchTimes times;
+     FILE *json = NULL;
+
+     in.weights = NULL;
+
+     while ((opt = getopt_long(argc, argv, "h", longopts, NULL)) != -1) {
+          switch (opt) {
+          case OPT_WARMUP:
+               warmup = atoi(optarg);
+               break;
+          case OPT_REPS:
+               reps = atoi(optarg);
+               break;
+          case OPT_THREADS:
+               if (!(nthreads = parseThreadList(optarg, threads, MAX_THREAD_COUNTS))) {
+                    fprintf(stderr, "--threads needs up to %d comma separated positive counts\n",
+                            MAX_THREAD_COUNTS);
+                    return EXIT_FAILURE;
+               }
+               break;
+          case OPT_BATCH:
+               batch = atoi(optarg);
+               break;
+          case OPT_WEIGHTS:
+               in.weights = optarg;
+               break;
+          case OPT_JSON:
+               json_path = optarg;
+               break;
+          case OPT_LIST:
+               for (c = CASES; c->name; c++)
+                    printf("%-18s %s\n", c->name, c->shape);
+               return EXIT_SUCCESS;
+          default:
+               fputs(usage, stderr);
+               return EXIT_FAILURE;
+          }
+     }
+     if (warmup < 0 || reps <= 0 || batch <= 0) {
+          fputs(usage, stderr);
+          return EXIT_FAILURE;
+     }
+     char **names = argv + optind;
+     int nnames = argc - optind;
+     for (int i = 0; i < nnames; i++) {
+          for (c = CASES; c->name && strcmp(c->name, names[i]); c++)
+               ;
+          if (!c->name) {
+               fprintf(stderr, "unknown case %s, see --list\n", names[i]);
+               return EXIT_FAILURE;
+          }
+     }
+     if (nthreads == 0) {
+          threads[nthreads++] = 1;
+#ifdef _OPENMP
+          if (omp_get_num_procs() > 1)
+               threads[nthreads++] = omp_get_num_procs();
+#endif
+     }
+
+     const char *weights = in.weights;
+     srand(1);
+     createInputs(&in, batch);
+     in.weights = weights;
+     for (c = CASES; c->name && strcmp(c->name, "loadWeights"); c++)
+          ;
+     if (!in.weights && isSelected(c, names, nnames)) {
+          int fd = mkstemp(synthetic);
+          if (fd == -1) {
+               perror(synthetic);
+               return EXIT_FAILURE;
+          }
+          close(fd);
+          writeSyntheticWeights(synthetic);
+          in.weights = synthetic;
+     }
+     if (json_path) {
+          json = strcmp(json_path, "-") ? fopen(json_path, "w") : stdout;
+          if (!json) {
+               perror(json_path);
+               return EXIT_FAILURE;
+          }
+          fprintf(json, "{\"benchmark\": \"host\", \"batch\": %d, \"warmup\": %d, \"results\": [", batch, warmup);
+     }
+
+     // the table to stderr when the JSON is on stdout
+     FILE *out = json == stdout ? stderr : stdout;
+     const char *sep = "\n";
+     fprintf(out, "%-18s %-28s %5s %7s %5s %10s %10s %10s %10s\n", "case", "shape", "batch", "threads", "reps",
+                 "min(ms)", "median(ms)", "mean(ms)", "max(ms)");
+     for (t = 0; t < nthreads; t++) {
+#ifdef _OPENMP
+          omp_set_num_threads(threads[t]);
+#else
+          if (threads[t] != 1)
+               continue;
+#endif
+          for (c = CASES; c->name; c++) {
+               if (!isSelected(c, names, nnames))
+                    continue;
+               int n = c->max_reps && c->max_reps < reps ? c->max_reps : reps;
+               timeCase(c->run, &in, c->max_reps ? 1 : warmup, n, &times);
+               fprintf(out, "%-18s %-28s %5d %7d %5d %10.4f %10.4f %10.4f %10.4f\n", c->name, c->shape, batch,
+                           threads[t], times.reps, times.min, times.median, times.mean, times.max);
+               if (json) {
+                    fprintf(json, "%s{\"case\": \"%s\", \"shape\": \"%s\", \"threads\": %d, \"reps\": %d, "
+                            "\"min_ms\": %.6f, \"median_ms\": %.6f, \"mean_ms\": %.6f, \"max_ms\": %.6f}", sep,
+                            c->name, c->shape, threads[t], times.reps, times.min, times.median, times.mean,
+                            times.max);
+                    sep = ",\n";
+               }
+          }
+     }
+     if (json) {
+          fprintf(json, "\n]}\n");
+          if (json != stdout)
+               fclose(json);
+     }
+     if (in.weights == synthetic)
+          unlink(synthetic);
+     destroyInputs(&in);
+     return EXIT_SUCCESS;
+}
@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "nms.h"
+#include "tensorHost.h"
+#include "sdt_alloc.h"
+
+#define NCLASS 3
+
+/* the pairwise loop detectionFilter() ran before nmsFilter() */
+static void nmsPairwise(float *bbox, const float *klass, const float *prob, int *keep, int num,
+                        float nms_thresh, float prob_thresh)
+{
+     for (int i = 0; i < num; i++)
+          keep[i] = prob[i] >= prob_thresh;
+     for (int i = 0; i < num; i++) {
+          if (prob[i] < prob_thresh)
+               continue;
+          for (int j = i + 1; j < num; j++)
+               if (keep[j] && klass[i] == klass[j] && computeIou(&bbox[i*4], &bbox[j*4]) > nms_thresh)
+                    keep[j] = 0;
+     }
+}
+
+/* num detections in descending score order, boxes of KITTI sizes on a 1242x375 image */
+static void fillDetections(float *bbox, float *klass, float *prob, int num)
+{
+     for (int i = 0; i < num; i++) {
+          bbox[i*4] = rand() % 1200;
+          bbox[i*4+1] = rand() % 300;
+          bbox[i*4+2] = bbox[i*4] + 20 + rand() % 200;
+          bbox[i*4+3] = bbox[i*4+1] + 20 + rand() % 100;
+          klass[i] = rand() % NCLASS;
+          prob[i] = 1 - (float)i / num;
+     }
+}
+
+int benchNms(int argc, char *argv[])
+{
+     int reps = argc > 1 ? atoi(argv[1]) : 10;
+     const float nms_thresh = 0.4;
+     double start, pair_ms, scalar_ms, simd_ms;
+     int num, r, i, kept, diff;
+
+     if (reps <= 0) {
+          fprintf(stderr, "usage: sqdtrt-bench nms [REPS]\n");
+          return EXIT_FAILURE;
+     }
+     printf("%6s %12s %12s %12s %8s %7s %6s\n", "boxes", "pairwise(ms)", "scalar(ms)", "avx2(ms)", "speedup",
+            "kept", "diff");
+     for (num = 64; num <= 8192; num *= 2) {
+          float *bbox = (float *)sdt_alloc(sizeof(float) * num * 4);
+          float *klass = (float *)sdt_alloc(sizeof(float) * num);
+          float *prob = (float *)sdt_alloc(sizeof(float) * num);
+          int *keep = (int *)sdt_alloc(sizeof(int) * num);
+          int *want = (int *)sdt_alloc(sizeof(int) * num);
+          NmsContext *nms = createNms(num, NCLASS);
+          fillDetections(bbox, klass, prob, num);
+
+          start = benchNow();
+          for (r = 0; r < reps; r++)
+               nmsPairwise(bbox, klass, prob, want, num, nms_thresh, 0);
+          pair_ms = (benchNow() - start) / reps;
+
+          nms->simd = 0;
+          start = benchNow();
+          for (r = 0; r < reps; r++)
+               nmsFilter(nms, bbox, klass, prob, keep, num, nms_thresh, 0);
+          scalar_ms = (benchNow() - start) / reps;
+
+          simd_ms = 0;
+          if (__builtin_cpu_supports("avx2")) {
+               nms->simd = 1;
+               start = benchNow();
+               for (r = 0; r < reps; r++)
+                    nmsFilter(nms, bbox, klass, prob, keep, num, nms_thresh, 0);
+               simd_ms = (benchNow() - start) / reps;
+          }
+          kept = nmsFilter(nms, bbox, klass, prob, keep, num, nms_thresh, 0);
+          for (i = 0, diff = 0; i < num; i++)
+               diff += keep[i] != want[i];
+
+          printf("%6d %12.3f %12.3f %12.3f %8.2f %7d %6d\n", num, pair_ms, scalar_ms, simd_ms,
+                 pair_ms / (simd_ms > 0 ? simd_ms : scalar_ms), kept, diff);
+          destroyNms(nms);
+          sdt_free(bbox);
+          sdt_free(klass);
+          sdt_free(prob);
+          sdt_free(keep);
+          sdt_free(want);
+     }
+     return EXIT_SUCCESS;
+}
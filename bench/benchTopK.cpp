@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "bench.h"
+#include "tensorHost.h"
+#include "sdt_alloc.h"
+
+/* the anchors of an image at the default 384x1248 input, 24x78 grid cells of 9 */
+#define IMAGE_ANCHORS (24 * 78 * 9)
+
+static const int KS[] = {64, 256, 1024, 0};
+
+static void freeHostTensor(Tensor *t)
+{
+     sdt_free(t->data);
+     sdt_free(t->dims);
+     sdt_free(t);
+}
+
+/* scores like those of the detector, most anchors close to 0 and few high ones */
+static void fillScores(float *data, long len)
+{
+     for (long i = 0; i < len; i++) {
+          float p = (float)rand() / RAND_MAX;
+          data[i] = p * p * p * p;
+     }
+}
+
+int benchTopK(int argc, char *argv[])
+{
+     int batch = argc > 1 ? atoi(argv[1]) : 1;
+     int reps = argc > 2 ? atoi(argv[2]) : 20;
+     const float floor = 0.3;
+     double start, sort_ms, topk_ms, floor_ms;
+     const int *k;
+     int r, i, j, diff;
+
+     if (batch <= 0 || reps <= 0) {
+          fprintf(stderr, "usage: sqdtrt-bench topk [BATCH] [REPS]\n");
+          return EXIT_FAILURE;
+     }
+     int dims[] = {batch, IMAGE_ANCHORS};
+     long len = (long)batch * IMAGE_ANCHORS;
+     float *scores = (float *)sdt_alloc(sizeof(float) * len);
+     Tensor *sorted = createTensor((float *)sdt_alloc(sizeof(float) * len), 2, dims);
+     int *order = (int *)sdt_alloc(sizeof(int) * len);
+     Tensor *src = createTensor(scores, 2, dims);
+     fillScores(scores, len);
+
+     // the full sort of the pipeline before tensorTopKBatch(), the same for every k
+     start = benchNow();
+     for (r = 0; r < reps; r++) {
+          memcpy(sorted->data, scores, sizeof(float) * len);
+          for (i = 0; i < len; i++)
+               order[i] = i;
+          tensorIndexSortBatchHost(sorted, order);
+     }
+     sort_ms = (benchNow() - start) / reps;
+
+     printf("%6s %6s %12s %12s %8s %14s %9s %6s\n", "batch", "k", "sort(ms)", "topk(ms)", "speedup",
+            "floor 0.3(ms)", "selected", "diff");
+     for (k = KS; *k; k++) {
+          float *val = (float *)sdt_alloc(sizeof(float) * batch * *k);
+          int *idx = (int *)sdt_alloc(sizeof(int) * batch * *k);
+          int *count = (int *)sdt_alloc(sizeof(int) * batch);
+
+          start = benchNow();
+          for (r = 0; r < reps; r++)
+               tensorTopKBatchHost(src, val, idx, *k, -INFINITY, NULL);
+          topk_ms = (benchNow() - start) / reps;
+          // the positions selected must be the first k of the sort of every image
+          for (i = 0, diff = 0; i < batch; i++)
+               for (j = 0; j < *k; j++)
+                    diff += idx[i * *k + j] != order[i * IMAGE_ANCHORS + j];
+
+          start = benchNow();
+          for (r = 0; r < reps; r++)
+               tensorTopKBatchHost(src, val, idx, *k, floor, count);
+          floor_ms = (benchNow() - start) / reps;
+
+          printf("%6d %6d %12.3f %12.3f %8.2f %14.3f %9d %6d\n", batch, *k, sort_ms, topk_ms,
+                 sort_ms / topk_ms, floor_ms, count[0], diff);
+          sdt_free(val);
+          sdt_free(idx);
+          sdt_free(count);
+     }
+     sdt_free(order);
+     freeHostTensor(src);
+     freeHostTensor(sorted);
+     return EXIT_SUCCESS;
+}
@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "tensorHost.h"
+#include "sdt_alloc.h"
+
+typedef struct {
+     const char *name;
+     int ndim;
+     int dims[5];               /* of src */
+     int axes[5];
+} TransposeShape;
+
+/* the three transposes of sqdtrt after the interpret engine, and NCHW to NHWC of an activation */
+static const TransposeShape SHAPES[] = {
+     {"class", 5, {1, 9, 3, 24, 78}, {0, 3, 4, 1, 2}},
+     {"conf", 5, {1, 9, 1, 24, 78}, {0, 3, 4, 1, 2}},
+     {"bbox", 5, {1, 9, 4, 24, 78}, {0, 3, 4, 1, 2}},
+     {"class_b8", 5, {8, 9, 3, 24, 78}, {0, 3, 4, 1, 2}},
+     {"bbox_b8", 5, {8, 9, 4, 24, 78}, {0, 3, 4, 1, 2}},
+     {"nchw_nhwc", 4, {1, 64, 96, 312}, {0, 2, 3, 1}},
+     {NULL, 0, {0}, {0}}
+};
+
+/* the removed transposeTensorKernel() per element: the index vector of dst into one
+   workspace, permuted into the other, then the src index from it */
+static void transposeIndexes(const Tensor *src, Tensor *dst, const int *axes, int *s_ids, int *d_ids)
+{
+     int ndim = dst->ndim;
+     for (int di = 0; di < dst->len; di++) {
+          int *ts = s_ids + (long)di * ndim, *td = d_ids + (long)di * ndim, id = di, si, i;
+          for (i = ndim-1; i >= 0; i--) {
+               td[i] = id % dst->dims[i];
+               id /= dst->dims[i];
+          }
+          for (i = 0; i < ndim; i++)
+               ts[axes[i]] = td[i];
+          for (i = 0, si = ts[0]; i < ndim-1; i++)
+               si = src->dims[i+1] * si + ts[i+1];
+          dst->data[di] = src->data[si];
+     }
+}
+
+int benchTranspose(int argc, char *argv[])
+{
+     int reps = argc > 1 ? atoi(argv[1]) : 20;
+     const TransposeShape *s;
+     double start, index_ms, plan_ms;
+     int r, i, d_dims[5];
+
+     if (reps <= 0) {
+          fprintf(stderr, "usage: sqdtrt-bench transpose [REPS]\n");
+          return EXIT_FAILURE;
+     }
+     printf("%-10s %9s %6s %12s %12s %8s %14s %6s\n", "tensor", "elements", "merged", "indexes(ms)",
+            "planned(ms)", "speedup", "workspace(MB)", "diff");
+     for (s = SHAPES; s->name; s++) {
+          for (i = 0; i < s->ndim; i++)
+               d_dims[i] = s->dims[s->axes[i]];
+          Tensor *src = createTensor(NULL, s->ndim, s->dims);
+          Tensor *ref = createTensor(NULL, s->ndim, d_dims);
+          Tensor *dst = createTensor(NULL, s->ndim, d_dims);
+          src->data = (float *)sdt_alloc(sizeof(float) * src->len);
+          ref->data = (float *)sdt_alloc(sizeof(float) * src->len);
+          dst->data = (float *)sdt_alloc(sizeof(float) * src->len);
+          int *s_ids = (int *)sdt_alloc(sizeof(int) * s->ndim * src->len);
+          int *d_ids = (int *)sdt_alloc(sizeof(int) * s->ndim * src->len);
+          TransposePlan plan;
+          int diff = 0;
+          for (i = 0; i < src->len; i++)
+               src->data[i] = i;
+          planTranspose(src, dst, s->axes, &plan);
+
+          start = benchNow();
+          for (r = 0; r < reps; r++)
+               transposeIndexes(src, ref, s->axes, s_ids, d_ids);
+          index_ms = (benchNow() - start) / reps;
+
+          start = benchNow();
+          for (r = 0; r < reps; r++)
+               transposeTensorHost(src, dst, s->axes);
+          plan_ms = (benchNow() - start) / reps;
+
+          for (i = 0; i < src->len; i++)
+               diff += dst->data[i] != ref->data[i];
+          // the two workspaces the indexes need, and the planned transpose doesn't
+          printf("%-10s %9d %4dD %12.3f %12.3f %8.2f %14.2f %6d\n", s->name, src->len, plan.ndim, index_ms,
+                 plan_ms, index_ms / plan_ms, 2.0 * sizeof(int) * s->ndim * src->len / (1 << 20), diff);
+          sdt_free(s_ids);
+          sdt_free(d_ids);
+          sdt_free(src->data);
+          sdt_free(ref->data);
+          sdt_free(dst->data);
+          sdt_free(src->dims);
+          sdt_free(ref->dims);
+          sdt_free(dst->dims);
+          sdt_free(src);
+          sdt_free(ref);
+          sdt_free(dst);
+     }
+     return EXIT_SUCCESS;
+}
@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "weightsFile.h"
+
+/* touch every payload, mapped pages are only read in on first access */
+static float touchWeights(const WeightMap &weightMap)
+{
+     float sum = 0;
+     for (auto &mem : weightMap) {
+          const unsigned char *p = (const unsigned char *)mem.second.values;
+          size_t size = mem.second.count * weightsTypeSize(mem.second.type);
+          for (size_t i = 0; i < size; i += 64)
+               sum += p[i];
+     }
+     return sum;
+}
+
+static void timeLoad(const char *file, int cold, double *load_ms, double *touch_ms)
+{
+     double start, loaded;
+
+     if (cold)
+          dropFileCache(file);
+     start = benchNow();
+     WeightMap weightMap = loadWeights(file);
+     loaded = benchNow();
+     volatile float sink = touchWeights(weightMap);
+     (void)sink;
+     *load_ms = loaded - start;
+     *touch_ms = benchNow() - loaded;
+     freeWeights(weightMap);
+}
+
+int benchWeights(int argc, char *argv[])
+{
+     int i, cold;
+     double load_ms, touch_ms;
+
+     if (argc < 2) {
+          fprintf(stderr, "usage: sqdtrt-bench weights WEIGHTS_FILE...\n");
+          return EXIT_FAILURE;
+     }
+     printf("%-40s %-6s %-5s %12s %12s %12s\n", "file", "format", "cache", "load(ms)", "touch(ms)", "total(ms)");
+     for (i = 1; i < argc; i++) {
+          for (cold = 1; cold >= 0; cold--) {
+               timeLoad(argv[i], cold, &load_ms, &touch_ms);
+               printf("%-40s %-6s %-5s %12.2f %12.2f %12.2f\n", argv[i],
+                      isBinaryWeightsFile(argv[i]) ? "wtb" : "wts", cold ? "cold" : "warm",
+                      load_ms, touch_ms, load_ms + touch_ms);
+          }
+     }
+     return EXIT_SUCCESS;
+}
@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "bench.h"
+#include "cpuWinograd.h"
+#include "cpuOps.h"
+#include "sdt_alloc.h"
+
+/* the 3x3 stride 1 convolutions at the default 384x1248 input */
+typedef struct {
+     const char *name;
+     int ic, oc, h, w, relu;
+} ConvShape;
+
+static const ConvShape SHAPES[] = {
+     {"fire2_expand3x3", 16, 64, 96, 312, 1},
+     {"fire4_expand3x3", 32, 128, 48, 156, 1},
+     {"fire6_expand3x3", 48, 192, 24, 78, 1},
+     {"fire8_expand3x3", 64, 256, 24, 78, 1},
+     {"fire10_expand3x3", 96, 384, 24, 78, 1},
+     {"conv12", 768, 72, 24, 78, 0},
+     {NULL, 0, 0, 0, 0, 0}
+};
+
+static void fillRandom(float *data, long len)
+{
+     for (long i = 0; i < len; i++)
+          data[i] = (float)rand() / RAND_MAX - 0.5f;
+}
+
+int benchWinograd(int argc, char *argv[])
+{
+     int reps = argc > 1 ? atoi(argv[1]) : 10;
+     const ConvShape *s;
+     double start, direct_ms, wino_ms;
+     int r;
+
+     if (reps <= 0) {
+          fprintf(stderr, "usage: sqdtrt-bench winograd [REPS]\n");
+          return EXIT_FAILURE;
+     }
+     printf("%-18s %5s %5s %6s %12s %12s %8s %10s %10s\n", "layer", "ic", "oc", "hw",
+            "direct(ms)", "winograd(ms)", "speedup", "mul_ratio", "rel_diff");
+     for (s = SHAPES; s->name; s++) {
+          long vol = (long)s->h * s->w;
+          long tiles = (long)((s->h + WINO_OUT - 1) / WINO_OUT) * ((s->w + WINO_OUT - 1) / WINO_OUT);
+          float *kernel = (float *)sdt_alloc(sizeof(float) * s->oc * s->ic * 9);
+          float *bias = (float *)sdt_alloc(sizeof(float) * s->oc);
+          float *src = (float *)sdt_alloc(sizeof(float) * s->ic * vol);
+          float *ref = (float *)sdt_alloc(sizeof(float) * s->oc * vol);
+          float *dst = (float *)sdt_alloc(sizeof(float) * s->oc * vol);
+          float diff = 0, ref_max = 0;
+          fillRandom(kernel, (long)s->oc * s->ic * 9);
+          fillRandom(bias, s->oc);
+          fillRandom(src, s->ic * vol);
+
+          start = benchNow();
+          for (r = 0; r < reps; r++)
+               conv2dDirect(src, ref, kernel, bias, s->ic, s->h, s->w, s->oc, 3, 1, 1, s->relu);
+          direct_ms = (benchNow() - start) / reps;
+
+          WinogradKernel *wk = createWinogradKernel(kernel, bias, s->ic, s->oc);
+          conv2dWinograd(wk, src, dst, s->h, s->w, s->relu);
+          start = benchNow();
+          for (r = 0; r < reps; r++)
+               conv2dWinograd(wk, src, dst, s->h, s->w, s->relu);
+          wino_ms = (benchNow() - start) / reps;
+          destroyWinogradKernel(wk);
+
+          for (long i = 0; i < s->oc * vol; i++) {
+               diff = fmaxf(diff, fabsf(ref[i] - dst[i]));
+               ref_max = fmaxf(ref_max, fabsf(ref[i]));
+          }
+          // multiplies of the direct convolution over those of the Winograd GEMMs
+          printf("%-18s %5d %5d %6ld %12.3f %12.3f %8.2f %10.2f %10.2e\n", s->name, s->ic, s->oc, vol,
+                 direct_ms, wino_ms, direct_ms / wino_ms, 9.0 * vol / (WINO_ELEMS * tiles),
+                 diff / ref_max);
+          sdt_free(kernel);
+          sdt_free(bias);
+          sdt_free(src);
+          sdt_free(ref);
+          sdt_free(dst);
+     }
+     return EXIT_SUCCESS;
+}
@@ -0,0 +1,589 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <err.h>
+#include "cpuEngine.h"
+#include "cpuOps.h"
+#include "cpuFused.h"
+#include "sdt_alloc.h"
+
+#define MAX_CPU_LAYERS 32
+
+#define CALIBRATION_MAGIC "sqdtrt-calibration"
+#define CALIBRATION_VERSION 1
+
+/* squeeze and expand widths of fire2 ~ fire11, same as createConvEngine() */
+typedef struct {
+     const char *name;
+     int s1x1, e1x1, e3x3;
+     const char *pool_after;    /* name of the max pooling that follows, or NULL */
+} FireSpec;
+
+static const FireSpec FIRES[] = {
+     {"fire2", 16, 64, 64, NULL},
+     {"fire3", 16, 64, 64, "pool3"},
+     {"fire4", 32, 128, 128, NULL},
+     {"fire5", 32, 128, 128, "pool5"},
+     {"fire6", 48, 192, 192, NULL},
+     {"fire7", 48, 192, 192, NULL},
+     {"fire8", 64, 256, 256, NULL},
+     {"fire9", 64, 256, 256, NULL},
+     {"fire10", 96, 384, 384, NULL},
+     {"fire11", 96, 384, 384, NULL},
+     {NULL, 0, 0, 0, NULL}
+};
+
+/* copies count weights to dst as float, half weights are converted */
+static void copyWeights(WeightMap &weightMap, const std::string &name, long count, float *dst)
+{
+     auto it = weightMap.find(name);
+     if (it == weightMap.end())
+          errx(EXIT_FAILURE, "missing weights %s", name.c_str());
+     if (it->second.count != count)
+          errx(EXIT_FAILURE, "weights %s: expect %ld values, got %ld", name.c_str(), count, (long)it->second.count);
+     if (it->second.type == WEIGHTS_FLOAT)
+          loadFloats(it->second.values, STORAGE_FP32, dst, count);
+     else if (it->second.type == WEIGHTS_HALF)
+          loadFloats(it->second.values, STORAGE_FP16, dst, count);
+     else
+          errx(EXIT_FAILURE, "weights %s: only float and half weights are supported by the cpu backend",
+               name.c_str());
+}
+
+/* copy the weights, the engine outlives the weight map */
+static void initConv(CpuConv *conv, WeightMap &weightMap,
+                     const std::string &kernel_name, const std::string &bias_name,
+                     int ic, int oc, int k, int stride, int pad, int relu)
+{
+     long kernel_count = (long)oc * ic * k * k;
+     conv->ic = ic;
+     conv->oc = oc;
+     conv->k = k;
+     conv->stride = stride;
+     conv->pad = pad;
+     conv->relu = relu;
+     conv->kernel = (float *)sdt_alloc(sizeof(float) * kernel_count);
+     conv->bias = (float *)sdt_alloc(sizeof(float) * oc);
+     copyWeights(weightMap, kernel_name, kernel_count, conv->kernel);
+     copyWeights(weightMap, bias_name, oc, conv->bias);
+     conv->packed = NULL;
+     conv->winograd = NULL;
+     conv->int8 = NULL;
+     conv->act_max = 0;
+     if (k == 1 && stride == 1 && pad == 0) {
+          conv->algo = CPU_CONV_GEMM;
+          conv->packed = packMatrix(conv->kernel, oc, ic, conv->bias);
+     } else if (k == 3 && stride == 1 && pad == 1) {
+          conv->algo = CPU_CONV_WINOGRAD;
+          conv->winograd = createWinogradKernel(conv->kernel, conv->bias, ic, oc);
+     } else {
+          conv->algo = CPU_CONV_IM2COL;
+          conv->packed = packMatrix(conv->kernel, oc, ic * k * k, conv->bias);
+     }
+}
+
+static CpuLayer *newLayer(CpuEngine *engine, CpuLayerKind kind, const char *name)
+{
+     assert(engine->nlayers < MAX_CPU_LAYERS);
+     CpuLayer *layer = &engine->layers[engine->nlayers++];
+     CpuLayer *prev = engine->nlayers > 1 ? layer - 1 : NULL;
+
+     memset(layer, 0, sizeof(CpuLayer));
+     layer->kind = kind;
+     strncpy(layer->name, name, sizeof(layer->name) - 1);
+     layer->c = prev ? prev->oc : engine->c;
+     layer->h = prev ? prev->oh : engine->h;
+     layer->w = prev ? prev->ow : engine->w;
+     return layer;
+}
+
+static void addConv(CpuEngine *engine, WeightMap &weightMap, const char *name,
+                    const char *bias_suffix, int oc, int k, int stride, int pad, int relu)
+{
+     CpuLayer *layer = newLayer(engine, CPU_LAYER_CONV, name);
+     std::string prefix(name);
+     initConv(&layer->conv, weightMap, prefix + "_kernels", prefix + bias_suffix,
+              layer->c, oc, k, stride, pad, relu);
+     layer->oc = oc;
+     layer->oh = convOutSize(layer->h, k, stride, pad);
+     layer->ow = convOutSize(layer->w, k, stride, pad);
+}
+
+static void addPool(CpuEngine *engine, const char *name, int k, int stride, int pad)
+{
+     CpuLayer *layer = newLayer(engine, CPU_LAYER_POOL, name);
+     layer->pool_k = k;
+     layer->pool_stride = stride;
+     layer->pool_pad = pad;
+     layer->oc = layer->c;
+     layer->oh = convOutSize(layer->h, k, stride, pad);
+     layer->ow = convOutSize(layer->w, k, stride, pad);
+}
+
+static void addFire(CpuEngine *engine, WeightMap &weightMap, const FireSpec *spec)
+{
+     CpuLayer *layer = newLayer(engine, CPU_LAYER_FIRE, spec->name);
+     std::string prefix(spec->name);
+     initConv(&layer->squeeze, weightMap, prefix + "_squeeze1x1_kernels", prefix + "_squeeze1x1_biases",
+              layer->c, spec->s1x1, 1, 1, 0, 1);
+     initConv(&layer->expand1x1, weightMap, prefix + "_expand1x1_kernels", prefix + "_expand1x1_biases",
+              spec->s1x1, spec->e1x1, 1, 1, 0, 1);
+     initConv(&layer->expand3x3, weightMap, prefix + "_expand3x3_kernels", prefix + "_expand3x3_biases",
+              spec->s1x1, spec->e3x3, 3, 1, 1, 1);
+     layer->oc = spec->e1x1 + spec->e3x3;
+     layer->oh = layer->h;
+     layer->ow = layer->w;
+}
+
+static CpuEngine *newEngine(int c, int h, int w)
+{
+     CpuEngine *engine = (CpuEngine *)sdt_alloc(sizeof(CpuEngine));
+
+     memset(engine, 0, sizeof(CpuEngine));
+     engine->c = c;
+     engine->h = h;
+     engine->w = w;
+     engine->fusion = CPU_FUSION_FIRE;
+     engine->storage = STORAGE_FP32;
+     engine->layers = (CpuLayer *)sdt_alloc(sizeof(CpuLayer) * MAX_CPU_LAYERS);
+     return engine;
+}
+
+/* largest activation between two layers */
+static long activationSize(const CpuEngine *engine)
+{
+     long act_size = (long)engine->c * engine->h * engine->w;
+     int i;
+
+     for (i = 0; i < engine->nlayers; i++) {
+          const CpuLayer *layer = &engine->layers[i];
+          long out_size = (long)layer->oc * layer->oh * layer->ow;
+          act_size = out_size > act_size ? out_size : act_size;
+     }
+     return act_size;
+}
+
+/* output shape and activation buffers, once all layers are added */
+static void allocEngineBuffers(CpuEngine *engine)
+{
+     long act_size = activationSize(engine), scratch_size = 0;
+     int i;
+
+     for (i = 0; i < engine->nlayers; i++) {
+          CpuLayer *layer = &engine->layers[i];
+          if (layer->kind == CPU_LAYER_FIRE && (long)layer->squeeze.oc * layer->h * layer->w > scratch_size)
+               scratch_size = (long)layer->squeeze.oc * layer->h * layer->w;
+     }
+     engine->oc = engine->layers[engine->nlayers-1].oc;
+     engine->oh = engine->layers[engine->nlayers-1].oh;
+     engine->ow = engine->layers[engine->nlayers-1].ow;
+     engine->buffers[0] = sdt_alloc(storageSize(engine->storage) * act_size);
+     engine->buffers[1] = sdt_alloc(storageSize(engine->storage) * act_size);
+     engine->scratch = (float *)sdt_alloc(sizeof(float) * scratch_size);
+}
+
+CpuEngine *createCpuEngine(WeightMap &weightMap, int c, int h, int w)
+{
+     CpuEngine *engine = newEngine(c, h, w);
+     const FireSpec *spec;
+
+     addConv(engine, weightMap, "conv1", "_bias", 64, 3, 2, 1, 1);
+     addPool(engine, "pool1", 3, 2, 1);
+     for (spec = FIRES; spec->name; spec++) {
+          addFire(engine, weightMap, spec);
+          if (spec->pool_after)
+               addPool(engine, spec->pool_after, 3, 2, 1);
+     }
+     // dropout11 is the identity during evaluation
+     addConv(engine, weightMap, "conv12", "_biases", 72, 3, 1, 1, 0);
+     allocEngineBuffers(engine);
+     return engine;
+}
+
+/* an engine of the fire modules first to last, without the pooling between them,
+   for benchmarks and tests */
+CpuEngine *createCpuFireEngine(WeightMap &weightMap, const char *first,
+                               const char *last, int c, int h, int w)
+{
+     CpuEngine *engine = newEngine(c, h, w);
+     const FireSpec *spec = FIRES;
+
+     while (spec->name && strcmp(spec->name, first))
+          spec++;
+     for (; spec->name; spec++) {
+          addFire(engine, weightMap, spec);
+          if (!strcmp(spec->name, last))
+               break;
+     }
+     if (!spec->name)
+          errx(EXIT_FAILURE, "no fire modules %s to %s", first, last);
+     allocEngineBuffers(engine);
+     return engine;
+}
+
+/* a 1x1 convolution is the GEMM of the [oc, ic] kernel and the [ic, h * w] image,
+   any other shape without Winograd that of the [oc, ic * k * k] kernel and its im2col matrix */
+static void runConv(const CpuConv *conv, const float *src, float *dst, int h, int w)
+{
+     long vol = (long)h * w;
+
+     switch (conv->algo) {
+     case CPU_CONV_GEMM:
+          gemmPacked(conv->packed, src, vol, dst, vol, vol, conv->relu ? GEMM_RELU : 0);
+          break;
+     case CPU_CONV_WINOGRAD:
+          conv2dWinograd(conv->winograd, src, dst, h, w, conv->relu);
+          break;
+     case CPU_CONV_IM2COL:
+          conv2dIm2col(conv->packed, src, dst, conv->ic, h, w, conv->k, conv->stride, conv->pad,
+                       conv->relu ? GEMM_RELU : 0);
+          break;
+     case CPU_CONV_INT8:
+          conv2dInt8(conv->int8, conv->act_max / INT8_ACT_MAX, src, dst, conv->ic, h, w,
+                     conv->k, conv->stride, conv->pad, conv->relu);
+          break;
+     default:
+          conv2dDirect(src, dst, conv->kernel, conv->bias, conv->ic, h, w, conv->oc,
+                       conv->k, conv->stride, conv->pad, conv->relu);
+          break;
+     }
+}
+
+/* squeeze -> relu -> [expand1x1 -> relu, expand3x3 -> relu] -> concat along channels,
+   the two expand outputs are written to their channel ranges of dst, no extra copy */
+static void runFire(const CpuLayer *layer, const float *src, float *dst, float *scratch)
+{
+     long vol = (long)layer->h * layer->w;
+     runConv(&layer->squeeze, src, scratch, layer->h, layer->w);
+     runConv(&layer->expand1x1, scratch, dst, layer->h, layer->w);
+     runConv(&layer->expand3x3, scratch, dst + layer->expand1x1.oc * vol, layer->h, layer->w);
+}
+
+static void runLayer(const CpuEngine *engine, const CpuLayer *layer, const float *src, float *dst)
+{
+     switch (layer->kind) {
+     case CPU_LAYER_CONV:
+          runConv(&layer->conv, src, dst, layer->h, layer->w);
+          break;
+     case CPU_LAYER_POOL:
+          maxPool2d(src, dst, layer->c, layer->h, layer->w, layer->pool_k, layer->pool_stride, layer->pool_pad);
+          break;
+     case CPU_LAYER_FIRE:
+          runFire(layer, src, dst, engine->scratch);
+          break;
+     default:
+          fprintf(stderr, "unknown CpuLayerKind %d\n", layer->kind);
+          abort();
+     }
+}
+
+/* Number of layers from layers[i] on that run as one operator: a convolution and the max
+   pooling after it, a fire module, or with CPU_FUSION_GROUP a group of them, each time with
+   the max pooling after the last module. */
+static int stepLength(const CpuEngine *engine, int i)
+{
+     const CpuLayer *layer = &engine->layers[i];
+     int left = engine->nlayers - i, n;
+
+     if (engine->fusion == CPU_FUSION_NONE || engine->calibrating)
+          return 1;
+     if (left > 1 && canFuseConvPool(layer, layer + 1))
+          return 2;
+     n = fireGroupLength(layer, left);
+     if (n == 0)
+          return 1;
+     if (engine->fusion != CPU_FUSION_GROUP)
+          n = 1;
+     if (n < left && canFusePool(layer + n))
+          n++;
+     return n;
+}
+
+/* the convolutions of a layer, and the suffixes of their names in the calibration table */
+static int layerConvs(CpuLayer *layer, CpuConv **convs, const char **suffixes)
+{
+     switch (layer->kind) {
+     case CPU_LAYER_CONV:
+          convs[0] = &layer->conv;
+          suffixes[0] = "";
+          return 1;
+     case CPU_LAYER_FIRE:
+          convs[0] = &layer->squeeze;
+          convs[1] = &layer->expand1x1;
+          convs[2] = &layer->expand3x3;
+          suffixes[0] = "_squeeze1x1";
+          suffixes[1] = "_expand1x1";
+          suffixes[2] = "_expand3x3";
+          return 3;
+     default:
+          return 0;
+     }
+}
+
+static void recordRange(CpuConv *conv, const float *src, long len)
+{
+     float m = conv->act_max;
+#pragma omp parallel for reduction(max:m)
+     for (long i = 0; i < len; i++)
+          m = src[i] > m ? src[i] : m;
+     conv->act_max = m;
+}
+
+/* after a layer ran unfused on src, the expands of a fire layer read the squeeze output
+   from the scratch buffer */
+static void recordLayerRanges(const CpuEngine *engine, CpuLayer *layer, const float *src)
+{
+     long vol = (long)layer->h * layer->w;
+
+     if (layer->kind == CPU_LAYER_CONV) {
+          recordRange(&layer->conv, src, layer->c * vol);
+     } else if (layer->kind == CPU_LAYER_FIRE) {
+          recordRange(&layer->squeeze, src, layer->c * vol);
+          recordRange(&layer->expand1x1, engine->scratch, layer->squeeze.oc * vol);
+          recordRange(&layer->expand3x3, engine->scratch, layer->squeeze.oc * vol);
+     }
+}
+
+/* staging buffer k of at least len floats */
+static float *stagingBuffer(CpuEngine *engine, int k, long len)
+{
+     if (engine->staging_size[k] < len) {
+          if (engine->staging[k])
+               sdt_free(engine->staging[k]);
+          engine->staging[k] = (float *)sdt_aligned_alloc(64, sizeof(float) * len);
+          engine->staging_size[k] = len;
+     }
+     return engine->staging[k];
+}
+
+/* The n layers of a step from stepLength(). The fused operators read and write half
+   storage themselves, a single layer gets float copies of its input and output. */
+static void runStep(CpuEngine *engine, CpuLayer *layers, int n, const void *src, StorageType src_type,
+                    void *dst, StorageType dst_type)
+{
+     if (n == 1 && (engine->fusion == CPU_FUSION_NONE || engine->calibrating || !canFuseFire(layers))) {
+          long in_size = (long)layers->c * layers->h * layers->w;
+          long out_size = (long)layers->oc * layers->oh * layers->ow;
+          const float *fsrc = (const float *)src;
+          float *fdst = (float *)dst;
+          if (src_type != STORAGE_FP32) {
+               fsrc = stagingBuffer(engine, 0, in_size);
+               loadFloats(src, src_type, const_cast<float *>(fsrc), in_size);
+          }
+          if (dst_type != STORAGE_FP32)
+               fdst = stagingBuffer(engine, 1, out_size);
+          runLayer(engine, layers, fsrc, fdst);
+          if (engine->calibrating)
+               recordLayerRanges(engine, layers, fsrc);
+          if (dst_type != STORAGE_FP32)
+               storeFloats(fdst, dst, dst_type, out_size);
+     } else if (layers[0].kind == CPU_LAYER_CONV) {
+          assert(src_type == STORAGE_FP32);
+          convPoolFused(&layers[0], &layers[1], (const float *)src, dst, dst_type);
+     } else {
+          int pool = layers[n - 1].kind == CPU_LAYER_POOL;
+          fireGroupFused(layers, n - pool, pool ? &layers[n - 1] : NULL, src, src_type, dst, dst_type);
+     }
+}
+
+/* input is [batchSize, c, h, w], output is [batchSize, oc, oh, ow];
+   fused layers run as one step, so activations alternate between the two
+   buffers by step rather than by layer. The buffers hold engine->storage,
+   the input and output are always float. */
+void cpuEngineInfer(CpuEngine *engine, const float *input, float *output, int batchSize)
+{
+     assert(engine && input && output && batchSize > 0);
+     long in_vol = (long)engine->c * engine->h * engine->w;
+     long out_vol = (long)engine->oc * engine->oh * engine->ow;
+     int n, i, step, next;
+
+     for (n = 0; n < batchSize; n++) {
+          const void *src = input + n * in_vol;
+          StorageType src_type = STORAGE_FP32;
+          for (i = 0, next = 0; i < engine->nlayers; i += step, next ^= 1) {
+               step = stepLength(engine, i);
+               int last = i + step == engine->nlayers;
+               void *dst = last ? (void *)(output + n * out_vol) : engine->buffers[next];
+               StorageType dst_type = last ? STORAGE_FP32 : engine->storage;
+               runStep(engine, &engine->layers[i], step, src, src_type, dst, dst_type);
+               src = dst;
+               src_type = dst_type;
+          }
+     }
+}
+
+static void freeConv(CpuConv *conv)
+{
+     sdt_free(conv->kernel);
+     sdt_free(conv->bias);
+     if (conv->packed)
+          freePackedMatrix(conv->packed);
+     if (conv->winograd)
+          destroyWinogradKernel(conv->winograd);
+     if (conv->int8)
+          freeInt8Matrix(conv->int8);
+}
+
+void destroyCpuEngine(CpuEngine *engine)
+{
+     assert(engine);
+     int i;
+     for (i = 0; i < engine->nlayers; i++) {
+          CpuLayer *layer = &engine->layers[i];
+          if (layer->kind == CPU_LAYER_CONV) {
+               freeConv(&layer->conv);
+          } else if (layer->kind == CPU_LAYER_FIRE) {
+               freeConv(&layer->squeeze);
+               freeConv(&layer->expand1x1);
+               freeConv(&layer->expand3x3);
+          }
+     }
+     sdt_free(engine->layers);
+     sdt_free(engine->buffers[0]);
+     sdt_free(engine->buffers[1]);
+     sdt_free(engine->scratch);
+     if (engine->staging[0])
+          sdt_free(engine->staging[0]);
+     if (engine->staging[1])
+          sdt_free(engine->staging[1]);
+     sdt_free(engine);
+}
+
+/* Stores the activations between steps as type. Half storage halves their memory and
+   bandwidth; every convolution still computes in float. */
+void setCpuStorage(CpuEngine *engine, StorageType type)
+{
+     assert(engine);
+     long act_size = activationSize(engine);
+
+     engine->storage = type;
+     sdt_free(engine->buffers[0]);
+     sdt_free(engine->buffers[1]);
+     engine->buffers[0] = sdt_alloc(storageSize(type) * act_size);
+     engine->buffers[1] = sdt_alloc(storageSize(type) * act_size);
+}
+
+/* switch a 3x3 stride 1 convolution between CPU_CONV_DIRECT and CPU_CONV_WINOGRAD, which
+   is expand3x3 of a fire layer or the convolution of a conv layer. layer "all" switches
+   every such convolution. Return the number of convolutions switched. */
+int setCpuConvAlgo(CpuEngine *engine, const char *layer, CpuConvAlgo algo)
+{
+     assert(engine && layer && (algo == CPU_CONV_DIRECT || algo == CPU_CONV_WINOGRAD));
+     int i, count = 0;
+
+     for (i = 0; i < engine->nlayers; i++) {
+          CpuLayer *l = &engine->layers[i];
+          CpuConv *conv = l->kind == CPU_LAYER_FIRE ? &l->expand3x3 : l->kind == CPU_LAYER_CONV ? &l->conv : NULL;
+          if (!conv || (strcmp(layer, "all") && strcmp(layer, l->name)))
+               continue;
+          if (conv->k != 3 || conv->stride != 1 || conv->pad != 1)
+               continue;
+          if (algo == CPU_CONV_WINOGRAD && !conv->winograd)
+               conv->winograd = createWinogradKernel(conv->kernel, conv->bias, conv->ic, conv->oc);
+          if (algo == CPU_CONV_DIRECT && conv->winograd) {
+               destroyWinogradKernel(conv->winograd);
+               conv->winograd = NULL;
+          }
+          conv->algo = algo;
+          count++;
+     }
+     return count;
+}
+
+/* Switch every convolution with a calibrated input range to CPU_CONV_INT8. conv1 reads the
+   image, which isn't the output of a ReLU and may be negative, so it stays in float.
+   Return the number of convolutions switched. */
+int quantizeCpuEngine(CpuEngine *engine)
+{
+     assert(engine);
+     CpuConv *convs[3];
+     const char *suffixes[3];
+     int i, j, n, count = 0;
+
+     for (i = 1; i < engine->nlayers; i++) {
+          n = layerConvs(&engine->layers[i], convs, suffixes);
+          for (j = 0; j < n; j++) {
+               CpuConv *conv = convs[j];
+               if (conv->act_max <= 0 || conv->int8)
+                    continue;
+               conv->int8 = quantizeMatrix(conv->kernel, conv->oc, conv->ic * conv->k * conv->k, conv->bias);
+               conv->algo = CPU_CONV_INT8;
+               count++;
+          }
+     }
+     return count;
+}
+
+/* Read the input ranges saved by saveCpuCalibration(). Return 1 if every convolution
+   but conv1 got one, 0 if the file is missing or doesn't match the engine. */
+int loadCpuCalibration(CpuEngine *engine, const char *path)
+{
+     assert(engine && path);
+     FILE *fp;
+     CpuConv *convs[3];
+     const char *suffixes[3];
+     char magic[32], name[64];
+     int version, i, j, n, ok = 1;
+     float value;
+
+     if ((fp = fopen(path, "r")) == NULL)
+          return 0;
+     if (fscanf(fp, "%31s %d", magic, &version) != 2 || strcmp(magic, CALIBRATION_MAGIC) ||
+         version != CALIBRATION_VERSION) {
+          fprintf(stderr, "Warning: %s is not a calibration table, ignored\n", path);
+          fclose(fp);
+          return 0;
+     }
+     while (fscanf(fp, "%63s %f", name, &value) == 2) {
+          for (i = 0; i < engine->nlayers; i++) {
+               n = layerConvs(&engine->layers[i], convs, suffixes);
+               for (j = 0; j < n; j++)
+                    if (!strcmp(name, (std::string(engine->layers[i].name) + suffixes[j]).c_str()))
+                         convs[j]->act_max = value;
+          }
+     }
+     fclose(fp);
+     for (i = 1; i < engine->nlayers; i++) {
+          n = layerConvs(&engine->layers[i], convs, suffixes);
+          for (j = 0; j < n; j++)
+               if (convs[j]->act_max <= 0)
+                    ok = 0;
+     }
+     if (!ok) {
+          fprintf(stderr, "Warning: calibration table %s misses some layers, ignored\n", path);
+          for (i = 0; i < engine->nlayers; i++) {
+               n = layerConvs(&engine->layers[i], convs, suffixes);
+               for (j = 0; j < n; j++)
+                    convs[j]->act_max = 0;
+          }
+     }
+     return ok;
+}
+
+/* one "name max" line per convolution, after a header line; return 1 on success */
+int saveCpuCalibration(const CpuEngine *engine, const char *path)
+{
+     assert(engine && path);
+     FILE *fp;
+     CpuConv *convs[3];
+     const char *suffixes[3];
+     int i, j, n, ok;
+
+     if ((fp = fopen(path, "w")) == NULL) {
+          warn("%s", path);
+          return 0;
+     }
+     fprintf(fp, "%s %d\n", CALIBRATION_MAGIC, CALIBRATION_VERSION);
+     for (i = 0; i < engine->nlayers; i++) {
+          n = layerConvs(&engine->layers[i], convs, suffixes);
+          for (j = 0; j < n; j++)
+               fprintf(fp, "%s%s %.9g\n", engine->layers[i].name, suffixes[j], convs[j]->act_max);
+     }
+     ok = !ferror(fp);
+     if (fclose(fp) != 0)
+          ok = 0;
+     if (!ok)
+          warn("%s", path);
+     return ok;
+}
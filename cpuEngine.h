@@ -0,0 +1,78 @@
+#ifndef _CPU_ENGINE_H_
+#define _CPU_ENGINE_H_
+
+#include "weightsFile.h"
+#include "cpuGemm.h"
+#include "cpuWinograd.h"
+#include "cpuInt8.h"
+#include "cpuHalf.h"
+
+/* Host executor of the SqueezeDet convolution graph built in createConvEngine(),
+   producing the same conv_out tensor as the TensorRT engine, [N, C, H, W] order. */
+
+typedef enum CpuConvAlgo {
+     CPU_CONV_DIRECT,           /* conv2dDirect(), any shape */
+     CPU_CONV_GEMM,             /* gemmPacked(), 1x1 stride 1 */
+     CPU_CONV_WINOGRAD,         /* conv2dWinograd(), 3x3 stride 1 pad 1 */
+     CPU_CONV_IM2COL,           /* conv2dIm2col(), any shape */
+     CPU_CONV_INT8              /* conv2dInt8(), any shape, input after a ReLU */
+} CpuConvAlgo;
+
+typedef struct {
+     int ic, oc, k, stride, pad, relu;
+     CpuConvAlgo algo;
+     float *kernel;             /* [oc, ic, k, k] */
+     float *bias;               /* [oc] */
+     PackedMatrix *packed;      /* CPU_CONV_GEMM and CPU_CONV_IM2COL, [oc, ic * k * k] */
+     WinogradKernel *winograd;  /* CPU_CONV_WINOGRAD */
+     Int8Matrix *int8;          /* CPU_CONV_INT8, [oc, ic * k * k] */
+     float act_max;             /* largest input value seen by the calibration */
+} CpuConv;
+
+typedef enum CpuFusion {
+     CPU_FUSION_NONE,           /* layer by layer */
+     CPU_FUSION_FIRE,           /* the stem and every fire module as one striped operator,
+                                   with the max pooling that follows */
+     CPU_FUSION_GROUP           /* consecutive fire modules depth first, stripe by stripe */
+} CpuFusion;
+
+typedef enum CpuLayerKind {
+     CPU_LAYER_CONV, CPU_LAYER_POOL, CPU_LAYER_FIRE
+} CpuLayerKind;
+
+typedef struct {
+     CpuLayerKind kind;
+     char name[16];
+     int c, h, w;               /* input shape */
+     int oc, oh, ow;            /* output shape */
+     CpuConv conv;              /* CPU_LAYER_CONV */
+     CpuConv squeeze, expand1x1, expand3x3; /* CPU_LAYER_FIRE, output is concat(expand1x1, expand3x3) */
+     int pool_k, pool_stride, pool_pad; /* CPU_LAYER_POOL */
+} CpuLayer;
+
+typedef struct {
+     int c, h, w;               /* input shape */
+     int oc, oh, ow;            /* conv_out shape */
+     int nlayers;
+     CpuLayer *layers;
+     CpuFusion fusion;
+     int calibrating;           /* run layer by layer and record the input range of every convolution */
+     StorageType storage;       /* of the activations between steps */
+     void *buffers[2];          /* ping-pong activations of one image, in storage */
+     float *scratch;            /* squeeze output of fire layers */
+     float *staging[2];         /* float input and output of an unfused step with half storage */
+     long staging_size[2];
+} CpuEngine;
+
+CpuEngine *createCpuEngine(WeightMap &weightMap, int c, int h, int w);
+CpuEngine *createCpuFireEngine(WeightMap &weightMap, const char *first,
+                               const char *last, int c, int h, int w);
+void cpuEngineInfer(CpuEngine *engine, const float *input, float *output, int batchSize);
+void destroyCpuEngine(CpuEngine *engine);
+void setCpuStorage(CpuEngine *engine, StorageType type);
+int setCpuConvAlgo(CpuEngine *engine, const char *layer, CpuConvAlgo algo);
+int quantizeCpuEngine(CpuEngine *engine);
+int loadCpuCalibration(CpuEngine *engine, const char *path);
+int saveCpuCalibration(const CpuEngine *engine, const char *path);
+
+#endif  /* _CPU_ENGINE_H_ */
@@ -0,0 +1,382 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <float.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "cpuFused.h"
+#include "sdt_alloc.h"
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+/* per-thread budget of the intermediates of a stripe, half of a 2MB L2 */
+#define FUSED_CACHE_BYTES (1024 * 1024)
+
+/* rows [y0, y1) of a [c, h, w] activation, channel c starts at data + c * cstride */
+typedef struct {
+     float *data;
+     long cstride;
+     int y0, y1;
+} RowWindow;
+
+/* per-thread buffers of fireGroupFused() */
+typedef struct {
+     float *tile;               /* squeeze output of a stripe */
+     float *windows[2];         /* outputs of the fire modules inside the group, and of the
+                                   last one when a max pooling follows or dst is half */
+     float *input;              /* rows of a half src converted to float */
+     float *row;                /* a pooled row before it's stored in half */
+     const float **brows;
+     WinogradWork *works[FIRE_GROUP_MAX];
+} GroupWork;
+
+static int maxThreads(void)
+{
+#ifdef _OPENMP
+     return omp_get_max_threads();
+#else
+     return 1;
+#endif
+}
+
+/* squeeze and expand1x1 run as GEMMs, expand3x3 with Winograd */
+int canFuseFire(const CpuLayer *layer)
+{
+     return layer->kind == CPU_LAYER_FIRE && layer->squeeze.algo == CPU_CONV_GEMM &&
+          layer->expand1x1.algo == CPU_CONV_GEMM && layer->expand3x3.algo == CPU_CONV_WINOGRAD;
+}
+
+/* conv1 runs as an im2col GEMM, which can produce one output row at a time */
+int canFuseConvPool(const CpuLayer *conv, const CpuLayer *pool)
+{
+     return conv->kind == CPU_LAYER_CONV && conv->conv.algo == CPU_CONV_IM2COL &&
+          pool->kind == CPU_LAYER_POOL && pool->pool_k <= POOL_K_MAX;
+}
+
+/* the stripes of a fire group are whole Winograd tiles, so they must also be whole pooling windows */
+int canFusePool(const CpuLayer *pool)
+{
+     return pool->kind == CPU_LAYER_POOL && pool->pool_k <= POOL_K_MAX && WINO_OUT % pool->pool_stride == 0;
+}
+
+/* Output row of a max pooling for all channels. rows[i] is channel 0 of input row
+   py * stride - pad + i, or NULL above or below the input, which like the columns beside
+   it doesn't take part in the max, same as maxPool2d(). */
+static void poolRow(const CpuLayer *pool, const float *const *rows, long cstride, float *dst, long dst_cstride)
+{
+     int k = pool->pool_k, s = pool->pool_stride, p = pool->pool_pad, w = pool->w;
+     int c, i, ox, x;
+
+     for (c = 0; c < pool->c; c++) {
+          float *orow = dst + c * dst_cstride;
+          for (ox = 0; ox < pool->ow; ox++) {
+               int x0 = max(ox * s - p, 0), x1 = min(ox * s - p + k, w);
+               float m = -FLT_MAX;
+               for (i = 0; i < k; i++) {
+                    if (!rows[i])
+                         continue;
+                    const float *irow = rows[i] + c * cstride;
+                    for (x = x0; x < x1; x++)
+                         m = max(m, irow[x]);
+               }
+               orow[ox] = m;
+          }
+     }
+}
+
+/* Stores a pooled row computed in float into dst of type dst_type. rowbuf holds the row of
+   every channel ow floats apart, it's only needed when dst is half. */
+static void storePoolRow(const CpuLayer *pool, const float *rowbuf, void *dst, StorageType dst_type, int py)
+{
+     long ovol = (long)pool->oh * pool->ow;
+     int c;
+
+     if (dst_type == STORAGE_FP32)
+          return;
+     for (c = 0; c < pool->c; c++)
+          storeFloats(rowbuf + (long)c * pool->ow, storageAt(dst, dst_type, c * ovol + (long)py * pool->ow),
+                      dst_type, pool->ow);
+}
+
+/* Output rows [py0, py1) of a max pooling, from the window in of its input */
+static void poolRows(const CpuLayer *pool, const RowWindow *in, void *dst, StorageType dst_type,
+                     int py0, int py1, float *rowbuf)
+{
+     const float *rows[POOL_K_MAX];
+     long ovol = (long)pool->oh * pool->ow;
+     int py, i;
+
+     for (py = py0; py < py1; py++) {
+          for (i = 0; i < pool->pool_k; i++) {
+               int y = py * pool->pool_stride - pool->pool_pad + i;
+               if (y < 0 || y >= pool->h) {
+                    rows[i] = NULL;
+                    continue;
+               }
+               assert(y >= in->y0 && y < in->y1);
+               rows[i] = in->data + (long)(y - in->y0) * pool->w;
+          }
+          if (dst_type == STORAGE_FP32)
+               poolRow(pool, rows, in->cstride, (float *)dst + (long)py * pool->ow, ovol);
+          else
+               poolRow(pool, rows, in->cstride, rowbuf, pool->ow);
+          storePoolRow(pool, rowbuf, dst, dst_type, py);
+     }
+}
+
+/* Convolution, bias and ReLU straight into the max pooling that follows, the convolution
+   output never exists as a whole. Threads split the pooled rows in stripes, and each keeps
+   the last pool_k convolution rows in a ring: going down a stripe every row is computed
+   once, as an im2col GEMM of a single row, and pooled while it's still in cache. Only the
+   row two stripes share is computed twice. A half dst is stored a pooled row at a time. */
+void convPoolFused(const CpuLayer *conv, const CpuLayer *pool, const float *src, void *dst, StorageType dst_type)
+{
+     assert(canFuseConvPool(conv, pool) && pool->c == conv->oc && pool->h == conv->oh && pool->w == conv->ow);
+     assert(src && dst && src != dst);
+     const CpuConv *cv = &conv->conv;
+     int oh = conv->oh, ow = conv->ow, k = pool->pool_k, s = pool->pool_stride, p = pool->pool_pad;
+     int ph = pool->oh, nthreads = maxThreads();
+     int rows = (ph + nthreads - 1) / nthreads;
+     int nstripes = (ph + rows - 1) / rows;
+     long slot = (long)conv->oc * ow, ovol = (long)ph * pool->ow;
+     int flags = cv->relu ? GEMM_RELU : 0;
+
+#pragma omp parallel
+     {
+          float *ring = (float *)sdt_aligned_alloc(64, sizeof(float) * k * slot);
+          float *col = (float *)sdt_aligned_alloc(64, sizeof(float) * cv->ic * cv->k * cv->k * ow);
+          float *rowbuf = dst_type == STORAGE_FP32 ? NULL :
+               (float *)sdt_aligned_alloc(64, sizeof(float) * pool->c * pool->ow);
+#pragma omp for schedule(static)
+          for (int i = 0; i < nstripes; i++) {
+               int py0 = i * rows, py1 = min(ph, py0 + rows);
+               int next = max(py0 * s - p, 0);    /* next convolution row to compute */
+               for (int py = py0; py < py1; py++) {
+                    const float *in_rows[POOL_K_MAX];
+                    for (int j = 0; j < k; j++) {
+                         int y = py * s - p + j;
+                         if (y < 0 || y >= oh) {
+                              in_rows[j] = NULL;
+                              continue;
+                         }
+                         // row next - k goes out of the ring, the window of py starts below it
+                         for (; next <= y; next++)
+                              convIm2colRows(cv->packed, src, cv->ic, conv->h, conv->w, cv->k, cv->stride,
+                                             cv->pad, next, next + 1, col, ring + next % k * slot, ow, flags);
+                         in_rows[j] = ring + y % k * slot;
+                    }
+                    if (dst_type == STORAGE_FP32)
+                         poolRow(pool, in_rows, ow, (float *)dst + (long)py * pool->ow, ovol);
+                    else
+                         poolRow(pool, in_rows, ow, rowbuf, pool->ow);
+                    storePoolRow(pool, rowbuf, dst, dst_type, py);
+               }
+          }
+          if (rowbuf)
+               sdt_free(rowbuf);
+          sdt_free(col);
+          sdt_free(ring);
+     }
+}
+
+/* number of fusible fire modules at the same resolution from layers[0] on, at most
+   FIRE_GROUP_MAX, 0 if layers[0] is not one */
+int fireGroupLength(const CpuLayer *layers, int nlayers)
+{
+     int n = 0;
+     while (n < nlayers && n < FIRE_GROUP_MAX && canFuseFire(&layers[n]) &&
+            layers[n].h == layers[0].h && layers[n].w == layers[0].w)
+          n++;
+     return n;
+}
+
+/* Output rows per stripe of a group of n fire modules, a multiple of the Winograd tile.
+   The squeeze output of a stripe and the outputs of all but the last module, with their
+   halo rows, should fit in FUSED_CACHE_BYTES, and every thread should get a stripe. But
+   a stripe has at least 8 * (n - 1) rows, so the halo rows recomputed by the earlier
+   modules add at most a quarter to their work. */
+static int groupStripeRows(const CpuLayer *layers, int n, int nthreads)
+{
+     long row_bytes = 0;
+     int j, rows;
+
+     for (j = 0; j < n; j++) {
+          int live = layers[j].squeeze.oc + (j > 0 ? layers[j].c : 0) + (j < n - 1 ? layers[j].oc : 0);
+          row_bytes = max(row_bytes, (long)sizeof(float) * live * layers[j].w);
+     }
+     rows = (int)(FUSED_CACHE_BYTES / row_bytes) - 2 * n;
+     rows = min(rows, (layers[0].h + nthreads - 1) / nthreads);
+     rows = max(rows, 8 * (n - 1));
+     return max(WINO_OUT, rows / WINO_OUT * WINO_OUT);
+}
+
+/* Output rows [y0, y0 + rows) of a fire module, from the window in that holds at least the
+   rows y0 - 1 to y0 + rows of its input, to the window out. The squeeze output of the rows
+   and their one row halo goes to tile, and both expands read it from there and write their
+   channel ranges of out, with the bias and ReLU fused. Each channel of a window is contiguous,
+   so every convolution is a single GEMM over all the rows. */
+static void fireRows(const CpuLayer *layer, const RowWindow *in, const RowWindow *out, int y0, int rows,
+                     float *tile, const float **brows, WinogradWork *work)
+{
+     int h = layer->h, w = layer->w, s = layer->squeeze.oc;
+     int ya = max(y0 - 1, 0), yb = min(y0 + rows + 1, h);
+     long ts = (long)(yb - ya) * w;
+     int c, t;
+
+     assert(in->y0 <= ya && yb <= in->y1 && out->y0 <= y0 && y0 + rows <= out->y1);
+     for (c = 0; c < layer->c; c++)
+          brows[c] = in->data + c * in->cstride + (long)(ya - in->y0) * w;
+     gemmIndirect(layer->squeeze.packed, brows, tile, ts, ts, layer->squeeze.relu ? GEMM_RELU : 0);
+
+     for (c = 0; c < s; c++)
+          brows[c] = tile + c * ts + (long)(y0 - ya) * w;
+     gemmIndirect(layer->expand1x1.packed, brows, out->data + (long)(y0 - out->y0) * w, out->cstride,
+                  rows * w, layer->expand1x1.relu ? GEMM_RELU : 0);
+
+     // the rows above and below the image and the columns beside it read as zeros
+     WinogradView view = {tile, ts, yb - ya, w, y0 - 1 - ya, -1,
+                          out->data + layer->expand1x1.oc * out->cstride + (long)(y0 - out->y0) * w,
+                          out->cstride, rows, w};
+     int tiles = winogradTileCount(rows, w);
+     for (t = 0; t < tiles; t += work->nb)
+          winogradTiles(layer->expand3x3.winograd, &view, t, min(work->nb, tiles - t), work,
+                        layer->expand3x3.relu);
+}
+
+/* Output rows [y0, y0 + rows) of the last module of a group, depth first: module j computes
+   n - 1 - j more rows on either side than the stripe, which the modules after it need as halo,
+   into a window that only lives in cache. With a max pooling after the group, y0 is a multiple
+   of its stride, the last module computes the rows its pooling windows cover into a window as
+   well, and the stripe's pooled rows go to dst. A half src is converted to float for the rows
+   the first module reads, and a half dst is stored from the window of the last one. */
+static void groupStripe(const CpuLayer *layers, int n, const CpuLayer *pool, const void *src, StorageType src_type,
+                        void *dst, StorageType dst_type, int y0, int rows, GroupWork *gw)
+{
+     int h = layers[0].h, w = layers[0].w;
+     long vol = (long)h * w;
+     RowWindow in = {(float *)const_cast<void *>(src), vol, 0, h}, out;
+     int lo = y0, hi = y0 + rows, py0 = 0, py1 = 0;
+     int c, j;
+
+     if (pool) {
+          py0 = y0 / pool->pool_stride;
+          py1 = y0 + rows == h ? pool->oh : (y0 + rows) / pool->pool_stride;
+          lo = max(py0 * pool->pool_stride - pool->pool_pad, 0);
+          hi = min((py1 - 1) * pool->pool_stride - pool->pool_pad + pool->pool_k, h);
+     }
+     if (src_type != STORAGE_FP32) {
+          int a = max(lo - n, 0), b = min(hi + n, h);
+          for (c = 0; c < layers[0].c; c++)
+               loadFloats(storageAt(src, src_type, c * vol + (long)a * w), src_type,
+                          gw->input + (long)c * (b - a) * w, (long)(b - a) * w);
+          in.data = gw->input;
+          in.cstride = (long)(b - a) * w;
+          in.y0 = a;
+          in.y1 = b;
+     }
+     for (j = 0; j < n; j++) {
+          int halo = n - 1 - j;
+          int a = max(lo - halo, 0), b = min(hi + halo, h);
+          if (j == n - 1 && !pool && dst_type == STORAGE_FP32) {
+               out.data = (float *)dst;
+               out.cstride = vol;
+               out.y0 = 0;
+               out.y1 = h;
+          } else {
+               out.data = gw->windows[j % 2];
+               out.cstride = (long)(b - a) * w;
+               out.y0 = a;
+               out.y1 = b;
+          }
+          fireRows(&layers[j], &in, &out, a, b - a, gw->tile, gw->brows, gw->works[j]);
+          in = out;
+     }
+     if (pool)
+          poolRows(pool, &in, dst, dst_type, py0, py1, gw->row);
+     else if (dst_type != STORAGE_FP32)
+          for (c = 0; c < layers[n - 1].oc; c++)
+               storeFloats(in.data + c * in.cstride, storageAt(dst, dst_type, c * vol + (long)y0 * w),
+                           dst_type, (long)rows * w);
+}
+
+/* same result as running the n fire modules one after another, and then the max pooling
+   pool if it isn't NULL, threads split the stripes. src and dst may be stored in half, the
+   stripes are computed in float all the same. */
+void fireGroupFused(const CpuLayer *layers, int n, const CpuLayer *pool, const void *src, StorageType src_type,
+                    void *dst, StorageType dst_type)
+{
+     assert(n > 0 && n <= FIRE_GROUP_MAX && fireGroupLength(layers, n) == n);
+     assert(!pool || (canFusePool(pool) && pool->c == layers[n - 1].oc && pool->h == layers[0].h));
+     assert(src && dst && src != dst);
+     int h = layers[0].h, w = layers[0].w;
+     int rows = groupStripeRows(layers, n, maxThreads());
+     int nstripes = (h + rows - 1) / rows;
+     int extra = pool ? pool->pool_k : 0;       /* rows the pooling windows reach beyond a stripe */
+     int nwindows = n - 1 + (pool || dst_type != STORAGE_FP32 ? 1 : 0);
+     long tile_size = 0, window_size = 0, nrows = 0;
+     long input_size = (long)layers[0].c * min(rows + extra + 2 * n, h) * w;
+     int j;
+
+     for (j = 0; j < n; j++) {
+          int span = min(rows + extra + 2 * (n - 1 - j), h);
+          tile_size = max(tile_size, (long)layers[j].squeeze.oc * min(span + 2, h) * w);
+          window_size = max(window_size, (long)layers[j].oc * span * w);
+          nrows = max(nrows, (long)max(layers[j].c, layers[j].squeeze.oc));
+     }
+
+#pragma omp parallel
+     {
+          GroupWork gw;
+          gw.tile = (float *)sdt_aligned_alloc(64, sizeof(float) * tile_size);
+          gw.windows[0] = nwindows > 0 ? (float *)sdt_aligned_alloc(64, sizeof(float) * window_size) : NULL;
+          gw.windows[1] = nwindows > 1 ? (float *)sdt_aligned_alloc(64, sizeof(float) * window_size) : NULL;
+          gw.input = src_type == STORAGE_FP32 ? NULL : (float *)sdt_aligned_alloc(64, sizeof(float) * input_size);
+          gw.row = pool && dst_type != STORAGE_FP32 ?
+               (float *)sdt_aligned_alloc(64, sizeof(float) * pool->c * pool->ow) : NULL;
+          gw.brows = (const float **)sdt_alloc(sizeof(float *) * nrows);
+          for (int k = 0; k < n; k++) {
+               int span = min(rows + extra + 2 * (n - 1 - k), h);
+               gw.works[k] = createWinogradWork(layers[k].expand3x3.winograd,
+                                                winogradBlockTiles(layers[k].expand3x3.winograd,
+                                                                   winogradTileCount(span, w), 1));
+          }
+#pragma omp for schedule(dynamic)
+          for (int i = 0; i < nstripes; i++)
+               groupStripe(layers, n, pool, src, src_type, dst, dst_type, i * rows, min(rows, h - i * rows), &gw);
+          for (int k = 0; k < n; k++)
+               destroyWinogradWork(gw.works[k]);
+          sdt_free(gw.brows);
+          if (gw.row)
+               sdt_free(gw.row);
+          if (gw.input)
+               sdt_free(gw.input);
+          if (gw.windows[0])
+               sdt_free(gw.windows[0]);
+          if (gw.windows[1])
+               sdt_free(gw.windows[1]);
+          sdt_free(gw.tile);
+     }
+}
+
+/* Activation bytes n fire modules move to and from memory. Layer by layer, every module
+   reads its input, the squeeze output is written once and read by both expands, and the
+   expand outputs are copied into the concat tensor. Fused, only the input of the group,
+   with the rows the stripes share read more than once, and the output of the last module
+   are. */
+void fireGroupTraffic(const CpuLayer *layers, int n, double *unfused_bytes, double *fused_bytes)
+{
+     assert(n > 0 && layers[0].kind == CPU_LAYER_FIRE);
+     double vol = (double)layers[0].h * layers[0].w;
+     int rows = groupStripeRows(layers, n, maxThreads());
+     int nstripes = (layers[0].h + rows - 1) / rows;
+     double shared = 2.0 * n * (nstripes - 1) * layers[0].w;
+     int j;
+
+     *unfused_bytes = 0;
+     for (j = 0; j < n; j++)
+          *unfused_bytes += sizeof(float) * (layers[j].c + 3 * layers[j].squeeze.oc + 3 * layers[j].oc) * vol;
+     *fused_bytes = sizeof(float) * (layers[0].c * (vol + shared) + layers[n - 1].oc * vol);
+}
@@ -0,0 +1,24 @@
+#ifndef _CPU_FUSED_H_
+#define _CPU_FUSED_H_
+
+#include "cpuEngine.h"
+#include "cpuHalf.h"
+
+/* Fused operators of the cpu backend. They work on horizontal stripes of the
+   output, so the intermediate tensors of a stripe stay in cache instead of
+   making a round trip through memory. With half storage they also convert
+   between the stored activations and the float stripes. */
+
+#define FIRE_GROUP_MAX 4        /* most fire modules fused depth first */
+#define POOL_K_MAX 4            /* largest fused max pooling window */
+
+int canFuseConvPool(const CpuLayer *conv, const CpuLayer *pool);
+int canFusePool(const CpuLayer *pool);
+void convPoolFused(const CpuLayer *conv, const CpuLayer *pool, const float *src, void *dst, StorageType dst_type);
+int canFuseFire(const CpuLayer *layer);
+int fireGroupLength(const CpuLayer *layers, int nlayers);
+void fireGroupFused(const CpuLayer *layers, int n, const CpuLayer *pool, const void *src, StorageType src_type,
+                    void *dst, StorageType dst_type);
+void fireGroupTraffic(const CpuLayer *layers, int n, double *unfused_bytes, double *fused_bytes);
+
+#endif  /* _CPU_FUSED_H_ */
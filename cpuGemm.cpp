@@ -0,0 +1,394 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <immintrin.h>
+#include "cpuGemm.h"
+#include "sdt_alloc.h"
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+/* columns of B per block, sized so a [k, block] slice of B stays in L2 */
+#define GEMM_L2_FLOATS (256 * 1024 / 4)
+
+/* per-thread budget of the im2col matrix of a block of output rows, in floats */
+#define IM2COL_FLOATS (256 * 1024 / 4)
+
+/* computes a full GEMM_MR x nr tile of C at c, from a packed panel a and B columns [boff, boff + nr) */
+typedef void (*MicroKernel)(int k, const float *a, const float *const *b, long boff,
+                            float *c, long ldc, const float *bias, int flags);
+
+typedef struct {
+     GemmKernelKind kind;
+     const char *name;
+     int nr;
+     MicroKernel func;
+} KernelInfo;
+
+static GemmKernelKind selectedKernel = GEMM_KERNEL_AUTO;
+
+static void microKernelScalar(int k, const float *a, const float *const *b, long boff,
+                              float *c, long ldc, const float *bias, int flags)
+{
+     float acc[GEMM_MR][8];
+     int i, j, p;
+
+     for (i = 0; i < GEMM_MR; i++)
+          for (j = 0; j < 8; j++)
+               acc[i][j] = (flags & GEMM_ACCUMULATE ? c[i * ldc + j] : 0) + bias[i];
+     for (p = 0; p < k; p++) {
+          const float *bp = b[p] + boff;
+          const float *ap = a + p * GEMM_MR;
+          for (i = 0; i < GEMM_MR; i++)
+               for (j = 0; j < 8; j++)
+                    acc[i][j] += ap[i] * bp[j];
+     }
+     for (i = 0; i < GEMM_MR; i++)
+          for (j = 0; j < 8; j++)
+               c[i * ldc + j] = flags & GEMM_RELU ? max(acc[i][j], 0.0f) : acc[i][j];
+}
+
+/* 6 x 16 tile in 12 ymm accumulators, one broadcast of A feeds two FMAs */
+__attribute__((target("avx2,fma")))
+static void microKernelAvx2(int k, const float *a, const float *const *b, long boff,
+                            float *c, long ldc, const float *bias, int flags)
+{
+     __m256 acc[GEMM_MR][2];
+     int i, p;
+
+     for (i = 0; i < GEMM_MR; i++) {
+          __m256 bi = _mm256_set1_ps(bias[i]);
+          if (flags & GEMM_ACCUMULATE) {
+               acc[i][0] = _mm256_add_ps(_mm256_loadu_ps(c + i * ldc), bi);
+               acc[i][1] = _mm256_add_ps(_mm256_loadu_ps(c + i * ldc + 8), bi);
+          } else {
+               acc[i][0] = acc[i][1] = bi;
+          }
+     }
+     for (p = 0; p < k; p++) {
+          const float *bp = b[p] + boff;
+          const float *ap = a + p * GEMM_MR;
+          __m256 b0 = _mm256_loadu_ps(bp);
+          __m256 b1 = _mm256_loadu_ps(bp + 8);
+          for (i = 0; i < GEMM_MR; i++) {
+               __m256 ai = _mm256_broadcast_ss(ap + i);
+               acc[i][0] = _mm256_fmadd_ps(ai, b0, acc[i][0]);
+               acc[i][1] = _mm256_fmadd_ps(ai, b1, acc[i][1]);
+          }
+     }
+     if (flags & GEMM_RELU) {
+          __m256 zero = _mm256_setzero_ps();
+          for (i = 0; i < GEMM_MR; i++) {
+               acc[i][0] = _mm256_max_ps(acc[i][0], zero);
+               acc[i][1] = _mm256_max_ps(acc[i][1], zero);
+          }
+     }
+     for (i = 0; i < GEMM_MR; i++) {
+          _mm256_storeu_ps(c + i * ldc, acc[i][0]);
+          _mm256_storeu_ps(c + i * ldc + 8, acc[i][1]);
+     }
+}
+
+/* 6 x 32 tile in 12 zmm accumulators */
+__attribute__((target("avx512f")))
+static void microKernelAvx512(int k, const float *a, const float *const *b, long boff,
+                              float *c, long ldc, const float *bias, int flags)
+{
+     __m512 acc[GEMM_MR][2];
+     int i, p;
+
+     for (i = 0; i < GEMM_MR; i++) {
+          __m512 bi = _mm512_set1_ps(bias[i]);
+          if (flags & GEMM_ACCUMULATE) {
+               acc[i][0] = _mm512_add_ps(_mm512_loadu_ps(c + i * ldc), bi);
+               acc[i][1] = _mm512_add_ps(_mm512_loadu_ps(c + i * ldc + 16), bi);
+          } else {
+               acc[i][0] = acc[i][1] = bi;
+          }
+     }
+     for (p = 0; p < k; p++) {
+          const float *bp = b[p] + boff;
+          const float *ap = a + p * GEMM_MR;
+          __m512 b0 = _mm512_loadu_ps(bp);
+          __m512 b1 = _mm512_loadu_ps(bp + 16);
+          for (i = 0; i < GEMM_MR; i++) {
+               __m512 ai = _mm512_set1_ps(ap[i]);
+               acc[i][0] = _mm512_fmadd_ps(ai, b0, acc[i][0]);
+               acc[i][1] = _mm512_fmadd_ps(ai, b1, acc[i][1]);
+          }
+     }
+     if (flags & GEMM_RELU) {
+          __m512 zero = _mm512_setzero_ps();
+          // the masked form, _mm512_max_ps() trips -Wmaybe-uninitialized in gcc 12
+          for (i = 0; i < GEMM_MR; i++) {
+               acc[i][0] = _mm512_maskz_max_ps(0xffff, acc[i][0], zero);
+               acc[i][1] = _mm512_maskz_max_ps(0xffff, acc[i][1], zero);
+          }
+     }
+     for (i = 0; i < GEMM_MR; i++) {
+          _mm512_storeu_ps(c + i * ldc, acc[i][0]);
+          _mm512_storeu_ps(c + i * ldc + 16, acc[i][1]);
+     }
+}
+
+static const KernelInfo KERNELS[] = {
+     {GEMM_KERNEL_SCALAR, "scalar", 8, microKernelScalar},
+     {GEMM_KERNEL_AVX2, "avx2", 16, microKernelAvx2},
+     {GEMM_KERNEL_AVX512, "avx512", 32, microKernelAvx512},
+};
+
+static const KernelInfo *kernelInfo(GemmKernelKind kind)
+{
+     for (size_t i = 0; i < sizeof(KERNELS) / sizeof(KERNELS[0]); i++)
+          if (KERNELS[i].kind == kind)
+               return &KERNELS[i];
+     return &KERNELS[0];
+}
+
+static int isKernelSupported(GemmKernelKind kind)
+{
+     switch (kind) {
+     case GEMM_KERNEL_SCALAR:
+          return 1;
+     case GEMM_KERNEL_AVX2:
+          return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+     case GEMM_KERNEL_AVX512:
+          return __builtin_cpu_supports("avx512f");
+     default:
+          return 0;
+     }
+}
+
+/* the widest kernel the cpu supports, unless SQDTRT_GEMM_KERNEL or setGemmKernel() says otherwise */
+GemmKernelKind gemmKernel(void)
+{
+     if (selectedKernel != GEMM_KERNEL_AUTO)
+          return selectedKernel;
+
+     GemmKernelKind kind = GEMM_KERNEL_SCALAR;
+     const char *env = getenv("SQDTRT_GEMM_KERNEL");
+     if (isKernelSupported(GEMM_KERNEL_AVX2))
+          kind = GEMM_KERNEL_AVX2;
+     if (isKernelSupported(GEMM_KERNEL_AVX512))
+          kind = GEMM_KERNEL_AVX512;
+     if (env) {
+          size_t i;
+          for (i = 0; i < sizeof(KERNELS) / sizeof(KERNELS[0]); i++)
+               if (!strcmp(env, KERNELS[i].name) && isKernelSupported(KERNELS[i].kind))
+                    break;
+          if (i < sizeof(KERNELS) / sizeof(KERNELS[0]))
+               kind = KERNELS[i].kind;
+          else
+               fprintf(stderr, "Warning: unsupported SQDTRT_GEMM_KERNEL %s, use %s\n", env, kernelInfo(kind)->name);
+     }
+     selectedKernel = kind;
+     return kind;
+}
+
+void setGemmKernel(GemmKernelKind kind)
+{
+     if (kind != GEMM_KERNEL_AUTO && !isKernelSupported(kind)) {
+          fprintf(stderr, "Warning: gemm kernel %s is not supported by this cpu\n", kernelInfo(kind)->name);
+          return;
+     }
+     selectedKernel = kind;
+}
+
+const char *gemmKernelName(GemmKernelKind kind)
+{
+     return kind == GEMM_KERNEL_AUTO ? "auto" : kernelInfo(kind)->name;
+}
+
+/* a is [m, k] row-major, bias is [m] or NULL */
+PackedMatrix *packMatrix(const float *a, int m, int k, const float *bias)
+{
+     assert(a && m > 0 && k > 0);
+     PackedMatrix *packed = (PackedMatrix *)sdt_alloc(sizeof(PackedMatrix));
+     int pi, i, p;
+
+     packed->m = m;
+     packed->k = k;
+     packed->panels = (m + GEMM_MR - 1) / GEMM_MR;
+     packed->data = (float *)sdt_aligned_alloc(64, sizeof(float) * packed->panels * k * GEMM_MR);
+     packed->bias = (float *)sdt_aligned_alloc(64, sizeof(float) * packed->panels * GEMM_MR);
+     for (pi = 0; pi < packed->panels; pi++) {
+          float *panel = packed->data + (long)pi * k * GEMM_MR;
+          for (p = 0; p < k; p++) {
+               for (i = 0; i < GEMM_MR; i++) {
+                    int row = pi * GEMM_MR + i;
+                    panel[p * GEMM_MR + i] = row < m ? a[(long)row * k + p] : 0;
+               }
+          }
+     }
+     for (i = 0; i < packed->panels * GEMM_MR; i++)
+          packed->bias[i] = bias && i < m ? bias[i] : 0;
+     return packed;
+}
+
+void freePackedMatrix(PackedMatrix *packed)
+{
+     assert(packed);
+     sdt_free(packed->data);
+     sdt_free(packed->bias);
+     sdt_free(packed);
+}
+
+/* partial tile at the bottom or right edge of C: compute a full tile into a local buffer,
+   then copy back the valid part */
+static void edgeTile(const KernelInfo *kern, int k, const float *a, const float *const *b, long boff,
+                     float *c, long ldc, int rows, int cols, const float *bias, int flags)
+{
+     float tile[GEMM_MR * GEMM_NR_MAX] __attribute__((aligned(64)));
+     int i, j, nr = kern->nr;
+
+     if (flags & GEMM_ACCUMULATE) {
+          memset(tile, 0, sizeof(tile));
+          for (i = 0; i < rows; i++)
+               for (j = 0; j < cols; j++)
+                    tile[i * nr + j] = c[i * ldc + j];
+     }
+     kern->func(k, a, b, boff, tile, nr, bias, flags);
+     for (i = 0; i < rows; i++)
+          for (j = 0; j < cols; j++)
+               c[i * ldc + j] = tile[i * nr + j];
+}
+
+/* zero padded copy of the last n % nr columns of B. Fused operators call gemmIndirect()
+   once per row from every thread, so the buffer is kept per thread and only grows. */
+static thread_local float *tailData;
+static thread_local const float **tailRows;
+static thread_local int tailCapacity;    /* rows of B */
+
+static const float *const *copyTail(const float *const *brows, int k, int nr, int col, int cols)
+{
+     int p;
+
+     if (k > tailCapacity) {
+          if (tailData) {
+               sdt_free(tailData);
+               sdt_free(tailRows);
+          }
+          tailData = (float *)sdt_aligned_alloc(64, sizeof(float) * k * GEMM_NR_MAX);
+          tailRows = (const float **)sdt_alloc(sizeof(float *) * k);
+          tailCapacity = k;
+     }
+     for (p = 0; p < k; p++) {
+          float *row = tailData + (long)p * nr;
+          memset(row, 0, sizeof(float) * nr);
+          memmove(row, brows[p] + col, sizeof(float) * cols);
+          tailRows[p] = row;
+     }
+     return tailRows;
+}
+
+/* C[m, n] = [C +] A x B + bias, row p of B starts at brows[p]; threads split
+   C into (column block, panel) tiles, consecutive panels share a block of B */
+void gemmIndirect(const PackedMatrix *a, const float *const *brows, float *c, long ldc, int n, int flags)
+{
+     assert(a && brows && c && n > 0);
+     const KernelInfo *kern = kernelInfo(gemmKernel());
+     int k = a->k, nr = kern->nr;
+     int nc = max(nr, GEMM_L2_FLOATS / k / nr * nr);
+     int nblocks = (n + nc - 1) / nc;
+     int full_n = n / nr * nr;
+     const float *const *tail_rows = full_n < n ? copyTail(brows, k, nr, full_n, n - full_n) : NULL;
+
+#pragma omp parallel for collapse(2) schedule(static)
+     for (int jb = 0; jb < nblocks; jb++) {
+          for (int pi = 0; pi < a->panels; pi++) {
+               const float *ap = a->data + (long)pi * k * GEMM_MR;
+               const float *bias = a->bias + pi * GEMM_MR;
+               float *cp = c + (long)pi * GEMM_MR * ldc;
+               int rows = min(GEMM_MR, a->m - pi * GEMM_MR);
+               int j1 = min(n, (jb + 1) * nc);
+               for (int j = jb * nc; j < j1; j += nr) {
+                    if (j >= full_n)
+                         edgeTile(kern, k, ap, tail_rows, 0, cp + j, ldc, rows, n - j, bias, flags);
+                    else if (rows < GEMM_MR)
+                         edgeTile(kern, k, ap, brows, j, cp + j, ldc, rows, nr, bias, flags);
+                    else
+                         kern->func(k, ap, brows, j, cp + j, ldc, bias, flags);
+               }
+          }
+     }
+}
+
+/* B is [k, n] with row stride ldb */
+void gemmPacked(const PackedMatrix *a, const float *b, long ldb, float *c, long ldc, int n, int flags)
+{
+     assert(a && b && c);
+     const float **brows = (const float **)sdt_alloc(sizeof(float *) * a->k);
+     int p;
+
+     for (p = 0; p < a->k; p++)
+          brows[p] = b + p * ldb;
+     gemmIndirect(a, brows, c, ldc, n, flags);
+     sdt_free(brows);
+}
+
+static int outSize(int in, int k, int stride, int pad)
+{
+     return (in + 2 * pad - k) / stride + 1;
+}
+
+/* Output rows [oy0, oy1) of a k x k convolution of src [c, h, w]. Their im2col matrix goes to
+   col, [c * k * k, (oy1 - oy0) * ow], then a is [oc, c * k * k] and the result goes to dst,
+   the first of the rows in channel 0, channel stride ldc. */
+void convIm2colRows(const PackedMatrix *a, const float *src, int c, int h, int w, int k, int stride, int pad,
+                    int oy0, int oy1, float *col, float *dst, long ldc, int flags)
+{
+     assert(a && a->k == c * k * k && src && col && dst && oy0 < oy1);
+     int ow = outSize(w, k, stride, pad);
+     long n = (long)(oy1 - oy0) * ow;
+     const float **rows = (const float **)sdt_alloc(sizeof(float *) * a->k);
+     int i, ky, kx, oy, ox;
+
+     for (i = 0; i < c; i++) {
+          const float *in = src + (long)i * h * w;
+          for (ky = 0; ky < k; ky++) {
+               for (kx = 0; kx < k; kx++) {
+                    int p = (i * k + ky) * k + kx;
+                    float *crow = col + p * n;
+                    for (oy = oy0; oy < oy1; oy++) {
+                         int iy = oy * stride - pad + ky;
+                         float *out = crow + (long)(oy - oy0) * ow;
+                         if (iy < 0 || iy >= h) {
+                              memset(out, 0, sizeof(float) * ow);
+                              continue;
+                         }
+                         const float *irow = in + (long)iy * w;
+                         for (ox = 0; ox < ow; ox++) {
+                              int ix = ox * stride - pad + kx;
+                              out[ox] = ix >= 0 && ix < w ? irow[ix] : 0;
+                         }
+                    }
+                    rows[p] = crow;
+               }
+          }
+     }
+     gemmIndirect(a, rows, dst, ldc, n, flags);
+     sdt_free(rows);
+}
+
+/* dst is [oc, oh, ow]; threads split the output rows in blocks whose im2col
+   matrix fits in IM2COL_FLOATS */
+void conv2dIm2col(const PackedMatrix *a, const float *src, float *dst, int c, int h, int w,
+                  int k, int stride, int pad, int flags)
+{
+     assert(a && src && dst && src != dst);
+     int oh = outSize(h, k, stride, pad), ow = outSize(w, k, stride, pad);
+     int rows = max(1, IM2COL_FLOATS / (c * k * k * ow));
+     int nblocks = (oh + rows - 1) / rows;
+     long ovol = (long)oh * ow;
+
+#pragma omp parallel
+     {
+          float *col = (float *)sdt_aligned_alloc(64, sizeof(float) * c * k * k * rows * ow);
+#pragma omp for schedule(dynamic)
+          for (int b = 0; b < nblocks; b++)
+               convIm2colRows(a, src, c, h, w, k, stride, pad, b * rows, min(oh, (b + 1) * rows),
+                              col, dst + (long)b * rows * ow, ovol, flags);
+          sdt_free(col);
+     }
+}
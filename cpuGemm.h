@@ -0,0 +1,45 @@
+#ifndef _CPU_GEMM_H_
+#define _CPU_GEMM_H_
+
+/* Single precision GEMM for the host convolutions: C[m, n] = A[m, k] x B[k, n] (+ bias),
+   with A (the weights) packed once at load time and B (the activations) used in place.
+   A 1x1 convolution of a [c, h, w] image is the GEMM of its [oc, c] kernel and the
+   image viewed as a [c, h * w] matrix. Any other convolution is the GEMM of its
+   [oc, c * k * k] kernel and the im2col matrix of the image. */
+
+#define GEMM_MR 6               /* rows of A per packed panel, rows of a C tile */
+#define GEMM_NR_MAX 32          /* widest C tile of all microkernels */
+
+enum {
+     GEMM_RELU = 1,             /* clamp C at zero after adding the bias */
+     GEMM_ACCUMULATE = 2        /* add to C instead of overwriting it */
+};
+
+typedef enum GemmKernelKind {
+     GEMM_KERNEL_AUTO, GEMM_KERNEL_SCALAR, GEMM_KERNEL_AVX2, GEMM_KERNEL_AVX512
+} GemmKernelKind;
+
+/* A is split into panels of GEMM_MR rows, each panel stored column by column
+   (k columns of GEMM_MR values), so a microkernel reads it sequentially.
+   The last panel and the bias are zero padded. */
+typedef struct {
+     int m, k;
+     int panels;
+     float *data;               /* [panels, k, GEMM_MR], 64-byte aligned */
+     float *bias;               /* [panels * GEMM_MR], zero if there is no bias */
+} PackedMatrix;
+
+PackedMatrix *packMatrix(const float *a, int m, int k, const float *bias);
+void freePackedMatrix(PackedMatrix *packed);
+void gemmPacked(const PackedMatrix *a, const float *b, long ldb, float *c, long ldc, int n, int flags);
+void gemmIndirect(const PackedMatrix *a, const float *const *brows, float *c, long ldc, int n, int flags);
+void convIm2colRows(const PackedMatrix *a, const float *src, int c, int h, int w, int k, int stride, int pad,
+                    int oy0, int oy1, float *col, float *dst, long ldc, int flags);
+void conv2dIm2col(const PackedMatrix *a, const float *src, float *dst, int c, int h, int w,
+                  int k, int stride, int pad, int flags);
+
+GemmKernelKind gemmKernel(void);
+void setGemmKernel(GemmKernelKind kind);
+const char *gemmKernelName(GemmKernelKind kind);
+
+#endif  /* _CPU_GEMM_H_ */
@@ -0,0 +1,161 @@
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <immintrin.h>
+#include "cpuHalf.h"
+
+static int hasF16c(void)
+{
+     static int f16c = -1;
+
+     if (f16c < 0)
+          f16c = __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+     return f16c;
+}
+
+size_t storageSize(StorageType type)
+{
+     return type == STORAGE_FP32 ? sizeof(float) : sizeof(uint16_t);
+}
+
+const char *storageName(StorageType type)
+{
+     switch (type) {
+     case STORAGE_FP32:
+          return "fp32";
+     case STORAGE_FP16:
+          return "fp16";
+     case STORAGE_BF16:
+          return "bf16";
+     default:
+          assert(0 && "unknown storage type");
+          return NULL;
+     }
+}
+
+float halfToFloat(uint16_t h)
+{
+     uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+     uint32_t e = (h >> 10) & 0x1f, m = h & 0x3ff, x;
+     float f;
+
+     if (e == 0) {               /* zero and subnormals, m units of 2^-24 */
+          f = ldexpf((float)m, -24);
+          return sign ? -f : f;
+     }
+     if (e == 31)                /* infinity, or NaN made quiet like F16C */
+          x = sign | 0x7f800000 | (m << 13) | (m ? 0x400000 : 0);
+     else
+          x = sign | ((e + 112) << 23) | (m << 13);
+     memcpy(&f, &x, sizeof(f));
+     return f;
+}
+
+/* rounds to nearest even, like F16C with _MM_FROUND_TO_NEAREST_INT */
+uint16_t floatToHalf(float f)
+{
+     uint32_t x, sign, abs, h, rem;
+
+     memcpy(&x, &f, sizeof(x));
+     sign = (x >> 16) & 0x8000;
+     abs = x & 0x7fffffff;
+     if (abs > 0x7f800000)       /* NaN, kept quiet */
+          return sign | 0x7e00 | ((abs >> 13) & 0x3ff);
+     if (abs >= 0x477ff000)      /* rounds to 65520 or more */
+          return sign | 0x7c00;
+     if (abs < 0x38800000)       /* below 2^-14, exact multiple of 2^-24 rounded */
+          return sign | (uint16_t)nearbyintf(fabsf(f) * 16777216.0f);
+     h = (abs - 0x38000000) >> 13;
+     rem = abs & 0x1fff;
+     if (rem > 0x1000 || (rem == 0x1000 && (h & 1)))
+          h++;
+     return sign | h;
+}
+
+static inline float bf16ToFloat(uint16_t h)
+{
+     uint32_t x = (uint32_t)h << 16;
+     float f;
+
+     memcpy(&f, &x, sizeof(f));
+     return f;
+}
+
+static inline uint16_t floatToBf16(float f)
+{
+     uint32_t x;
+
+     memcpy(&x, &f, sizeof(x));
+     if ((x & 0x7fffffff) > 0x7f800000)
+          return (x >> 16) | 0x40;
+     return (x + 0x7fff + ((x >> 16) & 1)) >> 16;
+}
+
+__attribute__((target("avx,f16c")))
+static long loadHalfF16c(const uint16_t *src, float *dst, long n)
+{
+     long i;
+
+     for (i = 0; i + 8 <= n; i += 8)
+          _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(src + i))));
+     return i;
+}
+
+__attribute__((target("avx,f16c")))
+static long storeHalfF16c(const float *src, uint16_t *dst, long n)
+{
+     long i;
+
+     for (i = 0; i + 8 <= n; i += 8)
+          _mm_storeu_si128((__m128i *)(dst + i),
+                           _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+     return i;
+}
+
+void loadFloats(const void *src, StorageType type, float *dst, long n)
+{
+     const uint16_t *h = (const uint16_t *)src;
+     long i = 0;
+
+     switch (type) {
+     case STORAGE_FP32:
+          memcpy(dst, src, n * sizeof(float));
+          break;
+     case STORAGE_FP16:
+          if (hasF16c())
+               i = loadHalfF16c(h, dst, n);
+          for (; i < n; i++)
+               dst[i] = halfToFloat(h[i]);
+          break;
+     case STORAGE_BF16:
+          for (; i < n; i++)
+               dst[i] = bf16ToFloat(h[i]);
+          break;
+     default:
+          assert(0 && "unknown storage type");
+     }
+}
+
+void storeFloats(const float *src, void *dst, StorageType type, long n)
+{
+     uint16_t *h = (uint16_t *)dst;
+     long i = 0;
+
+     switch (type) {
+     case STORAGE_FP32:
+          memcpy(dst, src, n * sizeof(float));
+          break;
+     case STORAGE_FP16:
+          if (hasF16c())
+               i = storeHalfF16c(src, h, n);
+          for (; i < n; i++)
+               h[i] = floatToHalf(src[i]);
+          break;
+     case STORAGE_BF16:
+          for (; i < n; i++)
+               h[i] = floatToBf16(src[i]);
+          break;
+     default:
+          assert(0 && "unknown storage type");
+     }
+}
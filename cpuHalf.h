@@ -0,0 +1,28 @@
+#ifndef _CPU_HALF_H_
+#define _CPU_HALF_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Half precision storage of host tensors. FP16 is IEEE binary16, converted with F16C when
+   the cpu has it. BF16 is the upper half of a float, rounded to nearest even. Values are
+   always computed in float, only stored in half. */
+
+typedef enum StorageType {
+     STORAGE_FP32, STORAGE_FP16, STORAGE_BF16
+} StorageType;
+
+size_t storageSize(StorageType type);
+const char *storageName(StorageType type);
+float halfToFloat(uint16_t h);
+uint16_t floatToHalf(float f);
+void loadFloats(const void *src, StorageType type, float *dst, long n);
+void storeFloats(const float *src, void *dst, StorageType type, long n);
+
+/* element i of an array of type */
+static inline void *storageAt(const void *base, StorageType type, long i)
+{
+     return (char *)base + i * (long)storageSize(type);
+}
+
+#endif  /* _CPU_HALF_H_ */
@@ -0,0 +1,406 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <immintrin.h>
+#include "cpuInt8.h"
+#include "sdt_alloc.h"
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+/* per-thread budget of a block of quantized activations, sized so it stays in L2
+   while all panels of A go over it */
+#define INT8_BLOCK_BYTES (128 * 1024)
+
+/* dequantization of a tile: row i of C is scale[i] * act_scale * (A x B) + bias[i] */
+typedef struct {
+     const float *scale, *bias;
+     float act_scale;
+     int relu;
+} TileOutput;
+
+/* computes a full INT8_MR x INT8_NR tile of C at c, from a packed panel a and groups of B,
+   each INT8_NR columns of INT8_KG values, bstride bytes apart */
+typedef void (*Int8MicroKernel)(int groups, const int8_t *a, const uint8_t *b, long bstride,
+                                float *c, long ldc, const TileOutput *out);
+
+typedef struct {
+     Int8KernelKind kind;
+     const char *name;
+     Int8MicroKernel func;
+} Int8KernelInfo;
+
+static Int8KernelKind selectedKernel = INT8_KERNEL_AUTO;
+
+static void microKernelScalar(int groups, const int8_t *a, const uint8_t *b, long bstride,
+                              float *c, long ldc, const TileOutput *out)
+{
+     int32_t acc[INT8_MR][INT8_NR];
+     int g, i, j, q;
+
+     memset(acc, 0, sizeof(acc));
+     for (g = 0; g < groups; g++) {
+          const int8_t *ap = a + g * INT8_MR * INT8_KG;
+          const uint8_t *bp = b + g * bstride;
+          for (i = 0; i < INT8_MR; i++)
+               for (j = 0; j < INT8_NR; j++)
+                    for (q = 0; q < INT8_KG; q++)
+                         acc[i][j] += ap[i * INT8_KG + q] * bp[j * INT8_KG + q];
+     }
+     for (i = 0; i < INT8_MR; i++) {
+          float s = out->scale[i] * out->act_scale;
+          for (j = 0; j < INT8_NR; j++) {
+               float v = acc[i][j] * s + out->bias[i];
+               c[i * ldc + j] = out->relu ? max(v, 0.0f) : v;
+          }
+     }
+}
+
+/* the INT8_KG weights of a row as one int32 to broadcast */
+static inline int32_t weightGroup(const int8_t *ap)
+{
+     int32_t v;
+     memcpy(&v, ap, sizeof(v));
+     return v;
+}
+
+/* vpmaddubsw adds two u8 x s8 products into an int16, which can't saturate as the
+   activations stay below 128, then vpmaddwd adds the two int16 sums into an int32 */
+__attribute__((target("avx2,fma")))
+static void microKernelAvx2(int groups, const int8_t *a, const uint8_t *b, long bstride,
+                            float *c, long ldc, const TileOutput *out)
+{
+     __m256i sum[INT8_MR][2];
+     __m256i ones = _mm256_set1_epi16(1);
+     int g, i;
+
+     for (i = 0; i < INT8_MR; i++)
+          sum[i][0] = sum[i][1] = _mm256_setzero_si256();
+     for (g = 0; g < groups; g++) {
+          const int8_t *ap = a + g * INT8_MR * INT8_KG;
+          const uint8_t *bp = b + g * bstride;
+          __m256i b0 = _mm256_loadu_si256((const __m256i *)bp);
+          __m256i b1 = _mm256_loadu_si256((const __m256i *)(bp + 32));
+          for (i = 0; i < INT8_MR; i++) {
+               __m256i ai = _mm256_set1_epi32(weightGroup(ap + i * INT8_KG));
+               sum[i][0] = _mm256_add_epi32(sum[i][0], _mm256_madd_epi16(_mm256_maddubs_epi16(b0, ai), ones));
+               sum[i][1] = _mm256_add_epi32(sum[i][1], _mm256_madd_epi16(_mm256_maddubs_epi16(b1, ai), ones));
+          }
+     }
+     for (i = 0; i < INT8_MR; i++) {
+          __m256 s = _mm256_set1_ps(out->scale[i] * out->act_scale), bi = _mm256_set1_ps(out->bias[i]);
+          __m256 v0 = _mm256_fmadd_ps(_mm256_cvtepi32_ps(sum[i][0]), s, bi);
+          __m256 v1 = _mm256_fmadd_ps(_mm256_cvtepi32_ps(sum[i][1]), s, bi);
+          if (out->relu) {
+               v0 = _mm256_max_ps(v0, _mm256_setzero_ps());
+               v1 = _mm256_max_ps(v1, _mm256_setzero_ps());
+          }
+          _mm256_storeu_ps(c + i * ldc, v0);
+          _mm256_storeu_ps(c + i * ldc + 8, v1);
+     }
+}
+
+/* vpdpbusd does the four products and the sum of a lane in one instruction */
+__attribute__((target("avx512f,avx512vnni")))
+static void microKernelVnni(int groups, const int8_t *a, const uint8_t *b, long bstride,
+                            float *c, long ldc, const TileOutput *out)
+{
+     __m512i sum[INT8_MR];
+     int g, i;
+
+     for (i = 0; i < INT8_MR; i++)
+          sum[i] = _mm512_setzero_si512();
+     for (g = 0; g < groups; g++) {
+          const int8_t *ap = a + g * INT8_MR * INT8_KG;
+          __m512i bv = _mm512_loadu_si512(b + g * bstride);
+          for (i = 0; i < INT8_MR; i++)
+               sum[i] = _mm512_dpbusd_epi32(sum[i], bv, _mm512_set1_epi32(weightGroup(ap + i * INT8_KG)));
+     }
+     // the masked forms, as in cpuGemm.cpp, keep gcc 12 from warning about uninitialized values
+     for (i = 0; i < INT8_MR; i++) {
+          __m512 v = _mm512_fmadd_ps(_mm512_maskz_cvtepi32_ps(0xffff, sum[i]), _mm512_set1_ps(out->scale[i] * out->act_scale),
+                                     _mm512_set1_ps(out->bias[i]));
+          if (out->relu)
+               v = _mm512_maskz_max_ps(0xffff, v, _mm512_setzero_ps());
+          _mm512_storeu_ps(c + i * ldc, v);
+     }
+}
+
+static const Int8KernelInfo KERNELS[] = {
+     {INT8_KERNEL_SCALAR, "scalar", microKernelScalar},
+     {INT8_KERNEL_AVX2, "avx2", microKernelAvx2},
+     {INT8_KERNEL_VNNI, "vnni", microKernelVnni},
+};
+
+static const Int8KernelInfo *kernelInfo(Int8KernelKind kind)
+{
+     for (size_t i = 0; i < sizeof(KERNELS) / sizeof(KERNELS[0]); i++)
+          if (KERNELS[i].kind == kind)
+               return &KERNELS[i];
+     return &KERNELS[0];
+}
+
+static int isKernelSupported(Int8KernelKind kind)
+{
+     switch (kind) {
+     case INT8_KERNEL_SCALAR:
+          return 1;
+     case INT8_KERNEL_AVX2:
+          return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+     case INT8_KERNEL_VNNI:
+          return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vnni");
+     default:
+          return 0;
+     }
+}
+
+/* the fastest kernel the cpu supports, unless SQDTRT_INT8_KERNEL or setInt8Kernel() says otherwise */
+Int8KernelKind int8Kernel(void)
+{
+     if (selectedKernel != INT8_KERNEL_AUTO)
+          return selectedKernel;
+
+     Int8KernelKind kind = INT8_KERNEL_SCALAR;
+     const char *env = getenv("SQDTRT_INT8_KERNEL");
+     if (isKernelSupported(INT8_KERNEL_AVX2))
+          kind = INT8_KERNEL_AVX2;
+     if (isKernelSupported(INT8_KERNEL_VNNI))
+          kind = INT8_KERNEL_VNNI;
+     if (env) {
+          size_t i;
+          for (i = 0; i < sizeof(KERNELS) / sizeof(KERNELS[0]); i++)
+               if (!strcmp(env, KERNELS[i].name) && isKernelSupported(KERNELS[i].kind))
+                    break;
+          if (i < sizeof(KERNELS) / sizeof(KERNELS[0]))
+               kind = KERNELS[i].kind;
+          else
+               fprintf(stderr, "Warning: unsupported SQDTRT_INT8_KERNEL %s, use %s\n", env, kernelInfo(kind)->name);
+     }
+     selectedKernel = kind;
+     return kind;
+}
+
+void setInt8Kernel(Int8KernelKind kind)
+{
+     if (kind != INT8_KERNEL_AUTO && !isKernelSupported(kind)) {
+          fprintf(stderr, "Warning: int8 kernel %s is not supported by this cpu\n", kernelInfo(kind)->name);
+          return;
+     }
+     selectedKernel = kind;
+}
+
+const char *int8KernelName(Int8KernelKind kind)
+{
+     return kind == INT8_KERNEL_AUTO ? "auto" : kernelInfo(kind)->name;
+}
+
+/* a is [m, k] row-major, bias is [m] or NULL; every row gets its own scale */
+Int8Matrix *quantizeMatrix(const float *a, int m, int k, const float *bias)
+{
+     assert(a && m > 0 && k > 0);
+     Int8Matrix *q = (Int8Matrix *)sdt_alloc(sizeof(Int8Matrix));
+     long size;
+     int row, p;
+
+     q->m = m;
+     q->k = k;
+     q->groups = (k + INT8_KG - 1) / INT8_KG;
+     q->panels = (m + INT8_MR - 1) / INT8_MR;
+     size = (long)q->panels * q->groups * INT8_MR * INT8_KG;
+     q->data = (int8_t *)sdt_aligned_alloc(64, size);
+     q->scale = (float *)sdt_aligned_alloc(64, sizeof(float) * q->panels * INT8_MR);
+     q->bias = (float *)sdt_aligned_alloc(64, sizeof(float) * q->panels * INT8_MR);
+     memset(q->data, 0, size);
+     for (row = 0; row < q->panels * INT8_MR; row++) {
+          q->scale[row] = 0;
+          q->bias[row] = bias && row < m ? bias[row] : 0;
+     }
+     for (row = 0; row < m; row++) {
+          const float *arow = a + (long)row * k;
+          int8_t *panel = q->data + (long)(row / INT8_MR) * q->groups * INT8_MR * INT8_KG;
+          float amax = 0;
+          for (p = 0; p < k; p++)
+               amax = max(amax, fabsf(arow[p]));
+          q->scale[row] = amax > 0 ? amax / 127 : 1;
+          for (p = 0; p < k; p++) {
+               long v = lrintf(arow[p] / q->scale[row]);
+               panel[((long)(p / INT8_KG) * INT8_MR + row % INT8_MR) * INT8_KG + p % INT8_KG] =
+                    (int8_t)min(max(v, -127L), 127L);
+          }
+     }
+     return q;
+}
+
+void freeInt8Matrix(Int8Matrix *q)
+{
+     assert(q);
+     sdt_free(q->data);
+     sdt_free(q->scale);
+     sdt_free(q->bias);
+     sdt_free(q);
+}
+
+/* src [len] to [0, INT8_ACT_MAX], rounded to nearest, 16 values at a time with SSE2:
+   the int32 to int16 and int16 to u8 packs saturate, which clamps at zero */
+static void quantizeActivations(const float *src, uint8_t *dst, long len, float inv_scale)
+{
+     long nvec = len / 16 * 16;
+
+#pragma omp parallel for schedule(static)
+     for (long i = 0; i < nvec; i += 16) {
+          __m128 s = _mm_set1_ps(inv_scale);
+          __m128i q0 = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i), s));
+          __m128i q1 = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i + 4), s));
+          __m128i q2 = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i + 8), s));
+          __m128i q3 = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i + 12), s));
+          __m128i q = _mm_packus_epi16(_mm_packs_epi32(q0, q1), _mm_packs_epi32(q2, q3));
+          _mm_storeu_si128((__m128i *)(dst + i), _mm_min_epu8(q, _mm_set1_epi8(INT8_ACT_MAX)));
+     }
+     for (long i = nvec; i < len; i++) {
+          long v = lrintf(src[i] * inv_scale);
+          dst[i] = (uint8_t)min(max(v, 0L), (long)INT8_ACT_MAX);
+     }
+}
+
+/* Columns [j0, j0 + cols) of the im2col matrix of the quantized src into col, [c * k * k, cols],
+   with rows[p] pointing at row p. Each output row of a kernel tap is one copy with stride 1. */
+static void im2colBytes(const uint8_t *src, int c, int h, int w, int k, int stride, int pad, int ow,
+                        long j0, int cols, uint8_t *col, const uint8_t **rows)
+{
+     int p, kk = c * k * k;
+
+     for (p = 0; p < kk; p++) {
+          int i = p / (k * k), ky = p / k % k, kx = p % k;
+          const uint8_t *in = src + (long)i * h * w;
+          uint8_t *crow = col + (long)p * cols;
+          long j = j0;
+          rows[p] = crow;
+          while (j < j0 + cols) {
+               int oy = (int)(j / ow), ox0 = (int)(j % ow);
+               int ox1 = (int)min((long)ow, ox0 + (j0 + cols - j));
+               int iy = oy * stride - pad + ky, ox;
+               uint8_t *out = crow + (j - j0);
+               if (iy < 0 || iy >= h) {
+                    memset(out, 0, ox1 - ox0);
+               } else if (stride == 1) {
+                    // input columns ox - pad + kx, zero outside [0, w)
+                    int a = min(max(pad - kx, ox0), ox1), b = max(min(w + pad - kx, ox1), a);
+                    memset(out, 0, a - ox0);
+                    memcpy(out + (a - ox0), in + (long)iy * w + a - pad + kx, b - a);
+                    memset(out + (b - ox0), 0, ox1 - b);
+               } else {
+                    for (ox = ox0; ox < ox1; ox++) {
+                         int ix = ox * stride - pad + kx;
+                         out[ox - ox0] = ix >= 0 && ix < w ? in[(long)iy * w + ix] : 0;
+                    }
+               }
+               j += ox1 - ox0;
+          }
+     }
+}
+
+/* rows [kk, cols] of bytes into b as [groups, nb, INT8_KG], the padding of k and of the
+   columns is zero. Full groups interleave 16 columns at a time with SSE2. */
+static void interleaveRows(const uint8_t *const *rows, int kk, int cols, int nb, int groups, uint8_t *b)
+{
+     int g, q, jj;
+
+     for (g = 0; g < groups; g++) {
+          const uint8_t *r[INT8_KG];
+          uint8_t *bg = b + (long)g * nb * INT8_KG;
+          for (q = 0; q < INT8_KG; q++)
+               r[q] = g * INT8_KG + q < kk ? rows[g * INT8_KG + q] : NULL;
+          jj = 0;
+          if (r[INT8_KG - 1]) {
+               for (; jj + 16 <= cols; jj += 16) {
+                    __m128i r0 = _mm_loadu_si128((const __m128i *)(r[0] + jj));
+                    __m128i r1 = _mm_loadu_si128((const __m128i *)(r[1] + jj));
+                    __m128i r2 = _mm_loadu_si128((const __m128i *)(r[2] + jj));
+                    __m128i r3 = _mm_loadu_si128((const __m128i *)(r[3] + jj));
+                    __m128i lo01 = _mm_unpacklo_epi8(r0, r1), hi01 = _mm_unpackhi_epi8(r0, r1);
+                    __m128i lo23 = _mm_unpacklo_epi8(r2, r3), hi23 = _mm_unpackhi_epi8(r2, r3);
+                    __m128i *out = (__m128i *)(bg + jj * INT8_KG);
+                    _mm_storeu_si128(out, _mm_unpacklo_epi16(lo01, lo23));
+                    _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(lo01, lo23));
+                    _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(hi01, hi23));
+                    _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(hi01, hi23));
+               }
+          }
+          for (; jj < cols; jj++)
+               for (q = 0; q < INT8_KG; q++)
+                    bg[jj * INT8_KG + q] = r[q] ? r[q][jj] : 0;
+          memset(bg + cols * INT8_KG, 0, ((cols + INT8_NR - 1) / INT8_NR * INT8_NR - cols) * INT8_KG);
+     }
+}
+
+/* partial tile at the bottom or right edge of C: compute a full tile into a local buffer,
+   then copy back the valid part */
+static void edgeTile(const Int8KernelInfo *kern, int groups, const int8_t *a, const uint8_t *b, long bstride,
+                     float *c, long ldc, int rows, int cols, const TileOutput *out)
+{
+     float tile[INT8_MR * INT8_NR] __attribute__((aligned(64)));
+     int i, j;
+
+     kern->func(groups, a, b, bstride, tile, INT8_NR, out);
+     for (i = 0; i < rows; i++)
+          for (j = 0; j < cols; j++)
+               c[i * ldc + j] = tile[i * INT8_NR + j];
+}
+
+/* src is [c, h, w] with values in [0, act_scale * INT8_ACT_MAX], dst is [oc, oh, ow].
+   src is quantized once, then threads split the output columns in blocks, each packed
+   and multiplied by all panels of a while it's in cache. */
+void conv2dInt8(const Int8Matrix *a, float act_scale, const float *src, float *dst, int c, int h, int w,
+                int k, int stride, int pad, int relu)
+{
+     assert(a && a->k == c * k * k && act_scale > 0 && src && dst && src != dst);
+     const Int8KernelInfo *kern = kernelInfo(int8Kernel());
+     int oh = (h + 2 * pad - k) / stride + 1, ow = (w + 2 * pad - k) / stride + 1;
+     int pointwise = k == 1 && stride == 1 && pad == 0;
+     long n = (long)oh * ow, vol = (long)h * w;
+     int nb = max(INT8_NR, INT8_BLOCK_BYTES / (a->groups * INT8_KG) / INT8_NR * INT8_NR);
+     nb = (int)min((long)nb, (n + INT8_NR - 1) / INT8_NR * INT8_NR);
+     long nblocks = (n + nb - 1) / nb;
+     uint8_t *qsrc = (uint8_t *)sdt_aligned_alloc(64, c * vol);
+
+     quantizeActivations(src, qsrc, c * vol, 1 / act_scale);
+#pragma omp parallel
+     {
+          uint8_t *b = (uint8_t *)sdt_aligned_alloc(64, (long)a->groups * nb * INT8_KG);
+          uint8_t *col = pointwise ? NULL : (uint8_t *)sdt_alloc((long)a->k * nb);
+          const uint8_t **rows = (const uint8_t **)sdt_alloc(sizeof(uint8_t *) * a->k);
+#pragma omp for schedule(dynamic)
+          for (long blk = 0; blk < nblocks; blk++) {
+               long j0 = blk * nb;
+               int cols = (int)min((long)nb, n - j0);
+               if (pointwise) {
+                    for (int i = 0; i < c; i++)
+                         rows[i] = qsrc + i * vol + j0;
+               } else {
+                    im2colBytes(qsrc, c, h, w, k, stride, pad, ow, j0, cols, col, rows);
+               }
+               interleaveRows(rows, a->k, cols, nb, a->groups, b);
+               for (int pi = 0; pi < a->panels; pi++) {
+                    const int8_t *ap = a->data + (long)pi * a->groups * INT8_MR * INT8_KG;
+                    TileOutput out = {a->scale + pi * INT8_MR, a->bias + pi * INT8_MR, act_scale, relu};
+                    float *cp = dst + (long)pi * INT8_MR * n + j0;
+                    int nrows = min(INT8_MR, a->m - pi * INT8_MR);
+                    for (int jj = 0; jj < cols; jj += INT8_NR) {
+                         const uint8_t *bp = b + jj * INT8_KG;
+                         if (nrows < INT8_MR || jj + INT8_NR > cols)
+                              edgeTile(kern, a->groups, ap, bp, (long)nb * INT8_KG, cp + jj, n,
+                                       nrows, min(INT8_NR, cols - jj), &out);
+                         else
+                              kern->func(a->groups, ap, bp, (long)nb * INT8_KG, cp + jj, n, &out);
+                    }
+               }
+          }
+          sdt_free(rows);
+          if (col)
+               sdt_free(col);
+          sdt_free(b);
+     }
+     sdt_free(qsrc);
+}
@@ -0,0 +1,42 @@
+#ifndef _CPU_INT8_H_
+#define _CPU_INT8_H_
+
+#include <stdint.h>
+
+/* INT8 convolutions for the host backend. Weights are quantized symmetrically per output
+   channel, activations per tensor to [0, INT8_ACT_MAX], which covers every convolution
+   input after a ReLU. 7 bits rather than 8 keep the pairwise int16 sums of the AVX2 kernel
+   from saturating. The products are summed in int32 and scaled back to float with the bias
+   and ReLU, so only the convolutions themselves change precision. */
+
+#define INT8_MR 6               /* rows of A per packed panel, rows of a C tile */
+#define INT8_NR 16              /* columns of a C tile, of all kernels */
+#define INT8_KG 4               /* k values summed by one int32 lane */
+#define INT8_ACT_MAX 127        /* largest quantized activation */
+
+typedef enum Int8KernelKind {
+     INT8_KERNEL_AUTO, INT8_KERNEL_SCALAR, INT8_KERNEL_AVX2, INT8_KERNEL_VNNI
+} Int8KernelKind;
+
+/* A is split into panels of INT8_MR rows, each panel stored as groups of INT8_KG
+   consecutive k values per row, so a kernel broadcasts one int32 of a row at a time.
+   k, the last panel, the scales and the bias are zero padded. */
+typedef struct {
+     int m, k;
+     int groups;                /* k / INT8_KG, rounded up */
+     int panels;
+     int8_t *data;              /* [panels, groups, INT8_MR, INT8_KG], 64-byte aligned */
+     float *scale;              /* [panels * INT8_MR], max |row| / 127 */
+     float *bias;               /* [panels * INT8_MR] */
+} Int8Matrix;
+
+Int8Matrix *quantizeMatrix(const float *a, int m, int k, const float *bias);
+void freeInt8Matrix(Int8Matrix *q);
+void conv2dInt8(const Int8Matrix *a, float act_scale, const float *src, float *dst, int c, int h, int w,
+                int k, int stride, int pad, int relu);
+
+Int8KernelKind int8Kernel(void);
+void setInt8Kernel(Int8KernelKind kind);
+const char *int8KernelName(Int8KernelKind kind);
+
+#endif  /* _CPU_INT8_H_ */
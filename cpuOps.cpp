@@ -0,0 +1,102 @@
+#include <assert.h>
+#include <float.h>
+#include "cpuOps.h"
+
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+int convOutSize(int in, int k, int stride, int pad)
+{
+     assert(stride > 0 && in + 2 * pad >= k);
+     return (in + 2 * pad - k) / stride + 1;
+}
+
+/* first and one-past-last output column whose input column ox * stride - pad + kx is inside [0, w) */
+static void validRange(int w, int ow, int kx, int stride, int pad, int *lo, int *hi)
+{
+     int first = pad - kx;      /* smallest ox * stride that is in range */
+     *lo = first > 0 ? (first + stride - 1) / stride : 0;
+     *hi = min(ow, (w - 1 + pad - kx) / stride + 1);
+     if (w - 1 + pad - kx < 0)
+          *hi = 0;
+}
+
+/* kernel is [oc, c, k, k], bias is [oc], dst is [oc, oh, ow];
+   every output channel is independent, so threads split the output channels */
+void conv2dDirect(const float *src, float *dst, const float *kernel, const float *bias,
+                  int c, int h, int w, int oc, int k, int stride, int pad, int relu)
+{
+     assert(src && dst && kernel && src != dst);
+     int oh = convOutSize(h, k, stride, pad);
+     int ow = convOutSize(w, k, stride, pad);
+     long ovol = (long)oh * ow, ivol = (long)h * w;
+
+#pragma omp parallel for schedule(static)
+     for (int o = 0; o < oc; o++) {
+          float *out = dst + o * ovol;
+          float b = bias ? bias[o] : 0;
+          for (long j = 0; j < ovol; j++)
+               out[j] = b;
+          for (int i = 0; i < c; i++) {
+               const float *in = src + i * ivol;
+               const float *kern = kernel + ((long)o * c + i) * k * k;
+               for (int ky = 0; ky < k; ky++) {
+                    for (int kx = 0; kx < k; kx++) {
+                         float wv = kern[ky * k + kx];
+                         int lo, hi;
+                         validRange(w, ow, kx, stride, pad, &lo, &hi);
+                         for (int oy = 0; oy < oh; oy++) {
+                              int iy = oy * stride - pad + ky;
+                              if (iy < 0 || iy >= h)
+                                   continue;
+                              const float *irow = in + (long)iy * w - pad + kx;
+                              float *orow = out + (long)oy * ow;
+                              if (stride == 1) {
+                                   for (int ox = lo; ox < hi; ox++)
+                                        orow[ox] += wv * irow[ox];
+                              } else {
+                                   for (int ox = lo; ox < hi; ox++)
+                                        orow[ox] += wv * irow[ox * stride];
+                              }
+                         }
+                    }
+               }
+          }
+          if (relu)
+               for (long j = 0; j < ovol; j++)
+                    out[j] = max(out[j], 0.0f);
+     }
+}
+
+/* padded positions are ignored rather than treated as zeros, as TensorRT does */
+void maxPool2d(const float *src, float *dst, int c, int h, int w, int k, int stride, int pad)
+{
+     assert(src && dst && src != dst);
+     int oh = convOutSize(h, k, stride, pad);
+     int ow = convOutSize(w, k, stride, pad);
+
+#pragma omp parallel for collapse(2) schedule(static)
+     for (int i = 0; i < c; i++) {
+          for (int oy = 0; oy < oh; oy++) {
+               const float *in = src + (long)i * h * w;
+               float *orow = dst + ((long)i * oh + oy) * ow;
+               int y0 = max(oy * stride - pad, 0), y1 = min(oy * stride - pad + k, h);
+               for (int ox = 0; ox < ow; ox++) {
+                    int x0 = max(ox * stride - pad, 0), x1 = min(ox * stride - pad + k, w);
+                    float m = -FLT_MAX;
+                    for (int y = y0; y < y1; y++)
+                         for (int x = x0; x < x1; x++)
+                              m = max(m, in[(long)y * w + x]);
+                    orow[ox] = m;
+               }
+          }
+     }
+}
+
+void reluInplace(float *data, long len)
+{
+     assert(data);
+#pragma omp parallel for schedule(static)
+     for (long i = 0; i < len; i++)
+          data[i] = max(data[i], 0.0f);
+}
@@ -0,0 +1,13 @@
+#ifndef _CPU_OPS_H_
+#define _CPU_OPS_H_
+
+/* Reference host operators for one image in [C, H, W] order.
+   Output sizes follow TensorRT: out = (in + 2 * pad - k) / stride + 1 */
+
+int convOutSize(int in, int k, int stride, int pad);
+void conv2dDirect(const float *src, float *dst, const float *kernel, const float *bias,
+                  int c, int h, int w, int oc, int k, int stride, int pad, int relu);
+void maxPool2d(const float *src, float *dst, int c, int h, int w, int k, int stride, int pad);
+void reluInplace(float *data, long len);
+
+#endif  /* _CPU_OPS_H_ */
@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "cpuWinograd.h"
+#include "sdt_alloc.h"
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+/* per-thread budget of the transformed input and output of a block of tiles, in floats */
+#define WINO_BLOCK_FLOATS (1024 * 1024 / 4)
+
+/* kernel transform matrix of F(4x4, 3x3), see Lavin & Gray, "Fast Algorithms for Convolutional Neural Networks" */
+static const float G[WINO_IN][3] = {
+     {1.0f / 4, 0, 0},
+     {-1.0f / 6, -1.0f / 6, -1.0f / 6},
+     {-1.0f / 6, 1.0f / 6, -1.0f / 6},
+     {1.0f / 24, 1.0f / 12, 1.0f / 6},
+     {1.0f / 24, -1.0f / 12, 1.0f / 6},
+     {0, 0, 1}
+};
+
+/* u = G g G^T */
+static void transformKernel(const float *g, float *u)
+{
+     float t[WINO_IN][3];
+     int i, j, k;
+
+     for (i = 0; i < WINO_IN; i++)
+          for (j = 0; j < 3; j++)
+               for (t[i][j] = 0, k = 0; k < 3; k++)
+                    t[i][j] += G[i][k] * g[k * 3 + j];
+     for (i = 0; i < WINO_IN; i++)
+          for (j = 0; j < WINO_IN; j++)
+               for (u[i * WINO_IN + j] = 0, k = 0; k < 3; k++)
+                    u[i * WINO_IN + j] += t[i][k] * G[j][k];
+}
+
+/* r = B^T d for 6 values with strides ds and rs */
+static inline void transformInput6(const float *d, int ds, float *r, int rs)
+{
+     float d0 = d[0], d1 = d[ds], d2 = d[2 * ds], d3 = d[3 * ds], d4 = d[4 * ds], d5 = d[5 * ds];
+     r[0] = 4 * d0 - 5 * d2 + d4;
+     r[rs] = -4 * (d1 + d2) + d3 + d4;
+     r[2 * rs] = 4 * (d1 - d2) - d3 + d4;
+     r[3 * rs] = 2 * (d3 - d1) - d2 + d4;
+     r[4 * rs] = 2 * (d1 - d3) - d2 + d4;
+     r[5 * rs] = 4 * d1 - 5 * d3 + d5;
+}
+
+/* r = A^T m for 6 values into 4 */
+static inline void transformOutput6(const float *m, int ms, float *r, int rs)
+{
+     float m0 = m[0], m1 = m[ms], m2 = m[2 * ms], m3 = m[3 * ms], m4 = m[4 * ms], m5 = m[5 * ms];
+     r[0] = m0 + m1 + m2 + m3 + m4;
+     r[rs] = m1 - m2 + 2 * (m3 - m4);
+     r[2 * rs] = m1 + m2 + 4 * (m3 + m4);
+     r[3 * rs] = m1 - m2 + 8 * (m3 - m4) + m5;
+}
+
+/* kernel is [oc, ic, 3, 3], bias is [oc] or NULL */
+WinogradKernel *createWinogradKernel(const float *kernel, const float *bias, int ic, int oc)
+{
+     assert(kernel && ic > 0 && oc > 0);
+     WinogradKernel *wk = (WinogradKernel *)sdt_alloc(sizeof(WinogradKernel));
+     float *u = (float *)sdt_alloc(sizeof(float) * WINO_ELEMS * oc * ic);
+     float tile[WINO_ELEMS];
+     long n = (long)oc * ic, i;
+     int e;
+
+     wk->ic = ic;
+     wk->oc = oc;
+     wk->bias = (float *)sdt_alloc(sizeof(float) * oc);
+     for (i = 0; i < oc; i++)
+          wk->bias[i] = bias ? bias[i] : 0;
+     for (i = 0; i < n; i++) {
+          transformKernel(kernel + i * 9, tile);
+          for (e = 0; e < WINO_ELEMS; e++)
+               u[e * n + i] = tile[e];
+     }
+     for (e = 0; e < WINO_ELEMS; e++)
+          wk->u[e] = packMatrix(u + e * n, oc, ic, NULL);
+     sdt_free(u);
+     return wk;
+}
+
+void destroyWinogradKernel(WinogradKernel *wk)
+{
+     assert(wk);
+     int e;
+     for (e = 0; e < WINO_ELEMS; e++)
+          freePackedMatrix(wk->u[e]);
+     sdt_free(wk->bias);
+     sdt_free(wk);
+}
+
+WinogradWork *createWinogradWork(const WinogradKernel *wk, int nb)
+{
+     assert(wk && nb > 0);
+     WinogradWork *work = (WinogradWork *)sdt_alloc(sizeof(WinogradWork));
+     work->nb = nb;
+     work->v = (float *)sdt_aligned_alloc(64, sizeof(float) * WINO_ELEMS * wk->ic * nb);
+     work->m = (float *)sdt_aligned_alloc(64, sizeof(float) * WINO_ELEMS * wk->oc * nb);
+     work->rows = (const float **)sdt_alloc(sizeof(float *) * WINO_ELEMS * wk->ic);
+     return work;
+}
+
+void destroyWinogradWork(WinogradWork *work)
+{
+     assert(work);
+     sdt_free(work->v);
+     sdt_free(work->m);
+     sdt_free(work->rows);
+     sdt_free(work);
+}
+
+int winogradTileCount(int oh, int ow)
+{
+     return ((oh + WINO_OUT - 1) / WINO_OUT) * ((ow + WINO_OUT - 1) / WINO_OUT);
+}
+
+/* v[e * vs] = B^T d B of the 6x6 tile of in whose top left corner is (y0, x0), zero outside the image */
+static void inputTile(const float *in, int h, int w, int y0, int x0, float *v, long vs)
+{
+     float d[WINO_IN][WINO_IN], t[WINO_IN][WINO_IN], r[WINO_IN];
+     int i, j;
+
+     if (y0 >= 0 && y0 + WINO_IN <= h && x0 >= 0 && x0 + WINO_IN <= w) {
+          for (i = 0; i < WINO_IN; i++)
+               for (j = 0; j < WINO_IN; j++)
+                    d[i][j] = in[(long)(y0 + i) * w + x0 + j];
+     } else {
+          for (i = 0; i < WINO_IN; i++) {
+               int y = y0 + i;
+               for (j = 0; j < WINO_IN; j++) {
+                    int x = x0 + j;
+                    d[i][j] = y >= 0 && y < h && x >= 0 && x < w ? in[(long)y * w + x] : 0;
+               }
+          }
+     }
+     for (j = 0; j < WINO_IN; j++)
+          transformInput6(&d[0][j], WINO_IN, &t[0][j], WINO_IN);
+     for (i = 0; i < WINO_IN; i++) {
+          transformInput6(t[i], 1, r, 1);
+          for (j = 0; j < WINO_IN; j++)
+               v[(i * WINO_IN + j) * vs] = r[j];
+     }
+}
+
+/* A^T m A of the products m[e * ms] plus bias, written to the 4x4 tile of out at (y0, x0) */
+static void outputTile(const float *m, long ms, float bias, int relu, float *out, int h, int w, int y0, int x0)
+{
+     float d[WINO_IN][WINO_IN], t[WINO_OUT][WINO_IN], y[WINO_OUT][WINO_OUT];
+     int i, j;
+
+     for (i = 0; i < WINO_IN; i++)
+          for (j = 0; j < WINO_IN; j++)
+               d[i][j] = m[(i * WINO_IN + j) * ms];
+     for (j = 0; j < WINO_IN; j++)
+          transformOutput6(&d[0][j], WINO_IN, &t[0][j], WINO_IN);
+     for (i = 0; i < WINO_OUT; i++)
+          transformOutput6(t[i], 1, y[i], 1);
+     for (i = 0; i < WINO_OUT && y0 + i < h; i++) {
+          float *orow = out + (long)(y0 + i) * w + x0;
+          for (j = 0; j < WINO_OUT && x0 + j < w; j++) {
+               float val = y[i][j] + bias;
+               orow[j] = relu ? max(val, 0.0f) : val;
+          }
+     }
+}
+
+/* tiles [t0, t0 + n) of the view, in row-major tile order; n <= work->nb */
+void winogradTiles(const WinogradKernel *wk, const WinogradView *view, int t0, int n, WinogradWork *work, int relu)
+{
+     assert(wk && view && work && n > 0 && n <= work->nb);
+     int ic = wk->ic, oc = wk->oc, nb = work->nb;
+     int tw = (view->ow + WINO_OUT - 1) / WINO_OUT;
+     int c, o, e, t;
+
+     for (c = 0; c < ic; c++)
+          for (t = 0; t < n; t++) {
+               int ty = (t0 + t) / tw, tx = (t0 + t) % tw;
+               inputTile(view->src + c * view->src_cstride, view->ih, view->iw,
+                         ty * WINO_OUT + view->y_off, tx * WINO_OUT + view->x_off,
+                         work->v + (long)c * nb + t, (long)ic * nb);
+          }
+     for (e = 0; e < WINO_ELEMS; e++) {
+          for (c = 0; c < ic; c++)
+               work->rows[e * ic + c] = work->v + ((long)e * ic + c) * nb;
+          gemmIndirect(wk->u[e], work->rows + e * ic, work->m + (long)e * oc * nb, nb, n, 0);
+     }
+     for (o = 0; o < oc; o++)
+          for (t = 0; t < n; t++) {
+               int ty = (t0 + t) / tw, tx = (t0 + t) % tw;
+               outputTile(work->m + (long)o * nb + t, (long)oc * nb, wk->bias[o], relu,
+                          view->dst + o * view->dst_cstride, view->oh, view->ow,
+                          ty * WINO_OUT, tx * WINO_OUT);
+          }
+}
+
+/* tiles per block, a multiple of the widest gemm tile that keeps a block's
+   transforms within WINO_BLOCK_FLOATS and still gives every thread a block */
+int winogradBlockTiles(const WinogradKernel *wk, int tiles, int nthreads)
+{
+     int per_tile = WINO_ELEMS * (wk->ic + wk->oc);
+     int nb = WINO_BLOCK_FLOATS / per_tile / GEMM_NR_MAX * GEMM_NR_MAX;
+     int spread = ((tiles + nthreads - 1) / nthreads + GEMM_NR_MAX - 1) / GEMM_NR_MAX * GEMM_NR_MAX;
+     return max(GEMM_NR_MAX, min(nb, spread));
+}
+
+/* src is [ic, h, w], dst is [oc, h, w]; threads split the tiles in blocks,
+   each block is transformed, multiplied and transformed back by one thread */
+void conv2dWinograd(const WinogradKernel *wk, const float *src, float *dst, int h, int w, int relu)
+{
+     assert(wk && src && dst && src != dst);
+     WinogradView view = {src, (long)h * w, h, w, -1, -1, dst, (long)h * w, h, w};
+     int tiles = winogradTileCount(h, w);
+     int nthreads = 1;
+#ifdef _OPENMP
+     nthreads = omp_get_max_threads();
+#endif
+     int nb = winogradBlockTiles(wk, tiles, nthreads);
+     int nblocks = (tiles + nb - 1) / nb;
+
+#pragma omp parallel
+     {
+          WinogradWork *work = createWinogradWork(wk, nb);
+#pragma omp for schedule(dynamic)
+          for (int b = 0; b < nblocks; b++)
+               winogradTiles(wk, &view, b * nb, min(nb, tiles - b * nb), work, relu);
+          destroyWinogradWork(work);
+     }
+}
@@ -0,0 +1,51 @@
+#ifndef _CPU_WINOGRAD_H_
+#define _CPU_WINOGRAD_H_
+
+#include "cpuGemm.h"
+
+/* Winograd F(4x4, 3x3) convolution for 3x3 kernels with stride 1 and pad 1.
+   Every 4x4 output tile is computed from a 6x6 input tile with 36 multiplies
+   per input-output channel pair instead of 144. The kernels are transformed
+   once at load time into 36 [oc, ic] matrices, one per element of the 6x6
+   tile, so the products of a block of tiles are 36 GEMMs. */
+
+#define WINO_OUT 4                      /* output tile size */
+#define WINO_IN (WINO_OUT + 2)          /* input tile size */
+#define WINO_ELEMS (WINO_IN * WINO_IN)
+
+typedef struct {
+     int ic, oc;
+     PackedMatrix *u[WINO_ELEMS];       /* G g G^T of every kernel g, by element of the 6x6 tile */
+     float *bias;                       /* [oc] */
+} WinogradKernel;
+
+/* Where the tiles of a convolution read and write. Output pixel (y, x) of channel o is
+   dst[o * dst_cstride + y * ow + x], its 3x3 window starts at input (y + y_off, x + x_off)
+   of src[c * src_cstride + y * iw + x], and the input is zero outside ih x iw. */
+typedef struct {
+     const float *src;
+     long src_cstride;
+     int ih, iw, y_off, x_off;
+     float *dst;
+     long dst_cstride;
+     int oh, ow;
+} WinogradView;
+
+/* per-thread buffers of a block of nb tiles */
+typedef struct {
+     int nb;
+     float *v;                          /* transformed input, [WINO_ELEMS, ic, nb] */
+     float *m;                          /* products, [WINO_ELEMS, oc, nb] */
+     const float **rows;                /* rows of v, [WINO_ELEMS * ic] */
+} WinogradWork;
+
+WinogradKernel *createWinogradKernel(const float *kernel, const float *bias, int ic, int oc);
+void destroyWinogradKernel(WinogradKernel *wk);
+WinogradWork *createWinogradWork(const WinogradKernel *wk, int nb);
+void destroyWinogradWork(WinogradWork *work);
+int winogradTileCount(int oh, int ow);
+int winogradBlockTiles(const WinogradKernel *wk, int tiles, int nthreads);
+void winogradTiles(const WinogradKernel *wk, const WinogradView *view, int t0, int n, WinogradWork *work, int relu);
+void conv2dWinograd(const WinogradKernel *wk, const float *src, float *dst, int h, int w, int relu);
+
+#endif  /* _CPU_WINOGRAD_H_ */
@@ -0,0 +1,264 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <immintrin.h>
+#include "detection.h"
+#include "nms.h"
+#include "trace.h"
+#include "sdt_alloc.h"
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+/* The interleaved 8-bit BGR pixels of an image to data[3][height][width], less the
+   mean of every channel, the layout of the network input. */
+float *packInput(float *data, const unsigned char *bgr, int height, int width, const float *mean)
+{
+     assert(data && bgr && mean);
+     TRACE_SCOPE("layout");
+     long vol = (long)height * width;
+
+     for (int c = 0; c < 3; c++)
+          for (long j = 0; j < vol; j++)
+               data[c * vol + j] = float(bgr[j * 3 + c]) - mean[c];
+     return data;
+}
+
+/* the two source pixels of an output column or row and the weight of the second */
+typedef struct {
+     int *first, *second;       /* byte offsets of the columns, indices of the rows */
+     float *weight;
+} ResizeTaps;
+
+/* Bilinear taps of dst outputs over src inputs, with the pixel centers and edge
+   clamping of cv::resize(INTER_LINEAR). stride scales the indices. */
+static void resizeTaps(ResizeTaps *taps, int src, int dst, int stride)
+{
+     double scale = (double)src / dst;
+
+     for (int d = 0; d < dst; d++) {
+          double f = (d + 0.5) * scale - 0.5;
+          int s = (int)floor(f);
+          f -= s;
+          if (s < 0) {
+               s = 0;
+               f = 0;
+          }
+          if (s >= src - 1) {
+               s = src - 1;
+               f = 0;
+          }
+          taps->first[d] = s * stride;
+          taps->second[d] = min(s + 1, src - 1) * stride;
+          taps->weight[d] = (float)f;
+     }
+}
+
+/* the source row at bgr, resampled to the width columns of dst[3][width] */
+static void resampleRowScalar(const unsigned char *bgr, const ResizeTaps *cols, int begin, int width, float *dst)
+{
+     for (int x = begin; x < width; x++) {
+          const unsigned char *a = bgr + cols->first[x], *b = bgr + cols->second[x];
+          float w = cols->weight[x];
+          for (int c = 0; c < 3; c++)
+               dst[c * width + x] = a[c] + w * (b[c] - a[c]);
+     }
+}
+
+/* 8 columns at a time, from the 4 bytes at each tap, B, G, R and one past. Returns the
+   first column left to resampleRowScalar(), those whose taps end less than 4 bytes
+   before the end of the row, end. */
+__attribute__((target("avx2,fma")))
+static int resampleRowAvx2(const unsigned char *bgr, const ResizeTaps *cols, int width, int end, float *dst)
+{
+     const __m256i mask = _mm256_set1_epi32(0xff);
+     int x;
+
+     for (x = 0; x + 8 <= width && cols->second[x + 7] + 4 <= end; x += 8) {
+          __m256i a = _mm256_i32gather_epi32((const int *)bgr, _mm256_loadu_si256((const __m256i *)(cols->first + x)), 1);
+          __m256i b = _mm256_i32gather_epi32((const int *)bgr, _mm256_loadu_si256((const __m256i *)(cols->second + x)), 1);
+          __m256 w = _mm256_loadu_ps(cols->weight + x);
+          for (int c = 0; c < 3; c++) {
+               __m256 va = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(a, 8 * c), mask));
+               __m256 vb = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(b, 8 * c), mask));
+               _mm256_storeu_ps(dst + c * width + x, _mm256_fmadd_ps(w, _mm256_sub_ps(vb, va), va));
+          }
+     }
+     return x;
+}
+
+/* dst[3][width] = row0 + weight * (row1 - row0) - mean, the rows resampled ones */
+static void blendRowsScalar(const float *row0, const float *row1, float weight, const float *mean, float *dst,
+                            int width, long plane)
+{
+     for (int c = 0; c < 3; c++) {
+          const float *r0 = row0 + c * width, *r1 = row1 + c * width;
+          float *d = dst + c * plane;
+          for (int x = 0; x < width; x++)
+               d[x] = r0[x] + weight * (r1[x] - r0[x]) - mean[c];
+     }
+}
+
+__attribute__((target("avx2,fma")))
+static void blendRowsAvx2(const float *row0, const float *row1, float weight, const float *mean, float *dst,
+                          int width, long plane)
+{
+     __m256 w = _mm256_set1_ps(weight);
+
+     for (int c = 0; c < 3; c++) {
+          const float *r0 = row0 + c * width, *r1 = row1 + c * width;
+          float *d = dst + c * plane;
+          __m256 m = _mm256_set1_ps(mean[c]);
+          int x;
+          for (x = 0; x + 8 <= width; x += 8) {
+               __m256 v0 = _mm256_loadu_ps(r0 + x);
+               __m256 v = _mm256_fmadd_ps(w, _mm256_sub_ps(_mm256_loadu_ps(r1 + x), v0), v0);
+               _mm256_storeu_ps(d + x, _mm256_sub_ps(v, m));
+          }
+          for (; x < width; x++)
+               d[x] = r0[x] + weight * (r1[x] - r0[x]) - mean[c];
+     }
+}
+
+/* the two resampled source rows last used by a thread */
+typedef struct {
+     int row[2];
+     float *buf[2];             /* [3][width] */
+} RowCache;
+
+/* the resampled source row sy, not evicting the one of row keep */
+static float *resampledRow(RowCache *cache, const unsigned char *bgr, long src_step, int src_end,
+                           const ResizeTaps *cols, int width, int sy, int keep, int simd)
+{
+     int i = cache->row[0] == sy ? 0 : cache->row[1] == sy ? 1 : -1;
+
+     if (i >= 0)
+          return cache->buf[i];
+     i = cache->row[0] == keep ? 1 : 0;
+     const unsigned char *src = bgr + sy * src_step;
+     int x = simd ? resampleRowAvx2(src, cols, width, src_end, cache->buf[i]) : 0;
+     resampleRowScalar(src, cols, x, width, cache->buf[i]);
+     cache->row[i] = sy;
+     return cache->buf[i];
+}
+
+/* The src_h x src_w interleaved 8-bit BGR image at bgr, with rows src_step bytes apart,
+   bilinearly resized to data[3][height][width] less the mean of every channel: the
+   resize of cv::resize(INTER_LINEAR) and the layout of packInput() in one pass, without
+   the resized image. The pixels are not rounded to 8 bits in between as by cv::resize,
+   so they are up to 1 apart from its. Every output row is a blend of two source rows
+   resampled once into a cache of the thread, RESIZE_PARALLEL splits the rows over the
+   OpenMP threads and RESIZE_SCALAR does without AVX2. */
+float *resizeInput(float *data, const unsigned char *bgr, int src_h, int src_w, long src_step, int height,
+                   int width, const float *mean, int flags)
+{
+     assert(data && bgr && mean);
+     assert(src_h > 0 && src_w > 0 && height > 0 && width > 0 && src_step >= src_w * 3L);
+     TRACE_SCOPE("resize");
+     int simd = !(flags & RESIZE_SCALAR) && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+     long plane = (long)height * width;
+     ResizeTaps cols, rows;
+
+     cols.first = (int *)sdt_alloc(sizeof(int) * width);
+     cols.second = (int *)sdt_alloc(sizeof(int) * width);
+     cols.weight = (float *)sdt_alloc(sizeof(float) * width);
+     rows.first = (int *)sdt_alloc(sizeof(int) * height);
+     rows.second = (int *)sdt_alloc(sizeof(int) * height);
+     rows.weight = (float *)sdt_alloc(sizeof(float) * height);
+     resizeTaps(&cols, src_w, width, 3);
+     resizeTaps(&rows, src_h, height, 1);
+
+#pragma omp parallel if (flags & RESIZE_PARALLEL)
+     {
+          RowCache cache = {{-1, -1}, {NULL, NULL}};
+          cache.buf[0] = (float *)sdt_alloc(sizeof(float) * 3 * width);
+          cache.buf[1] = (float *)sdt_alloc(sizeof(float) * 3 * width);
+
+          // static, so the rows of a thread are consecutive and share their source rows
+#pragma omp for schedule(static)
+          for (int y = 0; y < height; y++) {
+               int y0 = rows.first[y], y1 = rows.second[y];
+               const float *r0 = resampledRow(&cache, bgr, src_step, src_w * 3, &cols, width, y0, y1, simd);
+               const float *r1 = resampledRow(&cache, bgr, src_step, src_w * 3, &cols, width, y1, y0, simd);
+               if (simd)
+                    blendRowsAvx2(r0, r1, rows.weight[y], mean, data + (long)y * width, width, plane);
+               else
+                    blendRowsScalar(r0, r1, rows.weight[y], mean, data + (long)y * width, width, plane);
+          }
+          sdt_free(cache.buf[0]);
+          sdt_free(cache.buf[1]);
+     }
+     sdt_free(cols.first);
+     sdt_free(cols.second);
+     sdt_free(cols.weight);
+     sdt_free(rows.first);
+     sdt_free(rows.second);
+     sdt_free(rows.weight);
+     return data;
+}
+
+/* The anchors of the H x W grid over a width x height input, B per cell of the w x h
+   of anchor_shape[B][2], as [N][H][W][B][4] center x, center y, w, h. */
+float *prepareAnchors(const float *anchor_shape, int width, int height, int N, int H, int W, int B)
+{
+     assert(anchor_shape && N > 0);
+     long vol = (long)H * W * B * 4;
+     float *anchors = (float *)sdt_alloc(sizeof(float) * vol * N);
+     float center_x, center_y;
+     int i, j, k;
+
+     for (i = 0; i < H; i++) {
+          center_y = (i + 1) * height / (H + 1.0);
+          for (j = 0; j < W; j++) {
+               center_x = (j + 1) * width / (W + 1.0);
+               for (k = 0; k < B; k++) {
+                    float *a = &anchors[((i * W + j) * B + k) * 4];
+                    a[0] = center_x;
+                    a[1] = center_y;
+                    a[2] = anchor_shape[k*2];
+                    a[3] = anchor_shape[k*2+1];
+               }
+          }
+     }
+     for (i = 1; i < N; i++)
+          memcpy(anchors + i * vol, anchors, sizeof(float) * vol);
+     return anchors;
+}
+
+/* the detections under prob_thresh, such as the empty slots of a top-k with a score floor, don't count.
+   nms holds at least preds->num detections, a caller keeps one per thread for every image. */
+void detectionFilter(NmsContext *nms, struct predictions *preds, float nms_thresh, float prob_thresh)
+{
+     assert(nms && preds->bbox && preds->klass && preds->prob && preds->keep);
+     TRACE_SCOPE("nms");
+
+     nmsFilter(nms, preds->bbox, preds->klass, preds->prob, preds->keep, preds->num, nms_thresh, prob_thresh);
+}
+
+/* the detections of image i of a batch */
+struct predictions imagePredictions(const struct predictions *preds, int i)
+{
+     struct predictions image;
+     image.klass = preds->klass + i * preds->num;
+     image.prob = preds->prob + i * preds->num;
+     image.bbox = preds->bbox + i * preds->num * 4;
+     image.keep = preds->keep + i * preds->num;
+     image.num = preds->num;
+     return image;
+}
+
+/* one KITTI line per detection kept */
+void fprintResult(FILE *fp, const struct predictions *preds, const char *const *class_names)
+{
+     assert(fp && preds->bbox && preds->klass && preds->prob && preds->keep && class_names);
+
+     for (int i = 0; i < preds->num; i++) {
+          if (!preds->keep[i])
+               continue;
+          const float *bbox = &preds->bbox[i * 4];
+          fprintf(fp, "%s -1 -1 0.0 %.2f %.2f %.2f %.2f 0.0 0.0 0.0 0.0 0.0 0.0 0.0 %.3f\n",
+                  class_names[(int)preds->klass[i]], bbox[0], bbox[1], bbox[2], bbox[3], preds->prob[i]);
+     }
+}
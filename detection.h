@@ -0,0 +1,31 @@
+#ifndef _DETECTION_H_
+#define _DETECTION_H_
+
+#include <stdio.h>
+#include "nms.h"
+
+/* The host steps of a detection around the network: the input layout, the anchor
+   grid, the NMS of the top detections and their KITTI result lines. They need
+   neither a GPU nor OpenCV, so the benchmarks and tests run them as they are. */
+
+/* the detections of one image, or of a batch with num per image one after another */
+struct predictions {
+     float *klass;
+     float *prob;
+     float *bbox;               /* [num][4] x1, y1, x2, y2 */
+     int *keep;
+     int num;
+};
+
+#define RESIZE_PARALLEL 1       /* rows over the OpenMP threads */
+#define RESIZE_SCALAR 2         /* without AVX2 */
+
+float *packInput(float *data, const unsigned char *bgr, int height, int width, const float *mean);
+float *resizeInput(float *data, const unsigned char *bgr, int src_h, int src_w, long src_step, int height,
+                   int width, const float *mean, int flags);
+float *prepareAnchors(const float *anchor_shape, int width, int height, int N, int H, int W, int B);
+void detectionFilter(NmsContext *nms, struct predictions *preds, float nms_thresh, float prob_thresh);
+struct predictions imagePredictions(const struct predictions *preds, int i);
+void fprintResult(FILE *fp, const struct predictions *preds, const char *const *class_names);
+
+#endif  /* _DETECTION_H_ */
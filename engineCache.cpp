@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <err.h>
+#include <cuda_runtime.h>
+#include "engineCache.h"
+#include "sdt_alloc.h"
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+#define HASH_BUF_SIZE (1 << 20)
+
+static const char ENGINE_CACHE_MAGIC[8] = {'S', 'Q', 'D', 'T', 'R', 'T', 'E', 'C'};
+static const uint32_t ENGINE_CACHE_VERSION = 2;   /* 2 added network_version to the key */
+
+/* on-disk layout: header, conv engine blob, interpret engine blob */
+typedef struct {
+     char magic[8];
+     uint32_t version;
+     uint32_t reserved;
+     EngineCacheKey key;
+     uint64_t conv_size;
+     uint64_t interp_size;
+} EngineCacheHeader;
+
+static const char *dataTypeName(int dt)
+{
+     switch (static_cast<DataType>(dt)) {
+     case DataType::kFLOAT:
+          return "fp32";
+     case DataType::kHALF:
+          return "fp16";
+     case DataType::kINT8:
+          return "int8";
+     default:
+          return "unknown";
+     }
+}
+
+uint64_t hashFile(const char *path)
+{
+     assert(path);
+     FILE *fp;
+     unsigned char *buf;
+     size_t n, i;
+     uint64_t hash = FNV_OFFSET_BASIS;
+
+     if ((fp = fopen(path, "rb")) == NULL)
+          err(EXIT_FAILURE, "%s", path);
+     buf = (unsigned char *)sdt_alloc(HASH_BUF_SIZE);
+     while ((n = fread(buf, 1, HASH_BUF_SIZE, fp)) > 0) {
+          for (i = 0; i < n; i++) {
+               hash ^= buf[i];
+               hash *= FNV_PRIME;
+          }
+     }
+     if (ferror(fp))
+          err(EXIT_FAILURE, "%s", path);
+     sdt_free(buf);
+     fclose(fp);
+     return hash;
+}
+
+/* network_version numbers the network definitions the engines are built from, the weights
+   file and the shapes don't tell a change of the graph itself */
+void initEngineCacheKey(EngineCacheKey *key, const char *weights_file, int network_version, int batch_size,
+                        int c, int h, int w, DataType dt)
+{
+     assert(key && weights_file);
+     int device;
+     cudaDeviceProp prop;
+
+     memset(key, 0, sizeof(EngineCacheKey)); /* no garbage in padding, we compare with memcmp */
+     key->weights_hash = hashFile(weights_file);
+     key->network_version = network_version;
+     key->batch_size = batch_size;
+     key->input_c = c;
+     key->input_h = h;
+     key->input_w = w;
+     key->data_type = static_cast<int32_t>(dt);
+#ifdef NV_TENSORRT_MAJOR
+     key->trt_version = NV_TENSORRT_MAJOR * 10000 + NV_TENSORRT_MINOR * 100 + NV_TENSORRT_PATCH;
+#endif
+     if (cudaGetDevice(&device) == cudaSuccess &&
+         cudaGetDeviceProperties(&prop, device) == cudaSuccess) {
+          key->device_major = prop.major;
+          key->device_minor = prop.minor;
+     }
+}
+
+char *engineCachePath(char *buf, const char *cache_dir, const EngineCacheKey *key)
+{
+     assert(buf && cache_dir && key);
+     size_t len = strlen(cache_dir);
+
+     sprintf(buf, "%s%ssqdtrt-%016llx-g%d-n%d-%dx%dx%d-%s-trt%d-sm%d%d.engine",
+             cache_dir, len > 0 && cache_dir[len-1] != '/' ? "/" : "",
+             (unsigned long long)key->weights_hash, key->network_version, key->batch_size,
+             key->input_c, key->input_h, key->input_w, dataTypeName(key->data_type),
+             key->trt_version, key->device_major, key->device_minor);
+     return buf;
+}
+
+/* return 1 and malloc'ed blobs on a hit, 0 if the file is missing, stale or corrupted */
+int loadEngineCache(const char *path, const EngineCacheKey *key, void **conv_blob, size_t *conv_size, void **interp_blob, size_t *interp_size)
+{
+     assert(path && key && conv_blob && conv_size && interp_blob && interp_size);
+     FILE *fp;
+     EngineCacheHeader header;
+     void *conv, *interp;
+
+     if ((fp = fopen(path, "rb")) == NULL)
+          return 0;
+     if (fread(&header, sizeof(header), 1, fp) != 1 ||
+         memcmp(header.magic, ENGINE_CACHE_MAGIC, sizeof(header.magic)) ||
+         header.version != ENGINE_CACHE_VERSION ||
+         memcmp(&header.key, key, sizeof(EngineCacheKey)) ||
+         header.conv_size == 0 || header.interp_size == 0) {
+          fclose(fp);
+          return 0;
+     }
+
+     conv = sdt_alloc(header.conv_size);
+     interp = sdt_alloc(header.interp_size);
+     if (fread(conv, header.conv_size, 1, fp) != 1 ||
+         fread(interp, header.interp_size, 1, fp) != 1) {
+          fprintf(stderr, "Warning: truncated engine cache file %s, ignored\n", path);
+          sdt_free(conv);
+          sdt_free(interp);
+          fclose(fp);
+          return 0;
+     }
+     fclose(fp);
+
+     *conv_blob = conv;
+     *conv_size = header.conv_size;
+     *interp_blob = interp;
+     *interp_size = header.interp_size;
+     return 1;
+}
+
+/* write to a temporary file and rename it, so concurrent jobs never see a partial cache */
+int saveEngineCache(const char *path, const EngineCacheKey *key, IHostMemory *conv_blob, IHostMemory *interp_blob)
+{
+     assert(path && key && conv_blob && interp_blob);
+     FILE *fp;
+     EngineCacheHeader header;
+     int ok;
+     char *tmp_path = (char *)sdt_alloc(strlen(path) + 32);
+
+     memset(&header, 0, sizeof(header));
+     memmove(header.magic, ENGINE_CACHE_MAGIC, sizeof(header.magic));
+     header.version = ENGINE_CACHE_VERSION;
+     header.key = *key;
+     header.conv_size = conv_blob->size();
+     header.interp_size = interp_blob->size();
+
+     sprintf(tmp_path, "%s.tmp.%ld", path, (long)getpid());
+     if ((fp = fopen(tmp_path, "wb")) == NULL) {
+          warn("%s", tmp_path);
+          sdt_free(tmp_path);
+          return 0;
+     }
+     ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+          fwrite(conv_blob->data(), conv_blob->size(), 1, fp) == 1 &&
+          fwrite(interp_blob->data(), interp_blob->size(), 1, fp) == 1;
+     if (fclose(fp) != 0)
+          ok = 0;
+     if (!ok || rename(tmp_path, path) == -1) {
+          warn("%s", path);
+          unlink(tmp_path);
+          sdt_free(tmp_path);
+          return 0;
+     }
+     sdt_free(tmp_path);
+     return 1;
+}
@@ -0,0 +1,28 @@
+#ifndef _ENGINE_CACHE_H_
+#define _ENGINE_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "NvInfer.h"
+
+using namespace nvinfer1;
+
+/* everything a serialized engine depends on; two engines with equal keys are interchangeable */
+typedef struct {
+     uint64_t weights_hash;     /* FNV-1a of the whole weights file */
+     int32_t network_version;   /* of the graphs the engines are built from, see initEngineCacheKey() */
+     int32_t batch_size;
+     int32_t input_c, input_h, input_w;
+     int32_t data_type;         /* nvinfer1::DataType */
+     int32_t trt_version;       /* MAJOR * 10000 + MINOR * 100 + PATCH, 0 if unknown */
+     int32_t device_major, device_minor; /* compute capability the engine was built for */
+} EngineCacheKey;
+
+uint64_t hashFile(const char *path);
+void initEngineCacheKey(EngineCacheKey *key, const char *weights_file, int network_version, int batch_size,
+                        int c, int h, int w, DataType dt);
+char *engineCachePath(char *buf, const char *cache_dir, const EngineCacheKey *key);
+int loadEngineCache(const char *path, const EngineCacheKey *key, void **conv_blob, size_t *conv_size, void **interp_blob, size_t *interp_size);
+int saveEngineCache(const char *path, const EngineCacheKey *key, IHostMemory *conv_blob, IHostMemory *interp_blob);
+
+#endif  /* _ENGINE_CACHE_H_ */
@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <err.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "inputCache.h"
+#include "sdt_alloc.h"
+
+struct InputCache {
+     char *path, *tmp_path;
+     int height, width;
+     size_t pixels;             /* bytes of an entry's pixels */
+     // the pack read at open, NULL if there was none
+     char *addr;
+     size_t size;
+     const InputCacheEntry *entries;
+     const char *names;
+     uint32_t count;
+     std::map<std::string, uint32_t> index; /* the entries of this input size by image */
+     // the entries added by this run, their pixels in the temporary file from
+     // INPUT_CACHE_ALIGNMENT on and the rest written by closeInputCache()
+     pthread_mutex_t mutex;
+     FILE *tmp;
+     int failed;                /* the temporary file can't be written, nothing is added */
+     uint64_t tmp_size;
+     std::vector<InputCacheEntry> added;
+     std::map<std::string, uint32_t> added_index;
+     int hits;
+};
+
+/* the mtime and size of the image file, returns 0 if it can't be read */
+static int statImage(const char *image, int64_t *mtime_ns, int64_t *file_size)
+{
+     struct stat st;
+
+     if (stat(image, &st) == -1)
+          return 0;
+     *mtime_ns = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+     *file_size = st.st_size;
+     return 1;
+}
+
+/* maps the pack at cache->path, returns 0 if there is none or it is not a valid one */
+static int mapPack(InputCache *cache)
+{
+     const InputCacheHeader *header;
+     struct stat st;
+     int fd;
+
+     if ((fd = open(cache->path, O_RDONLY)) == -1)
+          return 0;
+     if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(InputCacheHeader)) {
+          close(fd);
+          return 0;
+     }
+     cache->size = st.st_size;
+     cache->addr = (char *)mmap(NULL, cache->size, PROT_READ, MAP_PRIVATE, fd, 0);
+     close(fd);
+     if (cache->addr == MAP_FAILED) {
+          cache->addr = NULL;
+          return 0;
+     }
+
+     header = (const InputCacheHeader *)cache->addr;
+     if (memcmp(header->magic, INPUT_CACHE_MAGIC, sizeof(header->magic)) ||
+         header->version != INPUT_CACHE_VERSION || header->alignment != INPUT_CACHE_ALIGNMENT ||
+         header->file_size != cache->size ||
+         header->entries_offset + (uint64_t)header->count * sizeof(InputCacheEntry) > cache->size ||
+         header->names_offset + header->names_size > cache->size ||
+         header->names_size == 0 || cache->addr[header->names_offset + header->names_size - 1] != '\0')
+          return 0;
+     cache->entries = (const InputCacheEntry *)(cache->addr + header->entries_offset);
+     cache->names = cache->addr + header->names_offset;
+     for (uint32_t i = 0; i < header->count; i++) {
+          const InputCacheEntry *e = &cache->entries[i];
+          if (e->name_offset >= header->names_size || e->height <= 0 || e->width <= 0 ||
+              e->offset % INPUT_CACHE_ALIGNMENT != 0 ||
+              e->offset + (uint64_t)e->height * e->width * 3 > header->entries_offset)
+               return 0;
+     }
+     cache->count = header->count;
+     return 1;
+}
+
+/* The cache of the inputs of height x width in the pack file path, which need not
+   exist yet. An invalid pack is ignored and replaced by closeInputCache(). */
+InputCache *openInputCache(const char *path, int height, int width)
+{
+     assert(path && height > 0 && width > 0);
+     InputCache *cache = new InputCache();
+
+     cache->path = strdup(path);
+     cache->height = height;
+     cache->width = width;
+     cache->pixels = (size_t)height * width * 3;
+     pthread_mutex_init(&cache->mutex, NULL);
+     if (!mapPack(cache)) {
+          if (cache->addr) {
+               fprintf(stderr, "Warning: invalid input cache %s, ignored\n", path);
+               munmap(cache->addr, cache->size);
+               cache->addr = NULL;
+          }
+          cache->entries = NULL;
+          cache->count = 0;
+          return cache;
+     }
+     // the images are read in the order they were cached in, most likely
+     madvise(cache->addr, cache->size, MADV_SEQUENTIAL);
+     for (uint32_t i = 0; i < cache->count; i++) {
+          const InputCacheEntry *e = &cache->entries[i];
+          if (e->height == height && e->width == width)
+               cache->index[std::string(cache->names + e->name_offset)] = i;
+     }
+     return cache;
+}
+
+/* The cached pixels of image, [height][width][3] in the mapping, and its size, or NULL
+   if it isn't cached or has changed since. Safe to call from several threads. */
+const unsigned char *inputCacheLookup(InputCache *cache, const char *image, float *img_width, float *img_height)
+{
+     assert(cache && image && img_width && img_height);
+     std::map<std::string, uint32_t>::const_iterator it = cache->index.find(image);
+     int64_t mtime_ns, file_size;
+
+     if (it == cache->index.end())
+          return NULL;
+     const InputCacheEntry *e = &cache->entries[it->second];
+     if (!statImage(image, &mtime_ns, &file_size) || mtime_ns != e->mtime_ns || file_size != e->file_size)
+          return NULL;
+     *img_width = e->img_width;
+     *img_height = e->img_height;
+     // start reading them in while the images before are preprocessed
+     long page = sysconf(_SC_PAGESIZE);
+     uint64_t begin = e->offset / page * page;
+     madvise(cache->addr + begin, e->offset + cache->pixels - begin, MADV_WILLNEED);
+     __sync_fetch_and_add(&cache->hits, 1);
+     return (const unsigned char *)cache->addr + e->offset;
+}
+
+/* writes size bytes of data to the temporary file, padded to the alignment */
+static int appendAligned(InputCache *cache, const void *data, size_t size)
+{
+     static const char zeros[INPUT_CACHE_ALIGNMENT] = {0};
+     size_t pad = (INPUT_CACHE_ALIGNMENT - size % INPUT_CACHE_ALIGNMENT) % INPUT_CACHE_ALIGNMENT;
+
+     if (fwrite(data, 1, size, cache->tmp) != size || fwrite(zeros, 1, pad, cache->tmp) != pad)
+          return 0;
+     cache->tmp_size += size + pad;
+     return 1;
+}
+
+/* Adds the [height][width][3] pixels of image, img_width x img_height originally, to the
+   pack when the cache is closed. Safe to call from several threads. */
+void inputCacheInsert(InputCache *cache, const char *image, const unsigned char *bgr, float img_width,
+                      float img_height)
+{
+     assert(cache && image && bgr);
+     InputCacheEntry e;
+
+     memset(&e, 0, sizeof(e));
+     if (!statImage(image, &e.mtime_ns, &e.file_size))
+          return;
+     e.height = cache->height;
+     e.width = cache->width;
+     e.img_width = img_width;
+     e.img_height = img_height;
+
+     pthread_mutex_lock(&cache->mutex);
+     if (!cache->failed && !cache->tmp) {
+          InputCacheHeader header;
+          memset(&header, 0, sizeof(header));
+          cache->tmp_path = (char *)sdt_alloc(strlen(cache->path) + 32);
+          sprintf(cache->tmp_path, "%s.tmp.%ld", cache->path, (long)getpid());
+          if (!(cache->tmp = fopen(cache->tmp_path, "w+b")) || !appendAligned(cache, &header, sizeof(header))) {
+               warn("%s", cache->tmp_path);
+               cache->failed = 1;
+          }
+     }
+     if (!cache->failed && !cache->added_index.count(image)) {
+          e.offset = cache->tmp_size;
+          if (appendAligned(cache, bgr, cache->pixels)) {
+               cache->added_index[image] = cache->added.size();
+               cache->added.push_back(e);
+          } else {
+               warn("%s", cache->tmp_path);
+               cache->failed = 1;
+          }
+     }
+     pthread_mutex_unlock(&cache->mutex);
+}
+
+/* The entries of the old pack and of this run into the temporary file, which replaces
+   the pack. The old entries of images added again, gone or changed are left out.
+   Returns 0 if it can't be written. */
+static int writePack(InputCache *cache, int *added)
+{
+     std::vector<InputCacheEntry> entries;
+     std::string names;
+     InputCacheHeader header;
+     int64_t mtime_ns, file_size;
+     uint32_t i;
+
+     for (i = 0; i < cache->count; i++) {
+          InputCacheEntry e = cache->entries[i];
+          const char *name = cache->names + e.name_offset;
+          if ((e.height == cache->height && e.width == cache->width && cache->added_index.count(name)) ||
+              !statImage(name, &mtime_ns, &file_size) || mtime_ns != e.mtime_ns || file_size != e.file_size)
+               continue;
+          const char *pixels = cache->addr + e.offset;
+          e.offset = cache->tmp_size;
+          e.name_offset = names.size();
+          names.append(name, strlen(name) + 1);
+          if (!appendAligned(cache, pixels, (size_t)e.height * e.width * 3))
+               return 0;
+          entries.push_back(e);
+     }
+     for (std::map<std::string, uint32_t>::const_iterator it = cache->added_index.begin();
+          it != cache->added_index.end(); ++it) {
+          InputCacheEntry e = cache->added[it->second];
+          e.name_offset = names.size();
+          names.append(it->first.c_str(), it->first.size() + 1);
+          entries.push_back(e);
+     }
+     *added = cache->added.size();
+
+     memset(&header, 0, sizeof(header));
+     memcpy(header.magic, INPUT_CACHE_MAGIC, sizeof(header.magic));
+     header.version = INPUT_CACHE_VERSION;
+     header.count = entries.size();
+     header.alignment = INPUT_CACHE_ALIGNMENT;
+     header.entries_offset = cache->tmp_size;
+     if (!appendAligned(cache, entries.data(), sizeof(InputCacheEntry) * entries.size()))
+          return 0;
+     header.names_offset = cache->tmp_size;
+     header.names_size = names.size();
+     if (!appendAligned(cache, names.data(), names.size()))
+          return 0;
+     header.file_size = cache->tmp_size;
+     return fseek(cache->tmp, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, cache->tmp) == 1;
+}
+
+/* Writes the entries added by this run into the pack, if any, and frees the cache.
+   hits and added, if not NULL, are set to the number of images found and added. */
+void closeInputCache(InputCache *cache, int *hits, int *added)
+{
+     assert(cache);
+     int nadded = 0;
+
+     if (cache->tmp) {
+          int ok = !cache->failed && writePack(cache, &nadded);
+          if (fclose(cache->tmp) != 0)
+               ok = 0;
+          if (!ok || rename(cache->tmp_path, cache->path) == -1) {
+               warn("%s", cache->path);
+               unlink(cache->tmp_path);
+               nadded = 0;
+          }
+     }
+     if (hits)
+          *hits = cache->hits;
+     if (added)
+          *added = nadded;
+     if (cache->addr)
+          munmap(cache->addr, cache->size);
+     pthread_mutex_destroy(&cache->mutex);
+     sdt_free(cache->tmp_path);
+     sdt_free(cache->path);
+     delete cache;
+}
@@ -0,0 +1,50 @@
+#ifndef _INPUT_CACHE_H_
+#define _INPUT_CACHE_H_
+
+#include <stdint.h>
+
+/* The resized 8-bit BGR pixels of images, with their original size, in one pack file
+   mapped into memory, so repeated runs over the same images skip decoding and resizing
+   them. An entry is found by the image path and the input size, and is used only while
+   the image has the mtime and size it was cached with. The entries of a run are added
+   when the cache is closed, the pack is rewritten to a temporary file and renamed, so
+   other jobs never see a partial one.
+
+   Pack file, all fields little-endian:
+   header | pixels of every entry | entry table (count entries) | name table.
+   Every entry's pixels start at a multiple of INPUT_CACHE_ALIGNMENT bytes. */
+#define INPUT_CACHE_MAGIC "SQDI"
+#define INPUT_CACHE_VERSION 1
+#define INPUT_CACHE_ALIGNMENT 64
+
+typedef struct {
+     char magic[4];
+     uint32_t version;
+     uint32_t count;            /* number of entries */
+     uint32_t alignment;        /* pixel alignment, INPUT_CACHE_ALIGNMENT */
+     uint64_t entries_offset;
+     uint64_t names_offset;
+     uint64_t names_size;
+     uint64_t file_size;
+     uint64_t reserved[2];
+} InputCacheHeader;             /* 64 bytes */
+
+typedef struct {
+     uint32_t name_offset;      /* relative to names_offset, names are NUL-terminated */
+     int32_t height, width;     /* of the input */
+     float img_width, img_height; /* of the image, for transformBboxSQD() */
+     uint32_t reserved;
+     int64_t mtime_ns;          /* of the image file */
+     int64_t file_size;
+     uint64_t offset;           /* of the [height][width][3] pixels from the file beginning */
+} InputCacheEntry;              /* 48 bytes */
+
+typedef struct InputCache InputCache;
+
+InputCache *openInputCache(const char *path, int height, int width);
+const unsigned char *inputCacheLookup(InputCache *cache, const char *image, float *img_width, float *img_height);
+void inputCacheInsert(InputCache *cache, const char *image, const unsigned char *bgr, float img_width,
+                      float img_height);
+void closeInputCache(InputCache *cache, int *hits, int *added);
+
+#endif  /* _INPUT_CACHE_H_ */
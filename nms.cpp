@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <immintrin.h>
+#include "nms.h"
+#include "sdt_alloc.h"
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+/* the same as in computeIou(), so both suppress the same boxes */
+static const float EPSILON = 1e-16;
+
+NmsContext *createNms(int capacity, int nclass)
+{
+     assert(capacity > 0 && nclass > 0);
+     NmsContext *nms = (NmsContext *)sdt_alloc(sizeof(NmsContext));
+     int padded = capacity + NMS_BLOCK;
+
+     nms->capacity = capacity;
+     nms->nclass = nclass;
+     nms->simd = __builtin_cpu_supports("avx2");
+     nms->order = (int *)sdt_alloc(sizeof(int) * capacity);
+     nms->start = (int *)sdt_alloc(sizeof(int) * (nclass + 1));
+     nms->x1 = (float *)sdt_alloc(sizeof(float) * padded * 5);
+     nms->y1 = nms->x1 + padded;
+     nms->x2 = nms->y1 + padded;
+     nms->y2 = nms->x2 + padded;
+     nms->area = nms->y2 + padded;
+     memset(nms->x1, 0, sizeof(float) * padded * 5);
+     nms->removed = (uint64_t *)sdt_alloc(sizeof(uint64_t) * (capacity / NMS_BLOCK + nclass + 1));
+     return nms;
+}
+
+void destroyNms(NmsContext *nms)
+{
+     assert(nms);
+     sdt_free(nms->order);
+     sdt_free(nms->start);
+     sdt_free(nms->x1);
+     sdt_free(nms->removed);
+     sdt_free(nms);
+}
+
+/* bits of the candidates j0 + [0, 64) whose IoU with candidate i exceeds thresh */
+static uint64_t overlapMaskScalar(const NmsContext *nms, int i, int j0, float thresh)
+{
+     uint64_t mask = 0;
+     float lr, tb, intersection, total;
+
+     for (int b = 0; b < NMS_BLOCK; b++) {
+          int j = j0 + b;
+          lr = min(nms->x2[i], nms->x2[j]) - max(nms->x1[i], nms->x1[j]);
+          tb = min(nms->y2[i], nms->y2[j]) - max(nms->y1[i], nms->y1[j]);
+          if (lr < 0 || tb < 0)
+               continue;
+          intersection = tb * lr + EPSILON;
+          total = nms->area[i] + nms->area[j] - intersection;
+          if (intersection / (total + EPSILON) > thresh)
+               mask |= (uint64_t)1 << b;
+     }
+     return mask;
+}
+
+/* no fma, its single rounding would make some IoUs differ from computeIou() */
+__attribute__((target("avx2")))
+static uint64_t overlapMaskAvx2(const NmsContext *nms, int i, int j0, float thresh)
+{
+     __m256 x1 = _mm256_set1_ps(nms->x1[i]), y1 = _mm256_set1_ps(nms->y1[i]);
+     __m256 x2 = _mm256_set1_ps(nms->x2[i]), y2 = _mm256_set1_ps(nms->y2[i]);
+     __m256 area = _mm256_set1_ps(nms->area[i]), th = _mm256_set1_ps(thresh);
+     __m256 eps = _mm256_set1_ps(EPSILON), zero = _mm256_setzero_ps();
+     uint64_t mask = 0;
+
+     for (int b = 0; b < NMS_BLOCK; b += 8) {
+          int j = j0 + b;
+          __m256 lr = _mm256_sub_ps(_mm256_min_ps(x2, _mm256_loadu_ps(nms->x2 + j)),
+                                    _mm256_max_ps(x1, _mm256_loadu_ps(nms->x1 + j)));
+          __m256 tb = _mm256_sub_ps(_mm256_min_ps(y2, _mm256_loadu_ps(nms->y2 + j)),
+                                    _mm256_max_ps(y1, _mm256_loadu_ps(nms->y1 + j)));
+          __m256 intersection = _mm256_add_ps(_mm256_mul_ps(tb, lr), eps);
+          __m256 total = _mm256_sub_ps(_mm256_add_ps(area, _mm256_loadu_ps(nms->area + j)), intersection);
+          __m256 iou = _mm256_div_ps(intersection, _mm256_add_ps(total, eps));
+          __m256 hit = _mm256_and_ps(_mm256_cmp_ps(iou, th, _CMP_GT_OQ),
+                                     _mm256_and_ps(_mm256_cmp_ps(lr, zero, _CMP_GE_OQ),
+                                                   _mm256_cmp_ps(tb, zero, _CMP_GE_OQ)));
+          mask |= (uint64_t)_mm256_movemask_ps(hit) << b;
+     }
+     return mask;
+}
+
+/* candidates [first, last) of one class */
+static void suppressClass(NmsContext *nms, int first, int last, uint64_t *removed, float thresh)
+{
+     int n = last - first, words = (n + NMS_BLOCK - 1) / NMS_BLOCK, i, w;
+
+     memset(removed, 0, sizeof(uint64_t) * words);
+     for (i = 0; i < n; i++) {
+          for (w = i / NMS_BLOCK; w < words; w++) {
+               int valid = min(NMS_BLOCK, n - w * NMS_BLOCK);
+               uint64_t all = valid == NMS_BLOCK ? ~(uint64_t)0 : ((uint64_t)1 << valid) - 1;
+               if (w == i / NMS_BLOCK)
+                    all &= ~(((uint64_t)2 << (i % NMS_BLOCK)) - 1); // only the later ones
+               if ((removed[w] & all) == all)
+                    continue;
+               uint64_t mask = nms->simd ? overlapMaskAvx2(nms, first + i, first + w * NMS_BLOCK, thresh) :
+                    overlapMaskScalar(nms, first + i, first + w * NMS_BLOCK, thresh);
+               removed[w] |= mask & all;
+          }
+     }
+}
+
+/* Fills keep[num] for the num detections of bbox[num][4] (x1, y1, x2, y2), klass[num]
+   and prob[num], sorted by descending prob, and returns how many are kept. Gives the
+   same keep as the pairwise loop with computeIou() it replaces. */
+int nmsFilter(NmsContext *nms, const float *bbox, const float *klass, const float *prob, int *keep, int num,
+              float nms_thresh, float prob_thresh)
+{
+     assert(nms && bbox && klass && prob && keep);
+     assert(num <= nms->capacity);
+     int i, c, p, kept = 0;
+
+     // bucket the candidates by class, a counting sort that keeps their order
+     memset(nms->start, 0, sizeof(int) * (nms->nclass + 1));
+     for (i = 0; i < num; i++) {
+          keep[i] = 0;
+          if (prob[i] >= prob_thresh) {
+               assert(klass[i] >= 0 && klass[i] < nms->nclass);
+               nms->start[(int)klass[i] + 1]++;
+          }
+     }
+     for (c = 0; c < nms->nclass; c++)
+          nms->start[c+1] += nms->start[c];
+     for (i = 0; i < num; i++) {
+          if (prob[i] < prob_thresh)
+               continue;
+          p = nms->start[(int)klass[i]]++;
+          nms->order[p] = i;
+          nms->x1[p] = bbox[i*4];
+          nms->y1[p] = bbox[i*4+1];
+          nms->x2[p] = bbox[i*4+2];
+          nms->y2[p] = bbox[i*4+3];
+          nms->area[p] = (bbox[i*4+2] - bbox[i*4]) * (bbox[i*4+3] - bbox[i*4+1]);
+     }
+     for (c = nms->nclass; c > 0; c--)
+          nms->start[c] = nms->start[c-1];
+     nms->start[0] = 0;
+
+     for (c = 0; c < nms->nclass; c++) {
+          uint64_t *removed = nms->removed + nms->start[c] / NMS_BLOCK + c;
+          suppressClass(nms, nms->start[c], nms->start[c+1], removed, nms_thresh);
+          for (p = nms->start[c]; p < nms->start[c+1]; p++) {
+               int b = p - nms->start[c];
+               if (!(removed[b / NMS_BLOCK] >> (b % NMS_BLOCK) & 1)) {
+                    keep[nms->order[p]] = 1;
+                    kept++;
+               }
+          }
+     }
+     return kept;
+}
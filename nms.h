@@ -0,0 +1,35 @@
+#ifndef _NMS_H_
+#define _NMS_H_
+
+#include <stdint.h>
+
+/* Non-maximum suppression of the detections of one image, with the semantics of
+   SqueezeDet: detections come in descending score order, and one is dropped when
+   it overlaps any earlier detection of its class by more than nms_thresh, whether
+   or not that one was dropped itself. Detections under prob_thresh are dropped and
+   don't suppress others.
+
+   The candidates are bucketed by class into structure-of-arrays boxes, so a box
+   is only compared with those of its class and 8 IoUs take one AVX2 pass. Each
+   comparison row sets bits of a suppression mask of 64 boxes per word, and the
+   words that are full already are skipped. */
+
+#define NMS_BLOCK 64            /* boxes per word of the suppression mask */
+
+typedef struct {
+     int capacity;              /* detections per image */
+     int nclass;
+     int simd;                  /* AVX2 IoUs, by default if the cpu has them */
+     int *order;                /* [capacity] detection of every candidate, bucketed by class */
+     int *start;                /* [nclass + 1] first candidate of every class in order */
+     float *x1, *y1, *x2, *y2;  /* [capacity + NMS_BLOCK] boxes of the candidates, a block can be read past the last */
+     float *area;
+     uint64_t *removed;         /* suppression mask, the words of a class start at start[c] / NMS_BLOCK + c */
+} NmsContext;
+
+NmsContext *createNms(int capacity, int nclass);
+void destroyNms(NmsContext *nms);
+int nmsFilter(NmsContext *nms, const float *bbox, const float *klass, const float *prob, int *keep, int num,
+              float nms_thresh, float prob_thresh);
+
+#endif  /* _NMS_H_ */
@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <err.h>
+#include "pipeline.h"
+#include "trace.h"
+#include "sdt_alloc.h"
+
+static double now(void)
+{
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* q->mutex held */
+static void countChanged(BoundedQueue *q, int count)
+{
+     double t = now();
+     q->area += q->count * (t - q->last);
+     q->last = t;
+     q->count = count;
+     if (count > q->max_count)
+          q->max_count = count;
+}
+
+BoundedQueue *createQueue(int capacity, long (*order)(const void *item))
+{
+     assert(capacity > 0);
+     BoundedQueue *q = (BoundedQueue *)sdt_alloc(sizeof(BoundedQueue));
+
+     memset(q, 0, sizeof(BoundedQueue));
+     q->items = (void **)sdt_alloc(sizeof(void *) * capacity);
+     q->capacity = capacity;
+     q->order = order;
+     pthread_mutex_init(&q->mutex, NULL);
+     pthread_cond_init(&q->changed, NULL);
+     q->start = q->last = now();
+     return q;
+}
+
+void destroyQueue(BoundedQueue *q)
+{
+     assert(q);
+     pthread_mutex_destroy(&q->mutex);
+     pthread_cond_destroy(&q->changed);
+     sdt_free(q->items);
+     sdt_free(q);
+}
+
+void queuePush(BoundedQueue *q, void *item)
+{
+     assert(q && item);
+     pthread_mutex_lock(&q->mutex);
+     if (q->count == q->capacity)
+          q->full_waits++;
+     while (q->count == q->capacity)
+          pthread_cond_wait(&q->changed, &q->mutex);
+     // an ordered queue keeps its items unsorted from items[0] on
+     q->items[q->order ? q->count : (q->head + q->count) % q->capacity] = item;
+     countChanged(q, q->count + 1);
+     q->pushes++;
+     pthread_cond_broadcast(&q->changed);
+     pthread_mutex_unlock(&q->mutex);
+}
+
+/* q->mutex held, index of the item of order among the first count, or -1 if it isn't there */
+static int findOrder(const BoundedQueue *q, long order, int count)
+{
+     for (int i = 0; i < count; i++)
+          if (q->order(q->items[i]) == order)
+               return i;
+     return -1;
+}
+
+/* q->mutex held, how many of the next max items in order are there, without a gap */
+static int countNext(const BoundedQueue *q, int max)
+{
+     int n = 0;
+     while (n < max && findOrder(q, q->next + n, q->count) >= 0)
+          n++;
+     return n;
+}
+
+/* Waits for max items, or fewer once the queue is closed, and pops them.
+   Returns how many, 0 when the queue is closed and empty. An ordered queue pops the
+   next max items in order, fewer once it is closed. */
+int queuePopMany(BoundedQueue *q, void **items, int max)
+{
+     assert(q && items && max > 0);
+     int n, i, k, left;
+
+     pthread_mutex_lock(&q->mutex);
+     if (q->order) {
+          if (countNext(q, max) < max && !q->closed)
+               q->empty_waits++;
+          while ((n = countNext(q, max)) < max && !(q->closed && (n > 0 || q->count == 0)))
+               pthread_cond_wait(&q->changed, &q->mutex);
+          if (n == 0) {
+               pthread_mutex_unlock(&q->mutex);
+               return 0;
+          }
+          for (k = 0, left = q->count; k < n; k++, left--) {
+               i = findOrder(q, q->next++, left);
+               items[k] = q->items[i];
+               q->items[i] = q->items[left - 1];
+          }
+     } else {
+          if (q->count < max && !q->closed)
+               q->empty_waits++;
+          while (q->count < max && !q->closed)
+               pthread_cond_wait(&q->changed, &q->mutex);
+          n = q->count < max ? q->count : max;
+          for (i = 0; i < n; i++)
+               items[i] = q->items[(q->head + i) % q->capacity];
+          q->head = (q->head + n) % q->capacity;
+     }
+     countChanged(q, q->count - n);
+     pthread_cond_broadcast(&q->changed);
+     pthread_mutex_unlock(&q->mutex);
+     return n;
+}
+
+void queueClose(BoundedQueue *q)
+{
+     assert(q);
+     pthread_mutex_lock(&q->mutex);
+     q->closed = 1;
+     pthread_cond_broadcast(&q->changed);
+     pthread_mutex_unlock(&q->mutex);
+}
+
+/* average number of items in the queue since it was created */
+double queueAverage(BoundedQueue *q)
+{
+     assert(q);
+     double avg;
+
+     pthread_mutex_lock(&q->mutex);
+     countChanged(q, q->count);
+     avg = q->last > q->start ? q->area / (q->last - q->start) : 0;
+     pthread_mutex_unlock(&q->mutex);
+     return avg;
+}
+
+/* the last worker of a stage to stop closes its output, so the next stage stops once it drained it */
+static void *stageWorker(void *arg)
+{
+     PipelineStage *stage = (PipelineStage *)arg;
+     void **items = (void **)sdt_alloc(sizeof(void *) * stage->batch);
+     int n, i, ret = 0, last;
+
+     traceThreadName(stage->name);
+     while (ret != STAGE_END && (n = queuePopMany(stage->in, items, stage->batch)) > 0) {
+          double start = now();
+          ret = stage->process(stage->ctx, items, n);
+          double busy = now() - start;
+          for (i = 0; i < n; i++)
+               queuePush(ret == STAGE_END ? stage->in : stage->out, items[i]);
+          pthread_mutex_lock(&stage->mutex);
+          stage->busy += busy;
+          if (ret != STAGE_END)
+               stage->items += n;
+          pthread_mutex_unlock(&stage->mutex);
+     }
+     pthread_mutex_lock(&stage->mutex);
+     last = --stage->running == 0;
+     pthread_mutex_unlock(&stage->mutex);
+     if (last)
+          queueClose(stage->out);
+     sdt_free(items);
+     return NULL;
+}
+
+/* starts the workers of every stage and returns once they all stopped */
+void runPipeline(PipelineStage *stages, int nstages)
+{
+     assert(stages && nstages > 0);
+     int total = 0, i, j, k;
+
+     for (i = 0; i < nstages; i++) {
+          assert(stages[i].workers > 0 && stages[i].batch > 0 && stages[i].in && stages[i].out);
+          pthread_mutex_init(&stages[i].mutex, NULL);
+          stages[i].running = stages[i].workers;
+          stages[i].items = 0;
+          stages[i].busy = 0;
+          total += stages[i].workers;
+     }
+     pthread_t *threads = (pthread_t *)sdt_alloc(sizeof(pthread_t) * total);
+     for (i = 0, k = 0; i < nstages; i++)
+          for (j = 0; j < stages[i].workers; j++, k++)
+               if (pthread_create(&threads[k], NULL, stageWorker, &stages[i]))
+                    errx(EXIT_FAILURE, "cannot start a worker of pipeline stage %s", stages[i].name);
+     for (k = 0; k < total; k++)
+          pthread_join(threads[k], NULL);
+     for (i = 0; i < nstages; i++)
+          pthread_mutex_destroy(&stages[i].mutex);
+     sdt_free(threads);
+}
+
+/* One line per stage: its time per item and how busy its workers were, then how full
+   its input queue was and how often it waited for input or to push its output. The
+   stage with the busiest workers is the bottleneck. */
+void printPipelineStats(FILE *fp, PipelineStage *stages, int nstages, double elapsed)
+{
+     assert(fp && stages && nstages > 0);
+     int i, bottleneck = 0;
+     double util, max_util = -1;
+
+     fprintf(fp, "%-12s %7s %7s %12s %6s %21s %8s %8s\n", "stage", "workers", "items", "ms/item", "busy",
+             "in queue avg/max/cap", "starved", "blocked");
+     for (i = 0; i < nstages; i++) {
+          PipelineStage *s = &stages[i];
+          util = elapsed > 0 ? s->busy / (s->workers * elapsed) : 0;
+          if (util > max_util) {
+               max_util = util;
+               bottleneck = i;
+          }
+          fprintf(fp, "%-12s %7d %7ld %12.2f %5.0f%% %10.1f/%4d/%4d %8ld %8ld\n", s->name, s->workers, s->items,
+                  s->items ? s->busy * 1000 / s->items : 0, util * 100, queueAverage(s->in), s->in->max_count,
+                  s->in->capacity, s->in->empty_waits, s->out->full_waits);
+     }
+     fprintf(fp, "bottleneck: %s\n", stages[bottleneck].name);
+}
@@ -0,0 +1,61 @@
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+#include <stdio.h>
+#include <pthread.h>
+
+/* Stages of a pipeline run on their own threads and hand items to each other through
+   bounded queues, so a slow stage holds the ones before it back instead of letting
+   items pile up. Every queue records how full it was over time, which shows where
+   the bottleneck is: the queues before it stay full, the ones after it empty. */
+
+#define STAGE_END -1            /* returned by a StageFunc when there's no more input */
+
+/* Bounded queue of items. A FIFO, or with an order function it hands out items by
+   order 0, 1, 2... whatever order they were pushed in, a batch being the next items
+   in order. An ordered queue must be able to hold every item in flight, or the next
+   one may never fit. */
+typedef struct {
+     void **items;
+     int capacity, head, count;
+     long (*order)(const void *item);
+     long next;                 /* order of the next item to pop */
+     int closed;                /* no more pushes, pops return what's left */
+     pthread_mutex_t mutex;
+     pthread_cond_t changed;
+     /* occupancy over time */
+     double start, last, area;
+     int max_count;
+     long pushes, full_waits, empty_waits;
+} BoundedQueue;
+
+BoundedQueue *createQueue(int capacity, long (*order)(const void *item));
+void destroyQueue(BoundedQueue *q);
+void queuePush(BoundedQueue *q, void *item);
+int queuePopMany(BoundedQueue *q, void **items, int max);
+void queueClose(BoundedQueue *q);
+double queueAverage(BoundedQueue *q);
+
+/* Processes the n items popped from the input queue, which then go to the output
+   queue. STAGE_END stops the worker and returns the items to the input queue unprocessed. */
+typedef int (*StageFunc)(void *ctx, void **items, int n);
+
+typedef struct {
+     const char *name;
+     int workers;
+     int batch;                 /* most items per call of process, it waits for a full batch
+                                   until the input queue is closed */
+     StageFunc process;
+     void *ctx;
+     BoundedQueue *in, *out;
+     /* filled by runPipeline() */
+     pthread_mutex_t mutex;
+     int running;
+     long items;
+     double busy;               /* seconds in process, summed over the workers */
+} PipelineStage;
+
+void runPipeline(PipelineStage *stages, int nstages);
+void printPipelineStats(FILE *fp, PipelineStage *stages, int nstages, double elapsed);
+
+#endif  /* _PIPELINE_H_ */
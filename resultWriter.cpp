@@ -0,0 +1,314 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <err.h>
+#include <pthread.h>
+#include "resultWriter.h"
+#include "pipeline.h"
+#include "trace.h"
+#include "sdt_alloc.h"
+
+/* the kept detections of a submitted image, copied so the caller can reuse its own */
+typedef struct {
+     char *image;
+     struct predictions preds;  /* keep all 1 */
+} ResultItem;
+
+struct ResultWriter {
+     const char *const *class_names;
+     char *result_dir;          /* NULL for a stream */
+     int fd;                    /* of the stream */
+     char *stream_path;
+     char *buf;                 /* the stream block, or the lines of one image */
+     size_t buf_size, used;
+     BoundedQueue *queue;
+     pthread_t thread;
+     double start;
+     ResultWriterStats stats;
+};
+
+/* The digits of printf("%.*f", decimals, v). v times a power of 10 up to 10^6 is
+   exact in a double, so rounding it to an integer, ties to even, rounds the exact
+   value as printf does. Others than |v| * 10^decimals < 10^15 go to printf. Returns
+   the end of the digits, without a NUL. */
+char *formatFixed(char *p, float v, int decimals)
+{
+     static const double SCALE[] = {1, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6};
+     assert(p && decimals >= 0 && decimals <= 6);
+     double scaled = (double)v * SCALE[decimals];
+     char digits[24];
+     int len = 0, i;
+
+     if (!(fabs(scaled) < 1e15))
+          return p + sprintf(p, "%.*f", decimals, v);
+     long long n = llrint(fabs(scaled));
+     if (signbit(v))
+          *p++ = '-';
+     do {
+          digits[len++] = '0' + n % 10;
+          n /= 10;
+     } while (n > 0 || len <= decimals);
+     for (i = len - 1; i >= decimals; i--)
+          *p++ = digits[i];
+     if (decimals) {
+          *p++ = '.';
+          for (i = decimals - 1; i >= 0; i--)
+               *p++ = digits[i];
+     }
+     return p;
+}
+
+static char *appendString(char *p, const char *s)
+{
+     size_t len = strlen(s);
+     memcpy(p, s, len);
+     return p + len;
+}
+
+/* The lines of fprintResult() for the detections kept, each after prefix and a space
+   unless prefix is NULL, to p, which has room for RESULT_LINE_MAX per detection.
+   Returns their end, without a NUL. */
+char *formatResult(char *p, const struct predictions *preds, const char *const *class_names, const char *prefix)
+{
+     assert(p && preds->bbox && preds->klass && preds->prob && preds->keep && class_names);
+     assert(!prefix || strlen(prefix) < RESULT_NAME_MAX);
+
+     for (int i = 0; i < preds->num; i++) {
+          if (!preds->keep[i])
+               continue;
+          const float *bbox = &preds->bbox[i * 4];
+          if (prefix) {
+               p = appendString(p, prefix);
+               *p++ = ' ';
+          }
+          p = appendString(p, class_names[(int)preds->klass[i]]);
+          p = appendString(p, " -1 -1 0.0");
+          for (int j = 0; j < 4; j++) {
+               *p++ = ' ';
+               p = formatFixed(p, bbox[j], 2);
+          }
+          p = appendString(p, " 0.0 0.0 0.0 0.0 0.0 0.0 0.0 ");
+          p = formatFixed(p, preds->prob[i], 3);
+          *p++ = '\n';
+     }
+     return p;
+}
+
+static double elapsedSince(double start)
+{
+     return traceNow() * 1e-9 - start;
+}
+
+/* writes all of buf to fd, returns 0 on an error */
+static int writeAll(ResultWriter *w, int fd, const char *buf, size_t size)
+{
+     while (size > 0) {
+          ssize_t n = write(fd, buf, size);
+          if (n == -1 && errno == EINTR)
+               continue;
+          if (n <= 0)
+               return 0;
+          w->stats.writes++;
+          w->stats.bytes += n;
+          buf += n;
+          size -= n;
+     }
+     return 1;
+}
+
+static void flushStream(ResultWriter *w)
+{
+     TRACE_SCOPE("flush");
+     if (w->used && !writeAll(w, w->fd, w->buf, w->used))
+          err(EXIT_FAILURE, "%s", w->stream_path);
+     w->used = 0;
+}
+
+/* RESULT_DIR/NAME.txt of image, as assemblePath() gives it */
+static void resultPath(char *path, const char *dir, const char *image)
+{
+     const char *name = strrchr(image, '/');
+     size_t len = strlen(dir);
+     char *suffix;
+
+     sprintf(path, "%s%s%s", dir, len > 0 && dir[len-1] != '/' ? "/" : "", name ? name + 1 : image);
+     if ((suffix = strrchr(path + len, '.')) == NULL)
+          suffix = path + strlen(path);
+     strcpy(suffix, ".txt");
+}
+
+/* the file name of image without its extension, the KITTI id */
+static void imageName(char *name, const char *image)
+{
+     const char *base = strrchr(image, '/');
+     char *suffix;
+
+     snprintf(name, RESULT_NAME_MAX, "%s", base ? base + 1 : image);
+     if ((suffix = strrchr(name, '.')) != NULL)
+          *suffix = '\0';
+}
+
+/* grows the buffer to size, on the writer thread */
+static void reserveBuffer(ResultWriter *w, size_t size)
+{
+     if (w->buf_size >= size)
+          return;
+     w->buf_size = size;
+     if (!(w->buf = (char *)realloc(w->buf, size)))
+          err(EXIT_FAILURE, "result buffer");
+}
+
+static void writeItem(ResultWriter *w, const ResultItem *item)
+{
+     char name[RESULT_NAME_MAX];
+     size_t bound = (size_t)(item->preds.num + 1) * RESULT_LINE_MAX;
+     char *p;
+
+     w->stats.images++;
+     w->stats.detections += item->preds.num;
+     if (w->result_dir) {
+          char *path = (char *)sdt_alloc(strlen(w->result_dir) + strlen(item->image) + 8);
+          int fd;
+          reserveBuffer(w, bound);
+          {
+               TRACE_SCOPE("format");
+               p = formatResult(w->buf, &item->preds, w->class_names, NULL);
+          }
+          TRACE_SCOPE("flush");
+          resultPath(path, w->result_dir, item->image);
+          if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1 ||
+              !writeAll(w, fd, w->buf, p - w->buf) || close(fd) == -1)
+               warn("%s", path);
+          else
+               w->stats.files++;
+          sdt_free(path);
+          return;
+     }
+     if (w->used + bound > w->buf_size)
+          flushStream(w);
+     reserveBuffer(w, bound);    // an image of more than a block of lines
+     TRACE_SCOPE("format");
+     imageName(name, item->image);
+     p = w->buf + w->used;
+     p = appendString(p, name);
+     *p++ = '\n';
+     p = formatResult(p, &item->preds, w->class_names, name);
+     w->used = p - w->buf;
+}
+
+static void freeItem(ResultItem *item)
+{
+     sdt_free(item->image);
+     sdt_free(item->preds.klass);
+     sdt_free(item->preds.prob);
+     sdt_free(item->preds.bbox);
+     sdt_free(item->preds.keep);
+     sdt_free(item);
+}
+
+static void *writerThread(void *arg)
+{
+     ResultWriter *w = (ResultWriter *)arg;
+     void *item;
+
+     traceThreadName("results");
+     while (queuePopMany(w->queue, &item, 1) == 1) {
+          double begin = traceNow() * 1e-9;
+          writeItem(w, (ResultItem *)item);
+          freeItem((ResultItem *)item);
+          w->stats.busy += elapsedSince(begin);
+     }
+     if (!w->result_dir) {
+          double begin = traceNow() * 1e-9;
+          flushStream(w);
+          w->stats.busy += elapsedSince(begin);
+     }
+     return NULL;
+}
+
+/* A writer of one file per image in result_dir, or, if stream_path isn't NULL, of
+   the stream of all of them to stream_path. */
+ResultWriter *createResultWriter(const char *result_dir, const char *stream_path, const char *const *class_names)
+{
+     assert((result_dir || stream_path) && class_names);
+     ResultWriter *w = (ResultWriter *)sdt_alloc(sizeof(ResultWriter));
+
+     memset(w, 0, sizeof(ResultWriter));
+     w->class_names = class_names;
+     w->fd = -1;
+     if (stream_path) {
+          w->stream_path = strdup(stream_path);
+          if ((w->fd = open(stream_path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1)
+               err(EXIT_FAILURE, "%s", stream_path);
+          w->stats.files = 1;
+          w->buf_size = RESULT_STREAM_BLOCK;
+     } else {
+          w->result_dir = strdup(result_dir);
+          w->buf_size = RESULT_LINE_MAX;
+     }
+     w->buf = (char *)sdt_alloc(w->buf_size);
+     w->queue = createQueue(RESULT_QUEUE_SIZE, NULL);
+     w->start = traceNow() * 1e-9;
+     if ((errno = pthread_create(&w->thread, NULL, writerThread, w)) != 0)
+          err(EXIT_FAILURE, "result writer thread");
+     return w;
+}
+
+/* Queues the kept detections of image to be written, waits only while RESULT_QUEUE_SIZE
+   images are queued already. */
+void resultWriterSubmit(ResultWriter *w, const char *image, const struct predictions *preds)
+{
+     assert(w && image && preds->bbox && preds->klass && preds->prob && preds->keep);
+     ResultItem *item = (ResultItem *)sdt_alloc(sizeof(ResultItem));
+     int i, n;
+
+     for (i = 0, n = 0; i < preds->num; i++)
+          n += preds->keep[i] != 0;
+     item->image = strdup(image);
+     item->preds.num = n;
+     item->preds.klass = (float *)sdt_alloc(sizeof(float) * (n + 1));
+     item->preds.prob = (float *)sdt_alloc(sizeof(float) * (n + 1));
+     item->preds.bbox = (float *)sdt_alloc(sizeof(float) * 4 * (n + 1));
+     item->preds.keep = (int *)sdt_alloc(sizeof(int) * (n + 1));
+     for (i = 0, n = 0; i < preds->num; i++) {
+          if (!preds->keep[i])
+               continue;
+          item->preds.klass[n] = preds->klass[i];
+          item->preds.prob[n] = preds->prob[i];
+          memcpy(&item->preds.bbox[n * 4], &preds->bbox[i * 4], sizeof(float) * 4);
+          item->preds.keep[n++] = 1;
+     }
+     queuePush(w->queue, item);
+}
+
+/* Writes what's left, stops the thread and frees the writer. stats, if not NULL, are
+   set to what it wrote. */
+void closeResultWriter(ResultWriter *w, ResultWriterStats *stats)
+{
+     assert(w);
+     queueClose(w->queue);
+     pthread_join(w->thread, NULL);
+     if (w->fd != -1 && close(w->fd) == -1)
+          err(EXIT_FAILURE, "%s", w->stream_path);
+     w->stats.elapsed = elapsedSince(w->start);
+     if (stats)
+          *stats = w->stats;
+     destroyQueue(w->queue);
+     sdt_free(w->buf);
+     sdt_free(w->result_dir);
+     sdt_free(w->stream_path);
+     sdt_free(w);
+}
+
+void fprintResultWriterStats(FILE *fp, const ResultWriterStats *stats)
+{
+     assert(fp && stats);
+     fprintf(fp, "results: %ld images, %ld detections, %.2f MB in %ld files and %ld writes, %.1f MB/s while "
+             "busy %.2fs of %.2fs\n", stats->images, stats->detections, stats->bytes / 1e6, stats->files,
+             stats->writes, stats->busy > 0 ? stats->bytes / 1e6 / stats->busy : 0, stats->busy, stats->elapsed);
+}
@@ -0,0 +1,38 @@
+#ifndef _RESULT_WRITER_H_
+#define _RESULT_WRITER_H_
+
+#include "detection.h"
+
+/* The KITTI result lines of the images, formatted and written on a thread of their own
+   so the detection doesn't wait for the file system. Either one file per image in a
+   directory, RESULT_DIR/NAME.txt as fprintResult() writes them, or one stream of all
+   images in the order they were submitted: a line "NAME" per image, then its
+   detections as "NAME KITTI_LINE", which scripts/splitresults.pl turns into the files.
+   The stream is written in blocks of RESULT_STREAM_BLOCK bytes.
+
+   The numbers are formatted by formatFixed(), the same digits as printf's "%.Nf" from
+   the exact value of the float, without parsing a format. */
+
+#define RESULT_STREAM_BLOCK (1 << 20)
+#define RESULT_QUEUE_SIZE 256   /* images submitted but not written yet */
+#define RESULT_NAME_MAX 256
+#define RESULT_LINE_MAX 1024    /* of a detection, with a name of up to RESULT_NAME_MAX */
+
+typedef struct {
+     long images, detections;
+     long files, writes;        /* files opened and write() calls */
+     long long bytes;
+     double busy;               /* s the writer thread formatted and wrote */
+     double elapsed;            /* s from its creation to its close */
+} ResultWriterStats;
+
+typedef struct ResultWriter ResultWriter;
+
+char *formatFixed(char *p, float v, int decimals);
+char *formatResult(char *p, const struct predictions *preds, const char *const *class_names, const char *prefix);
+ResultWriter *createResultWriter(const char *result_dir, const char *stream_path, const char *const *class_names);
+void resultWriterSubmit(ResultWriter *writer, const char *image, const struct predictions *preds);
+void closeResultWriter(ResultWriter *writer, ResultWriterStats *stats);
+void fprintResultWriterStats(FILE *fp, const ResultWriterStats *stats);
+
+#endif  /* _RESULT_WRITER_H_ */
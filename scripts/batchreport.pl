@@ -0,0 +1,50 @@
+#! /usr/bin/perl
+
+use warnings;
+use strict;
+
+my $usage = "usage: $0 IMAGE_DIR EVAL_LIST_FILE OUT_DIR [SQDTRT_OPTIONS...]
+Run sqdtrt over the images of EVAL_LIST_FILE with batch sizes from 1 to 16 and print
+how the detection time per image and the throughput scale with the batch size.
+
+The results of batch size N go to OUT_DIR/batchN. SQDTRT_OPTIONS (e.g. --backend=cpu
+or -w data/sqdtrt.wtb) are passed to every run. Each batch size builds its own engines
+the first time, so run the report twice, or pass --no-engine-cache to time the builds
+in neither. The sqdtrt binary is \$SQDTRT, ./sqdtrt by default.
+Set \$BATCHES to a space separated list to try other batch sizes.
+
+";
+
+my @BATCHES = split ' ', ($ENV{BATCHES} || "1 2 4 8 16");
+
+if (@ARGV < 3 || $ARGV[0] eq '-h' || $ARGV[0] eq '--help') {
+  print $usage;
+  exit;
+}
+my ($image_dir, $eval_list, $out_dir, @options) = @ARGV;
+my $sqdtrt = $ENV{SQDTRT} || "./sqdtrt";
+
+my (%fps, %detect, %imread);
+mkdir $out_dir;
+for my $batch (@BATCHES) {
+  my $dir = "$out_dir/batch$batch";
+  mkdir $dir;
+  my @cmd = ($sqdtrt, "--batch=$batch", @options, "-e", $eval_list, $image_dir, $dir);
+  print "@cmd\n";
+  open RUN, "-|", @cmd or die "Can't run ${sqdtrt}. ($!)";
+  while (<RUN>) {
+    if (/^Average timing: imread: ([\d.]+)ms detect: ([\d.]+)ms.*fps: ([\d.]+)Hz/) {
+      ($imread{$batch}, $detect{$batch}, $fps{$batch}) = ($1, $2, $3);
+    }
+  }
+  close RUN or die "${sqdtrt} failed with status $?\n";
+  die "${sqdtrt} printed no timing\n" unless defined $fps{$batch};
+}
+
+my $base = $BATCHES[0];
+printf "\n%8s %14s %14s %10s %10s\n", "batch", "imread (ms)", "detect (ms)", "fps", "speedup";
+for my $batch (@BATCHES) {
+  printf "%8d %14.2f %14.2f %10.2f %9.2fx\n", $batch, $imread{$batch}, $detect{$batch}, $fps{$batch},
+    $fps{$base} > 0 ? $fps{$batch} / $fps{$base} : 0;
+}
+print "\nimread and detect are per image, a batch shares its detect time among its images.\n";
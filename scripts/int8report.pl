@@ -0,0 +1,74 @@
+#! /usr/bin/perl
+
+use warnings;
+use strict;
+
+my $usage = "usage: $0 KITTI_DIR IMAGE_DIR EVAL_LIST_FILE OUT_DIR [SQDTRT_OPTIONS...]
+Run the cpu backend of sqdtrt over the images of EVAL_LIST_FILE in fp32 and in int8,
+evaluate both with kitti-eval/cpp/evaluate_object against the labels in KITTI_DIR/label_2,
+and print their throughput and average precisions side by side.
+
+The results of each precision go to OUT_DIR/fp32 and OUT_DIR/int8. The first int8 run
+calibrates on the same images and saves the calibration table next to the weights.
+SQDTRT_OPTIONS (e.g. --threads=8 -w data/sqdtrt.wtb) are passed to both runs.
+The sqdtrt binary is \$SQDTRT, ./sqdtrt by default.
+
+";
+
+my @PRECISIONS = ("fp32", "int8");
+my @CLASSES = ("car", "pedestrian", "cyclist");
+my @DIFFICULTIES = ("easy", "moderate", "hard");
+my $EVALUATE = "kitti-eval/cpp/evaluate_object";
+
+if (@ARGV < 4 || $ARGV[0] eq '-h' || $ARGV[0] eq '--help') {
+  print $usage;
+  exit;
+}
+my ($kitti_dir, $image_dir, $eval_list, $out_dir, @options) = @ARGV;
+my $sqdtrt = $ENV{SQDTRT} || "./sqdtrt";
+
+die "Can't find ${EVALUATE}, run make -C kitti-eval first.\n" unless -x $EVALUATE;
+open LIST, "<$eval_list" or die "Can't open file ${eval_list}. ($!)";
+my $nimages = grep { /\S/ } <LIST>;
+close LIST;
+
+my (%fps, %detect, %ap);
+mkdir $out_dir;
+for my $precision (@PRECISIONS) {
+  my $dir = "$out_dir/$precision";
+  mkdir $dir;
+  mkdir "$dir/data";
+  my @cmd = ($sqdtrt, "--backend=cpu", "--cpu-precision=$precision", @options,
+             "-e", $eval_list, $image_dir, "$dir/data");
+  print "@cmd\n";
+  open RUN, "-|", @cmd or die "Can't run ${sqdtrt}. ($!)";
+  while (<RUN>) {
+    if (/^Average timing:.*detect: ([\d.]+)ms.*fps: ([\d.]+)Hz/) {
+      ($detect{$precision}, $fps{$precision}) = ($1, $2);
+    }
+  }
+  close RUN or die "${sqdtrt} failed with status $?\n";
+  die "${sqdtrt} printed no timing\n" unless defined $fps{$precision};
+
+  system($EVALUATE, $kitti_dir, $eval_list, $dir, $nimages) == 0
+    or die "${EVALUATE} failed with status $?\n";
+  for my $class (@CLASSES) {
+    open STATS, "<$dir/stats_${class}_ap.txt" or next;
+    my @values = map { /^AP=([\d.eE+-]+)/ ? $1 : () } <STATS>;
+    close STATS;
+    $ap{$precision}{$class} = \@values;
+  }
+}
+
+printf "\n%-22s %10s %10s %10s\n", "", @PRECISIONS, "delta";
+printf "%-22s %10.2f %10.2f %+10.2f\n", "detect (ms)", $detect{fp32}, $detect{int8},
+  $detect{int8} - $detect{fp32};
+printf "%-22s %10.2f %10.2f %+10.2f\n", "fps", $fps{fp32}, $fps{int8}, $fps{int8} - $fps{fp32};
+for my $class (@CLASSES) {
+  next unless $ap{fp32}{$class} && $ap{int8}{$class};
+  for my $i (0 .. $#DIFFICULTIES) {
+    my ($a, $b) = ($ap{fp32}{$class}[$i], $ap{int8}{$class}[$i]);
+    next unless defined $a && defined $b;
+    printf "%-22s %10.4f %10.4f %+10.4f\n", "AP $class $DIFFICULTIES[$i]", $a, $b, $b - $a;
+  }
+}
@@ -0,0 +1,38 @@
+#! /usr/bin/perl
+
+use warnings;
+use strict;
+
+my $usage = "usage: $0 RESULTS_FILE RESULT_DIR
+Split RESULTS_FILE, written by sqdtrt --results-file, into one KITTI result file
+per image in RESULT_DIR, NAME.txt as sqdtrt writes them without --results-file.
+
+RESULTS_FILE has a line with the name of every image, then one line per detection
+of it, the name followed by the KITTI line.
+
+";
+
+if (@ARGV != 2 || $ARGV[0] eq '-h' || $ARGV[0] eq '--help') {
+  print $usage;
+  exit;
+}
+my ($ifname, $out_dir) = @ARGV;
+
+open INFILE, "<$ifname" or die "Can't open file ${ifname}. ($!)";
+mkdir $out_dir;
+my ($name, $nimages) = ("", 0);
+while (my $line = <INFILE>) {
+  my ($image, $result) = $line =~ /^(\S+)(?: (.*\n))?$/ or die "${ifname}:$.: not a result line\n";
+  if (!defined $result) {
+    close OUTFILE if $nimages;
+    open OUTFILE, ">$out_dir/$image.txt" or die "Can't open file ${out_dir}/${image}.txt. ($!)";
+    ($name, $nimages) = ($image, $nimages + 1);
+  } elsif ($image eq $name) {
+    print OUTFILE $result;
+  } else {
+    die "${ifname}:$.: a result of ${image} after the name of ${name}\n";
+  }
+}
+close OUTFILE if $nimages;
+close INFILE;
+print "$nimages images\n";
@@ -0,0 +1,72 @@
+#! /usr/bin/perl
+
+use warnings;
+use strict;
+
+my $usage = "usage: $0 SOURCE DEST\n" .
+'Convert a text weight file SOURCE (.wts, generated by wtsgen.pl) to a binary
+weight file DEST (.wtb), which sqdtrt maps into memory without parsing.
+
+Layout (little-endian): 64-byte header, 32-byte entry per tensor, NUL-terminated
+name table, then the tensor payloads, each aligned to 64 bytes.
+
+';
+
+my $MAGIC = "SQDW";
+my $VERSION = 1;
+my $ALIGNMENT = 64;
+my $HEADER_SIZE = 64;
+my $ENTRY_SIZE = 32;
+my %TYPE_SIZE = (0 => 4, 1 => 2, 2 => 1);
+my %TYPE_PACK = (0 => "V*", 1 => "v*", 2 => "C*");
+
+if (@ARGV != 2 || $ARGV[0] eq '-h' || $ARGV[0] eq '--help') {
+  print $usage;
+  exit;
+}
+my ($ifname, $ofname) = @ARGV;
+
+open INFILE, "<$ifname" or die "Can't open file ${ifname}. ($!)";
+my @tokens = split /\s+/, do { local $/; <INFILE> };
+close INFILE;
+shift @tokens if @tokens && $tokens[0] eq '';
+
+my $nweight = shift @tokens;
+my (@names, @types, @payloads);
+for (1 .. $nweight) {
+  my $name = shift @tokens;
+  my $type = shift @tokens;
+  my $size = shift @tokens;
+  die "${ifname}: truncated at tensor $_\n" unless defined $size && @tokens >= $size;
+  die "${ifname}: unsupported type $type of $name\n" unless exists $TYPE_PACK{$type};
+  my @hex = splice @tokens, 0, $size;
+  push @names, $name;
+  push @types, $type;
+  push @payloads, pack($TYPE_PACK{$type}, map { hex } @hex);
+  print "Converting ${name}...done\n";
+}
+
+sub align { my $n = shift; return int(($n + $ALIGNMENT - 1) / $ALIGNMENT) * $ALIGNMENT; }
+
+my $entries_offset = $HEADER_SIZE;
+my $names_offset = $entries_offset + $ENTRY_SIZE * $nweight;
+my $names = join "", map { "$_\0" } @names;
+my $offset = align($names_offset + length $names);
+my ($entries, $data) = ("", "");
+my $name_offset = 0;
+for my $i (0 .. $nweight - 1) {
+  my $count = length($payloads[$i]) / $TYPE_SIZE{$types[$i]};
+  $entries .= pack "V V Q< Q< Q<", $name_offset, $types[$i], $count, $offset, 0;
+  $name_offset += length($names[$i]) + 1;
+  my $padded = align(length $payloads[$i]);
+  $data .= $payloads[$i] . ("\0" x ($padded - length $payloads[$i]));
+  $offset += $padded;
+}
+my $header = pack "a4 V V V Q< Q< Q< Q< Q< Q<", $MAGIC, $VERSION, $nweight, $ALIGNMENT,
+  $entries_offset, $names_offset, length $names, $offset, 0, 0;
+my $pad = align($names_offset + length $names) - ($names_offset + length $names);
+
+open OUTFILE, ">$ofname" or die "Can't open file ${ofname}. ($!)";
+binmode OUTFILE;
+print OUTFILE $header, $entries, $names, "\0" x $pad, $data;
+close OUTFILE;
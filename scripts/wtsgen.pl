@@ -7,13 +7,34 @@ my $usage ="usage: $0 -t TYPE -o DEST SOURCE(s)\n" .
 'Convert input tensor file SOURCE(s) to one output weight file DEST to be used by TensorRT.
 
 [options]
-  -t, --type	weights data type, allowed 0 (float), 1 (half), 2 (int8), currently only support 0
+  -t, --type	weights data type, allowed 0 (float), 1 (half), 2 (int8),
+		currently only support 0 and 1
   -o, --out	followed by output file name
 
 Author: Zhao Zhixu
 ';
 my $ofname = "out.wts";
 my $type = "0";
+
+# IEEE half bits of a float, rounded to nearest even like F16C
+sub float_to_half {
+  my $x = unpack("L", pack("f", $_[0]));
+  my $sign = ($x >> 16) & 0x8000;
+  my $abs = $x & 0x7fffffff;
+  return $sign | 0x7e00 | (($abs >> 13) & 0x3ff) if $abs > 0x7f800000;
+  return $sign | 0x7c00 if $abs >= 0x477ff000;
+  if ($abs < 0x38800000) {
+    my $m = abs(unpack("f", pack("L", $abs))) * 16777216;
+    my $h = int($m);
+    my $rem = $m - $h;
+    $h++ if $rem > 0.5 || ($rem == 0.5 && ($h & 1));
+    return $sign | $h;
+  }
+  my $h = ($abs - 0x38000000) >> 13;
+  my $rem = $abs & 0x1fff;
+  $h++ if $rem > 0x1000 || ($rem == 0x1000 && ($h & 1));
+  return $sign | $h;
+}
 if (@ARGV == 0) {
   print $usage;
   exit;
@@ -25,6 +46,7 @@ while (my $opt = shift @ARGV) {
   }
   elsif ($opt eq '-t' || $opt eq '--type') {
     $type = shift @ARGV;
+    die "unsupported weights data type ${type}\n" unless $type eq "0" || $type eq "1";
   }
   elsif ($opt eq '-o' || $opt eq '--out') {
     $ofname = shift @ARGV;
@@ -58,7 +80,11 @@ while (my $fname = shift @ARGV) {
   $wname =~ s|.*/||;
   print OUTFILE "$wname $type $nfloat";
   foreach (@floats) {
-    push @outputs, join "", reverse split /(?=[0-9a-fA-F])/, unpack("h*", pack("f*", $_));
+    if ($type eq "1") {
+      push @outputs, sprintf("%x", float_to_half($_));
+    } else {
+      push @outputs, join "", reverse split /(?=[0-9a-fA-F])/, unpack("h*", pack("f*", $_));
+    }
   }
   print OUTFILE " " . (join " ", @outputs) . "\n";
   print "done\n";
@@ -29,6 +29,20 @@ void *sdt_alloc(size_t size)
      return p;
 }
 
+/* alignment must be a power of two multiple of sizeof(void *), free with sdt_free */
+void *sdt_aligned_alloc(size_t alignment, size_t size)
+{
+     void *p;
+     int ret;
+
+     if ((ret = posix_memalign(&p, alignment, size)) != 0) {
+          errno = ret;
+          err(EXIT_FAILURE, "posix_memalign(%lu, %lu) failed", alignment, size);
+     }
+
+     return p;
+}
+
 char *sdt_path_alloc(size_t *sizep)
 {
      char *ptr;
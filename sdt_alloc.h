@@ -4,6 +4,7 @@
 #include <stdlib.h>
 
 void *sdt_alloc(size_t size);
+void *sdt_aligned_alloc(size_t alignment, size_t size);
 char *sdt_path_alloc(size_t *sizep);
 
 #define sdt_free free
@@ -19,22 +19,40 @@
 
 // #define _GNU_SOURCE
 #include <getopt.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "common.h"
 #include "tensorUtil.h"
 #include "trtUtil.h"
+#include "engineCache.h"
+#include "cpuEngine.h"
+#include "cpuOps.h"
+#include "pipeline.h"
+#include "detection.h"
+#include "inputCache.h"
+#include "resultWriter.h"
+#include "tensorArena.h"
+#include "tensorHost.h"
+#include "trace.h"
 #include "sdt_alloc.h"
 
 static Logger gLogger;
 
-static const int INPUT_N = 1;   // one image at a time
 static const int INPUT_C = 3;
-static const int INPUT_H = 384;
-static const int INPUT_W = 1248;
+static const int TRAIN_INPUT_H = 384; // the resolution the weights and ANCHOR_SHAPE are for
+static const int TRAIN_INPUT_W = 1248;
+
+// The version of the networks of createConvEngine() and createInterpretEngine(), in the
+// engine cache key. Bump it with any change to either graph, or the cached engines of the
+// old one are loaded. 2: the interpret engine takes one image of the batch.
+static const int NETWORK_VERSION = 2;
 
 static const int CONVOUT_C = 72;
-static const int CONVOUT_H = 24;
-static const int CONVOUT_W = 78;
+static const int MIN_INPUT_SIZE = 16; // one conv_out cell
+// kernel, stride and padding of conv1, pool1, pool3 and pool5, the layers that shrink the grid
+static const int STRIDED_LAYERS[][3] = {{3, 2, 1}, {3, 2, 1}, {3, 2, 1}, {3, 2, 1}};
 
 static const int CLASS_SLICE_C = 27;
 static const int CONF_SLICE_C = 9;
@@ -48,8 +66,10 @@ static const float NMS_THRESH = 0.4;
 // static const float PROB_THRESH = 0.005;
 static const float PROB_THRESH = 0.3;
 static const float PLOT_PROB_THRESH = 0.4;
+static const int TRANS_AXES[] = {0, 3, 4, 1, 2}; // [N, B, C, H, W] to [N, H, W, B, C]
 // static const float EPSILON = 1e-16;
 
+static const char* WEIGHTS_NAME = "sqdtrt.wts";
 static const char* INPUT_NAME = "data";
 static const char* CONVOUT_NAME = "conv_out";
 static const char* CLASS_INPUT_NAME = "class_slice";
@@ -72,45 +92,57 @@ static const float PIXEL_MEAN[3]{ 103.939f, 116.779f, 123.68f }; // in BGR order
 
 static const double DEFAULT_FPS = 10;
 
-struct predictions {
-     float *klass;
-     float *prob;
-     float *bbox;
-     int *keep;
-     int num;
-};
+// --batch runs at most this many images through the pipeline at once
+static const int MAX_BATCH = 64;
 
+// default worker counts of the decode, preprocess and postprocess stages of --pipeline
+static const int PIPELINE_WORKERS[3] = {2, 2, 1};
+
+// --check-cpu reports a mismatch if max |cpu - trt| exceeds this fraction of max |trt|
+static const float CPU_CHECK_TOLERANCE = 1e-3;
+
+static int inputH = TRAIN_INPUT_H, inputW = TRAIN_INPUT_W; // --input-size
+static int convoutH, convoutW; // the grid of conv_out for inputH x inputW, see gridSize()
 static int anchorsNum;
 static int inputIndex, convoutIndex, classInputIndex, confInputIndex, classOutputIndex, confOutputIndex;
 
-// device buffers
+// device buffers, all in deviceArena
+static TensorArena *deviceArena;
 static void *convBuffers[2], *interpretBuffers[4];
-static float *bboxInput; // don't need to go into interpret engine
-static int *transAxesDevice;
 static Tensor *convoutTensor;
-static Tensor *classInputTensor;
+static Tensor *classInputTensor; // the interpret engine takes copies of the slices, dense and aligned
 static Tensor *confInputTensor;
-static Tensor *bboxInputTensor;
 static Tensor *classOutputTensor;
 static Tensor *confOutputTensor;
-static Tensor *bboxOutputTensor;
+static Tensor *bboxOutputTensor; // the views from here to anchorsDeviceTensor share the memory of others
 static Tensor *classTransTensor;
 static Tensor *confTransTensor;
 static Tensor *bboxTransTensor;
-static int *classTransWorkspace[2], *confTransWorkspace[2], *bboxTransWorkspace[2];
-static float *anchorsDevice;
+static Tensor *anchorsDeviceTensor; // the anchor grid broadcast to the batch
 static Tensor *reduceMaxResTensor;
 static Tensor *reduceArgResTensor;
 static Tensor *mulResTensor;
 static Tensor *bboxResTensor;
-static Tensor *anchorsDeviceTensor;
-static int *orderDevice, *orderDeviceTmp; // for top-n-detecion
+static int *topIdxDevice; // positions of the top-n-detection of every image in the batch
+static float *imgSizesDevice; // original {width, height} of every image in the batch
 static Tensor *finalClassTensor;
 static Tensor *finalProbsTensor;
 static Tensor *finalBboxTensor;
+static CpuEngine *cpuEngine; // NULL unless --backend=cpu or --check-cpu
+static float *convoutHost;
+// host buffers of --backend=cpu, all in hostArena but convoutHostTensor, the data of convoutHost
+static TensorArena *hostArena; // NULL with the TensorRT backend
+static Tensor *convoutHostTensor;
+static Tensor *anchorsHostTensor; // a view, the anchor grid broadcast to the batch
+static Tensor *scoresHostTensor;
+static Tensor *classHostTensor;
+static Tensor *bboxHostTensor;
+static int *topIdxHost;
 static cudaStream_t stream;
-static cudaEvent_t start_imread, stop_imread, start_detect, stop_detect, start_misc, stop_misc;
-static float timeDetect, timeImread, timeMisc;
+static double timeDetect; // ms of the last doInference()
+static int unfusedPostprocess; // --postprocess=unfused, the reference for interpretConvout()
+static InputCache *inputCache; // NULL unless --input-cache
+static float scoreFloor; // PROB_THRESH with --score-floor, scores are products of probabilities otherwise >= 0
 
 std::string locateFile(const std::string& input)
 {
@@ -149,16 +181,33 @@ addFireLayer(INetworkDefinition* network, ITensor &input, int ns1x1, int ne1x1,
      return concat;
 }
 
+static_assert(WEIGHTS_FLOAT == static_cast<int>(DataType::kFLOAT) &&
+              WEIGHTS_HALF == static_cast<int>(DataType::kHALF) &&
+              WEIGHTS_INT8 == static_cast<int>(DataType::kINT8), "WeightsType must match nvinfer1::DataType");
+
+// the weights as TensorRT takes them, the values are not copied
+static std::map<std::string, Weights> trtWeights(const WeightMap &weightMap)
+{
+     std::map<std::string, Weights> trt;
+     for (auto &mem : weightMap)
+          trt[mem.first] = Weights{static_cast<DataType>(mem.second.type), mem.second.values, mem.second.count};
+     return trt;
+}
+
 // Creat the Engine using only the API and not any parser.
 ICudaEngine *
-createConvEngine(unsigned int maxBatchSize, IBuilder *builder, DataType dt)
+createConvEngine(unsigned int maxBatchSize, IBuilder *builder, DataType dt, const std::string &weightsFile)
 {
      INetworkDefinition* network = builder->createNetwork();
 
-     auto data = network->addInput(INPUT_NAME, dt, DimsCHW{INPUT_C, INPUT_H, INPUT_W});
+     auto data = network->addInput(INPUT_NAME, dt, DimsCHW{INPUT_C, inputH, inputW});
      assert(data != nullptr);
 
-     std::map<std::string, Weights> weightMap = loadWeights(locateFile("sqdtrt.wts"));
+     double start = getUnixTime();
+     WeightMap hostWeights = loadWeights(weightsFile);
+     std::map<std::string, Weights> weightMap = trtWeights(hostWeights);
+     printf("loaded %s weights %s in %.2fms\n", isBinaryWeightsFile(weightsFile) ? "mapped" : "text",
+            weightsFile.c_str(), (getUnixTime() - start) * 1000);
      auto conv1 = network->addConvolution(*data, 64, DimsHW{3, 3},
                                           weightMap["conv1_kernels"],
                                           weightMap["conv1_bias"]);
@@ -280,10 +329,7 @@ createConvEngine(unsigned int maxBatchSize, IBuilder *builder, DataType dt)
      // network->destroy();	// SIGSEGV, don't know why
 
      // Once we have built the cuda engine, we can release all of our held memory.
-     for (auto &mem : weightMap)
-     {
-          sdt_free((void*)(mem.second.values));
-     }
+     freeWeights(hostWeights);
      return engine;
 }
 
@@ -292,10 +338,10 @@ createInterpretEngine(unsigned int maxBatchSize, IBuilder *builder, DataType dt)
 {
      INetworkDefinition* network = builder->createNetwork();
 
-     auto class_tensor = network->addInput(CLASS_INPUT_NAME, dt, DimsNCHW{ANCHORS_PER_GRID, OUTPUT_CLS_SIZE, CONVOUT_H, CONVOUT_W});
+     auto class_tensor = network->addInput(CLASS_INPUT_NAME, dt, DimsNCHW{ANCHORS_PER_GRID, OUTPUT_CLS_SIZE, convoutH, convoutW});
      assert(class_tensor != nullptr);
-     // auto confidence_tensor = network->addInput(CONF_INPUT_NAME, dt, DimsNCHW{INPUT_N, 1, 1, CONVOUT_W * CONVOUT_H * ANCHORS_PER_GRID});
-     auto confidence_tensor = network->addInput(CONF_INPUT_NAME, dt, DimsCHW{1, 1, INPUT_N * CONVOUT_W * CONVOUT_H * ANCHORS_PER_GRID});
+     // one image of the batch, which is implicit
+     auto confidence_tensor = network->addInput(CONF_INPUT_NAME, dt, DimsCHW{1, 1, convoutW * convoutH * ANCHORS_PER_GRID});
      assert(confidence_tensor != nullptr);
 
      auto class_softmax = network->addSoftMax(*class_tensor);
@@ -320,13 +366,13 @@ createInterpretEngine(unsigned int maxBatchSize, IBuilder *builder, DataType dt)
 }
 
 // maxBatch - NB must be at least as large as the batch we want to run with)
-void APIToModel(unsigned int maxBatchSize, IHostMemory **convModelStream, IHostMemory **interpretModelStream)
+void APIToModel(unsigned int maxBatchSize, const std::string &weightsFile, IHostMemory **convModelStream, IHostMemory **interpretModelStream)
 {
      // create the builder
      IBuilder* builder = createInferBuilder(gLogger);
 
      // create the model to populate the network, then set the outputs and create an engine
-     ICudaEngine* convEngine = createConvEngine(maxBatchSize, builder, DataType::kFLOAT);
+     ICudaEngine* convEngine = createConvEngine(maxBatchSize, builder, DataType::kFLOAT, weightsFile);
      ICudaEngine* interpretEngine = createInterpretEngine(maxBatchSize, builder, DataType::kFLOAT);
 
      assert(convEngine != nullptr);
@@ -340,8 +386,84 @@ void APIToModel(unsigned int maxBatchSize, IHostMemory **convModelStream, IHostM
      builder->destroy();
 }
 
-// batch size is 1
-void setUpDevice(IExecutionContext *convContext, IExecutionContext *interpretContext, float* anchors, int batchSize)
+// Deserialize the engines from cache_dir if a matching cache exists, otherwise build them
+// and fill the cache. A NULL cache_dir disables the cache, rebuild ignores existing entries.
+void loadEngines(IRuntime *runtime, const std::string &weightsFile, unsigned int maxBatchSize,
+                 const char *cache_dir, int rebuild, ICudaEngine **convEngine, ICudaEngine **interpretEngine)
+{
+     EngineCacheKey key;
+     char *cache_path = NULL;
+     void *convBlob, *interpretBlob;
+     size_t convBlobSize, interpretBlobSize;
+     double start = getUnixTime();
+
+     if (cache_dir) {
+          initEngineCacheKey(&key, weightsFile.c_str(), NETWORK_VERSION, maxBatchSize, INPUT_C, inputH, inputW,
+                             DataType::kFLOAT);
+          cache_path = sdt_path_alloc(NULL);
+          engineCachePath(cache_path, cache_dir, &key);
+          if (!rebuild && loadEngineCache(cache_path, &key, &convBlob, &convBlobSize, &interpretBlob, &interpretBlobSize)) {
+               *convEngine = runtime->deserializeCudaEngine(convBlob, convBlobSize, nullptr);
+               *interpretEngine = runtime->deserializeCudaEngine(interpretBlob, interpretBlobSize, nullptr);
+               sdt_free(convBlob);
+               sdt_free(interpretBlob);
+               if (*convEngine != nullptr && *interpretEngine != nullptr) {
+                    printf("engine cache hit: %s (loaded in %.2fms)\n", cache_path, (getUnixTime() - start) * 1000);
+                    sdt_free(cache_path);
+                    return;
+               }
+               fprintf(stderr, "Warning: cannot deserialize engines in %s, rebuilding\n", cache_path);
+               if (*convEngine != nullptr)
+                    (*convEngine)->destroy();
+               if (*interpretEngine != nullptr)
+                    (*interpretEngine)->destroy();
+          }
+     }
+
+     IHostMemory *convModelStream{ nullptr };
+     IHostMemory *interpretModelStream{ nullptr };
+     APIToModel(maxBatchSize, weightsFile, &convModelStream, &interpretModelStream);
+     *convEngine = runtime->deserializeCudaEngine(convModelStream->data(), convModelStream->size(), nullptr);
+     *interpretEngine = runtime->deserializeCudaEngine(interpretModelStream->data(), interpretModelStream->size(), nullptr);
+     assert(*convEngine != nullptr && *interpretEngine != nullptr);
+
+     if (cache_dir) {
+          printf("engine cache %s: %s (built in %.2fms)\n", rebuild ? "rebuild" : "miss",
+                 cache_path, (getUnixTime() - start) * 1000);
+          if (!saveEngineCache(cache_path, &key, convModelStream, interpretModelStream))
+               fprintf(stderr, "Warning: cannot save engine cache %s\n", cache_path);
+          sdt_free(cache_path);
+     } else {
+          printf("engine cache disabled (built in %.2fms)\n", (getUnixTime() - start) * 1000);
+     }
+     convModelStream->destroy();
+     interpretModelStream->destroy();
+}
+
+// the steps of doInference() in order, a device buffer only takes memory from the
+// first step using it through the last
+enum {
+     STEP_INPUT,                // input and image sizes to the device
+     STEP_CONV,                 // conv engine, or the cpu engine
+     STEP_SLICE,                // slices of conv_out, or the fused interpretConvout()
+     STEP_INTERPRET,            // interpret engine
+     STEP_REDUCE,
+     STEP_MULTIPLY,
+     STEP_BBOX,
+     STEP_TOPK,
+     STEP_PICK,
+     STEP_OUTPUT                // final tensors to the host, and the conv_out for --check-cpu
+};
+
+// step of a buffer only the unfused post-processing uses
+static int unfusedStep(int step)
+{
+     return unfusedPostprocess ? step : -1;
+}
+
+// every tensor holds batchSize images, the first dimension, anchors is the grid of one image
+void setUpDevice(IExecutionContext *convContext, IExecutionContext *interpretContext, float* anchors, int batchSize,
+                 int checkCpu)
 {
      const ICudaEngine &convEngine = convContext->getEngine();
      const ICudaEngine &interpretEngine = interpretContext->getEngine();
@@ -358,317 +480,312 @@ void setUpDevice(IExecutionContext *convContext, IExecutionContext *interpretCon
      classOutputIndex = interpretEngine.getBindingIndex(CLASS_OUTPUT_NAME);
      confOutputIndex = interpretEngine.getBindingIndex(CONF_OUTPUT_NAME);
 
-     // create GPU buffers and a stream
-     anchorsNum = batchSize * CONVOUT_W * CONVOUT_H * ANCHORS_PER_GRID;
-     size_t inputSize = batchSize * INPUT_C * INPUT_H * INPUT_W * sizeof(float);
-     size_t convoutSize = batchSize * CONVOUT_H * CONVOUT_W * CONVOUT_C * sizeof(float);
-     size_t classInputSize = batchSize * CONVOUT_H * CONVOUT_W * CLASS_SLICE_C * sizeof(float);
-     size_t confInputSize = batchSize * CONVOUT_H * CONVOUT_W * CONF_SLICE_C * sizeof(float);
-     size_t bboxInputSize = batchSize * CONVOUT_H * CONVOUT_W * BBOX_SLICE_C * sizeof(float);
-     size_t classOutputSize = batchSize * OUTPUT_CLS_SIZE * anchorsNum * sizeof(float);
-     size_t confOutputSize = anchorsNum * sizeof(float);
-     CHECK(cudaMalloc(&convBuffers[inputIndex], inputSize));
-     CHECK(cudaMalloc(&convBuffers[convoutIndex], convoutSize));
-     CHECK(cudaMalloc(&interpretBuffers[classInputIndex], classInputSize));
-     CHECK(cudaMalloc(&interpretBuffers[confInputIndex], confInputSize));
-     CHECK(cudaMalloc(&bboxInput, bboxInputSize));
-     CHECK(cudaMalloc(&interpretBuffers[classOutputIndex], classOutputSize));
-     CHECK(cudaMalloc(&interpretBuffers[confOutputIndex], confOutputSize));
-
-     int convout_dims[] = {batchSize, CONVOUT_C, CONVOUT_H, CONVOUT_W};
-     int classInputDims[] = {batchSize, CLASS_SLICE_C, CONVOUT_H, CONVOUT_W};
-     int confInputDims[] = {batchSize, CONF_SLICE_C, CONVOUT_H, CONVOUT_W};
-     int bboxInputDims[] = {batchSize, BBOX_SLICE_C, CONVOUT_H, CONVOUT_W};
-     int classOutputDims[] = {batchSize, ANCHORS_PER_GRID, OUTPUT_CLS_SIZE, CONVOUT_H, CONVOUT_W};
-     int classTransDims[] = {batchSize, CONVOUT_H, CONVOUT_W, ANCHORS_PER_GRID, OUTPUT_CLS_SIZE};
-     int confOutputDims[] = {batchSize, ANCHORS_PER_GRID, 1, CONVOUT_H, CONVOUT_W};
-     int confTransDims[] = {batchSize, CONVOUT_H, CONVOUT_W, ANCHORS_PER_GRID, 1};
-     int bboxOutputDims[] = {batchSize, ANCHORS_PER_GRID, OUTPUT_BBOX_SIZE, CONVOUT_H, CONVOUT_W};
-     int bboxTransDims[] = {batchSize, CONVOUT_H, CONVOUT_W, ANCHORS_PER_GRID, OUTPUT_BBOX_SIZE};
-     int transAxes[] = {0, 3, 4, 1, 2};
-     transAxesDevice = (int *)cloneMem(transAxes, sizeof(int) * 5, H2D);
-     convoutTensor = createTensor((float *)convBuffers[convoutIndex], 4, convout_dims);
-     classInputTensor = createTensor((float *)interpretBuffers[classInputIndex], 4, classInputDims);
-     confInputTensor = createTensor((float *)interpretBuffers[confInputIndex], 4, confInputDims);
-     bboxInputTensor = createTensor(bboxInput, 4, bboxInputDims);
-     classOutputTensor = createTensor((float *)interpretBuffers[classOutputIndex], 5, classOutputDims);
-     confOutputTensor = createTensor((float *)interpretBuffers[confOutputIndex], 5, confOutputDims);
-     bboxOutputTensor = reshapeTensor(bboxInputTensor, 5, bboxOutputDims);
-     classTransTensor = mallocTensor(5, classTransDims, DEVICE);
-     confTransTensor = mallocTensor(5, confTransDims, DEVICE);
-     bboxTransTensor = mallocTensor(5, bboxTransDims, DEVICE);
-     CHECK(cudaMalloc(&classTransWorkspace[0], sizeof(int) * classTransTensor->ndim * classTransTensor->len));
-     CHECK(cudaMalloc(&classTransWorkspace[1], sizeof(int) * classTransTensor->ndim * classTransTensor->len));
-     CHECK(cudaMalloc(&confTransWorkspace[0], sizeof(int) * confTransTensor->ndim * confTransTensor->len));
-     CHECK(cudaMalloc(&confTransWorkspace[1], sizeof(int) * confTransTensor->ndim * confTransTensor->len));
-     CHECK(cudaMalloc(&bboxTransWorkspace[0], sizeof(int) * bboxTransTensor->ndim * bboxTransTensor->len));
-     CHECK(cudaMalloc(&bboxTransWorkspace[1], sizeof(int) * bboxTransTensor->ndim * bboxTransTensor->len));
-
-     size_t anchorsDeviceSize = anchorsNum * ANCHOR_SIZE * sizeof(float);
-     anchorsDevice = (float *)cloneMem(anchors, anchorsDeviceSize, H2D);
-
-     int reduceMaxResDims[] = {batchSize, CONVOUT_H, CONVOUT_W, ANCHORS_PER_GRID, 1};
-     int reduceArgResDims[] = {batchSize, CONVOUT_H, CONVOUT_W, ANCHORS_PER_GRID, 1};
-     int mulResDims[] = {batchSize, CONVOUT_H, CONVOUT_W, ANCHORS_PER_GRID, 1};
-     int bboxResDims[] = {batchSize, CONVOUT_H, CONVOUT_W, ANCHORS_PER_GRID, OUTPUT_BBOX_SIZE};
-     // int anchorsDeviceDims[] = {batchSize, ANCHORS_PER_GRID, ANCHOR_SIZE, CONVOUT_H, CONVOUT_W};
-     int anchorsDeviceDims[] = {batchSize, CONVOUT_H, CONVOUT_W, ANCHORS_PER_GRID, ANCHOR_SIZE};
-     reduceMaxResTensor = mallocTensor(5, reduceMaxResDims, DEVICE);
-     reduceArgResTensor = mallocTensor(5, reduceArgResDims, DEVICE);
-     mulResTensor = mallocTensor(5, mulResDims, DEVICE);
-     bboxResTensor = mallocTensor(5, bboxResDims, DEVICE);
-     anchorsDeviceTensor = createTensor(anchorsDevice, 5, anchorsDeviceDims);
-
-     int *orderHost = (int *)sdt_alloc(anchorsNum * sizeof(int));
-     for (int i = 0; i < anchorsNum; i++)
-          orderHost[i] = i;
-     orderDevice = (int *)cloneMem(orderHost, anchorsNum * sizeof(int), H2D);
-     orderDeviceTmp = (int *)cloneMem(orderHost, anchorsNum * sizeof(int), H2D);
-     sdt_free(orderHost);
+     // the steps of every buffer, unused ones get first < 0: everything between conv_out
+     // and the scores with the fused post-processing
+     int scoresStep = unfusedPostprocess ? STEP_MULTIPLY : STEP_SLICE;
+     int classStep = unfusedPostprocess ? STEP_REDUCE : STEP_SLICE;
+     int bboxStep = unfusedPostprocess ? STEP_BBOX : STEP_SLICE;
+     // the unfused bboxes are read from conv_out through views
+     int convoutStep = checkCpu ? STEP_OUTPUT : bboxStep;
+
+     anchorsNum = batchSize * convoutW * convoutH * ANCHORS_PER_GRID;
+     deviceArena = createArena(DEVICE, 32);
+#ifdef DEBUG
+     deviceArena->reuse = 0; // every tensor is saved after the inference
+#endif
+     int inputDims[] = {batchSize, INPUT_C, inputH, inputW};
+     int convout_dims[] = {batchSize, CONVOUT_C, convoutH, convoutW};
+     int convoutBboxDims[] = {batchSize, CONVOUT_C / OUTPUT_BBOX_SIZE, OUTPUT_BBOX_SIZE, convoutH, convoutW};
+     int classInputDims[] = {batchSize, CLASS_SLICE_C, convoutH, convoutW};
+     int confInputDims[] = {batchSize, CONF_SLICE_C, convoutH, convoutW};
+     int classOutputDims[] = {batchSize, ANCHORS_PER_GRID, OUTPUT_CLS_SIZE, convoutH, convoutW};
+     int confOutputDims[] = {batchSize, ANCHORS_PER_GRID, 1, convoutH, convoutW};
+     Tensor *inputTensor = arenaTensor(deviceArena, "input", 4, inputDims, STEP_INPUT, STEP_CONV);
+     convoutTensor = arenaTensor(deviceArena, "convout", 4, convout_dims, STEP_CONV, convoutStep);
+     classInputTensor = arenaTensor(deviceArena, "classInput", 4, classInputDims, unfusedStep(STEP_SLICE), STEP_INTERPRET);
+     confInputTensor = arenaTensor(deviceArena, "confInput", 4, confInputDims, unfusedStep(STEP_SLICE), STEP_INTERPRET);
+     classOutputTensor = arenaTensor(deviceArena, "classOutput", 5, classOutputDims,
+                                     unfusedStep(STEP_INTERPRET), STEP_REDUCE);
+     confOutputTensor = arenaTensor(deviceArena, "confOutput", 5, confOutputDims,
+                                    unfusedStep(STEP_INTERPRET), STEP_MULTIPLY);
+
+     int reduceMaxResDims[] = {batchSize, convoutH, convoutW, ANCHORS_PER_GRID, 1};
+     int reduceArgResDims[] = {batchSize, convoutH, convoutW, ANCHORS_PER_GRID, 1};
+     int mulResDims[] = {batchSize, convoutH, convoutW, ANCHORS_PER_GRID, 1};
+     int bboxResDims[] = {batchSize, convoutH, convoutW, ANCHORS_PER_GRID, OUTPUT_BBOX_SIZE};
+     // int anchorsDeviceDims[] = {batchSize, ANCHORS_PER_GRID, ANCHOR_SIZE, convoutH, convoutW};
+     int anchorsDeviceDims[] = {batchSize, convoutH, convoutW, ANCHORS_PER_GRID, ANCHOR_SIZE};
+     int anchorGridDims[] = {1, convoutH, convoutW, ANCHORS_PER_GRID, ANCHOR_SIZE};
+     reduceMaxResTensor = arenaTensor(deviceArena, "reduceMaxRes", 5, reduceMaxResDims,
+                                      unfusedStep(STEP_REDUCE), STEP_MULTIPLY);
+     reduceArgResTensor = arenaTensor(deviceArena, "reduceArgRes", 5, reduceArgResDims, classStep, STEP_PICK);
+     mulResTensor = arenaTensor(deviceArena, "mulRes", 5, mulResDims, scoresStep, STEP_TOPK);
+     bboxResTensor = arenaTensor(deviceArena, "bboxRes", 5, bboxResDims, bboxStep, STEP_PICK);
+     // the anchor grid of one image is copied once, for all the inferences
+     Tensor *anchorGridTensor = arenaTensor(deviceArena, "anchors", 5, anchorGridDims, STEP_INPUT, STEP_OUTPUT);
+
+     arenaAdd(deviceArena, "topIdx", (void **)&topIdxDevice, batchSize * TOP_N_DETECTION * sizeof(int),
+              STEP_TOPK, STEP_PICK);
+     arenaAdd(deviceArena, "imgSizes", (void **)&imgSizesDevice, batchSize * 2 * sizeof(float),
+              STEP_INPUT, bboxStep);
 
      int finalProbsDims[] = {batchSize, TOP_N_DETECTION, 1};
      int finalClassDims[] = {batchSize, TOP_N_DETECTION, 1};
      int finalBboxDims[] = {batchSize, TOP_N_DETECTION, OUTPUT_BBOX_SIZE};
-     // finalProbsTensor shares data with mulResTensor
-     finalProbsTensor = createTensor(mulResTensor->data, 3, finalProbsDims);
-     // finalProbsTensor = mallocTensor(3, finalProbsDims, DEVICE);
-     finalClassTensor = mallocTensor(3, finalClassDims, DEVICE);
-     finalBboxTensor = mallocTensor(3, finalBboxDims, DEVICE);
+     finalProbsTensor = arenaTensor(deviceArena, "finalProbs", 3, finalProbsDims, STEP_TOPK, STEP_OUTPUT);
+     finalClassTensor = arenaTensor(deviceArena, "finalClass", 3, finalClassDims, STEP_PICK, STEP_OUTPUT);
+     finalBboxTensor = arenaTensor(deviceArena, "finalBbox", 3, finalBboxDims, STEP_PICK, STEP_OUTPUT);
+
+     // one cudaMalloc for all of them
+     allocArena(deviceArena);
+     fprintArena(stdout, deviceArena);
+     CHECK(cudaMemcpy(anchorGridTensor->data, anchors, anchorGridTensor->len * sizeof(float), cudaMemcpyHostToDevice));
+
+     // the views, no memory of their own
+     Tensor *convoutBbox = reshapeTensor(convoutTensor, 5, convoutBboxDims);
+     bboxOutputTensor = sliceTensorView(convoutBbox, 1, (CLASS_SLICE_C + CONF_SLICE_C) / OUTPUT_BBOX_SIZE,
+                                        BBOX_SLICE_C / OUTPUT_BBOX_SIZE);
+     freeTensor(convoutBbox, 0);
+     classTransTensor = permuteTensorView(classOutputTensor, TRANS_AXES);
+     confTransTensor = permuteTensorView(confOutputTensor, TRANS_AXES);
+     bboxTransTensor = permuteTensorView(bboxOutputTensor, TRANS_AXES);
+     anchorsDeviceTensor = broadcastTensorView(anchorGridTensor, 5, anchorsDeviceDims);
+
+     convBuffers[inputIndex] = inputTensor->data;
+     convBuffers[convoutIndex] = convoutTensor->data;
+     interpretBuffers[classInputIndex] = classInputTensor->data;
+     interpretBuffers[confInputIndex] = confInputTensor->data;
+     interpretBuffers[classOutputIndex] = classOutputTensor->data;
+     interpretBuffers[confOutputIndex] = confOutputTensor->data;
 
      CHECK(cudaStreamCreate(&stream));
-     CHECK(cudaEventCreate(&start_imread));
-     CHECK(cudaEventCreate(&stop_imread));
-     CHECK(cudaEventCreate(&start_detect));
-     CHECK(cudaEventCreate(&stop_detect));
-     CHECK(cudaEventCreate(&start_misc));
-     CHECK(cudaEventCreate(&stop_misc));
 }
 
-// batch size is 1
-void doInference(IExecutionContext *convContext, IExecutionContext *interpretContext, float* input, int inputSize, int img_width, int img_height, int x_shift, int y_shift, struct predictions *preds, int batchSize)
+// The buffers of the cpu backend, which runs the convolutions and the fused post-processing
+// on the host without CUDA, conv_out is convoutHost. Every tensor holds batchSize images,
+// anchors is the grid of one image.
+void setUpHost(const float *anchors, int batchSize)
 {
-     CHECK(cudaEventRecord(start_detect, 0));
-
-     // DMA the input to the GPU,  execute the batch asynchronously, and DMA it back:
-     CHECK(cudaMemcpyAsync(convBuffers[inputIndex], input, inputSize, cudaMemcpyHostToDevice, stream));
-
-     convContext->enqueue(batchSize, convBuffers, stream, nullptr);
-     sliceTensor(convoutTensor, classInputTensor, 1, 0, CLASS_SLICE_C);
-     sliceTensor(convoutTensor, confInputTensor, 1, CLASS_SLICE_C, CONF_SLICE_C);
-     sliceTensor(convoutTensor, bboxInputTensor, 1, CLASS_SLICE_C + CONF_SLICE_C, BBOX_SLICE_C);
-     interpretContext->enqueue(batchSize, interpretBuffers, stream, nullptr);
-     transposeTensor(classOutputTensor, classTransTensor, transAxesDevice, classTransWorkspace);
-     transposeTensor(confOutputTensor, confTransTensor, transAxesDevice, confTransWorkspace);
-     transposeTensor(bboxOutputTensor, bboxTransTensor, transAxesDevice, bboxTransWorkspace);
-     reduceArgMax(classTransTensor, reduceMaxResTensor, reduceArgResTensor, 4);
-     multiplyElement(reduceMaxResTensor, confTransTensor, mulResTensor);
-     transformBboxSQD(bboxTransTensor, anchorsDeviceTensor, bboxResTensor, INPUT_W, INPUT_H, img_width, img_height, x_shift, y_shift);
-
-     CHECK(cudaEventRecord(stop_detect, 0));
-     CHECK(cudaEventSynchronize(stop_detect));
-     CHECK(cudaEventElapsedTime(&timeDetect, start_detect, stop_detect));
+     assert(cpuEngine && convoutHost);
+     anchorsNum = batchSize * convoutW * convoutH * ANCHORS_PER_GRID;
+     hostArena = createArena(HOST, 8);
+#ifdef DEBUG
+     hostArena->reuse = 0;
+#endif
+     int convoutDims[] = {batchSize, CONVOUT_C, convoutH, convoutW};
+     int resDims[] = {batchSize, convoutH, convoutW, ANCHORS_PER_GRID, 1};
+     int bboxResDims[] = {batchSize, convoutH, convoutW, ANCHORS_PER_GRID, OUTPUT_BBOX_SIZE};
+     int anchorsDims[] = {batchSize, convoutH, convoutW, ANCHORS_PER_GRID, ANCHOR_SIZE};
+     int anchorGridDims[] = {1, convoutH, convoutW, ANCHORS_PER_GRID, ANCHOR_SIZE};
+     scoresHostTensor = arenaTensor(hostArena, "mulRes", 5, resDims, STEP_SLICE, STEP_TOPK);
+     classHostTensor = arenaTensor(hostArena, "reduceArgRes", 5, resDims, STEP_SLICE, STEP_PICK);
+     bboxHostTensor = arenaTensor(hostArena, "bboxRes", 5, bboxResDims, STEP_SLICE, STEP_PICK);
+     Tensor *anchorGridTensor = arenaTensor(hostArena, "anchors", 5, anchorGridDims, STEP_INPUT, STEP_OUTPUT);
+     arenaAdd(hostArena, "topIdx", (void **)&topIdxHost, batchSize * TOP_N_DETECTION * sizeof(int),
+              STEP_TOPK, STEP_PICK);
+
+     allocArena(hostArena);
+     fprintArena(stdout, hostArena);
+     memcpy(anchorGridTensor->data, anchors, anchorGridTensor->len * sizeof(float));
+     convoutHostTensor = createTensor(convoutHost, 4, convoutDims);
+     anchorsHostTensor = broadcastTensorView(anchorGridTensor, 5, anchorsDims);
+}
+
+// doInference() of the cpu backend, the final detections are picked right into preds
+static void inferHost(const float *input, const float *img_sizes, int x_shift, int y_shift,
+                      struct predictions *preds, int batchSize)
+{
+     {
+          TRACE_SCOPE("cpuConv");
+          cpuEngineInfer(cpuEngine, input, convoutHost, batchSize);
+     }
+     {
+          TRACE_SCOPE("interpretConvout");
+          interpretConvoutHost(convoutHostTensor, anchorsHostTensor, scoresHostTensor, classHostTensor,
+                               bboxHostTensor, inputW, inputH, img_sizes, x_shift, y_shift);
+     }
+#ifdef DEBUG
+     saveTensor("data/convoutTensor.txt", convoutHostTensor, "%15.6e");
+     saveTensor("data/mulResTensor.txt", scoresHostTensor, "%15.6e");
+     saveTensor("data/reduceArgResTensor.txt", classHostTensor, "%15.6e");
+     saveTensor("data/bboxResTensor.txt", bboxHostTensor, "%15.6e");
+#endif
+     {
+          TRACE_SCOPE("topK");
+          tensorTopKBatchHost(scoresHostTensor, preds->prob, topIdxHost, TOP_N_DETECTION, scoreFloor, NULL);
+     }
+     TRACE_SCOPE("pickElements");
+     pickElementsHost(classHostTensor->data, preds->klass, 1, topIdxHost, batchSize * TOP_N_DETECTION);
+     pickElementsHost(bboxHostTensor->data, preds->bbox, OUTPUT_BBOX_SIZE, topIdxHost,
+                      batchSize * TOP_N_DETECTION);
+}
+
+// input holds batchSize images, img_sizes their original {width, height}, and preds gets
+// the top detections of each, and timeDetect its ms. The contexts are NULL with useCpu.
+void doInference(IExecutionContext *convContext, IExecutionContext *interpretContext, int useCpu, float* input, int inputSize, const float *img_sizes, int x_shift, int y_shift, struct predictions *preds, int batchSize)
+{
+     static const int inferStage = traceStage("infer");
+     long long begin = traceBegin();
+
+     if (useCpu) {
+          inferHost(input, img_sizes, x_shift, y_shift, preds, batchSize);
+          timeDetect = traceEnd(inferStage, begin);
+          return;
+     }
+     CHECK(cudaMemcpyAsync(imgSizesDevice, img_sizes, batchSize * 2 * sizeof(float), cudaMemcpyHostToDevice, stream));
+     {
+          // DMA the input to the GPU,  execute the batch asynchronously, and DMA it back:
+          TRACE_SCOPE("conv");
+          CHECK(cudaMemcpyAsync(convBuffers[inputIndex], input, inputSize, cudaMemcpyHostToDevice, stream));
+          convContext->enqueue(batchSize, convBuffers, stream, nullptr);
+          if (traceSync)
+               CHECK(cudaStreamSynchronize(stream));
+     }
+     if (unfusedPostprocess) {
+          // the bbox slice and the transposes are views, read in place by the operators
+          sliceTensor(convoutTensor, classInputTensor, 1, 0, CLASS_SLICE_C);
+          sliceTensor(convoutTensor, confInputTensor, 1, CLASS_SLICE_C, CONF_SLICE_C);
+          {
+               TRACE_SCOPE("interpret");
+               interpretContext->enqueue(batchSize, interpretBuffers, stream, nullptr);
+               if (traceSync)
+                    CHECK(cudaStreamSynchronize(stream));
+          }
+          reduceArgMax(classTransTensor, reduceMaxResTensor, reduceArgResTensor, 4);
+          multiplyElement(reduceMaxResTensor, confTransTensor, mulResTensor);
+          transformBboxSQD(bboxTransTensor, anchorsDeviceTensor, bboxResTensor, inputW, inputH, imgSizesDevice, x_shift, y_shift);
+     } else {
+          // scores, classes and bboxes of all anchors in one pass over conv_out
+          interpretConvout(convoutTensor, anchorsDeviceTensor, mulResTensor, reduceArgResTensor, bboxResTensor,
+                           inputW, inputH, imgSizesDevice, x_shift, y_shift);
+     }
 
 #ifdef DEBUG
      saveDeviceTensor("data/convoutTensor.txt", convoutTensor, "%15.6e");
-     saveDeviceTensor("data/classInputTensor.txt", classInputTensor, "%15.6e");
-     saveDeviceTensor("data/confInputTensor.txt", confInputTensor, "%15.6e");
-     saveDeviceTensor("data/bboxInputTensor.txt", bboxInputTensor, "%15.6e");
-     saveDeviceTensor("data/classOutputTensor.txt", classOutputTensor, "%15.6e");
-     saveDeviceTensor("data/confOutputTensor.txt", confOutputTensor, "%15.6e");
-     saveDeviceTensor("data/bboxOutputTensor.txt", bboxOutputTensor, "%15.6e");
      saveDeviceTensor("data/mulResTensor.txt", mulResTensor, "%15.6e");
-     saveDeviceTensor("data/reduceMaxResTensor.txt", reduceMaxResTensor, "%15.6e");
      saveDeviceTensor("data/reduceArgResTensor.txt", reduceArgResTensor, "%15.6e");
      saveDeviceTensor("data/bboxResTensor.txt", bboxResTensor, "%15.6e");
-     saveDeviceTensor("data/confTransTensor.txt", confTransTensor, "%15.6e");
-     saveDeviceTensor("data/classTransTensor.txt", classTransTensor, "%15.6e");
-     saveDeviceTensor("data/bboxTransTensor.txt", bboxTransTensor, "%15.6e");
      saveDeviceTensor("data/anchorsDeviceTensor.txt", anchorsDeviceTensor, "%15.6e");
-
-     int classInputDims2[] = {batchSize, 9, 3, CONVOUT_W*CONVOUT_H};
-     int classInputDims3[] = {batchSize, 3, 9, CONVOUT_W*CONVOUT_H};
-     Tensor *classInput2 = reshapeTensor(classInputTensor, 4, classInputDims2);
-     Tensor *classInput3 = reshapeTensor(classInputTensor, 4, classInputDims3);
-     saveDeviceTensor("data/classInputDims2.txt", classInput2, "%15.6e");
-     saveDeviceTensor("data/classInputDims3.txt", classInput3, "%15.6e");
+     if (unfusedPostprocess) { // the fused post-processing has no memory for the others
+          saveDeviceTensor("data/classInputTensor.txt", classInputTensor, "%15.6e");
+          saveDeviceTensor("data/confInputTensor.txt", confInputTensor, "%15.6e");
+          saveDeviceTensor("data/classOutputTensor.txt", classOutputTensor, "%15.6e");
+          saveDeviceTensor("data/confOutputTensor.txt", confOutputTensor, "%15.6e");
+          saveDeviceTensor("data/bboxOutputTensor.txt", bboxOutputTensor, "%15.6e");
+          saveDeviceTensor("data/reduceMaxResTensor.txt", reduceMaxResTensor, "%15.6e");
+          saveDeviceTensor("data/confTransTensor.txt", confTransTensor, "%15.6e");
+          saveDeviceTensor("data/classTransTensor.txt", classTransTensor, "%15.6e");
+          saveDeviceTensor("data/bboxTransTensor.txt", bboxTransTensor, "%15.6e");
+
+          int classInputDims2[] = {batchSize, 9, 3, convoutW*convoutH};
+          int classInputDims3[] = {batchSize, 3, 9, convoutW*convoutH};
+          Tensor *classInput2 = reshapeTensor(classInputTensor, 4, classInputDims2);
+          Tensor *classInput3 = reshapeTensor(classInputTensor, 4, classInputDims3);
+          saveDeviceTensor("data/classInputDims2.txt", classInput2, "%15.6e");
+          saveDeviceTensor("data/classInputDims3.txt", classInput3, "%15.6e");
+     }
 #endif
-     // filter top-n-detection
-     CHECK(cudaEventRecord(start_misc, 0));
-     CHECK(cudaMemcpy(orderDeviceTmp, orderDevice, anchorsNum * sizeof(int), cudaMemcpyDeviceToDevice));
-     tensorIndexSort(mulResTensor, orderDeviceTmp);
-     // already sort mulResTensor (sharing data with finalProbsTensor), so we can skip this
-     // pickElements(mulResTensor->data, finalProbsTensor->data, 1, orderDeviceTmp, TOP_N_DETECTION);
-     pickElements(reduceArgResTensor->data, finalClassTensor->data, 1, orderDeviceTmp, TOP_N_DETECTION);
-     pickElements(bboxResTensor->data, finalBboxTensor->data, OUTPUT_BBOX_SIZE, orderDeviceTmp, TOP_N_DETECTION);
+     // select the top-n-detection of every image, their positions are into the whole batch
+     tensorTopKBatch(mulResTensor, finalProbsTensor->data, topIdxDevice, TOP_N_DETECTION, scoreFloor, NULL);
+     pickElements(reduceArgResTensor->data, finalClassTensor->data, 1, topIdxDevice, batchSize * TOP_N_DETECTION);
+     pickElements(bboxResTensor->data, finalBboxTensor->data, OUTPUT_BBOX_SIZE, topIdxDevice,
+                  batchSize * TOP_N_DETECTION);
 
 #ifdef DEBUG
-     FILE * sort_file = fopen("data/orderDevice.txt", "w");
-     int *orderHost2 = (int *)cloneMem(orderDevice, anchorsNum * sizeof(int), D2H);
-     for (int i = 0; i < anchorsNum; i++)
-          fprintf(sort_file, "%d\n", orderHost2[i]);
+     FILE * sort_file = fopen("data/topIdxDevice.txt", "w");
+     int *topIdxHost = (int *)cloneMem(topIdxDevice, batchSize * TOP_N_DETECTION * sizeof(int), D2H);
+     for (int i = 0; i < batchSize * TOP_N_DETECTION; i++)
+          fprintf(sort_file, "%d\n", topIdxHost[i]);
      fclose(sort_file);
-     sdt_free(orderHost2);
+     sdt_free(topIdxHost);
      saveDeviceTensor("data/finalClassTensor.txt", finalClassTensor, "%15.6e");
      saveDeviceTensor("data/finalProbsTensor.txt", finalProbsTensor, "%15.6e");
      saveDeviceTensor("data/finalBboxTensor.txt", finalBboxTensor, "%15.6e");
 #endif
 
-     CHECK(cudaMemcpyAsync(preds->prob, finalProbsTensor->data, finalProbsTensor->len*sizeof(float), cudaMemcpyDeviceToHost, stream));
-     CHECK(cudaMemcpyAsync(preds->klass, finalClassTensor->data, finalClassTensor->len*sizeof(float), cudaMemcpyDeviceToHost, stream));
-     CHECK(cudaMemcpyAsync(preds->bbox, finalBboxTensor->data, finalBboxTensor->len*sizeof(float), cudaMemcpyDeviceToHost, stream));
-     CHECK(cudaStreamSynchronize(stream));
+     {
+          // waits for the device, this span holds what the asynchronous ones above didn't
+          TRACE_SCOPE("download");
+          CHECK(cudaMemcpyAsync(preds->prob, finalProbsTensor->data, finalProbsTensor->len*sizeof(float), cudaMemcpyDeviceToHost, stream));
+          CHECK(cudaMemcpyAsync(preds->klass, finalClassTensor->data, finalClassTensor->len*sizeof(float), cudaMemcpyDeviceToHost, stream));
+          CHECK(cudaMemcpyAsync(preds->bbox, finalBboxTensor->data, finalBboxTensor->len*sizeof(float), cudaMemcpyDeviceToHost, stream));
+          CHECK(cudaStreamSynchronize(stream));
+     }
+     timeDetect = traceEnd(inferStage, begin);
 }
 
-void cleanUp()
+// Run the cpu backend on the input of the last doInference() with the TensorRT backend,
+// and compare their conv_out.
+void checkCpuBackend(const float *input, int batchSize)
 {
-     // timer destroy
-     CHECK(cudaEventDestroy(start_imread));
-     CHECK(cudaEventDestroy(stop_imread));
-     CHECK(cudaEventDestroy(start_detect));
-     CHECK(cudaEventDestroy(stop_detect));
-     CHECK(cudaEventDestroy(start_misc));
-     CHECK(cudaEventDestroy(stop_misc));
+     assert(cpuEngine && convoutHost);
+     TRACE_SCOPE("checkCpu");
+     float *trtConvout = (float *)cloneMem(convoutTensor->data, convoutTensor->len*sizeof(float), D2H);
+     float maxDiff = 0, maxAbs = 0;
+
+     cpuEngineInfer(cpuEngine, input, convoutHost, batchSize);
+     for (int i = 0; i < convoutTensor->len; i++) {
+          maxDiff = std::max(maxDiff, std::fabs(convoutHost[i] - trtConvout[i]));
+          maxAbs = std::max(maxAbs, std::fabs(trtConvout[i]));
+     }
+     printf("cpu check: max abs diff %.3e, relative %.3e %s\n", maxDiff, maxDiff / (maxAbs + 1e-16),
+            maxDiff > CPU_CHECK_TOLERANCE * maxAbs ? "MISMATCH" : "ok");
+     sdt_free(trtConvout);
+}
 
+void cleanUp()
+{
+     if (hostArena) {
+          freeTensor(convoutHostTensor, 0);
+          freeTensor(anchorsHostTensor, 0);
+          freeArena(hostArena);
+          return;
+     }
      // release the stream and the buffers
      CHECK(cudaStreamDestroy(stream));
-     CHECK(cudaFree(convBuffers[inputIndex]));
-     CHECK(cudaFree(convBuffers[convoutIndex]));
-     CHECK(cudaFree(interpretBuffers[classInputIndex]));
-     CHECK(cudaFree(interpretBuffers[confInputIndex]));
-     CHECK(cudaFree(bboxInput));
-     CHECK(cudaFree(interpretBuffers[classOutputIndex]));
-     CHECK(cudaFree(interpretBuffers[confOutputIndex]));
-     CHECK(cudaFree(classTransTensor->data));
-     CHECK(cudaFree(confTransTensor->data));
-     CHECK(cudaFree(bboxTransTensor->data));
-     CHECK(cudaFree(classTransWorkspace[0]));
-     CHECK(cudaFree(classTransWorkspace[1]));
-     CHECK(cudaFree(confTransWorkspace[0]));
-     CHECK(cudaFree(confTransWorkspace[1]));
-     CHECK(cudaFree(bboxTransWorkspace[0]));
-     CHECK(cudaFree(bboxTransWorkspace[1]));
-     CHECK(cudaFree(reduceMaxResTensor->data));
-     CHECK(cudaFree(reduceArgResTensor->data));
-     CHECK(cudaFree(mulResTensor->data));
-     CHECK(cudaFree(bboxResTensor->data));
-     CHECK(cudaFree(transAxesDevice));
-     CHECK(cudaFree(anchorsDevice));
-     CHECK(cudaFree(orderDevice));
-     CHECK(cudaFree(orderDeviceTmp));
-     // already freed mulResTensor data (sharing data with finalProbsTensor), so skip this
-     // CHECK(cudaFree(finalProbsTensor->data));
-     CHECK(cudaFree(finalClassTensor->data));
-     CHECK(cudaFree(finalBboxTensor->data));
-
-     // free remaining tensor structure (already freed their data)
-     freeTensor(convoutTensor, 0);
-     freeTensor(classInputTensor, 0);
-     freeTensor(confInputTensor, 0);
-     freeTensor(bboxInputTensor, 0);
-     freeTensor(classOutputTensor, 0);
-     freeTensor(confOutputTensor, 0);
+     // the views first, their data is in the arena
      freeTensor(bboxOutputTensor, 0);
-     freeTensor(reduceMaxResTensor, 0);
-     freeTensor(reduceArgResTensor, 0);
-     freeTensor(mulResTensor, 0);
-     freeTensor(bboxResTensor, 0);
+     freeTensor(classTransTensor, 0);
+     freeTensor(confTransTensor, 0);
+     freeTensor(bboxTransTensor, 0);
      freeTensor(anchorsDeviceTensor, 0);
-     freeTensor(finalClassTensor, 0);
-     freeTensor(finalProbsTensor, 0);
-     freeTensor(finalBboxTensor, 0);
+     freeArena(deviceArena);
 }
 
-// rearrange image data to [N, C, H, W] order
-float *prepareData(float *data, cv::Mat &frame)
+// resize the image into data in [C, H, W] order, in one pass without a resized image
+float *prepareData(float *data, const cv::Mat &origin, float *img_width, float *img_height, int flags)
 {
-     assert(data && !frame.empty());
-     unsigned int volChl = INPUT_H*INPUT_W;
-     for (int c = 0; c < INPUT_C; ++c)
-     {
-          // the color image to input should be in BGR order
-          for (unsigned j = 0; j < volChl; ++j)
-               data[c*volChl + j] = float(frame.data[j*INPUT_C+c]) - PIXEL_MEAN[c];
+     assert(data && !origin.empty() && origin.type() == CV_8UC3);
+     if (img_width && img_height) {
+          *img_width = origin.cols;
+          *img_height = origin.rows;
      }
-
-     CHECK(cudaEventRecord(stop_imread, 0));
-     CHECK(cudaEventSynchronize(stop_imread));
-     CHECK(cudaEventElapsedTime(&timeImread, start_imread, stop_imread));
-     return data;
+     return resizeInput(data, origin.data, origin.rows, origin.cols, origin.step, inputH, inputW, PIXEL_MEAN, flags);
 }
 
-float *prepareAnchors(const float *anchor_shape, int width, int height, int N, int H, int W, int B)
+// The input of an image from its cached pixels, or from origin, which with the input cache
+// are resized by cv::resize() into resized and cached as name, so a later hit packs the
+// same input
+static void prepareInput(float *data, const unsigned char *cached, cv::Mat &origin, cv::Mat &resized,
+                         const char *name, float *img_size, int flags)
 {
-     assert(anchor_shape);
-     float center_x[W], center_y[H];
-     float anchors[H * W * B * 4];
-     int i, j, k;
-
-     for (i = 1; i <= W; i++)
-          center_x[i-1] = i * width / (W + 1.0);
-     for (i = 1; i <= H; i++)
-          center_y[i-1] = i * height / (H + 1.0);
-
-     int h_vol = W * B * 4;
-     int w_vol = B * 4;
-     int b_vol = 4;
-     for (i = 0; i < H; i++) {
-          for (j = 0; j < W; j++) {
-               for (k = 0; k < B; k++) {
-                    anchors[i*h_vol+j*w_vol+k*b_vol] = center_x[j];
-                    anchors[i*h_vol+j*w_vol+k*b_vol+1] = center_y[i];
-                    anchors[i*h_vol+j*w_vol+k*b_vol+2] = anchor_shape[k*2];
-                    anchors[i*h_vol+j*w_vol+k*b_vol+3] = anchor_shape[k*2+1];
-               }
-          }
+     if (cached) {
+          packInput(data, cached, inputH, inputW, PIXEL_MEAN);
+     } else if (inputCache && name) {
+          preprocessFrame(resized, origin, inputW, inputH, &img_size[0], &img_size[1]);
+          inputCacheInsert(inputCache, name, resized.data, img_size[0], img_size[1]);
+          packInput(data, resized.data, inputH, inputW, PIXEL_MEAN);
+     } else {
+          prepareData(data, origin, &img_size[0], &img_size[1], flags);
      }
-
-     float *ret = (float *)repeatMem(anchors, sizeof(float)*4*B*H*W, N, H2H);
-     assert(ret);
-     return ret;
 }
 
-void detectionFilter(struct predictions *preds, float nms_thresh, float prob_thresh)
+// conv_out rows or columns for in rows or columns of input
+static int gridSize(int in)
 {
-     assert(preds->bbox && preds->klass && preds->prob && preds->keep);
-
-     int i, j, num = preds->num;
-     int *keep = preds->keep;
-     float *klass = preds->klass;
-     float *bbox = preds->bbox;
-     for (i = 0; i < num; i++)
-          keep[i] = 1;
-     for (i = 0; i < num; i++) {
-          // keep[i] = 1;
-          // if (probs[i] < prob_thresh) {
-          //      keep[i] = 0;
-          //      continue;
-          // }
-          // for (j = i - 1; j >= 0 ; j--) {
-          for (j = i + 1; j < num; j++) {
-               if (!keep[j] || klass[i] != klass[j])
-                    continue;
-               if (computeIou(&bbox[i*OUTPUT_BBOX_SIZE],&bbox[j*OUTPUT_BBOX_SIZE]) > nms_thresh)
-                         keep[j] = 0;
-          }
-     }
-     CHECK(cudaEventRecord(stop_misc, 0));
-     CHECK(cudaEventSynchronize(stop_misc));
-     CHECK(cudaEventElapsedTime(&timeMisc, start_misc, stop_misc));
-}
-
-void fprintResult(FILE *fp, struct predictions *preds)
-{
-     assert(fp && preds->bbox && preds->klass && preds->prob && preds->keep);
-
-     int i;
-     float *bbox;
-     for (i = 0; i < preds->num; i++) {
-          if (!preds->keep[i])
-               continue;
-          bbox = &preds->bbox[i * OUTPUT_BBOX_SIZE];
-          fprintf(fp, "%s -1 -1 0.0 %.2f %.2f %.2f %.2f 0.0 0.0 0.0 0.0 0.0 0.0 0.0 %.3f\n",
-                  CLASS_NAMES[(int)preds->klass[i]], bbox[0], bbox[1], bbox[2], bbox[3], preds->prob[i]);
-     }
+     for (size_t i = 0; i < sizeof(STRIDED_LAYERS) / sizeof(STRIDED_LAYERS[0]); i++)
+          in = convOutSize(in, STRIDED_LAYERS[i][0], STRIDED_LAYERS[i][1], STRIDED_LAYERS[i][2]);
+     return in;
 }
 
 void drawBbox(cv::Mat &frame, struct predictions *preds)
@@ -688,12 +805,351 @@ void drawBbox(cv::Mat &frame, struct predictions *preds)
      sdt_free(prob_s);
 }
 
+// run the 3x3 convolutions of the comma separated layers with Winograd, the others directly
+static void selectWinogradLayers(CpuEngine *engine, const char *layers)
+{
+     char *list = strdup(layers), *name;
+
+     setCpuConvAlgo(engine, "all", CPU_CONV_DIRECT);
+     for (name = strtok(list, ","); name; name = strtok(NULL, ","))
+          if (strcmp(name, "none") && !setCpuConvAlgo(engine, name, CPU_CONV_WINOGRAD))
+               errx(EXIT_FAILURE, "--winograd: %s has no 3x3 stride 1 convolution", name);
+     free(list);
+}
+
+// Run the cpu backend in float over the images to record the input range of every
+// convolution, which quantizeCpuEngine() needs
+static void calibrateCpuEngine(CpuEngine *engine, const std::vector<std::string> &images, float *data)
+{
+     cv::Mat frame_origin;
+     float img_width, img_height;
+     double start = getUnixTime();
+
+     engine->calibrating = 1;
+     for (size_t i = 0; i < images.size(); i++) {
+          frame_origin = cv::imread(images[i]);
+          if (frame_origin.empty()) {
+               fprintf(stderr, "error reading image %s\n", images[i].c_str());
+               continue;
+          }
+          prepareData(data, frame_origin, &img_width, &img_height, RESIZE_PARALLEL);
+          cpuEngineInfer(engine, data, convoutHost, 1);
+     }
+     engine->calibrating = 0;
+     printf("cpu calibration: %d images in %.2fs\n", (int)images.size(), getUnixTime() - start);
+}
+
+// A frame buffer of --pipeline. The frames cycle from the free queue through the stages
+// and back, so their buffers are allocated once.
+struct Frame {
+     long seq;                  // position in the input, the write stage goes by it
+     int empty;                 // unreadable, passed on only to keep the order
+     std::string name;
+     const unsigned char *cached; // pixels in the input cache, origin is not read
+     cv::Mat origin, resized;
+     float *data;               // network input of one image
+     float imgSize[2];
+     struct predictions preds;
+};
+
+static long frameSeq(const void *item)
+{
+     return ((const Frame *)item)->seq;
+}
+
+// the state shared by the stages of --pipeline
+struct PipelineContext {
+     // decode, the input is read under mutex
+     pthread_mutex_t mutex;
+     const std::vector<std::string> *images; // NULL for a video
+     cv::VideoCapture *cap;
+     size_t next_image;
+     long next_seq;
+     int done, stop;            // the input is exhausted, or the user quit
+     // infer, a single worker
+     IExecutionContext *convContext, *interpretContext;
+     int use_cpu, check_cpu, batch, x_shift, y_shift;
+     float *data, *imgSizes;
+     size_t inputSize;
+     struct predictions *preds;
+     // postprocess, the NMS contexts of the workers not running one, under mutex
+     NmsContext **nmsFree;
+     int nnmsFree;
+     // write, a single worker
+     ResultWriter *results;     // NULL for a video
+     char *img_name_buf;
+     cv::VideoWriter *writer;   // NULL unless --bbox-dir with a video
+     long nimages;
+};
+
+static int decodeStage(void *ctx, void **items, int n)
+{
+     PipelineContext *pc = (PipelineContext *)ctx;
+     Frame *f = (Frame *)items[0];
+
+     pthread_mutex_lock(&pc->mutex);
+     if (pc->stop || pc->done || (pc->images && pc->next_image >= pc->images->size())) {
+          pc->done = 1;
+          pthread_mutex_unlock(&pc->mutex);
+          return STAGE_END;
+     }
+     if (pc->images) {
+          f->name = (*pc->images)[pc->next_image++];
+     } else if (pc->cap->read(f->origin) == false) { // end of video
+          pc->done = 1;
+          pthread_mutex_unlock(&pc->mutex);
+          return STAGE_END;
+     }
+     f->seq = pc->next_seq++;
+     pthread_mutex_unlock(&pc->mutex);
+
+     f->cached = NULL;
+     if (pc->images) {
+          TRACE_SCOPE("decode");
+          if (inputCache)
+               f->cached = inputCacheLookup(inputCache, f->name.c_str(), &f->imgSize[0], &f->imgSize[1]);
+          if (f->cached)
+               f->origin.release();
+          else
+               f->origin = cv::imread(f->name);
+     }
+     f->empty = !f->cached && f->origin.empty();
+     if (f->empty)
+          fprintf(stderr, "error reading %s %s\n", pc->images ? "image" : "frame",
+                  pc->images ? f->name.c_str() : std::to_string(f->seq).c_str());
+     return 0;
+}
+
+static int preprocessStage(void *ctx, void **items, int n)
+{
+     PipelineContext *pc = (PipelineContext *)ctx;
+     Frame *f = (Frame *)items[0];
+
+     if (!f->empty) {
+          TRACE_SCOPE("preprocess");
+          // the workers already run frames in parallel
+          prepareInput(f->data, f->cached, f->origin, f->resized, pc->images ? f->name.c_str() : NULL, f->imgSize,
+                       0);
+     }
+     return 0;
+}
+
+static void copyPredictions(struct predictions *dst, const struct predictions *src)
+{
+     assert(dst->num == src->num);
+     memcpy(dst->klass, src->klass, sizeof(float) * src->num);
+     memcpy(dst->prob, src->prob, sizeof(float) * src->num);
+     memcpy(dst->bbox, src->bbox, sizeof(float) * src->num * OUTPUT_BBOX_SIZE);
+}
+
+// gathers the readable frames of a batch into the input of doInference()
+static int inferStage(void *ctx, void **items, int n)
+{
+     PipelineContext *pc = (PipelineContext *)ctx;
+     size_t inputVol = INPUT_C * inputH * inputW;
+     int i, m;
+
+     for (i = 0, m = 0; i < n; i++) {
+          Frame *f = (Frame *)items[i];
+          if (f->empty)
+               continue;
+          memcpy(pc->data + m * inputVol, f->data, sizeof(float) * inputVol);
+          pc->imgSizes[m * 2] = f->imgSize[0];
+          pc->imgSizes[m * 2 + 1] = f->imgSize[1];
+          m++;
+     }
+     if (m == 0)
+          return 0;
+     doInference(pc->convContext, pc->interpretContext, pc->use_cpu, pc->data, pc->inputSize, pc->imgSizes,
+                 pc->x_shift, pc->y_shift, pc->preds, pc->batch);
+     if (pc->check_cpu && !pc->use_cpu)
+          checkCpuBackend(pc->data, pc->batch);
+     for (i = 0, m = 0; i < n; i++) {
+          Frame *f = (Frame *)items[i];
+          if (f->empty)
+               continue;
+          struct predictions imagePreds = imagePredictions(pc->preds, m++);
+          copyPredictions(&f->preds, &imagePreds);
+     }
+     return 0;
+}
+
+// takes one of the NMS contexts, there are as many as workers
+static int postprocessStage(void *ctx, void **items, int n)
+{
+     PipelineContext *pc = (PipelineContext *)ctx;
+     Frame *f = (Frame *)items[0];
+     NmsContext *nms;
+
+     if (f->empty)
+          return 0;
+     pthread_mutex_lock(&pc->mutex);
+     nms = pc->nmsFree[--pc->nnmsFree];
+     pthread_mutex_unlock(&pc->mutex);
+     detectionFilter(nms, &f->preds, NMS_THRESH, scoreFloor);
+     pthread_mutex_lock(&pc->mutex);
+     pc->nmsFree[pc->nnmsFree++] = nms;
+     pthread_mutex_unlock(&pc->mutex);
+     return 0;
+}
+
+// gets the frames in input order from its ordered input queue
+static int writeStage(void *ctx, void **items, int n)
+{
+     PipelineContext *pc = (PipelineContext *)ctx;
+     Frame *f = (Frame *)items[0];
+     char key;
+     TRACE_SCOPE("write");
+
+     if (pc->images) {
+          getFileName(pc->img_name_buf, f->name.c_str());
+          printf("(%ld/%d) image: %s\n", f->seq + 1, (int)pc->images->size(), pc->img_name_buf);
+     }
+     if (f->empty || pc->stop)
+          return 0;
+     pc->nimages++;
+     if (pc->images) {
+          resultWriterSubmit(pc->results, f->name.c_str(), &f->preds);
+          return 0;
+     }
+     drawBbox(f->origin, &f->preds);
+     if (pc->writer)
+          pc->writer->write(f->origin);
+     cv::imshow("detection", f->origin);
+     key = cv::waitKey(1);
+     if (key == ' ') {
+          cv::waitKey(0);
+     } else if (key == 'q' || key == 27) { // 27 is the ASCII code of ESC
+          pthread_mutex_lock(&pc->mutex);
+          pc->stop = 1;
+          pthread_mutex_unlock(&pc->mutex);
+     }
+     return 0;
+}
+
+// Run the images or the video of pc through the decode, preprocess, infer, postprocess
+// and write stages on their own threads, with workers[] threads for decode, preprocess and
+// postprocess. Returns the number of images detected, their average busy time per stage
+// group in ms, and the throughput.
+static long runFramePipeline(PipelineContext *pc, const int *workers, int queue_size,
+                             double *imread_ms, double *detect_ms, double *misc_ms, double *fps)
+{
+     assert(queue_size >= pc->batch);
+     size_t inputVol = INPUT_C * inputH * inputW;
+     // infer takes its batches in input order too, or the frames held back by the ordered
+     // write queue could leave it waiting for a batch that never fills, so both ordered
+     // queues hold every frame
+     int nframes = 4 * queue_size + pc->batch;
+     std::vector<Frame> frames(nframes);
+     BoundedQueue *freeFrames = createQueue(nframes, NULL);
+     BoundedQueue *decoded = createQueue(queue_size, NULL);
+     BoundedQueue *prepared = createQueue(nframes, frameSeq);
+     BoundedQueue *inferred = createQueue(queue_size, NULL);
+     BoundedQueue *filtered = createQueue(nframes, frameSeq);
+     PipelineStage stages[] = {
+          {"decode", workers[0], 1, decodeStage, pc, freeFrames, decoded},
+          {"preprocess", workers[1], 1, preprocessStage, pc, decoded, prepared},
+          {"infer", 1, pc->batch, inferStage, pc, prepared, inferred},
+          {"postprocess", workers[2], 1, postprocessStage, pc, inferred, filtered},
+          {"write", 1, 1, writeStage, pc, filtered, freeFrames},
+     };
+     int nstages = sizeof(stages) / sizeof(stages[0]);
+
+     for (int i = 0; i < nframes; i++) {
+          Frame *f = &frames[i];
+          f->data = (float *)sdt_alloc(sizeof(float) * inputVol);
+          f->preds.prob = (float *)sdt_alloc(sizeof(float) * TOP_N_DETECTION);
+          f->preds.klass = (float *)sdt_alloc(sizeof(float) * TOP_N_DETECTION);
+          f->preds.bbox = (float *)sdt_alloc(sizeof(float) * TOP_N_DETECTION * OUTPUT_BBOX_SIZE);
+          f->preds.keep = (int *)sdt_alloc(sizeof(int) * TOP_N_DETECTION);
+          f->preds.num = TOP_N_DETECTION;
+          queuePush(freeFrames, f);
+     }
+     pc->nmsFree = (NmsContext **)sdt_alloc(sizeof(NmsContext *) * workers[2]);
+     for (pc->nnmsFree = 0; pc->nnmsFree < workers[2]; pc->nnmsFree++)
+          pc->nmsFree[pc->nnmsFree] = createNms(TOP_N_DETECTION, OUTPUT_CLS_SIZE);
+     printf("pipeline: %d/%d/1/%d/1 workers, %d frames, queues of %d\n", workers[0], workers[1], workers[2],
+            nframes, queue_size);
+
+     double start = getUnixTime();
+     runPipeline(stages, nstages);
+     double elapsed = getUnixTime() - start;
+     printPipelineStats(stdout, stages, nstages, elapsed);
+
+     long nimages = std::max(pc->nimages, 1L);
+     *imread_ms = (stages[0].busy + stages[1].busy) * 1000 / nimages;
+     *detect_ms = stages[2].busy * 1000 / nimages;
+     *misc_ms = stages[3].busy * 1000 / nimages;
+     *fps = elapsed > 0 ? pc->nimages / elapsed : 0;
+
+     for (int i = 0; i < nframes; i++) {
+          sdt_free(frames[i].data);
+          sdt_free(frames[i].preds.prob);
+          sdt_free(frames[i].preds.klass);
+          sdt_free(frames[i].preds.bbox);
+          sdt_free(frames[i].preds.keep);
+     }
+     for (int i = 0; i < pc->nnmsFree; i++)
+          destroyNms(pc->nmsFree[i]);
+     sdt_free(pc->nmsFree);
+     destroyQueue(freeFrames);
+     destroyQueue(decoded);
+     destroyQueue(prepared);
+     destroyQueue(inferred);
+     destroyQueue(filtered);
+     return pc->nimages;
+}
+
+enum {
+     OPT_ENGINE_CACHE = 256,    // long options without a short form
+     OPT_NO_ENGINE_CACHE,
+     OPT_REBUILD_ENGINE,
+     OPT_BACKEND,
+     OPT_CHECK_CPU,
+     OPT_THREADS,
+     OPT_WINOGRAD,
+     OPT_CPU_FUSION,
+     OPT_CPU_PRECISION,
+     OPT_CPU_STORAGE,
+     OPT_BATCH,
+     OPT_PIPELINE,
+     OPT_QUEUE_SIZE,
+     OPT_POSTPROCESS,
+     OPT_SCORE_FLOOR,
+     OPT_INPUT_SIZE,
+     OPT_TRACE,
+     OPT_TRACE_SYNC,
+     OPT_INPUT_CACHE,
+     OPT_RESULTS_FILE
+};
+
 static const struct option longopts[] = {
      {"eval-list", 1, NULL, 'e'},
      {"video", 1, NULL, 'v'},
      {"bbox-dir", 1, NULL, 'b'},
      {"x-shift", 1, NULL, 'x'},
      {"y-shift", 1, NULL, 'y'},
+     {"weights", 1, NULL, 'w'},
+     {"engine-cache", 1, NULL, OPT_ENGINE_CACHE},
+     {"no-engine-cache", 0, NULL, OPT_NO_ENGINE_CACHE},
+     {"rebuild-engine", 0, NULL, OPT_REBUILD_ENGINE},
+     {"backend", 1, NULL, OPT_BACKEND},
+     {"check-cpu", 0, NULL, OPT_CHECK_CPU},
+     {"threads", 1, NULL, OPT_THREADS},
+     {"winograd", 1, NULL, OPT_WINOGRAD},
+     {"cpu-fusion", 1, NULL, OPT_CPU_FUSION},
+     {"cpu-precision", 1, NULL, OPT_CPU_PRECISION},
+     {"cpu-storage", 1, NULL, OPT_CPU_STORAGE},
+     {"batch", 1, NULL, OPT_BATCH},
+     {"pipeline", 2, NULL, OPT_PIPELINE},
+     {"queue-size", 1, NULL, OPT_QUEUE_SIZE},
+     {"postprocess", 1, NULL, OPT_POSTPROCESS},
+     {"score-floor", 0, NULL, OPT_SCORE_FLOOR},
+     {"input-size", 1, NULL, OPT_INPUT_SIZE},
+     {"trace", 1, NULL, OPT_TRACE},
+     {"trace-sync", 0, NULL, OPT_TRACE_SYNC},
+     {"input-cache", 1, NULL, OPT_INPUT_CACHE},
+     {"results-file", 1, NULL, OPT_RESULTS_FILE},
      {"help", 0, NULL, 'h'},
      {0, 0, 0, 0}
 };
@@ -713,6 +1169,72 @@ Options:\n\
                                                save them in BBOX_DIR.\n\
        -x, --x-shift=X_SHIFT                   Shift all bboxes downward X_SHIFT pixels.\n\
        -y, --y-shift=Y_SHIFT                   Shift all bboxes rightward Y_SHIFT pixels.\n\
+       -w, --weights=WEIGHTS_FILE              Load weights from WEIGHTS_FILE, either the text .wts\n\
+                                               or the binary .wtb format (default: data/sqdtrt.wts).\n\
+           --batch=N                           Run N images through the detection pipeline at once\n\
+                                               (default: 1, at most 64). Larger batches give a higher\n\
+                                               throughput at the cost of latency.\n\
+           --pipeline[=DECODE,PREPROCESS,POSTPROCESS]\n\
+                                               Decode, preprocess, infer, postprocess and write\n\
+                                               the images on their own threads, with DECODE,\n\
+                                               PREPROCESS and POSTPROCESS workers (default: 2,2,1)\n\
+                                               and one for infer and write each. Print how busy\n\
+                                               every stage was and how full its input queue.\n\
+           --queue-size=N                      Hold at most N frames between the stages of\n\
+                                               --pipeline (default: twice the batch size).\n\
+           --postprocess=MODE                  Turn conv_out into scored boxes with one fused\n\
+                                               kernel (fused, default), or with the slices,\n\
+                                               interpret engine and transposes it replaces\n\
+                                               (unfused).\n\
+           --score-floor                       Only select the top 64 detections of an image\n\
+                                               from those with a score of at least PROB_THRESH\n\
+                                               (0.3), instead of from all of them.\n\
+           --input-size=WxH                    Resize the images to W x H for the network\n\
+                                               (default: 1248x384), such as 624x192 for a\n\
+                                               quarter of the work. The grid and the anchors\n\
+                                               follow from it.\n\
+           --trace=TRACE_FILE                  Write the spans of every stage and tensor operator\n\
+                                               to TRACE_FILE as Chrome trace events, for\n\
+                                               chrome://tracing or Perfetto.\n\
+           --trace-sync                        Wait for the GPU at the end of every traced\n\
+                                               operator, so its span is its run time rather\n\
+                                               than its launch. Slows the detection down.\n\
+           --input-cache=PACK_FILE             Keep the resized images in PACK_FILE, and read\n\
+                                               them from it instead of decoding and resizing\n\
+                                               them again in later runs over the same images,\n\
+                                               until they change.\n\
+           --results-file=RESULTS_FILE         Write the results of all images to RESULTS_FILE\n\
+                                               instead of one file each in RESULT_DIR: a line\n\
+                                               with the image name, then its KITTI lines after\n\
+                                               the name. scripts/splitresults.pl splits it into\n\
+                                               the files.\n\
+           --engine-cache=CACHE_DIR            Cache serialized TensorRT engines in CACHE_DIR\n\
+                                               (default: the directory of the weights file).\n\
+           --no-engine-cache                   Always build the engines, don't read or write\n\
+                                               the engine cache.\n\
+           --rebuild-engine                    Ignore the cached engines, rebuild and overwrite them.\n\
+           --backend=BACKEND                   Run the detection with BACKEND, trt (default) for\n\
+                                               TensorRT on the GPU, or cpu for the host executor\n\
+                                               and post-processing, without a GPU.\n\
+           --check-cpu                         Also run the cpu backend on every frame and compare\n\
+                                               its output with the TensorRT backend.\n\
+           --threads=THREADS                   Use THREADS host threads for the cpu backend.\n\
+           --winograd=LAYERS                   Run the 3x3 convolutions of the comma separated LAYERS\n\
+                                               (e.g. fire2,conv12) with Winograd on the cpu backend and\n\
+                                               the others directly, all (default) or none.\n\
+           --cpu-fusion=MODE                   Fuse the layers of the cpu backend by MODE: none for\n\
+                                               layer by layer, fire (default) for one operator per\n\
+                                               fire module, or group for consecutive fire modules\n\
+                                               depth first.\n\
+           --cpu-precision=PRECISION           Run the convolutions of the cpu backend in fp32\n\
+                                               (default) or int8. int8 reads the activation ranges\n\
+                                               from a calibration table next to the weights file,\n\
+                                               or calibrates on the images of --eval-list and\n\
+                                               writes one.\n\
+           --cpu-storage=TYPE                  Store the activations between the layers of the cpu\n\
+                                               backend as fp32 (default), fp16 or bf16, which halves\n\
+                                               their memory and bandwidth. They are still computed\n\
+                                               in fp32.\n\
        -h, --help                              Print this help and exit.\n";
 
 static void print_usage_and_exit()
@@ -725,8 +1247,14 @@ int main(int argc, char *argv[])
 {
      int opt, optindex;
      char *img_dir = NULL, *result_dir = NULL, *eval_list = NULL, *video = NULL, *bbox_dir = NULL;
-     int x_shift = 0, y_shift = 0;
-     while ((opt = getopt_long(argc, argv, ":e:v:b:x:y:h", longopts, &optindex)) != -1) {
+     char *engine_cache = NULL, *weights = NULL, *winograd_layers = NULL, *trace_file = NULL, *input_cache = NULL;
+     char *results_file = NULL;
+     int x_shift = 0, y_shift = 0, use_engine_cache = 1, rebuild_engine = 0;
+     int use_cpu = 0, check_cpu = 0, cpu_int8 = 0, batch = 1;
+     int pipeline = 0, queue_size = 0, workers[3] = {PIPELINE_WORKERS[0], PIPELINE_WORKERS[1], PIPELINE_WORKERS[2]};
+     CpuFusion cpu_fusion = CPU_FUSION_FIRE;
+     StorageType cpu_storage = STORAGE_FP32;
+     while ((opt = getopt_long(argc, argv, ":e:v:b:x:y:w:h", longopts, &optindex)) != -1) {
           switch (opt) {
           case 'e':
                eval_list = optarg;
@@ -743,6 +1271,121 @@ int main(int argc, char *argv[])
           case 'y':
                y_shift = atoi(optarg);
                break;
+          case 'w':
+               weights = optarg;
+               break;
+          case OPT_ENGINE_CACHE:
+               engine_cache = optarg;
+               break;
+          case OPT_NO_ENGINE_CACHE:
+               use_engine_cache = 0;
+               break;
+          case OPT_REBUILD_ENGINE:
+               rebuild_engine = 1;
+               break;
+          case OPT_BACKEND:
+               if (!strcmp(optarg, "cpu")) {
+                    use_cpu = 1;
+               } else if (strcmp(optarg, "trt")) {
+                    fprintf(stderr, "unknown backend %s\n", optarg);
+                    print_usage_and_exit();
+               }
+               break;
+          case OPT_CHECK_CPU:
+               check_cpu = 1;
+               break;
+          case OPT_THREADS:
+#ifdef _OPENMP
+               omp_set_num_threads(atoi(optarg));
+#endif
+               break;
+          case OPT_WINOGRAD:
+               winograd_layers = optarg;
+               break;
+          case OPT_CPU_FUSION:
+               if (!strcmp(optarg, "none")) {
+                    cpu_fusion = CPU_FUSION_NONE;
+               } else if (!strcmp(optarg, "fire")) {
+                    cpu_fusion = CPU_FUSION_FIRE;
+               } else if (!strcmp(optarg, "group")) {
+                    cpu_fusion = CPU_FUSION_GROUP;
+               } else {
+                    fprintf(stderr, "unknown cpu fusion mode %s\n", optarg);
+                    print_usage_and_exit();
+               }
+               break;
+          case OPT_CPU_PRECISION:
+               if (!strcmp(optarg, "int8")) {
+                    cpu_int8 = 1;
+               } else if (strcmp(optarg, "fp32")) {
+                    fprintf(stderr, "unknown cpu precision %s\n", optarg);
+                    print_usage_and_exit();
+               }
+               break;
+          case OPT_CPU_STORAGE:
+               if (!strcmp(optarg, "fp32")) {
+                    cpu_storage = STORAGE_FP32;
+               } else if (!strcmp(optarg, "fp16")) {
+                    cpu_storage = STORAGE_FP16;
+               } else if (!strcmp(optarg, "bf16")) {
+                    cpu_storage = STORAGE_BF16;
+               } else {
+                    fprintf(stderr, "unknown cpu storage type %s\n", optarg);
+                    print_usage_and_exit();
+               }
+               break;
+          case OPT_BATCH:
+               batch = atoi(optarg);
+               if (batch < 1 || batch > MAX_BATCH) {
+                    fprintf(stderr, "batch size must be between 1 and %d\n", MAX_BATCH);
+                    print_usage_and_exit();
+               }
+               break;
+          case OPT_PIPELINE:
+               pipeline = 1;
+               if (optarg && (sscanf(optarg, "%d,%d,%d", &workers[0], &workers[1], &workers[2]) != 3 ||
+                              workers[0] < 1 || workers[1] < 1 || workers[2] < 1)) {
+                    fprintf(stderr, "--pipeline needs three worker counts of at least 1\n");
+                    print_usage_and_exit();
+               }
+               break;
+          case OPT_QUEUE_SIZE:
+               queue_size = atoi(optarg);
+               if (queue_size < 1) {
+                    fprintf(stderr, "queue size must be at least 1\n");
+                    print_usage_and_exit();
+               }
+               break;
+          case OPT_POSTPROCESS:
+               if (!strcmp(optarg, "unfused")) {
+                    unfusedPostprocess = 1;
+               } else if (strcmp(optarg, "fused")) {
+                    fprintf(stderr, "unknown postprocess mode %s\n", optarg);
+                    print_usage_and_exit();
+               }
+               break;
+          case OPT_SCORE_FLOOR:
+               scoreFloor = PROB_THRESH;
+               break;
+          case OPT_INPUT_SIZE:
+               if (sscanf(optarg, "%dx%d", &inputW, &inputH) != 2 ||
+                   inputW < MIN_INPUT_SIZE || inputH < MIN_INPUT_SIZE) {
+                    fprintf(stderr, "input size must be WxH, both at least %d\n", MIN_INPUT_SIZE);
+                    print_usage_and_exit();
+               }
+               break;
+          case OPT_TRACE:
+               trace_file = optarg;
+               break;
+          case OPT_TRACE_SYNC:
+               traceSync = 1;
+               break;
+          case OPT_INPUT_CACHE:
+               input_cache = optarg;
+               break;
+          case OPT_RESULTS_FILE:
+               results_file = optarg;
+               break;
           case 'h':
                print_usage_and_exit();
                break;
@@ -764,36 +1407,111 @@ int main(int argc, char *argv[])
      }
      if (bbox_dir != NULL)
           validateDir(bbox_dir, 1);
+     if (engine_cache != NULL)
+          validateDir(engine_cache, 1);
+     if (queue_size == 0)
+          queue_size = 2 * batch;
+     if (pipeline && queue_size < batch) {
+          fprintf(stderr, "queue size must be at least the batch size %d\n", batch);
+          print_usage_and_exit();
+     }
+     if (use_cpu && unfusedPostprocess)
+          errx(EXIT_FAILURE, "--postprocess=unfused needs the TensorRT interpret engine, not --backend=cpu");
+     traceThreadName("main");
+     if (trace_file != NULL && !traceOpen(trace_file))
+          err(EXIT_FAILURE, "cannot write the trace %s", trace_file);
+
+     // the grid follows the input size, and so do the anchors with their shapes scaled to it
+     convoutH = gridSize(inputH);
+     convoutW = gridSize(inputW);
+     float anchorShape[ANCHORS_PER_GRID * 2];
+     for (int i = 0; i < ANCHORS_PER_GRID; i++) {
+          anchorShape[i*2] = ANCHOR_SHAPE[i*2] * inputW / TRAIN_INPUT_W;
+          anchorShape[i*2+1] = ANCHOR_SHAPE[i*2+1] * inputH / TRAIN_INPUT_H;
+     }
+     if (inputW != TRAIN_INPUT_W || inputH != TRAIN_INPUT_H)
+          printf("input %dx%d, conv_out grid %dx%d\n", inputW, inputH, convoutW, convoutH);
+     if (input_cache != NULL) {
+          if (video != NULL)
+               errx(EXIT_FAILURE, "--input-cache is for images, not a video");
+          inputCache = openInputCache(input_cache, inputH, inputW);
+     }
 
-     // maloc host memory
-     size_t inputSize = sizeof(float) * INPUT_C * INPUT_H * INPUT_W;
+     // maloc host memory, for a whole batch
+     size_t inputVol = INPUT_C * inputH * inputW;
+     size_t inputSize = sizeof(float) * inputVol * batch;
      float *data = (float *)sdt_alloc(inputSize);
-     float *anchors = prepareAnchors(ANCHOR_SHAPE, INPUT_W, INPUT_H, INPUT_N, CONVOUT_H, CONVOUT_W, ANCHORS_PER_GRID);
+     float *imgSizes = (float *)sdt_alloc(sizeof(float) * 2 * batch);
+     float *anchors = prepareAnchors(anchorShape, inputW, inputH, 1, convoutH, convoutW, ANCHORS_PER_GRID);
      struct predictions preds;
-     preds.prob = (float *)sdt_alloc(sizeof(float) * TOP_N_DETECTION);
-     preds.klass = (float *)sdt_alloc(sizeof(float) * TOP_N_DETECTION);
-     preds.bbox = (float *)sdt_alloc(sizeof(float) * TOP_N_DETECTION * OUTPUT_BBOX_SIZE);
-     preds.keep = (int *)sdt_alloc(sizeof(int) * TOP_N_DETECTION);
+     preds.prob = (float *)sdt_alloc(sizeof(float) * TOP_N_DETECTION * batch);
+     preds.klass = (float *)sdt_alloc(sizeof(float) * TOP_N_DETECTION * batch);
+     preds.bbox = (float *)sdt_alloc(sizeof(float) * TOP_N_DETECTION * OUTPUT_BBOX_SIZE * batch);
+     preds.keep = (int *)sdt_alloc(sizeof(int) * TOP_N_DETECTION * batch);
      preds.num = TOP_N_DETECTION;
+     NmsContext *nms = createNms(TOP_N_DETECTION, OUTPUT_CLS_SIZE); // reused by every image of the loop
+
+     // create engines, or deserialize them from the engine cache
+     std::string weightsFile = weights ? std::string(weights) : locateFile(WEIGHTS_NAME);
+     std::string weightsDir = weightsFile.find('/') == std::string::npos ?
+          std::string(".") : weightsFile.substr(0, weightsFile.rfind('/'));
+     if (use_engine_cache && engine_cache == NULL)
+          engine_cache = const_cast<char *>(weightsDir.c_str());
+     // the cpu backend needs neither TensorRT nor a GPU
+     IRuntime *runtime = NULL;
+     ICudaEngine *convEngine = NULL, *interpretEngine = NULL;
+     IExecutionContext *convContext = NULL, *interpretContext = NULL;
+     if (!use_cpu) {
+          runtime = createInferRuntime(gLogger);
+          loadEngines(runtime, weightsFile, batch, use_engine_cache ? engine_cache : NULL,
+                      rebuild_engine, &convEngine, &interpretEngine);
+          convContext = convEngine->createExecutionContext();
+          interpretContext = interpretEngine->createExecutionContext();
+
+          // malloc device memory
+          setUpDevice(convContext, interpretContext, anchors, batch, check_cpu);
+     }
 
-     // create engines
-     IHostMemory *convModelStream{ nullptr };
-     IHostMemory *interpretModelStream{ nullptr };
-     APIToModel(INPUT_N, &convModelStream, &interpretModelStream);
-
-     // deserialize engines
-     IRuntime* runtime = createInferRuntime(gLogger);
-     ICudaEngine* convEngine = runtime->deserializeCudaEngine(convModelStream->data(), convModelStream->size(), nullptr);
-     ICudaEngine* interpretEngine = runtime->deserializeCudaEngine(interpretModelStream->data(), interpretModelStream->size(), nullptr);
-     IExecutionContext *convContext = convEngine->createExecutionContext();
-     IExecutionContext *interpretContext = interpretEngine->createExecutionContext();
-
-     // malloc device memory
-     setUpDevice(convContext, interpretContext, anchors, INPUT_N);
+     // the cpu backend keeps its own copy of the weights
+     if (use_cpu || check_cpu) {
+          WeightMap weightMap = loadWeights(weightsFile);
+          cpuEngine = createCpuEngine(weightMap, INPUT_C, inputH, inputW);
+          assert(cpuEngine->oc == CONVOUT_C && cpuEngine->oh == convoutH && cpuEngine->ow == convoutW);
+          if (winograd_layers)
+               selectWinogradLayers(cpuEngine, winograd_layers);
+          cpuEngine->fusion = cpu_fusion;
+          if (cpu_storage != STORAGE_FP32) {
+               setCpuStorage(cpuEngine, cpu_storage);
+               printf("cpu activations stored as %s\n", storageName(cpu_storage));
+          }
+          freeWeights(weightMap);
+          convoutHost = (float *)sdt_alloc(sizeof(float) * batch * CONVOUT_C * convoutH * convoutW);
+     }
+     if (use_cpu)
+          setUpHost(anchors, batch);
+
+     // the calibration table is named after the weights it was computed with
+     if (cpuEngine && cpu_int8) {
+          char *calib_path = sdt_path_alloc(NULL);
+          sprintf(calib_path, "%s/sqdtrt-%016llx.calib", weightsDir.c_str(),
+                  (unsigned long long)hashFile(weightsFile.c_str()));
+          if (loadCpuCalibration(cpuEngine, calib_path)) {
+               printf("cpu calibration table: %s\n", calib_path);
+          } else {
+               if (img_dir == NULL || eval_list == NULL)
+                    errx(EXIT_FAILURE, "no calibration table %s, int8 needs --eval-list images to calibrate",
+                         calib_path);
+               calibrateCpuEngine(cpuEngine, getImageList(img_dir, eval_list), data);
+               if (saveCpuCalibration(cpuEngine, calib_path))
+                    printf("cpu calibration table saved: %s\n", calib_path);
+          }
+          printf("cpu int8: %d convolutions quantized, %s kernel\n", quantizeCpuEngine(cpuEngine),
+                 int8KernelName(int8Kernel()));
+          sdt_free(calib_path);
+     }
 
      // read image or video, alloc path buffer
-     FILE *result_fp;
-     char *result_file_path = NULL;
+     ResultWriter *resultWriter = NULL;
      char *img_name_buf = NULL;
      char *bbox_file_path = NULL;
      std::vector<std::string> imageList;
@@ -801,9 +1519,9 @@ int main(int argc, char *argv[])
      // double write_fps;
      cv::VideoCapture cap;
      cv::VideoWriter writer;
-     cv::Mat frame, frame_origin;
+     cv::Mat frame;
      if (video == NULL) {
-          result_file_path = sdt_path_alloc(NULL);
+          resultWriter = createResultWriter(results_file ? NULL : result_dir, results_file, CLASS_NAMES);
           img_name_buf = sdt_path_alloc(NULL);
           imageList = getImageList(img_dir, eval_list);
           img_list_size = imageList.size();
@@ -837,102 +1555,182 @@ int main(int argc, char *argv[])
           }
      }
 
-     // do inference
-     int frame_idx = 0;
+     double avg_imread, avg_detect, avg_misc, avg_fps;
+     if (pipeline) {
+          PipelineContext pc = PipelineContext();
+          pthread_mutex_init(&pc.mutex, NULL);
+          pc.images = video == NULL ? &imageList : NULL;
+          pc.cap = &cap;
+          pc.convContext = convContext;
+          pc.interpretContext = interpretContext;
+          pc.use_cpu = use_cpu;
+          pc.check_cpu = check_cpu;
+          pc.batch = batch;
+          pc.x_shift = x_shift;
+          pc.y_shift = y_shift;
+          pc.data = data;
+          pc.imgSizes = imgSizes;
+          pc.inputSize = inputSize;
+          pc.preds = &preds;
+          pc.results = resultWriter;
+          pc.img_name_buf = img_name_buf;
+          pc.writer = video != NULL && bbox_dir != NULL ? &writer : NULL;
+          runFramePipeline(&pc, workers, queue_size, &avg_imread, &avg_detect, &avg_misc, &avg_fps);
+          pthread_mutex_destroy(&pc.mutex);
+     }
+
+     // do inference, a batch of up to batch images or frames at a time, unless --pipeline did
+     int frame_idx = 0, nimages = 0, n, done = pipeline;
      char key;
      double start_fps, end_fps;
      double fps;
      double imread_time_sum = 0, detect_time_sum = 0, misc_time_sum = 0, fps_sum = 0;
-     float img_width, img_height;
-     for (;; frame_idx++) {
+     double timeImread, timeMisc;
+     std::vector<cv::Mat> origins(batch);
+     std::vector<const unsigned char *> cached(batch);
+     std::vector<std::string> names(batch);
+     const int readTrace = traceStage("read"), postprocessTrace = traceStage("postprocess");
+     while (!done) {
           start_fps = getUnixTime();
-          if (video == NULL) {
-               if (frame_idx >= img_list_size) { // end of images
-                    frame_idx--;
-                    break;
-               }
-               getFileName(img_name_buf, imageList[frame_idx].c_str());
-               printf("(%d/%d) image: %s ", frame_idx+1, img_list_size, img_name_buf);
-               CHECK(cudaEventRecord(start_imread, 0));
-               frame_origin = cv::imread(imageList[frame_idx]);
-               if (frame_origin.empty()) {
-                    fprintf(stderr, "error reading image\n");
-                    continue;
+          long long begin = traceBegin();
+          for (n = 0; n < batch;) {
+               if (video == NULL) {
+                    if (frame_idx >= img_list_size) { // end of images
+                         done = 1;
+                         break;
+                    }
+                    names[n] = imageList[frame_idx++];
+                    getFileName(img_name_buf, names[n].c_str());
+                    printf("(%d/%d) image: %s ", frame_idx, img_list_size, img_name_buf);
+                    TRACE_SCOPE("decode");
+                    cached[n] = inputCache ? inputCacheLookup(inputCache, names[n].c_str(), &imgSizes[n * 2],
+                                                              &imgSizes[n * 2 + 1]) : NULL;
+                    if (!cached[n] && (origins[n] = cv::imread(names[n])).empty()) {
+                         fprintf(stderr, "error reading image\n");
+                         continue;
+                    }
+               } else {
+                    TRACE_SCOPE("decode");
+                    cached[n] = NULL;
+                    if (cap.read(origins[n]) == false) { // end of video
+                         done = 1;
+                         break;
+                    }
+                    if (origins[n].empty()) {
+                         fprintf(stderr, "error reading frame %d\n", frame_idx++);
+                         continue;
+                    }
+                    frame_idx++;
                }
-          } else {
-               CHECK(cudaEventRecord(start_imread, 0));
-               if (cap.read(frame_origin) == false) { // end of video
-                    frame_idx--;
-                    break;
-               }
-               if (frame_origin.empty()) {
-                    fprintf(stderr, "error reading frame %d\n", frame_idx);
-                    continue;
+               {
+                    TRACE_SCOPE("preprocess");
+                    prepareInput(data + n * inputVol, cached[n], origins[n], frame,
+                                 video == NULL ? names[n].c_str() : NULL, &imgSizes[n * 2], RESIZE_PARALLEL);
                }
+               n++;
           }
-          preprocessFrame(frame, frame_origin, INPUT_W, INPUT_H, &img_width, &img_height);
-          prepareData(data, frame);
-
-          doInference(convContext, interpretContext, data, inputSize, img_width, img_height, x_shift, y_shift, &preds, INPUT_N);
-          detectionFilter(&preds, NMS_THRESH, PROB_THRESH);
+          timeImread = traceEnd(readTrace, begin);
+          if (n == 0)
+               break;
 
-          if (video == NULL) {
-               assemblePath(result_file_path, result_dir, imageList[frame_idx].c_str(), ".txt");
-               result_fp = fopen(result_file_path, "w");
-               fprintResult(result_fp, &preds);
-               fclose(result_fp);
-          } else {
-               drawBbox(frame_origin, &preds);
-               if (bbox_dir != NULL) {
-                    writer.write(frame_origin);
-               }
-               cv::imshow("detection", frame_origin);
-               key = cv::waitKey(1);
-               if (key == ' ') {
-                    cv::waitKey(0);
-               } else if (key == 'q' || key == 27) { // 27 is the ASCII code of ESC
-                    frame_idx--;
-                    break;
+          // the last batch may not be full, the images left over from the one before go
+          // through the pipeline as well and their detections are ignored
+          doInference(convContext, interpretContext, use_cpu, data, inputSize, imgSizes, x_shift, y_shift, &preds, batch);
+          if (check_cpu && !use_cpu)
+               checkCpuBackend(data, batch);
+          begin = traceBegin();
+          for (int i = 0; i < n; i++) {
+               struct predictions imagePreds = imagePredictions(&preds, i);
+               detectionFilter(nms, &imagePreds, NMS_THRESH, scoreFloor);
+          }
+          timeMisc = traceEnd(postprocessTrace, begin);
+          for (int i = 0; i < n; i++) {
+               struct predictions imagePreds = imagePredictions(&preds, i);
+               TRACE_SCOPE("write");
+               if (video == NULL) {
+                    resultWriterSubmit(resultWriter, names[i].c_str(), &imagePreds);
+               } else {
+                    drawBbox(origins[i], &imagePreds);
+                    if (bbox_dir != NULL) {
+                         writer.write(origins[i]);
+                    }
+                    cv::imshow("detection", origins[i]);
+                    key = cv::waitKey(1);
+                    if (key == ' ') {
+                         cv::waitKey(0);
+                    } else if (key == 'q' || key == 27) { // 27 is the ASCII code of ESC
+                         done = 1;
+                         n = i + 1;
+                         break;
+                    }
                }
           }
 
           end_fps = getUnixTime();
-          fps = 1 / (end_fps - start_fps);
+          fps = n / (end_fps - start_fps);
+          if (batch > 1)
+               printf("batch of %d ", n);
           printf("imread: %.2fms detect: %.2fms misc: %.2fms fps: %.2fHz\n", timeImread, timeDetect, timeMisc, fps);
           imread_time_sum += timeImread;
           detect_time_sum += timeDetect;
           misc_time_sum += timeMisc;
-          fps_sum += fps;
+          fps_sum += fps * n;
+          nimages += n;
      }
      cap.release();
      writer.release();
      // clean up device memory
      cleanUp();
+     if (resultWriter) {
+          ResultWriterStats stats;
+          closeResultWriter(resultWriter, &stats);
+          fprintResultWriterStats(stdout, &stats);
+     }
+     if (inputCache) {
+          int hits, added;
+          closeInputCache(inputCache, &hits, &added);
+          printf("input cache: %d hits, %d added\n", hits, added);
+     }
 
      // compute timing result
-     double avg_imread, avg_detect, avg_misc, avg_fps;
-     avg_imread = imread_time_sum / (frame_idx + 1);
-     avg_detect = detect_time_sum / (frame_idx + 1);
-     avg_misc = misc_time_sum / (frame_idx + 1);
-     avg_fps = fps_sum / (frame_idx + 1);
+     // per image, a batch shares its detect time among its images
+     if (!pipeline) {
+          nimages = std::max(nimages, 1);
+          avg_imread = imread_time_sum / nimages;
+          avg_detect = detect_time_sum / nimages;
+          avg_misc = misc_time_sum / nimages;
+          avg_fps = fps_sum / nimages;
+     }
      printf("Average timing: imread: %.2fms detect: %.2fms misc: %.2fms fps: %.2fHz\n", avg_imread, avg_detect, avg_misc, avg_fps);
+     printTraceStats(stdout);
+     if (trace_file != NULL) {
+          traceClose();
+          printf("trace: %s\n", trace_file);
+     }
 
      // destroy the engine
-     convContext->destroy();
-     interpretContext->destroy();
-     convEngine->destroy();
-     interpretEngine->destroy();
-     runtime->destroy();
+     if (runtime) {
+          convContext->destroy();
+          interpretContext->destroy();
+          convEngine->destroy();
+          interpretEngine->destroy();
+          runtime->destroy();
+     }
 
      // clean up host memory
      sdt_free(img_name_buf);
-     sdt_free(result_file_path);
      sdt_free(data);
+     sdt_free(imgSizes);
      sdt_free(anchors);
+     if (cpuEngine) {
+          destroyCpuEngine(cpuEngine);
+          sdt_free(convoutHost);
+     }
      sdt_free(preds.prob);
      sdt_free(preds.klass);
      sdt_free(preds.bbox);
      sdt_free(preds.keep);
+     destroyNms(nms);
 
      return 0;
 }
@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <algorithm>
+#include "tensorArena.h"
+#include "sdt_alloc.h"
+
+/* an arena for up to capacity buffers */
+TensorArena *createArena(MallocKind kind, int capacity)
+{
+     assert(capacity > 0);
+     TensorArena *arena = (TensorArena *)sdt_alloc(sizeof(TensorArena));
+
+     memset(arena, 0, sizeof(TensorArena));
+     arena->kind = kind;
+     arena->reuse = 1;
+     arena->capacity = capacity;
+     arena->buffers = (ArenaBuffer *)sdt_alloc(sizeof(ArenaBuffer) * capacity);
+     arena->tensors = (Tensor **)sdt_alloc(sizeof(Tensor *) * capacity);
+     return arena;
+}
+
+/* *ptr gets a buffer of size bytes, valid from step first through step last */
+void arenaAdd(TensorArena *arena, const char *name, void **ptr, size_t size, int first, int last)
+{
+     assert(arena && name && ptr && !arena->data);
+     assert(arena->num < arena->capacity);
+     assert(first < 0 || first <= last);
+
+     ArenaBuffer *b = &arena->buffers[arena->num++];
+     b->name = name;
+     b->ptr = ptr;
+     b->size = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+     b->first = first;
+     b->last = last;
+     b->offset = 0;
+     *ptr = NULL;
+}
+
+/* a tensor whose data is in the arena, NULL until allocArena() */
+Tensor *arenaTensor(TensorArena *arena, const char *name, int ndim, const int *dims, int first, int last)
+{
+     assert(arena);
+     Tensor *t = createTensor(NULL, ndim, dims);
+
+     arena->tensors[arena->ntensors++] = t;
+     arenaAdd(arena, name, (void **)&t->data, sizeof(float) * t->len, first, last);
+     return t;
+}
+
+static int isLive(const ArenaBuffer *b)
+{
+     return b->first >= 0;
+}
+
+static int overlapInTime(const ArenaBuffer *a, const ArenaBuffer *b)
+{
+     return a->first <= b->last && b->first <= a->last;
+}
+
+struct LargerBuffer {
+     const ArenaBuffer *buffers;
+     bool operator()(int a, int b) const
+     {
+          return buffers[a].size > buffers[b].size || (buffers[a].size == buffers[b].size && a < b);
+     }
+};
+
+struct LowerOffset {
+     const ArenaBuffer *buffers;
+     bool operator()(int a, int b) const { return buffers[a].offset < buffers[b].offset; }
+};
+
+/* Sets the offsets of all buffers and returns the size of the arena. A buffer goes to
+   the lowest gap between the buffers placed before it that are live during any of
+   its steps. */
+size_t planArena(TensorArena *arena)
+{
+     assert(arena && !arena->data);
+     int *order = (int *)sdt_alloc(sizeof(int) * (arena->num + 1));
+     int *placed = (int *)sdt_alloc(sizeof(int) * (arena->num + 1));
+     int i, j, k, nplaced = 0;
+     LargerBuffer larger = {arena->buffers};
+     LowerOffset lower = {arena->buffers};
+
+     arena->size = 0;
+     arena->total = 0;
+     for (i = 0; i < arena->num; i++) {
+          order[i] = i;
+          if (isLive(&arena->buffers[i]))
+               arena->total += arena->buffers[i].size;
+     }
+     std::sort(order, order + arena->num, larger);
+     for (i = 0; i < arena->num; i++) {
+          ArenaBuffer *b = &arena->buffers[order[i]];
+          if (!isLive(b))
+               continue;
+          size_t offset = 0;
+          if (arena->reuse) {
+               // the buffers placed already are sorted by offset
+               for (j = 0; j < nplaced; j++) {
+                    const ArenaBuffer *p = &arena->buffers[placed[j]];
+                    if (!overlapInTime(b, p))
+                         continue;
+                    if (offset + b->size <= p->offset)
+                         break;
+                    offset = std::max(offset, p->offset + p->size);
+               }
+          } else {
+               offset = arena->size;
+          }
+          b->offset = offset;
+          arena->size = std::max(arena->size, offset + b->size);
+          for (k = nplaced; k > 0 && lower(order[i], placed[k-1]); k--)
+               placed[k] = placed[k-1];
+          placed[k] = order[i];
+          nplaced++;
+     }
+     sdt_free(order);
+     sdt_free(placed);
+     return arena->size;
+}
+
+void fprintArena(FILE *stream, const TensorArena *arena)
+{
+     assert(stream && arena);
+     int live = 0;
+
+     for (int i = 0; i < arena->num; i++)
+          live += isLive(&arena->buffers[i]);
+     fprintf(stream, "%s arena: %d buffers in %.2f MB, %.2f MB allocated one by one\n",
+             arena->kind == DEVICE ? "device" : "host", live, arena->size / 1048576.0, arena->total / 1048576.0);
+#ifdef DEBUG
+     for (int i = 0; i < arena->num; i++) {
+          const ArenaBuffer *b = &arena->buffers[i];
+          if (isLive(b))
+               fprintf(stream, "  %-20s %10zu bytes at %10zu, steps %d-%d\n", b->name, b->size, b->offset,
+                       b->first, b->last);
+     }
+#endif
+}
+
+/* the arena without its memory, see freeArena() */
+void destroyArena(TensorArena *arena)
+{
+     assert(arena && !arena->data);
+     for (int i = 0; i < arena->ntensors; i++) {
+          sdt_free(arena->tensors[i]->dims);
+          sdt_free(arena->tensors[i]);
+     }
+     sdt_free(arena->tensors);
+     sdt_free(arena->buffers);
+     sdt_free(arena);
+}
@@ -0,0 +1,45 @@
+#ifndef _TENSOR_ARENA_H_
+#define _TENSOR_ARENA_H_
+
+#include <stdio.h>
+#include "tensorUtil.h"
+
+/* One allocation for all the buffers of an inference. Every buffer is added with the
+   first and last step of the inference sequence it is used in, and buffers whose
+   steps don't overlap can share memory. planArena() packs them greedily, the largest
+   first, at the lowest offset free during all of its steps. allocArena() and
+   freeArena() are in tensorUtil.cu with the other allocations of either MallocKind. */
+
+#define ARENA_ALIGN 256         /* of every buffer, the same as of a cudaMalloc() */
+
+typedef struct {
+     const char *name;
+     void **ptr;                /* set to the buffer by allocArena() */
+     size_t size;
+     int first, last;           /* steps using it, a buffer with first < 0 gets no memory */
+     size_t offset;
+} ArenaBuffer;
+
+typedef struct {
+     MallocKind kind;
+     int reuse;                 /* 0 to give every buffer memory of its own, such as to look at them all afterwards */
+     int num, capacity;
+     ArenaBuffer *buffers;      /* [capacity] */
+     int ntensors;
+     Tensor **tensors;          /* [capacity] those of arenaTensor(), freed with the arena */
+     size_t size;               /* of the arena, after planArena() */
+     size_t total;              /* of all buffers, if each was allocated on its own */
+     void *data;
+} TensorArena;
+
+TensorArena *createArena(MallocKind kind, int capacity);
+void arenaAdd(TensorArena *arena, const char *name, void **ptr, size_t size, int first, int last);
+Tensor *arenaTensor(TensorArena *arena, const char *name, int ndim, const int *dims, int first, int last);
+size_t planArena(TensorArena *arena);
+void fprintArena(FILE *stream, const TensorArena *arena);
+void destroyArena(TensorArena *arena);
+
+void allocArena(TensorArena *arena);
+void freeArena(TensorArena *arena);
+
+#endif  /* _TENSOR_ARENA_H_ */
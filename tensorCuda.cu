@@ -1,26 +1,26 @@
 #include <cuda_runtime.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <math.h>
+#include "tensorCuda.h"
 
 #define max(a, b) ((a) > (b) ? (a) : (b))
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
 static __device__ float E = 2.718281828;
 
-static __device__ int getIndex(int *ids, int ndim, int *dims)
+/* of element i from the plan's strides, the same as planOffset() of tensorHost.cpp */
+static __device__ long planOffset(const TransposePlan &plan, long i)
 {
-     int i, id;
-     for (i = 0, id = ids[0]; i < ndim-1; i++)
-          id = dims[i+1] * id + ids[i+1];
-     return id;
-}
-
-static __device__ void getIndexes(int id, int *ids, int ndim, int *dims)
-{
-     for (int i = ndim-1; i >=0; i--) {
-          ids[i] = id % dims[i];
-          id = id / dims[i];
+     long offset = 0;
+#pragma unroll
+     for (int k = MAXDIM - 1; k >= 0; k--) {
+          if (k >= plan.ndim)
+               continue;
+          offset += i % plan.dims[k] * plan.strides[k];
+          i /= plan.dims[k];
      }
+     return offset;
 }
 
 /* __global__ void sliceTensorKernel(float *src, float *dst, int sdim, int ddim, int start, int block_size) */
@@ -65,6 +65,36 @@ __global__ void reduceArgMaxKernel(float *src, float *dst, float *arg, int dim_s
      arg[di] = maxi;
 }
 
+/* a view src, each thread reads the dim_size elements step apart from the offset the plan
+   gives its record */
+__global__ void reduceArgMaxStridedKernel(float *src, float *dst, float *arg, TransposePlan plan, int dim_size, long step, int block_size, int total)
+{
+     int di = blockIdx.x * block_size + threadIdx.x;
+     if (di >= total)
+          return;
+
+     const float *s = src + planOffset(plan, di);
+     float now, max = s[0];
+     int maxi = 0;
+     for (int i = 1; i < dim_size; i++) {
+          now = s[i * step];
+          if (now > max) {
+               max = now;
+               maxi = i;
+          }
+     }
+     dst[di] = max;
+     arg[di] = maxi;
+}
+
+__global__ void multiplyStridedKernel(float *src1, float *src2, float *dst, TransposePlan plan1, TransposePlan plan2, int block_size, int total)
+{
+     int di = blockIdx.x * block_size + threadIdx.x;
+     if (di >= total)
+          return;
+     dst[di] = src1[planOffset(plan1, di)] * src2[planOffset(plan2, di)];
+}
+
 __global__ void multiplyElementKernel(float *src1, float *src2, float *dst, int block_size, int total)
 {
      int di = blockIdx.x * block_size + threadIdx.x;
@@ -73,52 +103,268 @@ __global__ void multiplyElementKernel(float *src1, float *src2, float *dst, int
      dst[di] = src1[di] * src2[di];
 }
 
-__global__ void transposeTensorKernel(float *src, float *dst, int ndim, int *s_dims, int *d_dims, int *s_ids, int *d_ids, int *axes, int block_size, int total)
+/* dst[di] from the plan's strides, with a loop the compiler unrolls for NDIM > 0 and
+   one over plan.ndim dimensions for NDIM = 0 */
+template <int NDIM>
+__global__ void transposeStridedKernel(float *src, float *dst, TransposePlan plan, int block_size, int total)
 {
      int di = blockIdx.x * block_size + threadIdx.x;
      if (di >= total)
           return;
 
-     int *t_s_ids = s_ids + di * ndim;
-     int *t_d_ids = d_ids + di * ndim;
-     getIndexes(di, t_d_ids, ndim, d_dims);
-     for (int i = 0; i < ndim; i++)
-          t_s_ids[axes[i]] = t_d_ids[i];
-     int si = getIndex(t_s_ids, ndim, s_dims);
-
+     int ndim = NDIM > 0 ? NDIM : plan.ndim, rest = di;
+     long si = 0;
+#pragma unroll
+     for (int k = (NDIM > 0 ? NDIM : MAXDIM) - 1; k >= 0; k--) {
+          if (k >= ndim)
+               continue;
+          si += rest % plan.dims[k] * plan.strides[k];
+          rest /= plan.dims[k];
+     }
      dst[di] = src[si];
 }
 
-__global__ void transformBboxSQDKernel(float *delta, float *anchor, float *res, float width, float height, float img_width, float img_height, int x_shift, int y_shift, int block_size, int total)
+template __global__ void transposeStridedKernel<0>(float *src, float *dst, TransposePlan plan, int block_size, int total);
+template __global__ void transposeStridedKernel<2>(float *src, float *dst, TransposePlan plan, int block_size, int total);
+template __global__ void transposeStridedKernel<3>(float *src, float *dst, TransposePlan plan, int block_size, int total);
+template __global__ void transposeStridedKernel<4>(float *src, float *dst, TransposePlan plan, int block_size, int total);
+
+/* [batch, rows, cols] to [batch, cols, rows] through a shared memory tile, so that both
+   the reads and the writes are coalesced. Blocks of TRANSPOSE_TILE x TRANSPOSE_ROWS
+   threads, a grid of column tiles x row tiles x batch. The images of src are batch_stride apart. */
+__global__ void transposeBatchedKernel(float *src, float *dst, int rows, int cols, long batch_stride)
+{
+     __shared__ float tile[TRANSPOSE_TILE][TRANSPOSE_TILE + 1]; // +1 against bank conflicts
+     long vol = (long)rows * cols;
+     int x = blockIdx.x * TRANSPOSE_TILE + threadIdx.x;
+     int y = blockIdx.y * TRANSPOSE_TILE + threadIdx.y;
+
+     src += blockIdx.z * batch_stride;
+     dst += blockIdx.z * vol;
+     for (int j = 0; j < TRANSPOSE_TILE; j += TRANSPOSE_ROWS)
+          if (x < cols && y + j < rows)
+               tile[threadIdx.y + j][threadIdx.x] = src[(long)(y + j) * cols + x];
+     __syncthreads();
+     x = blockIdx.y * TRANSPOSE_TILE + threadIdx.x;
+     y = blockIdx.x * TRANSPOSE_TILE + threadIdx.y;
+     for (int j = 0; j < TRANSPOSE_TILE; j += TRANSPOSE_ROWS)
+          if (x < rows && y + j < cols)
+               dst[(long)(y + j) * rows + x] = tile[threadIdx.x][threadIdx.y + j];
+}
+
+/* one bbox from its delta d and anchor a, according to SqueezeDet's source code */
+static __device__ void decodeBboxSQD(const float *d, const float *a, float *r, float x_scale, float y_scale,
+                                     float img_width, float img_height, int x_shift, int y_shift)
+{
+     /* TODO: don't know why (maybe the resize), always has some shift compared to groundtruth*/
+     float cx = (a[0] + d[0] * a[2]) / x_scale + x_shift;
+     float cy = (a[1] + d[1] * a[3]) / y_scale + y_shift;
+     float w = (a[2] * (d[2] < 1 ? expf(d[2]) : d[2] * E)) / x_scale;
+     float h = (a[3] * (d[3] < 1 ? expf(d[3]) : d[3] * E)) / y_scale;
+     r[0] = min(max(cx - w * 0.5, 0), img_width - 1);
+     r[1] = min(max(cy - h * 0.5, 0), img_height - 1);
+     r[2] = max(min(cx + w * 0.5, img_width - 1), 0);
+     r[3] = max(min(cy + h * 0.5, img_height - 1), 0);
+}
+
+/* delta and anchor are read through the plans of their bbox records, from planRecords() */
+__global__ void transformBboxSQDKernel(float *delta, float *anchor, float *res, TransposePlan d_plan, long d_step, TransposePlan a_plan, long a_step, float width, float height, float *img_sizes, int anchor_num, int x_shift, int y_shift, int block_size, int total)
 {
      int di = blockIdx.x * block_size + threadIdx.x;
      if (di >= total)
           return;
 
-     /* int batch_idx = di / anchor_num; */
-     /* now only support batch_size = 1 */
+     /* every image of the batch has its own original size */
+     int batch_idx = di / anchor_num;
+     float img_width = img_sizes[batch_idx * 2];
+     float img_height = img_sizes[batch_idx * 2 + 1];
      float x_scale = 1.0 * width / img_width;
      float y_scale = 1.0 * height / img_height;
 
-     /* (not used) si is the index of the first elements to be computed in the thread, then
-        si = 4 * anchor_num * batch_idx + (di - anchor_num * batch_idx),
-        which is the same as the following code: */
-     /* int si = 3 * anchor_num * batch_idx  + di; */
      /* take 4 elements from each of delta and anchor */
-     int si = di * 4;
-     float d[4] = {delta[si], delta[si+1], delta[si+2], delta[si+3]};
-     float a[4] = {anchor[si], anchor[si+1], anchor[si+2], anchor[si+3]};
-     /* compute and put 4 result elements to res, according to SqueezeDet's source code */
+     const float *ds = delta + planOffset(d_plan, di), *as = anchor + planOffset(a_plan, di);
+     float d[4] = {ds[0], ds[d_step], ds[2 * d_step], ds[3 * d_step]};
+     float a[4] = {as[0], as[a_step], as[2 * a_step], as[3 * a_step]};
+     /* compute and put 4 result elements to res */
+     decodeBboxSQD(d, a, res + di * 4, x_scale, y_scale, img_width, img_height, x_shift, y_shift);
+}
 
-     /* TODO: don't know why (maybe the resize), always has some shift compared to groundtruth*/
-     float cx = (a[0] + d[0] * a[2]) / x_scale + x_shift;
-     float cy = (a[1] + d[1] * a[3]) / y_scale + y_shift;
-     float w = (a[2] * (d[2] < 1 ? expf(d[2]) : d[2] * E)) / x_scale;
-     float h = (a[3] * (d[3] < 1 ? expf(d[3]) : d[3] * E)) / y_scale;
-     res[si] = min(max(cx - w * 0.5, 0), img_width - 1);
-     res[si+1] = min(max(cy - h * 0.5, 0), img_height - 1);
-     res[si+2] = max(min(cx + w * 0.5, img_width - 1), 0);
-     res[si+3] = max(min(cy + h * 0.5, img_height - 1), 0);
+/* One thread per anchor, the threads of a block go along the image rows of conv_out,
+   so their reads of every channel are coalesced. conv_out is [N, B * (ncls + 5), H, W] with
+   the class logits, then the confidences, then the bbox deltas of the B anchors, and
+   score, klass and bbox are [N, H, W, B] records. The anchor records are read through
+   a_plan, so one grid can be broadcast to the batch. */
+__global__ void interpretConvoutKernel(float *convout, float *anchor, float *score, float *klass, float *bbox, TransposePlan a_plan, long a_step, float width, float height, float *img_sizes, int H, int W, int B, int ncls, int x_shift, int y_shift, int block_size, int total)
+{
+     int ti = blockIdx.x * block_size + threadIdx.x;
+     if (ti >= total)
+          return;
+
+     /* ti is ((n * H + y) * B + a) * W + x */
+     int x = ti % W;
+     int a = ti / W % B;
+     int ny = ti / (W * B);     /* n * H + y */
+     int n = ny / H, y = ny % H;
+     int plane = H * W;
+     float *cell = convout + n * B * (ncls + 5) * plane + y * W + x;
+     float *logits = cell + a * ncls * plane;
+     float conf = cell[(B * ncls + a) * plane];
+     float *delta = cell + (B * (ncls + 1) + a * 4) * plane;
+
+     float m = logits[0], sum = 0;
+     int c, arg = 0;
+     for (c = 1; c < ncls; c++) {
+          if (logits[c * plane] > m) {
+               m = logits[c * plane];
+               arg = c;
+          }
+     }
+     for (c = 0; c < ncls; c++)
+          sum += expf(logits[c * plane] - m);
+
+     int o = (ny * W + x) * B + a;
+     score[o] = (1 / sum) * (1 / (1 + expf(-conf)));
+     klass[o] = arg;
+
+     float img_width = img_sizes[n * 2];
+     float img_height = img_sizes[n * 2 + 1];
+     float d[4] = {delta[0], delta[plane], delta[2 * plane], delta[3 * plane]};
+     const float *as = anchor + planOffset(a_plan, o);
+     float an[4] = {as[0], as[a_step], as[2 * a_step], as[3 * a_step]};
+     decodeBboxSQD(d, an, bbox + o * 4, 1.0 * width / img_width, 1.0 * height / img_height,
+                   img_width, img_height, x_shift, y_shift);
+}
+
+/* orders floats as unsigned ints, the larger float has the larger key */
+static __device__ __forceinline__ unsigned int floatKey(float f)
+{
+     unsigned int u = __float_as_uint(f);
+     return (u & 0x80000000) ? ~u : u | 0x80000000;
+}
+
+/* One block per segment of seg_len elements. A radix select over the keys of the
+   candidates (elements >= floor), 8 bits at a time from the top, finds the key of
+   the k-th largest one; the candidates above it and the first ones equal to it in
+   index order are gathered into shared memory and bitonic sorted there. blockDim.x
+   must be a multiple of 32, the dynamic shared memory holds a power of two >= k
+   values and indexes. */
+__global__ void topKKernel(float *src, float *val, int *idx, int *count, int seg_len, int k, float floor)
+{
+     extern __shared__ float topk_shared[];
+     __shared__ unsigned int hist[256];
+     __shared__ int warp_num[32];
+     __shared__ unsigned int prefix, mask;
+     __shared__ int num, want, above, ties;
+     int tid = threadIdx.x, lane = tid & 31, warp = tid >> 5;
+     int n2, i, j, shift, size, stride;
+     float *seg = src + (long)blockIdx.x * seg_len;
+
+     n2 = 1;
+     while (n2 < k)
+          n2 <<= 1;
+     float *s_val = topk_shared;
+     int *s_idx = (int *)(topk_shared + n2);
+
+     if (tid == 0) {
+          prefix = 0;
+          mask = 0;
+     }
+     for (shift = 24; shift >= 0; shift -= 8) {
+          for (i = tid; i < 256; i += blockDim.x)
+               hist[i] = 0;
+          __syncthreads();
+          for (i = tid; i < seg_len; i += blockDim.x) {
+               unsigned int key = floatKey(seg[i]);
+               if (seg[i] >= floor && (key & mask) == prefix)
+                    atomicAdd(&hist[(key >> shift) & 0xff], 1u);
+          }
+          __syncthreads();
+          if (tid == 0) {
+               unsigned int sum = 0;
+               int d = 255;
+               if (shift == 24) {
+                    for (j = 0; j < 256; j++)
+                         sum += hist[j];
+                    num = want = min(k, (int)sum);
+                    sum = 0;
+               }
+               if (want > 0) {
+                    // the digit of the k-th largest, counting down from the largest
+                    while (sum + hist[d] < (unsigned int)want)
+                         sum += hist[d--];
+                    prefix |= (unsigned int)d << shift;
+                    mask |= 0xffu << shift;
+                    want -= sum;
+               }
+               above = 0;
+               ties = 0;
+          }
+          __syncthreads();
+     }
+
+     // prefix is the key of the k-th largest now, want the number of ties with it to take
+     if (num > 0) {
+          for (i = tid; i < seg_len; i += blockDim.x) {
+               if (seg[i] >= floor && floatKey(seg[i]) > prefix) {
+                    j = atomicAdd(&above, 1);
+                    s_val[j] = seg[i];
+                    s_idx[j] = i;
+               }
+          }
+          for (int base = 0; base < seg_len && ties < want; base += blockDim.x) {
+               i = base + tid;
+               int tie = i < seg_len && seg[i] >= floor && floatKey(seg[i]) == prefix;
+               unsigned int ballot = __ballot_sync(0xffffffff, tie);
+               if (lane == 0)
+                    warp_num[warp] = __popc(ballot);
+               __syncthreads();
+               if (tie) {
+                    int rank = ties + __popc(ballot & ((1u << lane) - 1));
+                    for (j = 0; j < warp; j++)
+                         rank += warp_num[j];
+                    if (rank < want) {
+                         s_val[num - want + rank] = seg[i];
+                         s_idx[num - want + rank] = i;
+                    }
+               }
+               __syncthreads();
+               if (tid == 0)
+                    for (j = 0; j < (int)(blockDim.x + 31) / 32; j++)
+                         ties += warp_num[j];
+               __syncthreads();
+          }
+     }
+     for (i = num + tid; i < n2; i += blockDim.x) {
+          s_val[i] = -INFINITY;
+          s_idx[i] = seg_len;
+     }
+     __syncthreads();
+
+     // larger value first, the smaller index first among equal ones
+     for (size = 2; size <= n2; size <<= 1) {
+          for (stride = size >> 1; stride > 0; stride >>= 1) {
+               for (j = tid; j < n2 / 2; j += blockDim.x) {
+                    int a = 2 * stride * (j / stride) + j % stride, b = a + stride;
+                    int b_first = s_val[b] > s_val[a] || (s_val[b] == s_val[a] && s_idx[b] < s_idx[a]);
+                    if (b_first == ((a & size) == 0)) {
+                         float v = s_val[a];
+                         int x = s_idx[a];
+                         s_val[a] = s_val[b];
+                         s_idx[a] = s_idx[b];
+                         s_val[b] = v;
+                         s_idx[b] = x;
+                    }
+               }
+               __syncthreads();
+          }
+     }
+
+     for (i = tid; i < k; i += blockDim.x) {
+          val[(long)blockIdx.x * k + i] = s_val[i];
+          idx[(long)blockIdx.x * k + i] = blockIdx.x * seg_len + (i < num ? s_idx[i] : 0);
+     }
+     if (count && tid == 0)
+          count[blockIdx.x] = num;
 }
 
 __global__ void pickElementsKernel(float *src, float *dst, int *idx, int stride, int block_size, int total)
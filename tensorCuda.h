@@ -1,14 +1,26 @@
 #ifndef _TENSOR_CUDA_H_
 #define _TENSOR_CUDA_H_
 
+#include "tensorHost.h"
+
 #define MAX_THREADS_PER_BLOCK 1024
 #define BLOCK_SIZE MAX_THREADS_PER_BLOCK
+#define TOPK_BLOCK_SIZE 512
+#define TOPK_MAX 4096           /* k of topKKernel, its shared memory is 8 bytes per k */
+#define TRANSPOSE_TILE 32
+#define TRANSPOSE_ROWS 8        /* thread rows of a transposeBatchedKernel block, each copies 4 tile rows */
 
 __global__ void sliceTensorKernel(float *src, float *dst, int start, int s_vol, int d_vol, int vol, int block_size, int total);
 __global__ void reduceArgMaxKernel(float *src, float *dst, float *arg, int dim_size, int reduce_vol, int batch_vol, int block_size, int total);
+__global__ void reduceArgMaxStridedKernel(float *src, float *dst, float *arg, TransposePlan plan, int dim_size, long step, int block_size, int total);
 __global__ void multiplyElementKernel(float *src1, float *src2, float *dst, int block_size, int total);
-__global__ void transposeTensorKernel(float *src, float *dst, int ndim, int *s_dims, int *d_dims, int *s_ids, int *d_ids, int *axes, int block_size, int total);
-__global__ void transformBboxSQDKernel(float *delta, float *anchor, float *res, float width, float height, float img_width, float img_height, int x_shift, int y_shift, int block_size, int total);
+__global__ void multiplyStridedKernel(float *src1, float *src2, float *dst, TransposePlan plan1, TransposePlan plan2, int block_size, int total);
+template <int NDIM>
+__global__ void transposeStridedKernel(float *src, float *dst, TransposePlan plan, int block_size, int total);
+__global__ void transposeBatchedKernel(float *src, float *dst, int rows, int cols, long batch_stride);
+__global__ void transformBboxSQDKernel(float *delta, float *anchor, float *res, TransposePlan d_plan, long d_step, TransposePlan a_plan, long a_step, float width, float height, float *img_sizes, int anchor_num, int x_shift, int y_shift, int block_size, int total);
+__global__ void interpretConvoutKernel(float *convout, float *anchor, float *score, float *klass, float *bbox, TransposePlan a_plan, long a_step, float width, float height, float *img_sizes, int H, int W, int B, int ncls, int x_shift, int y_shift, int block_size, int total);
+__global__ void topKKernel(float *src, float *val, int *idx, int *count, int seg_len, int k, float floor);
 __global__ void pickElementsKernel(float *src, float *dst, int *idx, int stride, int block_size, int total);
 
 #endif  /* _TENSOR_CUDA_H_ */
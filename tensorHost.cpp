@@ -0,0 +1,770 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+#include "tensorHost.h"
+#include "sdt_alloc.h"
+
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+#define PARALLEL_MIN 4096       /* smaller operators aren't worth waking the threads for */
+
+static float EPSILON = 1e-16;
+static float E = 2.718281828;
+
+static void assertTensor(const Tensor *tensor)
+{
+     assert(tensor && tensor->data);
+     assert(tensor->ndim < MAXDIM && tensor->ndim > 0);
+     assert(tensor->len == computeLength(tensor->ndim, tensor->dims));
+}
+
+int isTensorValid(const Tensor *tensor)
+{
+     return (tensor && tensor->data &&
+             tensor->ndim < MAXDIM && tensor->ndim > 0 &&
+             tensor->len == computeLength(tensor->ndim, tensor->dims));
+}
+
+int isShapeEqual(const Tensor *t1, const Tensor *t2)
+{
+     assertTensor(t1);
+     assertTensor(t2);
+     if (t1->ndim == t2->ndim) {
+          int ndim = t1->ndim;
+          while (--ndim >= 0)
+               if (t1->dims[ndim] != t2->dims[ndim])
+                    return 0;
+          return 1;
+     }
+     return 0;
+}
+
+int computeLength(int ndim, const int *dims)
+{
+     if (dims) {
+          int i, len = 1;
+          for (i = 0; i < ndim; i++)
+               len *= dims[i];
+          return len;
+     }
+     fprintf(stderr, "Warning: null dims in computeLength\n");
+     return 0;
+}
+
+Tensor *createTensor(float *data, int ndim, const int *dims)
+{
+     Tensor *t = (Tensor *)sdt_alloc(sizeof(Tensor));
+     t->data = data;
+     t->ndim = ndim;
+     t->dims = (int *)sdt_alloc(sizeof(int) * ndim);
+     memmove(t->dims, dims, sizeof(int) * ndim);
+     t->len = computeLength(ndim, dims);
+     t->strides = NULL;
+     return t;
+}
+
+/* a view of data with the given strides, NULL for a contiguous one */
+Tensor *createTensorView(float *data, int ndim, const int *dims, const int *strides)
+{
+     Tensor *t = createTensor(data, ndim, dims);
+     if (strides) {
+          t->strides = (int *)sdt_alloc(sizeof(int) * ndim);
+          memmove(t->strides, strides, sizeof(int) * ndim);
+     }
+     return t;
+}
+
+long tensorStride(const Tensor *tensor, int dim)
+{
+     assert(dim >= 0 && dim < tensor->ndim);
+     if (tensor->strides)
+          return tensor->strides[dim];
+     long stride = 1;
+     for (int i = dim+1; i < tensor->ndim; i++)
+          stride *= tensor->dims[i];
+     return stride;
+}
+
+/* whether the elements are in order one after another, the strides of dimensions of size 1 don't matter */
+int isTensorContiguous(const Tensor *tensor)
+{
+     if (!tensor->strides)
+          return 1;
+     long stride = 1;
+     for (int i = tensor->ndim-1; i >= 0; i--) {
+          if (tensor->dims[i] != 1 && tensor->strides[i] != stride)
+               return 0;
+          stride *= tensor->dims[i];
+     }
+     return 1;
+}
+
+/* of element i in the order of the dimensions */
+static long elementOffset(const Tensor *tensor, long i)
+{
+     if (!tensor->strides)
+          return i;
+     long offset = 0;
+     for (int k = tensor->ndim-1; k >= 0; k--) {
+          offset += i % tensor->dims[k] * tensor->strides[k];
+          i /= tensor->dims[k];
+     }
+     return offset;
+}
+
+/* of element i from the plan's strides */
+static long planOffset(const TransposePlan *plan, long i)
+{
+     long offset = 0;
+     for (int k = plan->ndim-1; k >= 0; k--) {
+          offset += i % plan->dims[k] * plan->strides[k];
+          i /= plan->dims[k];
+     }
+     return offset;
+}
+
+void fprintTensor(FILE *stream, const Tensor *tensor, const char *fmt)
+{
+     assertTensor(tensor);
+     int dim_sizes[MAXDIM], dim_levels[MAXDIM]; /* dimision size and how deep current chars go */
+     int ndim = tensor->ndim, len = tensor->len, *dims = tensor->dims; /* pointer short cut */
+     float *data = tensor->data;
+     char left_buf[MAXDIM+1], right_buf[MAXDIM+1]; /* buffer for brackets */
+     char *lp = left_buf, *rp = right_buf;
+     size_t right_len;
+     int i, j, k;
+
+     dim_sizes[ndim-1] = tensor->dims[ndim-1];
+     dim_levels[ndim-1] = 0;
+     for (i = ndim-2; i >= 0; i--) {
+          dim_sizes[i] = dims[i] * dim_sizes[i+1];
+          dim_levels[i] = 0;
+     }
+     for (i = 0; i < len; i++) {
+          for (j = 0; j < ndim; j++) {
+               if (i % dim_sizes[j] == 0)
+                    dim_levels[j]++;
+               if (dim_levels[j] == 1) {
+                    *lp++ = '[';
+                    dim_levels[j]++;
+               }
+               if (dim_levels[j] == 3) {
+                    *rp++ = ']';
+                    if (j != 0 && dim_levels[j] > dim_levels[j-1]) {
+                         *lp++ = '[';
+                         dim_levels[j] = 2;
+                    } else
+                         dim_levels[j] = 0;
+               }
+          }
+          *lp = *rp = '\0';
+          fprintf(stream, "%s", right_buf);
+          if (*right_buf != '\0') {
+               fprintf(stream, "\n");
+               right_len = strlen(right_buf);
+               for (k = ndim-right_len; k > 0; k--)
+                    fprintf(stream, " ");
+          }
+          fprintf(stream, "%s", left_buf);
+          if (*left_buf == '\0')
+               fprintf(stream, " ");
+          fprintf(stream, fmt, data[elementOffset(tensor, i)]);
+          lp = left_buf, rp = right_buf;
+     }
+     for (j = 0; j < ndim; j++)
+          fprintf(stream, "]");
+     fprintf(stream, "\n");
+}
+
+void printTensor(const Tensor *tensor, const char *fmt)
+{
+     fprintTensor(stdout, tensor, fmt);
+}
+
+void saveTensor(const char *file_name, const Tensor *tensor, const char *fmt)
+{
+     FILE *fp = fopen(file_name, "w");
+     fprintTensor(fp, tensor, fmt);
+     fclose(fp);
+}
+
+/* in-place reshape tensor */
+Tensor *reshapeTensor(const Tensor *src, int newNdim, const int *newDims)
+{
+     assert(isTensorValid(src) && isTensorContiguous(src));
+     assert(newDims);
+     assert(src->len == computeLength(newNdim, newDims));
+     Tensor *dst = createTensor(src->data, newNdim, newDims); /* new tensor */
+     return dst;
+}
+
+/* The views below share the memory of src without a copy. Free them with
+   freeTensor(view, 0). */
+
+/* elements [start, start + len) of dimension dim */
+Tensor *sliceTensorView(const Tensor *src, int dim, int start, int len)
+{
+     assert(isTensorValid(src));
+     assert(dim >= 0 && dim < src->ndim && start >= 0 && len > 0 && start + len <= src->dims[dim]);
+     int dims[MAXDIM], strides[MAXDIM];
+
+     for (int i = 0; i < src->ndim; i++) {
+          dims[i] = src->dims[i];
+          strides[i] = tensorStride(src, i);
+     }
+     dims[dim] = len;
+     return createTensorView(src->data + (long)start * strides[dim], src->ndim, dims, strides);
+}
+
+/* src repeated to dims, without a copy: the dimensions of src line up with the last ones
+   of dims, and those of size 1 or missing get stride 0 */
+Tensor *broadcastTensorView(const Tensor *src, int ndim, const int *dims)
+{
+     assert(isTensorValid(src) && dims);
+     assert(ndim >= src->ndim && ndim < MAXDIM);
+     int strides[MAXDIM], lead = ndim - src->ndim;
+
+     for (int i = 0; i < ndim; i++) {
+          if (i < lead || (src->dims[i-lead] == 1 && dims[i] != 1)) {
+               strides[i] = 0;
+          } else {
+               assert(src->dims[i-lead] == dims[i]);
+               strides[i] = tensorStride(src, i-lead);
+          }
+     }
+     return createTensorView(src->data, ndim, dims, strides);
+}
+
+/* dimension i of the view is dimension axes[i] of src, the transpose of transposeTensor() without a copy */
+Tensor *permuteTensorView(const Tensor *src, const int *axes)
+{
+     assert(isTensorValid(src) && axes);
+     int dims[MAXDIM], strides[MAXDIM];
+
+     for (int i = 0; i < src->ndim; i++) {
+          assert(axes[i] >= 0 && axes[i] < src->ndim);
+          dims[i] = src->dims[axes[i]];
+          strides[i] = tensorStride(src, axes[i]);
+     }
+     return createTensorView(src->data, src->ndim, dims, strides);
+}
+
+/* src is [..., src->dims[dim], vol], each outer block copies len * vol contiguous floats */
+Tensor *sliceTensorHost(const Tensor *src, Tensor *dst, int dim, int start, int len)
+{
+     assert(isTensorValid(src) && isTensorValid(dst) && isTensorContiguous(src));
+     assert(dst->ndim == src->ndim && dim < src->ndim && dim >= 0);
+     for (int i = 0; i < dst->ndim; i++)
+          assert(i == dim ? dst->dims[i] == len : dst->dims[i] == src->dims[i]);
+
+     int i, vol, d_vol, s_vol, outer;
+     for (i = dim+1, vol = 1; i < dst->ndim; i++)
+          vol *= dst->dims[i];
+     d_vol = vol * len;
+     s_vol = vol * src->dims[dim];
+     outer = dst->len / d_vol;
+
+#pragma omp parallel for schedule(static) if (dst->len > PARALLEL_MIN)
+     for (int o = 0; o < outer; o++)
+          memcpy(dst->data + (long)o * d_vol, src->data + (long)o * s_vol + (long)start * vol, sizeof(float) * d_vol);
+     return dst;
+}
+
+/* the reads of the first elements of the records along dimension dim of src, such as
+   dst of reduceArgMax() or the bboxes of a [..., 4] tensor, and the step between the
+   elements of one record */
+void planRecords(const Tensor *src, int dim, TransposePlan *plan, long *step)
+{
+     assert(isTensorValid(src) && dim >= 0 && dim < src->ndim);
+     int dims[MAXDIM], strides[MAXDIM];
+
+     for (int i = 0; i < src->ndim; i++) {
+          dims[i] = src->dims[i];
+          strides[i] = tensorStride(src, i);
+     }
+     dims[dim] = 1;
+     Tensor first = {src->ndim, dims, src->len / src->dims[dim], src->data, strides};
+     planStrided(&first, plan);
+     *step = strides[dim];
+}
+
+/* the running maximum of an outer block is kept in dst, so the inner loop over reduce_vol
+   elements has no dependencies between them. A view src is read record by record. */
+void *reduceArgMaxHost(const Tensor *src, Tensor *dst, Tensor *arg, int dim)
+{
+     assert(isTensorValid(src) && isTensorValid(dst) && isTensorValid(arg));
+     assert(dim < src->ndim && dim >= 0);
+     for (int i = 0; i < dst->ndim; i++)
+          assert(i == dim ? dst->dims[i] == 1 : dst->dims[i] == src->dims[i] &&
+                 i == dim ? arg->dims[i] == 1 : arg->dims[i] == src->dims[i]);
+
+     if (!isTensorContiguous(src)) {
+          TransposePlan plan;
+          long step;
+          planRecords(src, dim, &plan, &step);
+#pragma omp parallel for schedule(static) if (src->len > PARALLEL_MIN)
+          for (int j = 0; j < dst->len; j++) {
+               const float *s = src->data + planOffset(&plan, j);
+               float m = s[0];
+               int a = 0;
+               for (int k = 1; k < src->dims[dim]; k++) {
+                    if (s[k * step] > m) {
+                         m = s[k * step];
+                         a = k;
+                    }
+               }
+               dst->data[j] = m;
+               arg->data[j] = a;
+          }
+          return dst;
+     }
+
+     int i, dim_size = src->dims[dim], reduce_vol, outer;
+     for (i = dim+1, reduce_vol = 1; i < src->ndim; i++)
+          reduce_vol *= src->dims[i];
+     outer = dst->len / reduce_vol;
+
+#pragma omp parallel for schedule(static) if (src->len > PARALLEL_MIN)
+     for (int o = 0; o < outer; o++) {
+          const float *s = src->data + (long)o * dim_size * reduce_vol;
+          float *d = dst->data + (long)o * reduce_vol;
+          float *a = arg->data + (long)o * reduce_vol;
+          for (int j = 0; j < reduce_vol; j++) {
+               d[j] = s[j];
+               a[j] = 0;
+          }
+          for (int k = 1; k < dim_size; k++) {
+               const float *sk = s + (long)k * reduce_vol;
+               for (int j = 0; j < reduce_vol; j++) {
+                    a[j] = sk[j] > d[j] ? k : a[j];
+                    d[j] = sk[j] > d[j] ? sk[j] : d[j];
+               }
+          }
+     }
+     return dst;
+}
+
+Tensor *multiplyElementHost(const Tensor *src1, const Tensor *src2, Tensor *dst)
+{
+     assert(isShapeEqual(src1, src2));
+     assert(isShapeEqual(src1, dst));
+
+     const float *s1 = src1->data, *s2 = src2->data;
+     float *d = dst->data;
+     if (!isTensorContiguous(src1) || !isTensorContiguous(src2)) {
+          TransposePlan plan1, plan2;
+          planStrided(src1, &plan1);
+          planStrided(src2, &plan2);
+#pragma omp parallel for schedule(static) if (dst->len > PARALLEL_MIN)
+          for (int i = 0; i < dst->len; i++)
+               d[i] = s1[planOffset(&plan1, i)] * s2[planOffset(&plan2, i)];
+          return dst;
+     }
+#pragma omp parallel for schedule(static) if (dst->len > PARALLEL_MIN)
+     for (int i = 0; i < dst->len; i++)
+          d[i] = s1[i] * s2[i];
+     return dst;
+}
+
+/* dimension i of dst is dimension axes[i] of src, which can be a view */
+void planTranspose(const Tensor *src, const Tensor *dst, const int *axes, TransposePlan *plan)
+{
+     assert(isTensorValid(src) && isTensorValid(dst) && axes && plan);
+     assert(src->len == dst->len);
+     assert(src->ndim == dst->ndim);
+
+     int ndim = dst->ndim, i, n = 0;
+     for (i = 0; i < ndim; i++) {
+          assert(axes[i] >= 0 && axes[i] < ndim && dst->dims[i] == src->dims[axes[i]]);
+          long stride = tensorStride(src, axes[i]);
+          if (dst->dims[i] == 1)
+               continue;
+          // a dimension that follows the previous one in src too is merged into it
+          if (n > 0 && plan->strides[n-1] == stride * dst->dims[i]) {
+               plan->dims[n-1] *= dst->dims[i];
+               plan->strides[n-1] = stride;
+               continue;
+          }
+          plan->dims[n] = dst->dims[i];
+          plan->strides[n++] = stride;
+     }
+     if (n == 0) {
+          plan->dims[n] = 1;
+          plan->strides[n++] = 1;
+     }
+     plan->ndim = n;
+}
+
+/* the reads of the elements of src in order, such as a view into a contiguous copy */
+void planStrided(const Tensor *src, TransposePlan *plan)
+{
+     int axes[MAXDIM];
+     for (int i = 0; i < src->ndim; i++)
+          axes[i] = i;
+     planTranspose(src, src, axes, plan);
+}
+
+/* whether the plan swaps the last two dimensions of a [batch, rows, cols] src, like the
+   {0, 3, 4, 1, 2} transposes of sqdtrt do once merged, into a [batch, cols, rows] dst.
+   The images of src are batch_stride apart, more than rows * cols for a slice. */
+int isBatchedTranspose(const TransposePlan *plan, int *batch, int *rows, int *cols, long *batch_stride)
+{
+     const int *d = plan->dims + plan->ndim - 2;
+     const long *s = plan->strides + plan->ndim - 2;
+
+     if (plan->ndim < 2 || plan->ndim > 3 || s[0] != 1 || s[1] != d[0])
+          return 0;
+     *batch = plan->ndim == 3 ? plan->dims[0] : 1;
+     *rows = d[1];
+     *cols = d[0];
+     *batch_stride = plan->ndim == 3 ? plan->strides[0] : (long)d[0] * d[1];
+     return 1;
+}
+
+#define TRANSPOSE_TILE 32
+
+/* tile by tile, so both the rows read and the rows written stay in cache */
+static void transposeBatchedHost(const float *src, float *dst, int batch, int rows, int cols, long batch_stride)
+{
+     int row_tiles = (rows + TRANSPOSE_TILE - 1) / TRANSPOSE_TILE;
+     int col_tiles = (cols + TRANSPOSE_TILE - 1) / TRANSPOSE_TILE;
+     long vol = (long)rows * cols;
+
+#pragma omp parallel for schedule(static) if (batch * vol > PARALLEL_MIN)
+     for (long t = 0; t < (long)batch * row_tiles * col_tiles; t++) {
+          int b = t / ((long)row_tiles * col_tiles);
+          int r0 = t / col_tiles % row_tiles * TRANSPOSE_TILE;
+          int c0 = t % col_tiles * TRANSPOSE_TILE;
+          const float *s = src + b * batch_stride;
+          float *d = dst + b * vol;
+          for (int c = c0; c < min(c0 + TRANSPOSE_TILE, cols); c++)
+               for (int r = r0; r < min(r0 + TRANSPOSE_TILE, rows); r++)
+                    d[(long)c*rows+r] = s[(long)r*cols+c];
+     }
+}
+
+/* Every row of dst, its last merged dimension, starts at an offset from the plan's
+   strides and reads src with a constant stride, or with none at all if the transpose
+   only moved dimensions of size 1. */
+Tensor *transposeTensorHost(const Tensor *src, Tensor *dst, const int *axes)
+{
+     TransposePlan plan;
+     int batch, rows, cols;
+     long batch_stride;
+
+     assert(isTensorContiguous(dst));
+     planTranspose(src, dst, axes, &plan);
+     if (plan.ndim == 1 && plan.strides[0] == 1) {
+          memcpy(dst->data, src->data, sizeof(float) * src->len);
+          return dst;
+     }
+     if (isBatchedTranspose(&plan, &batch, &rows, &cols, &batch_stride)) {
+          transposeBatchedHost(src->data, dst->data, batch, rows, cols, batch_stride);
+          return dst;
+     }
+
+     int ndim = plan.ndim, row_len = plan.dims[ndim-1], rows_num = dst->len / row_len;
+     long step = plan.strides[ndim-1];
+#pragma omp parallel for schedule(static) if (dst->len > PARALLEL_MIN)
+     for (int r = 0; r < rows_num; r++) {
+          long offset = 0;
+          for (int k = ndim-2, rest = r; k >= 0; k--) {
+               offset += rest % plan.dims[k] * plan.strides[k];
+               rest /= plan.dims[k];
+          }
+          const float *s = src->data + offset;
+          float *d = dst->data + (long)r * row_len;
+          for (int j = 0; j < row_len; j++)
+               d[j] = s[j * step];
+     }
+     return dst;
+}
+
+/* one bbox from its delta d and anchor a, the same arithmetic as decodeBboxSQD() of tensorCuda.cu */
+static inline void decodeBboxSQD(const float *d, const float *a, float *r, float x_scale, float y_scale,
+                                 float img_width, float img_height, int x_shift, int y_shift)
+{
+     float cx = (a[0] + d[0] * a[2]) / x_scale + x_shift;
+     float cy = (a[1] + d[1] * a[3]) / y_scale + y_shift;
+     float w = (a[2] * (d[2] < 1 ? expf(d[2]) : d[2] * E)) / x_scale;
+     float h = (a[3] * (d[3] < 1 ? expf(d[3]) : d[3] * E)) / y_scale;
+     r[0] = min(max(cx - w * 0.5, 0), img_width - 1);
+     r[1] = min(max(cy - h * 0.5, 0), img_height - 1);
+     r[2] = max(min(cx + w * 0.5, img_width - 1), 0);
+     r[3] = max(min(cy + h * 0.5, img_height - 1), 0);
+}
+
+/* img_sizes is a host array, delta and anchor can be views such as a broadcast anchor grid */
+Tensor *transformBboxSQDHost(const Tensor *delta, const Tensor *anchor, Tensor *res, float width, float height,
+                             const float *img_sizes, int x_shift, int y_shift)
+{
+     assert(isShapeEqual(delta, anchor));
+     assert(isShapeEqual(delta, res));
+     assert(delta->ndim == 5);
+     assert(delta->dims[4] == 4);
+     assert(img_sizes);
+
+     int total = res->len / 4, anchor_num = total / res->dims[0];
+     const float *dp = delta->data, *ap = anchor->data;
+     float *rp = res->data;
+     TransposePlan d_plan, a_plan;
+     long d_step, a_step;
+     planRecords(delta, 4, &d_plan, &d_step);
+     planRecords(anchor, 4, &a_plan, &a_step);
+
+#pragma omp parallel for schedule(static) if (total > PARALLEL_MIN / 4)
+     for (int i = 0; i < total; i++) {
+          int batch_idx = i / anchor_num;
+          float img_width = img_sizes[batch_idx * 2];
+          float img_height = img_sizes[batch_idx * 2 + 1];
+          float x_scale = 1.0 * width / img_width;
+          float y_scale = 1.0 * height / img_height;
+          const float *ds = dp + planOffset(&d_plan, i), *as = ap + planOffset(&a_plan, i);
+          float d[4], a[4];
+          for (int c = 0; c < 4; c++) {
+               d[c] = ds[c * d_step];
+               a[c] = as[c * a_step];
+          }
+          decodeBboxSQD(d, a, rp + i * 4, x_scale, y_scale, img_width, img_height, x_shift, y_shift);
+     }
+     return res;
+}
+
+/* asserts the shapes of interpretConvout(), returns the number of classes */
+static int interpretShapes(const Tensor *convout, const Tensor *anchor, const Tensor *score, const Tensor *klass,
+                           const Tensor *bbox)
+{
+     assert(isTensorValid(convout) && convout->ndim == 4 && isTensorContiguous(convout));
+     assert(isShapeEqual(score, klass) && isShapeEqual(anchor, bbox));
+     assert(score->ndim == 5 && score->dims[4] == 1 && bbox->dims[4] == 4);
+     for (int i = 0; i < 4; i++)
+          assert(score->dims[i] == bbox->dims[i]);
+     assert(score->dims[0] == convout->dims[0] && score->dims[1] == convout->dims[2] &&
+            score->dims[2] == convout->dims[3]);
+     int B = score->dims[3], ncls = convout->dims[1] / B - 5;
+     assert(convout->dims[1] == B * (ncls + 5) && ncls > 0);
+     return ncls;
+}
+
+/* Every image row of convout is read once: for each anchor its class logits, confidence
+   and bbox delta channels, contiguous along the row. anchor can be a view, such as the
+   anchor grid of one image broadcast to the batch. */
+Tensor *interpretConvoutHost(const Tensor *convout, const Tensor *anchor, Tensor *score, Tensor *klass, Tensor *bbox,
+                             float width, float height, const float *img_sizes, int x_shift, int y_shift)
+{
+     int ncls = interpretShapes(convout, anchor, score, klass, bbox);
+     assert(img_sizes);
+     int N = convout->dims[0], C = convout->dims[1], H = convout->dims[2], W = convout->dims[3];
+     int B = score->dims[3];
+     long plane = (long)H * W;
+     TransposePlan a_plan;
+     long a_step;
+     planRecords(anchor, 4, &a_plan, &a_step);
+
+#pragma omp parallel for collapse(2) schedule(static) if (score->len > PARALLEL_MIN / 4)
+     for (int n = 0; n < N; n++) {
+          for (int y = 0; y < H; y++) {
+               const float *row = convout->data + n * C * plane + y * W;
+               const float *conf = row + B * ncls * plane, *delta = conf + B * plane;
+               float img_width = img_sizes[n * 2], img_height = img_sizes[n * 2 + 1];
+               float x_scale = 1.0 * width / img_width;
+               float y_scale = 1.0 * height / img_height;
+               long first = ((long)n * H + y) * W * B; /* the first anchor of the row in the outputs */
+               for (int a = 0; a < B; a++) {
+                    const float *logits = row + a * ncls * plane;
+                    for (int x = 0; x < W; x++) {
+                         long o = first + (long)x * B + a;
+                         float m = logits[x], sum = 0, d[4];
+                         int c, arg = 0;
+                         for (c = 1; c < ncls; c++) {
+                              if (logits[c * plane + x] > m) {
+                                   m = logits[c * plane + x];
+                                   arg = c;
+                              }
+                         }
+                         for (c = 0; c < ncls; c++)
+                              sum += expf(logits[c * plane + x] - m);
+                         /* the largest softmax probability is exp(0) / sum */
+                         score->data[o] = (1 / sum) * (1 / (1 + expf(-conf[a * plane + x])));
+                         klass->data[o] = arg;
+                         const float *as = anchor->data + planOffset(&a_plan, o);
+                         float an[4];
+                         for (c = 0; c < 4; c++) {
+                              d[c] = delta[(a * 4 + c) * plane + x];
+                              an[c] = as[c * a_step];
+                         }
+                         decodeBboxSQD(d, an, bbox->data + o * 4, x_scale, y_scale,
+                                       img_width, img_height, x_shift, y_shift);
+                    }
+               }
+          }
+     }
+     return score;
+}
+
+/* orders positions by descending key, equal keys keep their order like thrust's sort */
+struct GreaterKey {
+     const float *keys;
+     bool operator()(int a, int b) const { return keys[a] > keys[b]; }
+};
+
+/* sort n keys in descending order along with idx, order and tmp are workspaces of n */
+static void sortByKey(float *keys, int *idx, int n, int *order, float *tmp)
+{
+     GreaterKey greater = {keys};
+     int i;
+
+     for (i = 0; i < n; i++)
+          order[i] = i;
+     std::stable_sort(order, order + n, greater);
+     for (i = 0; i < n; i++)
+          tmp[i] = keys[order[i]];
+     memcpy(keys, tmp, sizeof(float) * n);
+     for (i = 0; i < n; i++)
+          order[i] = idx[order[i]];
+     memcpy(idx, order, sizeof(int) * n);
+}
+
+void tensorIndexSortHost(Tensor *src, int *idx)
+{
+     assert(isTensorValid(src));
+     assert(idx);
+
+     int *order = (int *)sdt_alloc(sizeof(int) * src->len);
+     float *tmp = (float *)sdt_alloc(sizeof(float) * src->len);
+     sortByKey(src->data, idx, src->len, order, tmp);
+     sdt_free(order);
+     sdt_free(tmp);
+}
+
+/* the images of a batch are sorted on threads of their own */
+void tensorIndexSortBatchHost(Tensor *src, int *idx)
+{
+     assert(isTensorValid(src));
+     assert(idx);
+
+     int vol = src->len / src->dims[0];
+#pragma omp parallel if (src->dims[0] > 1)
+     {
+          int *order = (int *)sdt_alloc(sizeof(int) * vol);
+          float *tmp = (float *)sdt_alloc(sizeof(float) * vol);
+#pragma omp for schedule(dynamic)
+          for (int i = 0; i < src->dims[0]; i++)
+               sortByKey(src->data + (long)i * vol, idx + (long)i * vol, vol, order, tmp);
+          sdt_free(order);
+          sdt_free(tmp);
+     }
+}
+
+struct TopKEntry {
+     float key;
+     int idx;
+};
+
+/* a before b if it has the larger key, or the same key and the smaller position like
+   the sorts above, so the heap in topKSegment() has the worst of its entries on top */
+struct BetterEntry {
+     bool operator()(const TopKEntry &a, const TopKEntry &b) const
+     {
+          return a.key > b.key || (a.key == b.key && a.idx < b.idx);
+     }
+};
+
+/* One pass over src keeping the best k candidates (elements >= floor) in a min-heap
+   of k entries, so most elements cost a single comparison. Returns the number of
+   candidates selected, the slots after them get -INFINITY and position 0. */
+static int topKSegment(const float *src, int len, int k, float floor, float *val, int *idx, TopKEntry *heap)
+{
+     BetterEntry better;
+     int i, n = 0;
+
+     for (i = 0; i < len; i++) {
+          // once the heap is full its top is >= floor already
+          if (n == k ? !(src[i] > heap[0].key) : !(src[i] >= floor))
+               continue;
+          if (n < k) {
+               heap[n].key = src[i];
+               heap[n++].idx = i;
+               std::push_heap(heap, heap + n, better);
+          } else {
+               std::pop_heap(heap, heap + k, better);
+               heap[k-1].key = src[i];
+               heap[k-1].idx = i;
+               std::push_heap(heap, heap + k, better);
+          }
+     }
+     std::sort_heap(heap, heap + n, better);
+     for (i = 0; i < k; i++) {
+          val[i] = i < n ? heap[i].key : -INFINITY;
+          idx[i] = i < n ? heap[i].idx : 0;
+     }
+     return n;
+}
+
+/* the segments of nseg images are selected on threads of their own */
+static void topKHost(const Tensor *src, int nseg, float *val, int *idx, int k, float floor, int *count)
+{
+     assert(isTensorValid(src));
+     assert(val && idx && k > 0 && src->len % nseg == 0);
+
+     int vol = src->len / nseg;
+#pragma omp parallel if (nseg > 1)
+     {
+          TopKEntry *heap = (TopKEntry *)sdt_alloc(sizeof(TopKEntry) * k);
+#pragma omp for schedule(dynamic)
+          for (int i = 0; i < nseg; i++) {
+               int n = topKSegment(src->data + (long)i * vol, vol, k, floor, val + (long)i * k,
+                                   idx + (long)i * k, heap);
+               for (int j = 0; j < k; j++)
+                    idx[(long)i*k+j] += i * vol;
+               if (count)
+                    count[i] = n;
+          }
+          sdt_free(heap);
+     }
+}
+
+void tensorTopKHost(const Tensor *src, float *val, int *idx, int k, float floor, int *count)
+{
+     topKHost(src, 1, val, idx, k, floor, count);
+}
+
+void tensorTopKBatchHost(const Tensor *src, float *val, int *idx, int k, float floor, int *count)
+{
+     assert(isTensorValid(src));
+     topKHost(src, src->dims[0], val, idx, k, floor, count);
+}
+
+void pickElementsHost(const float *src, float *dst, int stride, const int *idx, int len)
+{
+     assert(src && dst && idx);
+
+#pragma omp parallel for schedule(static) if ((long)len * stride > PARALLEL_MIN)
+     for (int i = 0; i < len; i++)
+          for (int j = 0; j < stride; j++)
+               dst[i*stride+j] = src[(long)idx[i]*stride+j];
+}
+
+/* compute the iou of two bboxes whose elements are {top_left_x, top_left_y, bottom_right_x, bottom_right_y} */
+float computeIou(float *bbox0, float *bbox1)
+{
+     assert(bbox0 && bbox1);
+
+     float lr, tb;              /* left-right, top-bottom for intersection*/
+     float intersection, total;
+     lr = min(bbox0[2], bbox1[2]) - max(bbox0[0], bbox1[0]);
+     if (lr >= 0) {
+          tb = min(bbox0[3], bbox1[3]) - max(bbox0[1], bbox1[1]);
+          if (tb >= 0) {
+               intersection = tb * lr + EPSILON;
+               total = (bbox0[2] - bbox0[0]) * (bbox0[3] - bbox0[1]) +
+                    (bbox1[2] - bbox1[0]) * (bbox1[3] - bbox1[1]) - intersection;
+               return intersection / (total + EPSILON);
+          }
+     }
+     return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef _TENSOR_HOST_H_
+#define _TENSOR_HOST_H_
+
+#include <stdio.h>
+#include "tensorUtil.h"
+
+/* The operators of tensorUtil.h on HOST tensors, which the operators there hand
+   host data to. Neither this file nor tensorHost.cpp need CUDA, so they build and
+   run on machines without a GPU. All arguments of an operator, including axes,
+   img_sizes and idx, are host memory. */
+
+#define MAXDIM 8
+
+/* A transpose as strided reads of src in the order of dst, with the dimensions that
+   stay next to each other merged and those of size 1 dropped. dst[i] is read from
+   src at sum(index_k * strides[k]), index_k its index along dims[k]. The plan of
+   planStrided() reads a view in its own order, which is how the operators take views. */
+typedef struct {
+     int ndim;
+     int dims[MAXDIM];          /* of dst */
+     long strides[MAXDIM];      /* of src along the dims of dst */
+} TransposePlan;
+
+Tensor *sliceTensorHost(const Tensor *src, Tensor *dst, int dim, int start, int len);
+void *reduceArgMaxHost(const Tensor *src, Tensor *dst, Tensor *arg, int dim);
+Tensor *multiplyElementHost(const Tensor *src1, const Tensor *src2, Tensor *dst);
+void planTranspose(const Tensor *src, const Tensor *dst, const int *axes, TransposePlan *plan);
+void planStrided(const Tensor *src, TransposePlan *plan);
+void planRecords(const Tensor *src, int dim, TransposePlan *plan, long *step);
+int isBatchedTranspose(const TransposePlan *plan, int *batch, int *rows, int *cols, long *batch_stride);
+Tensor *transposeTensorHost(const Tensor *src, Tensor *dst, const int *axes);
+Tensor *transformBboxSQDHost(const Tensor *delta, const Tensor *anchor, Tensor *res, float width, float height,
+                             const float *img_sizes, int x_shift, int y_shift);
+Tensor *interpretConvoutHost(const Tensor *convout, const Tensor *anchor, Tensor *score, Tensor *klass, Tensor *bbox,
+                             float width, float height, const float *img_sizes, int x_shift, int y_shift);
+void tensorIndexSortHost(Tensor *src, int *idx);
+void tensorIndexSortBatchHost(Tensor *src, int *idx);
+void tensorTopKHost(const Tensor *src, float *val, int *idx, int k, float floor, int *count);
+void tensorTopKBatchHost(const Tensor *src, float *val, int *idx, int k, float floor, int *count);
+void pickElementsHost(const float *src, float *dst, int stride, const int *idx, int len);
+
+#endif  /* _TENSOR_HOST_H_ */
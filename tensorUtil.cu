@@ -6,42 +6,28 @@
 #include <thrust/execution_policy.h>
 #include "tensorCuda.h"
 #include "tensorUtil.h"
+#include "tensorHost.h"
+#include "tensorArena.h"
 #include "errorHandle.h"
+#include "trace.h"
 #include "sdt_alloc.h"
 
-#define MAXDIM 8
 #define max(a, b) ((a) > (b) ? (a) : (b))
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
-static float EPSILON = 1e-16;
-
-static void assertTensor(const Tensor *tensor)
-{
-     assert(tensor && tensor->data);
-     assert(tensor->ndim < MAXDIM && tensor->ndim > 0);
-     assert(tensor->len == computeLength(tensor->ndim, tensor->dims));
-}
-
-int isTensorValid(const Tensor *tensor)
-{
-     return (tensor && tensor->data &&
-             tensor->ndim < MAXDIM && tensor->ndim > 0 &&
-             tensor->len == computeLength(tensor->ndim, tensor->dims));
-}
-
-int isShapeEqual(const Tensor *t1, const Tensor *t2)
-{
-     assertTensor(t1);
-     assertTensor(t2);
-     if (t1->ndim == t2->ndim) {
-          int ndim = t1->ndim;
-          while (--ndim >= 0)
-               if (t1->dims[ndim] != t2->dims[ndim])
-                    return 0;
-          return 1;
+/* the span of an operator, which with traceSync lasts until its kernels are done */
+struct OperatorScope : TraceScope {
+     explicit OperatorScope(int stage) : TraceScope(stage) {}
+     ~OperatorScope()
+     {
+          if (traceSync)
+               checkError(cudaDeviceSynchronize());
      }
-     return 0;
-}
+};
+
+#define TRACE_OPERATOR(name)                                              \
+     static const int TRACE_CONCAT(trace_stage_, __LINE__) = traceStage(name); \
+     OperatorScope TRACE_CONCAT(trace_scope_, __LINE__)(TRACE_CONCAT(trace_stage_, __LINE__))
 
 /* can only identify host memory alloced by cudaMallocHost, etc */
 int isHostMem(const void *ptr)
@@ -51,11 +37,21 @@ int isHostMem(const void *ptr)
      return attributes.memoryType == cudaMemoryTypeHost;
 }
 
-int isDeviceMem(const void *ptr)
+/* CUDA before 11 returns an error for memory it neither allocated nor registered,
+   which is host memory too */
+MallocKind memKind(const void *ptr)
 {
      cudaPointerAttributes attributes;
-     checkError(cudaPointerGetAttributes(&attributes, ptr));
-     return attributes.memoryType == cudaMemoryTypeDevice;
+     if (cudaPointerGetAttributes(&attributes, ptr) != cudaSuccess) {
+          cudaGetLastError();   /* don't leave the error to the next call */
+          return HOST;
+     }
+     return attributes.memoryType == cudaMemoryTypeDevice ? DEVICE : HOST;
+}
+
+int isDeviceMem(const void *ptr)
+{
+     return memKind(ptr) == DEVICE;
 }
 
 void *cloneMem(const void *src, size_t size, CloneKind kind)
@@ -90,7 +86,7 @@ void *cloneMem(const void *src, size_t size, CloneKind kind)
 
 Tensor *cloneTensor(const Tensor *src, CloneKind kind)
 {
-     assert(isTensorValid(src));
+     assert(isTensorValid(src) && isTensorContiguous(src));
      float *data = (float *)cloneMem(src->data, src->len * sizeof(float), kind);
      Tensor *dst = createTensor(data, src->ndim, src->dims);
      return dst;
@@ -133,29 +129,6 @@ void *repeatMem(void *data, size_t size, int times, CloneKind kind)
 }
 
 
-int computeLength(int ndim, const int *dims)
-{
-     if (dims) {
-          int i, len = 1;
-          for (i = 0; i < ndim; i++)
-               len *= dims[i];
-          return len;
-     }
-     fprintf(stderr, "Warning: null dims in computeLength\n");
-     return 0;
-}
-
-Tensor *createTensor(float *data, int ndim, const int *dims)
-{
-     Tensor *t = (Tensor *)sdt_alloc(sizeof(Tensor));
-     t->data = data;
-     t->ndim = ndim;
-     t->dims = (int *)sdt_alloc(sizeof(int) * ndim);
-     memmove(t->dims, dims, sizeof(int) * ndim);
-     t->len = computeLength(ndim, dims);
-     return t;
-}
-
 Tensor *mallocTensor(int ndim, const int* dims, const MallocKind mkind)
 {
      Tensor *t = createTensor(NULL, ndim, dims);
@@ -181,6 +154,7 @@ void freeTensor(Tensor *t, int do_free_data)
 {
      assert(isTensorValid(t));
      sdt_free(t->dims);
+     sdt_free(t->strides);
      if (do_free_data) {
           if (isDeviceMem(t->data))
                checkError(cudaFree(t->data));
@@ -190,70 +164,59 @@ void freeTensor(Tensor *t, int do_free_data)
      sdt_free(t);
 }
 
-void fprintTensor(FILE *stream, const Tensor *tensor, const char *fmt)
+/* plans the arena if not yet and points every buffer into one allocation */
+void allocArena(TensorArena *arena)
 {
-     assertTensor(tensor);
-     int dim_sizes[MAXDIM], dim_levels[MAXDIM]; /* dimision size and how deep current chars go */
-     int ndim = tensor->ndim, len = tensor->len, *dims = tensor->dims; /* pointer short cut */
-     float *data = tensor->data;
-     char left_buf[MAXDIM+1], right_buf[MAXDIM+1]; /* buffer for brackets */
-     char *lp = left_buf, *rp = right_buf;
-     size_t right_len;
-     int i, j, k;
-
-     dim_sizes[ndim-1] = tensor->dims[ndim-1];
-     dim_levels[ndim-1] = 0;
-     for (i = ndim-2; i >= 0; i--) {
-          dim_sizes[i] = dims[i] * dim_sizes[i+1];
-          dim_levels[i] = 0;
-     }
-     for (i = 0; i < len; i++) {
-          for (j = 0; j < ndim; j++) {
-               if (i % dim_sizes[j] == 0)
-                    dim_levels[j]++;
-               if (dim_levels[j] == 1) {
-                    *lp++ = '[';
-                    dim_levels[j]++;
-               }
-               if (dim_levels[j] == 3) {
-                    *rp++ = ']';
-                    if (j != 0 && dim_levels[j] > dim_levels[j-1]) {
-                         *lp++ = '[';
-                         dim_levels[j] = 2;
-                    } else
-                         dim_levels[j] = 0;
-               }
+     assert(arena && !arena->data);
+     char *data = NULL;
+
+     if (arena->size == 0)
+          planArena(arena);
+     if (arena->size > 0) {
+          switch (arena->kind) {
+          case HOST:
+               data = (char *)sdt_aligned_alloc(ARENA_ALIGN, arena->size);
+               break;
+          case DEVICE:
+               checkError(cudaMalloc(&data, arena->size));
+               break;
+          default:
+               fprintf(stderr, "unknown MallocKind %d\n", arena->kind);
+               exit(EXIT_FAILURE);
           }
-          *lp = *rp = '\0';
-          fprintf(stream, "%s", right_buf);
-          if (*right_buf != '\0') {
-               fprintf(stream, "\n");
-               right_len = strlen(right_buf);
-               for (k = ndim-right_len; k > 0; k--)
-                    fprintf(stream, " ");
-          }
-          fprintf(stream, "%s", left_buf);
-          if (*left_buf == '\0')
-               fprintf(stream, " ");
-          fprintf(stream, fmt, data[i]);
-          lp = left_buf, rp = right_buf;
      }
-     for (j = 0; j < ndim; j++)
-          fprintf(stream, "]");
-     fprintf(stream, "\n");
+     for (int i = 0; i < arena->num; i++) {
+          ArenaBuffer *b = &arena->buffers[i];
+          *b->ptr = b->first >= 0 ? data + b->offset : NULL;
+     }
+     arena->data = data;
 }
 
-void printTensor(const Tensor *tensor, const char *fmt)
+/* frees the memory and the arena with its tensors */
+void freeArena(TensorArena *arena)
 {
-     fprintTensor(stdout, tensor, fmt);
+     assert(arena);
+     if (arena->kind == DEVICE)
+          checkError(cudaFree(arena->data));
+     else
+          sdt_free(arena->data);
+     arena->data = NULL;
+     destroyArena(arena);
 }
 
 void fprintDeviceTensor(FILE *stream, const Tensor *d_tensor, const char *fmt)
 {
      assert(isTensorValid(d_tensor));
+     Tensor *view = NULL;
+     if (!isTensorContiguous(d_tensor)) {
+          view = mallocTensor(d_tensor->ndim, d_tensor->dims, DEVICE);
+          d_tensor = contiguousTensor(d_tensor, view);
+     }
      Tensor *h_tensor = cloneTensor(d_tensor, D2H);
      fprintTensor(stream, h_tensor, fmt);
      free(h_tensor->data); /* TODO: free t_tensor */
+     if (view)
+          freeTensor(view, 1);
 }
 
 void printDeviceTensor(const Tensor *d_tensor, const char *fmt)
@@ -261,13 +224,6 @@ void printDeviceTensor(const Tensor *d_tensor, const char *fmt)
      fprintDeviceTensor(stdout, d_tensor, fmt);
 }
 
-void saveTensor(const char *file_name, const Tensor *tensor, const char *fmt)
-{
-     FILE *fp = fopen(file_name, "w");
-     fprintTensor(fp, tensor, fmt);
-     fclose(fp);
-}
-
 void saveDeviceTensor(const char *file_name, const Tensor *d_tensor, const char *fmt)
 {
      FILE *fp = fopen(file_name, "w");
@@ -327,7 +283,11 @@ Tensor *createSlicedTensor(const Tensor *src, int dim, int start, int len)
      memmove(dst->dims, src->dims, sizeof(int) * dst->ndim);
      dst->dims[dim] = len;
      dst->len = src->len / src->dims[dim] * len;
-     checkError(cudaMalloc(&dst->data, sizeof(float) * dst->len));
+     dst->strides = NULL;
+     if (memKind(src->data) == HOST)
+          dst->data = (float *)sdt_alloc(sizeof(float) * dst->len);
+     else
+          checkError(cudaMalloc(&dst->data, sizeof(float) * dst->len));
      return dst;
 }
 
@@ -352,9 +312,14 @@ Tensor *createSlicedTensor(const Tensor *src, int dim, int start, int len)
 
 Tensor *sliceTensor(const Tensor *src, Tensor *dst, int dim, int start, int len)
 {
+     TRACE_OPERATOR("slice");
      assert(isTensorValid(src) && isTensorValid(dst));
+     if (memKind(src->data) == HOST) {
+          assert(memKind(dst->data) == HOST);
+          return sliceTensorHost(src, dst, dim, start, len);
+     }
      assert(isDeviceMem(src->data) && isDeviceMem(dst->data));
-     assert(dst->ndim == src->ndim);
+     assert(dst->ndim == src->ndim && isTensorContiguous(src));
      for (int i = 0; i < dst->ndim; i++)
           assert(i == dim ? dst->dims[i] == len : dst->dims[i] == src->dims[i]);
 
@@ -372,14 +337,14 @@ Tensor *sliceTensor(const Tensor *src, Tensor *dst, int dim, int start, int len)
      return dst;
 }
 
-/* in-place reshape tensor */
-Tensor *reshapeTensor(const Tensor *src, int newNdim, const int *newDims)
+/* a contiguous copy of the view src, in memory of the same kind */
+Tensor *contiguousTensor(const Tensor *src, Tensor *dst)
 {
-     assert(isTensorValid(src));
-     assert(newDims);
-     assert(src->len == computeLength(newNdim, newDims));
-     Tensor *dst = createTensor(src->data, newNdim, newDims); /* new tensor */
-     return dst;
+     assert(isTensorValid(src) && isTensorValid(dst) && isShapeEqual(src, dst));
+     int axes[MAXDIM];
+     for (int i = 0; i < src->ndim; i++)
+          axes[i] = i;
+     return transposeTensor(src, dst, axes);
 }
 
 Tensor *createReducedTensor(const Tensor *src, int dim)
@@ -393,19 +358,37 @@ Tensor *createReducedTensor(const Tensor *src, int dim)
      memmove(dst->dims, src->dims, sizeof(int) * dst->ndim);
      dst->dims[dim] = 1;
      dst->len = computeLength(dst->ndim, dst->dims);
-     checkError(cudaMalloc(&dst->data, sizeof(float) * dst->len));
+     dst->strides = NULL;
+     if (memKind(src->data) == HOST)
+          dst->data = (float *)sdt_alloc(sizeof(float) * dst->len);
+     else
+          checkError(cudaMalloc(&dst->data, sizeof(float) * dst->len));
      return dst;
 }
 
 void *reduceArgMax(const Tensor *src, Tensor *dst, Tensor *arg, int dim)
 {
+     TRACE_OPERATOR("reduceArgMax");
      assert(isTensorValid(src) && isTensorValid(dst) && isTensorValid(arg));
+     if (memKind(src->data) == HOST) {
+          assert(memKind(dst->data) == HOST && memKind(arg->data) == HOST);
+          return reduceArgMaxHost(src, dst, arg, dim);
+     }
      assert(isDeviceMem(src->data) && isDeviceMem(dst->data) && isDeviceMem(arg->data));
      assert(dim < src->ndim && dim >= 0);
      for (int i = 0; i < dst->ndim; i++)
           assert(i == dim ? dst->dims[i] == 1 : dst->dims[i] == src->dims[i] &&
                  i == dim ? arg->dims[i] == 1 : arg->dims[i] == src->dims[i]);
 
+     if (!isTensorContiguous(src)) {
+          TransposePlan plan;
+          long step;
+          planRecords(src, dim, &plan, &step);
+          int block_num = dst->len / MAX_THREADS_PER_BLOCK + 1;
+          reduceArgMaxStridedKernel<<<block_num, MAX_THREADS_PER_BLOCK>>>(src->data, dst->data, arg->data, plan, src->dims[dim], step, MAX_THREADS_PER_BLOCK, dst->len);
+          return dst;
+     }
+
      /* suppose the shape of src is [N, C, H, W], dim = 1, then thread_num is N x H x W
         reduce_vol is H x W, index_vol is C x H x W */
      int i, thread_num, block_size, block_num, reduce_vol, index_vol;
@@ -424,8 +407,13 @@ void *reduceArgMax(const Tensor *src, Tensor *dst, Tensor *arg, int dim)
 
 Tensor *multiplyElement(const Tensor *src1, const Tensor *src2, Tensor *dst)
 {
+     TRACE_OPERATOR("multiply");
      assert(isShapeEqual(src1, src2));
      assert(isShapeEqual(src1, dst));
+     if (memKind(src1->data) == HOST) {
+          assert(memKind(src2->data) == HOST && memKind(dst->data) == HOST);
+          return multiplyElementHost(src1, src2, dst);
+     }
      assert(isDeviceMem(src1->data) && isDeviceMem(src2->data) && isDeviceMem(dst->data));
 
      int thread_num, block_size, block_num;
@@ -433,71 +421,151 @@ Tensor *multiplyElement(const Tensor *src1, const Tensor *src2, Tensor *dst)
      block_size = MAX_THREADS_PER_BLOCK;
      block_num = thread_num / block_size + 1;
 
+     if (!isTensorContiguous(src1) || !isTensorContiguous(src2)) {
+          TransposePlan plan1, plan2;
+          planStrided(src1, &plan1);
+          planStrided(src2, &plan2);
+          multiplyStridedKernel<<<block_num, block_size>>>(src1->data, src2->data, dst->data, plan1, plan2, block_size, dst->len);
+          return dst;
+     }
      multiplyElementKernel<<<block_num, block_size>>>(src1->data, src2->data, dst->data, block_size, dst->len);
      return dst;
 }
 
-/* (optional) workspace size equals (sizeof(int) * dst->ndim * dst->len), two of them */
-Tensor *transposeTensor(const Tensor *src, Tensor *dst, int *axes, int **workspace)
+/* Dimension i of dst is dimension axes[i] of src, axes is host memory for tensors of
+   either kind. The strides come from planTranspose() once per call and go to the
+   kernel by value, so there is no workspace or copy to the device. src can be a view. */
+Tensor *transposeTensor(const Tensor *src, Tensor *dst, const int *axes)
 {
-     assert(isTensorValid(src) && isTensorValid(dst));
+     TRACE_OPERATOR("transpose");
+     assert(isTensorValid(src) && isTensorValid(dst) && axes);
      assert(src->len == dst->len);
      assert(src->ndim == dst->ndim);
+     assert(memKind(axes) == HOST);
+     if (memKind(src->data) == HOST) {
+          assert(memKind(dst->data) == HOST);
+          return transposeTensorHost(src, dst, axes);
+     }
+     assert(isDeviceMem(src->data) && isDeviceMem(dst->data));
+
+     TransposePlan plan;
+     int batch, rows, cols;
+     long batch_stride;
+     assert(isTensorContiguous(dst));
+     planTranspose(src, dst, axes, &plan);
+     if (plan.ndim == 1 && plan.strides[0] == 1) {
+          checkError(cudaMemcpy(dst->data, src->data, sizeof(float) * src->len, cudaMemcpyDeviceToDevice));
+          return dst;
+     }
+     if (isBatchedTranspose(&plan, &batch, &rows, &cols, &batch_stride)) {
+          dim3 block(TRANSPOSE_TILE, TRANSPOSE_ROWS);
+          dim3 grid((cols + TRANSPOSE_TILE - 1) / TRANSPOSE_TILE, (rows + TRANSPOSE_TILE - 1) / TRANSPOSE_TILE, batch);
+          transposeBatchedKernel<<<grid, block>>>(src->data, dst->data, rows, cols, batch_stride);
+          return dst;
+     }
 
-     int *s_ids, *d_ids, *s_dims, *d_dims;
      int thread_num, block_size, block_num;
      thread_num = dst->len;
      block_size = MAX_THREADS_PER_BLOCK;
      block_num = thread_num / block_size + 1;
-     s_dims = (int *)cloneMem(src->dims, sizeof(int) * src->ndim, H2D);
-     d_dims = (int *)cloneMem(dst->dims, sizeof(int) * dst->ndim, H2D);
-     if (!workspace) {
-          checkError(cudaMalloc(&s_ids, sizeof(int) * dst->ndim * thread_num));
-          checkError(cudaMalloc(&d_ids, sizeof(int) * dst->ndim * thread_num));
-     } else {
-          s_ids = workspace[0];
-          d_ids = workspace[1];
-     }
-
-     transposeTensorKernel<<<block_num, block_size>>>(src->data, dst->data, dst->ndim, s_dims, d_dims, s_ids, d_ids, axes, block_size, thread_num);
-
-     if (!workspace) {
-          checkError(cudaFree(s_ids));
-          checkError(cudaFree(d_ids));
+     switch (plan.ndim) {
+     case 2:
+          transposeStridedKernel<2><<<block_num, block_size>>>(src->data, dst->data, plan, block_size, thread_num);
+          break;
+     case 3:
+          transposeStridedKernel<3><<<block_num, block_size>>>(src->data, dst->data, plan, block_size, thread_num);
+          break;
+     case 4:
+          transposeStridedKernel<4><<<block_num, block_size>>>(src->data, dst->data, plan, block_size, thread_num);
+          break;
+     default:
+          transposeStridedKernel<0><<<block_num, block_size>>>(src->data, dst->data, plan, block_size, thread_num);
+          break;
      }
-     checkError(cudaFree(s_dims));
-     checkError(cudaFree(d_dims));
      return dst;
 }
 
 /* transform from bbox delta to bbox coordinates, using hyper param EXP_THRESH = 1.0.
    delta, anchor, res are all of the same shape [..., 4]
    width and height are resized image width and height.
-   x_scales and y_scales are (temporary) pointers to width/original_width and height/original_height. */
-Tensor *transformBboxSQD(const Tensor *delta, const Tensor *anchor, Tensor *res, float width, float height, float img_width, float img_height, int x_shift, int y_shift)
+   img_sizes is an array of the original {width, height} of every image, res->dims[0] of them,
+   in the same memory as the tensors. */
+Tensor *transformBboxSQD(const Tensor *delta, const Tensor *anchor, Tensor *res, float width, float height, float *img_sizes, int x_shift, int y_shift)
 {
+     TRACE_OPERATOR("transformBbox");
      assert(isShapeEqual(delta, anchor));
      assert(isShapeEqual(delta, res));
      assert(delta->ndim == 5);
      assert(delta->dims[4] == 4);
+     if (memKind(delta->data) == HOST) {
+          assert(memKind(anchor->data) == HOST && memKind(res->data) == HOST && memKind(img_sizes) == HOST);
+          return transformBboxSQDHost(delta, anchor, res, width, height, img_sizes, x_shift, y_shift);
+     }
      assert(isDeviceMem(delta->data) && isDeviceMem(anchor->data) && isDeviceMem(res->data));
+     assert(isDeviceMem(img_sizes));
 
-     /* take 4 elements from each of delta and anchor,
+     /* take 4 elements from each of delta and anchor, either of them a view,
         and put 4 result elements to res in one thread */
+     TransposePlan d_plan, a_plan;
+     long d_step, a_step;
+     planRecords(delta, 4, &d_plan, &d_step);
+     planRecords(anchor, 4, &a_plan, &a_step);
      int i, thread_num, block_size, block_num;
      for (i = 0, thread_num = 1; i < res->ndim-1; i++)
           thread_num *= res->dims[i];
      block_size = MAX_THREADS_PER_BLOCK;
      block_num = thread_num / block_size + 1;
 
-     transformBboxSQDKernel<<<block_num, block_size>>>(delta->data, anchor->data, res->data, width, height, img_width, img_height, x_shift, y_shift, block_size, thread_num);
+     transformBboxSQDKernel<<<block_num, block_size>>>(delta->data, anchor->data, res->data, d_plan, d_step, a_plan, a_step, width, height, img_sizes, thread_num / res->dims[0], x_shift, y_shift, block_size, thread_num);
      return res;
 }
 
+/* The post-processing from conv_out [N, B * (ncls + 5), H, W] to per-anchor records in one pass:
+   score [N, H, W, B, 1] is the largest softmax class probability times the sigmoid confidence,
+   klass the class of it, and bbox [N, H, W, B, 4] the box transformBboxSQD() decodes from the
+   bbox delta and anchor. It gives what the slices, the interpret engine, the transposes,
+   reduceArgMax, multiplyElement and transformBboxSQD give, without their intermediate tensors.
+   img_sizes is in the same memory as the tensors. */
+Tensor *interpretConvout(const Tensor *convout, const Tensor *anchor, Tensor *score, Tensor *klass, Tensor *bbox,
+                         float width, float height, float *img_sizes, int x_shift, int y_shift)
+{
+     TRACE_OPERATOR("interpretConvout");
+     assert(isTensorValid(convout) && isTensorValid(anchor) && isTensorValid(score) && isTensorValid(klass) &&
+            isTensorValid(bbox));
+     if (memKind(convout->data) == HOST) {
+          assert(memKind(anchor->data) == HOST && memKind(score->data) == HOST && memKind(klass->data) == HOST &&
+                 memKind(bbox->data) == HOST && memKind(img_sizes) == HOST);
+          return interpretConvoutHost(convout, anchor, score, klass, bbox, width, height, img_sizes, x_shift, y_shift);
+     }
+     assert(isDeviceMem(convout->data) && isDeviceMem(anchor->data) && isDeviceMem(score->data) &&
+            isDeviceMem(klass->data) && isDeviceMem(bbox->data) && isDeviceMem(img_sizes));
+     assert(convout->ndim == 4 && score->ndim == 5 && bbox->ndim == 5 && bbox->dims[4] == 4);
+     assert(isShapeEqual(score, klass) && isShapeEqual(anchor, bbox) && isTensorContiguous(convout));
+
+     TransposePlan a_plan;
+     long a_step;
+     planRecords(anchor, 4, &a_plan, &a_step);
+     int thread_num, block_size, block_num;
+     int H = convout->dims[2], W = convout->dims[3], B = score->dims[3];
+     int ncls = convout->dims[1] / B - 5;
+     assert(convout->dims[1] == B * (ncls + 5) && ncls > 0 && score->len == convout->dims[0] * H * W * B);
+     thread_num = score->len;
+     block_size = MAX_THREADS_PER_BLOCK;
+     block_num = thread_num / block_size + 1;
+
+     interpretConvoutKernel<<<block_num, block_size>>>(convout->data, anchor->data, score->data, klass->data, bbox->data, a_plan, a_step, width, height, img_sizes, H, W, B, ncls, x_shift, y_shift, block_size, thread_num);
+     return score;
+}
+
 void tensorIndexSort(Tensor *src, int *idx)
 {
      assert(isTensorValid(src));
      assert(idx);
+     if (memKind(src->data) == HOST) {
+          assert(memKind(idx) == HOST);
+          tensorIndexSortHost(src, idx);
+          return;
+     }
      assert(isDeviceMem(src->data) && isDeviceMem(idx));
 
      /* the thrust call below can be unreliable, sometimes produces error */
@@ -506,9 +574,76 @@ void tensorIndexSort(Tensor *src, int *idx)
      thrust::sort_by_key(thrust::device, src->data, src->data + src->len, idx, thrust::greater<float>());
 }
 
+/* sort each of the src->dims[0] images of a batch separately, along with their part of idx */
+void tensorIndexSortBatch(Tensor *src, int *idx)
+{
+     assert(isTensorValid(src));
+     assert(idx);
+     if (memKind(src->data) == HOST) {
+          assert(memKind(idx) == HOST);
+          tensorIndexSortBatchHost(src, idx);
+          return;
+     }
+     assert(isDeviceMem(src->data) && isDeviceMem(idx));
+
+     int i, vol = src->len / src->dims[0];
+     for (i = 0; i < src->dims[0]; i++)
+          thrust::sort_by_key(thrust::device, src->data + i * vol, src->data + (i + 1) * vol, idx + i * vol,
+                              thrust::greater<float>());
+}
+
+/* select the nseg segments of src on their own, see tensorTopKBatch() */
+static void topK(const Tensor *src, int nseg, float *val, int *idx, int k, float floor, int *count)
+{
+     TRACE_OPERATOR("topK");
+     assert(isTensorValid(src) && isTensorContiguous(src));
+     assert(val && idx && k > 0 && src->len % nseg == 0);
+     if (memKind(src->data) == HOST) {
+          assert(memKind(val) == HOST && memKind(idx) == HOST && (!count || memKind(count) == HOST));
+          if (nseg == 1)
+               tensorTopKHost(src, val, idx, k, floor, count);
+          else
+               tensorTopKBatchHost(src, val, idx, k, floor, count);
+          return;
+     }
+     assert(isDeviceMem(src->data) && isDeviceMem(val) && isDeviceMem(idx) && (!count || isDeviceMem(count)));
+     assert(k <= TOPK_MAX);
+
+     int n2 = 1;
+     while (n2 < k)
+          n2 <<= 1;
+     topKKernel<<<nseg, TOPK_BLOCK_SIZE, n2 * (sizeof(float) + sizeof(int))>>>(src->data, val, idx, count,
+                                                                             src->len / nseg, k, floor);
+}
+
+/* The k largest elements of src that are >= floor, in descending order like
+   tensorIndexSort() but without sorting the rest: their values go to val[k], their
+   positions in src to idx[k]. If count isn't NULL, it gets the number selected; the
+   slots after them, when fewer than k elements reach floor, get -INFINITY and
+   position 0. Pass -INFINITY as floor to select from all elements. */
+void tensorTopK(const Tensor *src, float *val, int *idx, int k, float floor, int *count)
+{
+     topK(src, 1, val, idx, k, floor, count);
+}
+
+/* tensorTopK() on each of the src->dims[0] images of a batch, into val[dims[0]][k],
+   idx[dims[0]][k] and count[dims[0]]. The positions are into the whole src, as
+   pickElements() takes them. */
+void tensorTopKBatch(const Tensor *src, float *val, int *idx, int k, float floor, int *count)
+{
+     assert(isTensorValid(src));
+     topK(src, src->dims[0], val, idx, k, floor, count);
+}
+
 void pickElements(float *src, float *dst, int stride, int *idx, int len)
 {
+     TRACE_OPERATOR("pickElements");
      assert(src && dst && idx);
+     if (memKind(src) == HOST) {
+          assert(memKind(dst) == HOST && memKind(idx) == HOST);
+          pickElementsHost(src, dst, stride, idx, len);
+          return;
+     }
      assert(isDeviceMem(src) && isDeviceMem(dst) && isDeviceMem(idx));
 
      int thread_num, block_size, block_num;
@@ -533,22 +668,3 @@ void pickElements(float *src, float *dst, int stride, int *idx, int len)
 /*      } */
 /* } */
 
-/* compute the iou of two bboxes whose elements are {top_left_x, top_left_y, bottom_right_x, bottom_right_y} */
-float computeIou(float *bbox0, float *bbox1)
-{
-     assert(bbox0 && bbox1);
-
-     float lr, tb;              /* left-right, top-bottom for intersection*/
-     float intersection, total;
-     lr = min(bbox0[2], bbox1[2]) - max(bbox0[0], bbox1[0]);
-     if (lr >= 0) {
-          tb = min(bbox0[3], bbox1[3]) - max(bbox0[1], bbox1[1]);
-          if (tb >= 0) {
-               intersection = tb * lr + EPSILON;
-               total = (bbox0[2] - bbox0[0]) * (bbox0[3] - bbox0[1]) +
-                    (bbox1[2] - bbox1[0]) * (bbox1[3] - bbox1[1]) - intersection;
-               return intersection / (total + EPSILON);
-          }
-     }
-     return 0;
-}
@@ -9,22 +9,30 @@ typedef enum CloneKind {
      H2H, H2D, D2D, D2H
 } CloneKind;
 
+/* A view has strides, in elements, and its data points to its first element in the
+   memory of another tensor; a stride of 0 repeats the elements along its dimension.
+   Tensors without strides are contiguous, like all the tensors operators write. */
 typedef struct {
      int ndim;
      int *dims;
      int len;
      float *data;
+     int *strides;              /* NULL if contiguous */
 } Tensor;
 
 int isTensorValid(const Tensor *tensor);
 int isShapeEqual(const Tensor *t1, const Tensor *t2);
 int isHostMem(const void *ptr);
 int isDeviceMem(const void *ptr);
+MallocKind memKind(const void *ptr);
 void *cloneMem(const void *src, size_t size, CloneKind kind);
 Tensor *cloneTensor(const Tensor *src, CloneKind kind);
 void *repeatMem(void *data, size_t size, int times, CloneKind kind);
 int computeLength(int ndim, const int *dims);
 Tensor *createTensor(float *data, int ndim, const int *dims);
+Tensor *createTensorView(float *data, int ndim, const int *dims, const int *strides);
+int isTensorContiguous(const Tensor *tensor);
+long tensorStride(const Tensor *tensor, int dim);
 Tensor *mallocTensor(int ndim, const int* dims, const MallocKind mkind);
 void freeTensor(Tensor *t, int do_free_data);
 
@@ -40,12 +48,21 @@ Tensor *sliceTensor(const Tensor *src, Tensor *dst, int dim, int start, int len)
 /* Tensor *creatSlicedTensorCuda(const Tensor *src, int dim, int start, int len); */
 /* void *sliceTensorCuda(const Tensor *src, Tensor *dst, int dim, int start, int len); */
 Tensor *reshapeTensor(const Tensor *src, int newNdim, const int *newDims);
+Tensor *sliceTensorView(const Tensor *src, int dim, int start, int len);
+Tensor *broadcastTensorView(const Tensor *src, int ndim, const int *dims);
+Tensor *permuteTensorView(const Tensor *src, const int *axes);
+Tensor *contiguousTensor(const Tensor *src, Tensor *dst);
 Tensor *createReducedTensor(const Tensor *src, int dim);
 void *reduceArgMax(const Tensor *src, Tensor *dst, Tensor *arg, int dim);
 Tensor *multiplyElement(const Tensor *src1, const Tensor *src2, Tensor *dst);
-Tensor *transposeTensor(const Tensor *src, Tensor *dst, int *axes, int **workspace);
-Tensor *transformBboxSQD(const Tensor *delta, const Tensor *anchor, Tensor *res, float width, float height, float img_width, float img_height, int x_shift, int y_shift);
+Tensor *transposeTensor(const Tensor *src, Tensor *dst, const int *axes);
+Tensor *transformBboxSQD(const Tensor *delta, const Tensor *anchor, Tensor *res, float width, float height, float *img_sizes, int x_shift, int y_shift);
+Tensor *interpretConvout(const Tensor *convout, const Tensor *anchor, Tensor *score, Tensor *klass, Tensor *bbox,
+                         float width, float height, float *img_sizes, int x_shift, int y_shift);
 void tensorIndexSort(Tensor *src, int *idx);
+void tensorIndexSortBatch(Tensor *src, int *idx);
+void tensorTopK(const Tensor *src, float *val, int *idx, int k, float floor, int *count);
+void tensorTopKBatch(const Tensor *src, float *val, int *idx, int k, float floor, int *count);
 void pickElements(float *src, float *dst, int stride, int *idx, int len);
 float computeIou(float *bbox0, float *bbox1);
 
@@ -1,9 +1,13 @@
 #include <time.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
+#include <math.h>
 #include <thrust/sort.h>
 #include <thrust/execution_policy.h>
 #include "tensorUtil.h"
+#include "tensorHost.h"
+#include "sdt_alloc.h"
 /* #include "trtUtil.h" */
 
 clock_t start, end;
@@ -133,16 +137,15 @@ void testTransformBboxSQD()
      Tensor *delta_cuda = createTensor(delta_cuda_data, 3, dims);
      Tensor *anchor_cuda = createTensor(anchor_cuda_data, 3, dims);
      Tensor *res_cuda = createTensor(res_cuda_data, 3, dims);
-     float x_scales[] = {1.}, y_scales[] = {1.};
-     float *x_scales_device = (float *)cloneMem(x_scales, sizeof(float), H2D);
-     float *y_scales_device = (float *)cloneMem(y_scales, sizeof(float), H2D);
+     float img_sizes[] = {1248, 384};
+     float *img_sizes_device = (float *)cloneMem(img_sizes, sizeof(float) * 2, H2D);
 
      printf("delta_host:\n");
      printTensor(delta_host, "%.6f");
      printf("anchor_host:\n");
      printTensor(anchor_host, "%.6f");
      start =clock();
-     transformBboxSQD(delta_cuda, anchor_cuda, res_cuda, 1248, 384, *x_scales_device, *y_scales_device, 0, 0);
+     transformBboxSQD(delta_cuda, anchor_cuda, res_cuda, 1248, 384, img_sizes_device, 0, 0);
      end = clock();
      printf("transformBboxSQD in %ld\n", end - start);
      float *res_host_data = (float *)cloneMem(res_cuda_data, sizeof(float) * 24, D2H);
@@ -222,6 +225,43 @@ void testThrustSort()
      printf("\n");
 }
 
+void testTopK()
+{
+     /* two images of anchor scores with many ties, topKKernel against the host heap */
+     int n = 2 * 16848, k, i, diff;
+     int ks[] = {64, 256, 1024};
+     int dims[] = {2, 16848};
+     float *f = (float *)sdt_alloc(n * sizeof(float));
+     for (i = 0; i < n; i++)
+          f[i] = (rand() % 1000) / 1000.0;
+     Tensor *src = createTensor(f, 2, dims);
+     Tensor *src_device = cloneTensor(src, H2D);
+
+     for (int j = 0; j < 3; j++) {
+          k = ks[j];
+          float *val = (float *)sdt_alloc(2 * k * sizeof(float));
+          int *idx = (int *)sdt_alloc(2 * k * sizeof(int));
+          float *val_device;
+          int *idx_device;
+          cudaMalloc(&val_device, 2 * k * sizeof(float));
+          cudaMalloc(&idx_device, 2 * k * sizeof(int));
+          tensorTopKBatchHost(src, val, idx, k, 0.5, NULL);
+          tensorTopKBatch(src_device, val_device, idx_device, k, 0.5, NULL);
+          float *val_host = (float *)cloneMem(val_device, 2 * k * sizeof(float), D2H);
+          int *idx_host = (int *)cloneMem(idx_device, 2 * k * sizeof(int), D2H);
+          for (i = 0, diff = 0; i < 2 * k; i++)
+               diff += val[i] != val_host[i] || idx[i] != idx_host[i];
+          printf("k %d: %d differences, top %.3f at %d\n", k, diff, val_host[0], idx_host[0]);
+          sdt_free(val);
+          sdt_free(idx);
+          sdt_free(val_host);
+          sdt_free(idx_host);
+          cudaFree(val_device);
+          cudaFree(idx_device);
+     }
+     sdt_free(f);
+}
+
 void findThrustBug()
 {
      const int SIZE = 16848;
@@ -427,14 +467,9 @@ void testTransposeTensor()
      int d_dims[] = {1, 3, 3, 2};
      Tensor *d_t = mallocTensor(s_t->ndim, d_dims, DEVICE);
      int axes[] = {0, 1, 3, 2};
-     int *axes_d = (int *)cloneMem(axes, sizeof(int) * 4, H2D);
-     int *workspace[2];
-     cudaMalloc(&workspace[0], sizeof(int) * s_t->ndim * s_t->len);
-     cudaMalloc(&workspace[1], sizeof(int) * d_t->ndim * d_t->len);
 
      start = clock();
-     /* transposeTensor(s_t, d_t, axes_d, workspace); */
-     transposeTensor(s_t, d_t, axes_d, NULL);
+     transposeTensor(s_t, d_t, axes);
      end = clock();
 
      printf("transposeTensor in %ld\n", end - start);
@@ -451,6 +486,7 @@ int main(int argc, char *argv[])
      /* testTransformBboxSQD(); */
      /* testAnchor(); */
      /* testThrustSort(); */
+     /* testTopK(); */
      /* findThrustBug(); */
      /* testOpencv(); */
      /* testIou(); */
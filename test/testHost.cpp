@@ -0,0 +1,1614 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <omp.h>
+#include "tensorHost.h"
+#include "nms.h"
+#include "detection.h"
+#include "tensorArena.h"
+#include "inputCache.h"
+#include "resultWriter.h"
+#include "pipeline.h"
+#include "trace.h"
+#include "cpuOps.h"
+#include "cpuWinograd.h"
+#include "cpuInt8.h"
+#include "cpuHalf.h"
+#include "cpuEngine.h"
+#include "cpuFused.h"
+#include "weightsFile.h"
+#include "sdt_alloc.h"
+
+/* The host operators, detection steps, queues, traces and cpu backend of sqdtrt, with their
+   expected results, so they run without a GPU. Prints one line per case and exits with the
+   number of failures. */
+
+int ndim = 4;
+int dims[] = {1, 3, 2, 3};
+float data[] = {0.0, 1.0, 2.0, 3.0,
+                4.0, 5.0, 6.0, 7.0,
+                8.0, 9.0, 10.0, 11.0,
+                12.0, 13.0, 14.0, 15.0,
+                16.0, 17.0};
+Tensor *t;
+
+static Tensor *hostTensor(int ndim, const int *dims)
+{
+     Tensor *ht = createTensor(NULL, ndim, dims);
+     ht->data = (float *)sdt_alloc(sizeof(float) * ht->len);
+     return ht;
+}
+
+static void freeHostTensor(Tensor *ht)
+{
+     sdt_free(ht->data);
+     sdt_free(ht->dims);
+     sdt_free(ht);
+}
+
+static int check(const char *name, const float *got, const float *want, int n, float tolerance)
+{
+     for (int i = 0; i < n; i++) {
+          if (fabsf(got[i] - want[i]) > tolerance) {
+               printf("%s: FAIL at %d, got %f, want %f\n", name, i, got[i], want[i]);
+               return 1;
+          }
+     }
+     printf("%s: ok\n", name);
+     return 0;
+}
+
+int testSliceTensorHost()
+{
+     int st_dims[] = {1, 2, 2, 3};
+     Tensor *st = hostTensor(4, st_dims);
+     float want[] = {6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17};
+
+     sliceTensorHost(t, st, 1, 1, 2);
+     int ret = check("sliceTensor", st->data, want, st->len, 0);
+     freeHostTensor(st);
+     return ret;
+}
+
+int testReduceArgMaxHost()
+{
+     int r_dims[] = {1, 3, 1, 3};
+     Tensor *dst = hostTensor(4, r_dims);
+     Tensor *arg = hostTensor(4, r_dims);
+     float want_dst[] = {3, 4, 5, 9, 10, 11, 15, 16, 17};
+     float want_arg[] = {1, 1, 1, 1, 1, 1, 1, 1, 1};
+     float src2[] = {2, 0, 1, 9, 9, 3};     /* first of equal maxima wins */
+     int src2_dims[] = {2, 3};
+     int r2_dims[] = {2, 1};
+     Tensor *s2 = createTensor(src2, 2, src2_dims);
+     Tensor *dst2 = hostTensor(2, r2_dims);
+     Tensor *arg2 = hostTensor(2, r2_dims);
+     float want_dst2[] = {2, 9};
+     float want_arg2[] = {0, 0};
+
+     reduceArgMaxHost(t, dst, arg, 2);
+     reduceArgMaxHost(s2, dst2, arg2, 1);
+     int ret = check("reduceArgMax max", dst->data, want_dst, dst->len, 0) +
+          check("reduceArgMax arg", arg->data, want_arg, arg->len, 0) +
+          check("reduceArgMax last dim max", dst2->data, want_dst2, 2, 0) +
+          check("reduceArgMax last dim arg", arg2->data, want_arg2, 2, 0);
+     freeHostTensor(dst);
+     freeHostTensor(arg);
+     freeHostTensor(dst2);
+     freeHostTensor(arg2);
+     sdt_free(s2->dims);
+     sdt_free(s2);
+     return ret;
+}
+
+int testMultiplyElementHost()
+{
+     Tensor *dst = hostTensor(t->ndim, t->dims);
+     float want[18];
+
+     for (int i = 0; i < 18; i++)
+          want[i] = data[i] * data[i];
+     multiplyElementHost(t, t, dst);
+     int ret = check("multiplyElement", dst->data, want, dst->len, 0);
+     freeHostTensor(dst);
+     return ret;
+}
+
+int testTransposeTensorHost()
+{
+     int d_dims[] = {1, 3, 3, 2};
+     int axes[] = {0, 1, 3, 2};
+     Tensor *dst = hostTensor(4, d_dims);
+     float want[] = {0, 3, 1, 4, 2, 5,
+                     6, 9, 7, 10, 8, 11,
+                     12, 15, 13, 16, 14, 17};
+
+     transposeTensorHost(t, dst, axes);
+     int ret = check("transposeTensor", dst->data, want, dst->len, 0);
+     freeHostTensor(dst);
+     return ret;
+}
+
+/* the transposes of sqdtrt, against index vector arithmetic */
+int testTransposeTensorHostLarge()
+{
+     int s_dims[] = {2, 9, 3, 24, 78};
+     int d_dims[] = {2, 24, 78, 9, 3};
+     int axes[] = {0, 3, 4, 1, 2};
+     Tensor *src = hostTensor(5, s_dims);
+     Tensor *dst = hostTensor(5, d_dims);
+     float *want = (float *)sdt_alloc(sizeof(float) * src->len);
+     int i, k, ids[5], s_ids[5], si;
+
+     for (i = 0; i < src->len; i++)
+          src->data[i] = i;
+     for (i = 0; i < dst->len; i++) {
+          for (k = 4, si = i; k >= 0; k--) {
+               ids[k] = si % d_dims[k];
+               si /= d_dims[k];
+          }
+          for (k = 0; k < 5; k++)
+               s_ids[axes[k]] = ids[k];
+          for (k = 1, si = s_ids[0]; k < 5; k++)
+               si = s_dims[k] * si + s_ids[k];
+          want[i] = src->data[si];
+     }
+     transposeTensorHost(src, dst, axes);
+     int ret = check("transposeTensor sqdtrt shape", dst->data, want, dst->len, 0);
+     freeHostTensor(src);
+     freeHostTensor(dst);
+     sdt_free(want);
+     return ret;
+}
+
+/* every permutation of a rank 5 tensor, with dimensions of size 1 to merge and drop */
+int testTransposeTensorHostAll()
+{
+     int shapes[][5] = {{2, 3, 4, 5, 6}, {1, 3, 1, 5, 2}, {2, 1, 7, 1, 1}};
+     int axes[5], d_dims[5], ids[5], s_ids[5], i, k, si, fails = 0;
+
+     for (int sh = 0; sh < 3; sh++) {
+          Tensor *src = hostTensor(5, shapes[sh]);
+          for (i = 0; i < src->len; i++)
+               src->data[i] = i;
+          for (int p = 0; p < 5 * 5 * 5 * 5 * 5; p++) {
+               int used = 0;
+               for (k = 0, si = p; k < 5; k++, si /= 5) {
+                    axes[k] = si % 5;
+                    used |= 1 << axes[k];
+               }
+               if (used != 0x1f)
+                    continue;
+               for (k = 0; k < 5; k++)
+                    d_dims[k] = shapes[sh][axes[k]];
+               Tensor *dst = hostTensor(5, d_dims);
+               transposeTensorHost(src, dst, axes);
+               for (i = 0; i < dst->len; i++) {
+                    for (k = 4, si = i; k >= 0; k--) {
+                         ids[k] = si % d_dims[k];
+                         si /= d_dims[k];
+                    }
+                    for (k = 0; k < 5; k++)
+                         s_ids[axes[k]] = ids[k];
+                    for (k = 1, si = s_ids[0]; k < 5; k++)
+                         si = shapes[sh][k] * si + s_ids[k];
+                    if (dst->data[i] != src->data[si]) {
+                         fails++;
+                         break;
+                    }
+               }
+               freeHostTensor(dst);
+          }
+          freeHostTensor(src);
+     }
+     printf("transposeTensor permutations: %s\n", fails ? "FAIL" : "ok");
+     return fails != 0;
+}
+
+int testTransformBboxSQDHost()
+{
+     /* two images of two anchors, the second image twice the size of the first */
+     int b_dims[] = {2, 1, 1, 2, 4};
+     float delta[] = {0.5, -0.5, 0, 0,   0, 0, 0, 0,
+                      0.5, -0.5, 0, 0,   0, 0, 0, 0};
+     float anchor[] = {100, 50, 20, 10,  5, 5, 20, 10,
+                       100, 50, 20, 10,  5, 5, 20, 10};
+     float img_sizes[] = {1248, 384, 2496, 768};
+     float want[] = {100, 40, 120, 50,  0, 0, 15, 10,
+                     200, 80, 240, 100, 0, 0, 30, 20};
+     Tensor *d = createTensor(delta, 5, b_dims);
+     Tensor *a = createTensor(anchor, 5, b_dims);
+     Tensor *res = hostTensor(5, b_dims);
+
+     transformBboxSQDHost(d, a, res, 1248, 384, img_sizes, 0, 0);
+     int ret = check("transformBboxSQD", res->data, want, res->len, 1e-4);
+     freeHostTensor(res);
+     sdt_free(d->dims);
+     sdt_free(d);
+     sdt_free(a->dims);
+     sdt_free(a);
+     return ret;
+}
+
+/* interpretConvoutHost() against the unfused chain of doInference(), with the softmax and
+   sigmoid of the interpret engine done here */
+int testInterpretConvoutHost()
+{
+     const int N = 2, B = 9, NCLS = 3, H = 3, W = 5, C = B * (NCLS + 5);
+     int convout_dims[] = {N, C, H, W};
+     int class_dims[] = {N, B * NCLS, H, W}, conf_dims[] = {N, B, H, W}, bbox_in_dims[] = {N, B * 4, H, W};
+     int class5_dims[] = {N, B, NCLS, H, W}, conf5_dims[] = {N, B, 1, H, W}, bbox5_dims[] = {N, B, 4, H, W};
+     int class_t_dims[] = {N, H, W, B, NCLS}, score_dims[] = {N, H, W, B, 1}, bbox_dims[] = {N, H, W, B, 4};
+     int axes[] = {0, 3, 4, 1, 2};
+     float img_sizes[] = {1242, 375, 620, 188};
+     int i, c;
+
+     Tensor *convout = hostTensor(4, convout_dims);
+     Tensor *anchor = hostTensor(5, bbox_dims);
+     for (i = 0; i < convout->len; i++)
+          convout->data[i] = (float)rand() / RAND_MAX * 4 - 2;
+     for (i = 0; i < anchor->len; i++)
+          anchor->data[i] = (float)rand() / RAND_MAX * 300 + 10;
+
+     Tensor *score = hostTensor(5, score_dims), *klass = hostTensor(5, score_dims), *bbox = hostTensor(5, bbox_dims);
+     interpretConvoutHost(convout, anchor, score, klass, bbox, 1248, 384, img_sizes, 0, 0);
+
+     Tensor *class_in = hostTensor(4, class_dims), *conf_in = hostTensor(4, conf_dims);
+     Tensor *bbox_in = hostTensor(4, bbox_in_dims);
+     sliceTensorHost(convout, class_in, 1, 0, B * NCLS);
+     sliceTensorHost(convout, conf_in, 1, B * NCLS, B);
+     sliceTensorHost(convout, bbox_in, 1, B * (NCLS + 1), B * 4);
+     /* softmax over the classes of every anchor, sigmoid of the confidences */
+     for (i = 0; i < N * B; i++) {
+          float *p = class_in->data + i * NCLS * H * W;
+          for (int j = 0; j < H * W; j++) {
+               float sum = 0;
+               for (c = 0; c < NCLS; c++)
+                    sum += expf(p[c * H * W + j]);
+               for (c = 0; c < NCLS; c++)
+                    p[c * H * W + j] = expf(p[c * H * W + j]) / sum;
+          }
+     }
+     for (i = 0; i < conf_in->len; i++)
+          conf_in->data[i] = 1 / (1 + expf(-conf_in->data[i]));
+     Tensor *class5 = reshapeTensor(class_in, 5, class5_dims), *conf5 = reshapeTensor(conf_in, 5, conf5_dims);
+     Tensor *bbox5 = reshapeTensor(bbox_in, 5, bbox5_dims);
+     Tensor *class_t = hostTensor(5, class_t_dims), *conf_t = hostTensor(5, score_dims);
+     Tensor *bbox_t = hostTensor(5, bbox_dims);
+     transposeTensorHost(class5, class_t, axes);
+     transposeTensorHost(conf5, conf_t, axes);
+     transposeTensorHost(bbox5, bbox_t, axes);
+     Tensor *max_ref = hostTensor(5, score_dims), *klass_ref = hostTensor(5, score_dims);
+     Tensor *score_ref = hostTensor(5, score_dims), *bbox_ref = hostTensor(5, bbox_dims);
+     reduceArgMaxHost(class_t, max_ref, klass_ref, 4);
+     multiplyElementHost(max_ref, conf_t, score_ref);
+     transformBboxSQDHost(bbox_t, anchor, bbox_ref, 1248, 384, img_sizes, 0, 0);
+
+     int ret = check("interpretConvout score", score->data, score_ref->data, score->len, 1e-6) +
+          check("interpretConvout class", klass->data, klass_ref->data, klass->len, 0) +
+          check("interpretConvout bbox", bbox->data, bbox_ref->data, bbox->len, 1e-3);
+     Tensor *tensors[] = {convout, anchor, score, klass, bbox, class_in, conf_in, bbox_in, class_t, conf_t, bbox_t,
+                          max_ref, klass_ref, score_ref, bbox_ref};
+     for (i = 0; i < (int)(sizeof(tensors) / sizeof(tensors[0])); i++)
+          freeHostTensor(tensors[i]);
+     Tensor *views[] = {class5, conf5, bbox5};
+     for (i = 0; i < 3; i++) {
+          sdt_free(views[i]->dims);
+          sdt_free(views[i]);
+     }
+     return ret;
+}
+
+static void freeView(Tensor *v)
+{
+     sdt_free(v->dims);
+     sdt_free(v->strides);
+     sdt_free(v);
+}
+
+/* the operators on slice, permute and broadcast views, against their contiguous copies */
+int testViewsHost()
+{
+     const int N = 2, B = 4, NCLS = 3, H = 2, W = 5;
+     int class_dims[] = {N, B, NCLS, H, W}, class_t_dims[] = {N, H, W, B, NCLS};
+     int score_dims[] = {N, H, W, B, 1}, bbox_dims[] = {N, H, W, B, 4}, grid_dims[] = {1, H, W, B, 4};
+     int conv_dims[] = {N, B * (NCLS + 5), H, W};
+     int st_dims[] = {1, 2, 2, 3};
+     int axes[] = {0, 3, 4, 1, 2};
+     float img_sizes[] = {1242, 375, 620, 188};
+     int i, ret = 0;
+
+     /* a slice is copied by transposeTensorHost() with the identity axes */
+     int identity[] = {0, 1, 2, 3};
+     Tensor *sv = sliceTensorView(t, 1, 1, 2);
+     Tensor *st = hostTensor(4, st_dims), *st_ref = hostTensor(4, st_dims);
+     transposeTensorHost(sv, st, identity);
+     sliceTensorHost(t, st_ref, 1, 1, 2);
+     ret += check("slice view", st->data, st_ref->data, st->len, 0) +
+          check("slice view data", sv->data, t->data + 6, 1, 0);
+
+     /* reduce and multiply on permutations, without transposing first */
+     Tensor *klass = hostTensor(5, class_dims), *conf = hostTensor(5, score_dims);
+     for (i = 0; i < klass->len; i++)
+          klass->data[i] = (float)rand() / RAND_MAX;
+     for (i = 0; i < conf->len; i++)
+          conf->data[i] = (float)rand() / RAND_MAX;
+     int conf5_dims[] = {N, B, 1, H, W};
+     Tensor *conf5 = reshapeTensor(conf, 5, conf5_dims);
+     Tensor *class_v = permuteTensorView(klass, axes), *conf_v = permuteTensorView(conf5, axes);
+     Tensor *class_t = hostTensor(5, class_t_dims), *conf_t = hostTensor(5, score_dims);
+     transposeTensorHost(klass, class_t, axes);
+     transposeTensorHost(conf5, conf_t, axes);
+     Tensor *max = hostTensor(5, score_dims), *arg = hostTensor(5, score_dims), *score = hostTensor(5, score_dims);
+     Tensor *max_ref = hostTensor(5, score_dims), *arg_ref = hostTensor(5, score_dims);
+     Tensor *score_ref = hostTensor(5, score_dims);
+     reduceArgMaxHost(class_v, max, arg, 4);
+     multiplyElementHost(max, conf_v, score);
+     reduceArgMaxHost(class_t, max_ref, arg_ref, 4);
+     multiplyElementHost(max_ref, conf_t, score_ref);
+     ret += check("permute view reduceArgMax", arg->data, arg_ref->data, arg->len, 0) +
+          check("permute view multiplyElement", score->data, score_ref->data, score->len, 0);
+
+     /* the bboxes of conv_out through a slice and a permutation, with one anchor grid for all images */
+     Tensor *convout = hostTensor(4, conv_dims), *grid = hostTensor(5, grid_dims);
+     Tensor *anchor = hostTensor(5, bbox_dims);
+     for (i = 0; i < convout->len; i++)
+          convout->data[i] = (float)rand() / RAND_MAX * 4 - 2;
+     for (i = 0; i < grid->len; i++)
+          grid->data[i] = (float)rand() / RAND_MAX * 300 + 10;
+     for (i = 0; i < anchor->len; i++)
+          anchor->data[i] = grid->data[i % grid->len];
+     Tensor *anchor_v = broadcastTensorView(grid, 5, bbox_dims);
+     int conv5_dims[] = {N, B * (NCLS + 5) / 4, 4, H, W}, bbox5_dims[] = {N, B, 4, H, W};
+     Tensor *conv5 = reshapeTensor(convout, 5, conv5_dims);
+     Tensor *bbox_s = sliceTensorView(conv5, 1, B * (NCLS + 1) / 4, B);
+     Tensor *bbox_v = permuteTensorView(bbox_s, axes);
+     Tensor *bbox_in = hostTensor(5, bbox5_dims), *bbox_t = hostTensor(5, bbox_dims);
+     int bbox_in_dims[] = {N, B * 4, H, W};
+     Tensor *bbox_in4 = reshapeTensor(bbox_in, 4, bbox_in_dims);
+     sliceTensorHost(convout, bbox_in4, 1, B * (NCLS + 1), B * 4);
+     transposeTensorHost(bbox_in, bbox_t, axes);
+     Tensor *bbox = hostTensor(5, bbox_dims), *bbox_ref = hostTensor(5, bbox_dims);
+     transformBboxSQDHost(bbox_v, anchor_v, bbox, 1248, 384, img_sizes, 0, 0);
+     transformBboxSQDHost(bbox_t, anchor, bbox_ref, 1248, 384, img_sizes, 0, 0);
+     ret += check("view transformBboxSQD", bbox->data, bbox_ref->data, bbox->len, 1e-3);
+
+     /* the fused interpretation with the broadcast grid */
+     Tensor *iscore = hostTensor(5, score_dims), *iklass = hostTensor(5, score_dims);
+     Tensor *ibbox = hostTensor(5, bbox_dims), *ibbox_ref = hostTensor(5, bbox_dims);
+     interpretConvoutHost(convout, anchor_v, iscore, iklass, ibbox, 1248, 384, img_sizes, 0, 0);
+     interpretConvoutHost(convout, anchor, iscore, iklass, ibbox_ref, 1248, 384, img_sizes, 0, 0);
+     ret += check("broadcast anchor interpretConvout", ibbox->data, ibbox_ref->data, ibbox->len, 0);
+
+     Tensor *tensors[] = {st, st_ref, klass, conf, class_t, conf_t, max, arg, score, max_ref, arg_ref, score_ref,
+                          convout, grid, anchor, bbox_in, bbox_t, bbox, bbox_ref, iscore, iklass, ibbox, ibbox_ref};
+     for (i = 0; i < (int)(sizeof(tensors) / sizeof(tensors[0])); i++)
+          freeHostTensor(tensors[i]);
+     Tensor *views[] = {sv, conf5, class_v, conf_v, anchor_v, conv5, bbox_s, bbox_v, bbox_in4};
+     for (i = 0; i < (int)(sizeof(views) / sizeof(views[0])); i++)
+          freeView(views[i]);
+     return ret;
+}
+
+int testSortHost()
+{
+     float f[] = {3.1, 9.2, 7.3, 5.4, 4.5, 0.6, 2.7, 6.8, 1.9,
+                  1, 3, 2, 3, 0, 0, 5, 4, 1};
+     int id[] = {0, 1, 2, 3, 4, 5, 6, 7, 8,
+                 9, 10, 11, 12, 13, 14, 15, 16, 17};
+     float want_f[] = {9.2, 7.3, 6.8, 5.4, 4.5, 3.1, 2.7, 1.9, 0.6,
+                       5, 4, 3, 3, 2, 1, 1, 0, 0};
+     float want_id[] = {1, 2, 7, 3, 4, 0, 6, 8, 5,
+                        15, 16, 10, 12, 11, 9, 17, 13, 14}; /* equal keys keep their order */
+     float got_id[18];
+     int s_dims[] = {2, 9};
+     Tensor *s = createTensor(f, 2, s_dims);
+
+     tensorIndexSortBatchHost(s, id);
+     for (int i = 0; i < 18; i++)
+          got_id[i] = id[i];
+     int ret = check("tensorIndexSortBatch keys", f, want_f, 18, 0) +
+          check("tensorIndexSortBatch indexes", got_id, want_id, 18, 0);
+     sdt_free(s->dims);
+     sdt_free(s);
+     return ret;
+}
+
+int testTopKHost()
+{
+     float f[] = {3.1, 9.2, 7.3, 5.4, 4.5, 0.6, 2.7, 6.8, 1.9,
+                  1, 3, 2, 3, 0, 0, 5, 4, 1};
+     float val[8], got_idx[8], got_count[2];
+     int idx[8], count[2];
+     float want_val[] = {9.2, 7.3, 6.8, 5.4, 5, 4, 3, 3};
+     float want_idx[] = {1, 2, 7, 3, 15, 16, 10, 12}; /* positions into the whole batch, ties in order */
+     float want_floor_val[] = {9.2, 7.3, 6.8, 5.4, 5, 4, -INFINITY, -INFINITY};
+     float want_floor_idx[] = {1, 2, 7, 3, 15, 16, 9, 9};
+     float want_count[] = {4, 2};
+     int s_dims[] = {2, 9};
+     Tensor *s = createTensor(f, 2, s_dims);
+     int i, ret;
+
+     tensorTopKBatchHost(s, val, idx, 4, -INFINITY, NULL);
+     for (i = 0; i < 8; i++)
+          got_idx[i] = idx[i];
+     ret = check("tensorTopKBatch values", val, want_val, 8, 0) +
+          check("tensorTopKBatch indexes", got_idx, want_idx, 8, 0);
+
+     tensorTopKBatchHost(s, val, idx, 4, 3.5, count);
+     for (i = 0; i < 8; i++)
+          got_idx[i] = idx[i];
+     got_count[0] = count[0];
+     got_count[1] = count[1];
+     ret += check("tensorTopKBatch floor values", val, want_floor_val, 8, 0) +
+          check("tensorTopKBatch floor indexes", got_idx, want_floor_idx, 8, 0) +
+          check("tensorTopKBatch floor counts", got_count, want_count, 2, 0);
+     sdt_free(s->dims);
+     sdt_free(s);
+     return ret;
+}
+
+int testPickElementsHost()
+{
+     int index[] = {3, 2, 1, 0};
+     float dst[16];
+     float want[] = {12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3};
+
+     pickElementsHost(data, dst, 4, index, 4);
+     return check("pickElements", dst, want, 16, 0);
+}
+
+/* the pairwise loop detectionFilter() ran before nmsFilter() */
+static void nmsReference(float *bbox, const float *klass, const float *prob, int *keep, int num,
+                         float nms_thresh, float prob_thresh)
+{
+     for (int i = 0; i < num; i++)
+          keep[i] = prob[i] >= prob_thresh;
+     for (int i = 0; i < num; i++) {
+          if (prob[i] < prob_thresh)
+               continue;
+          for (int j = i + 1; j < num; j++)
+               if (keep[j] && klass[i] == klass[j] && computeIou(&bbox[i*4], &bbox[j*4]) > nms_thresh)
+                    keep[j] = 0;
+     }
+}
+
+int testNmsHost()
+{
+     int sizes[] = {1, 7, 64, 65, 200, 1000};
+     int ret = 0;
+
+     for (int s = 0; s < 6; s++) {
+          int num = sizes[s], diff = 0, i;
+          float *bbox = (float *)sdt_alloc(sizeof(float) * num * 4);
+          float *klass = (float *)sdt_alloc(sizeof(float) * num);
+          float *prob = (float *)sdt_alloc(sizeof(float) * num);
+          int *keep = (int *)sdt_alloc(sizeof(int) * num);
+          int *want = (int *)sdt_alloc(sizeof(int) * num);
+          /* boxes crowded into a small image so that many overlap, descending probs */
+          for (i = 0; i < num; i++) {
+               bbox[i*4] = rand() % 200;
+               bbox[i*4+1] = rand() % 100;
+               bbox[i*4+2] = bbox[i*4] + 10 + rand() % 60;
+               bbox[i*4+3] = bbox[i*4+1] + 10 + rand() % 40;
+               klass[i] = rand() % 3;
+               prob[i] = 1 - (float)i / num;
+          }
+          NmsContext *nms = createNms(num, 3);
+          for (int simd = 0; simd < 2; simd++) {
+               nms->simd = simd && __builtin_cpu_supports("avx2");
+               for (int p = 0; p < 2; p++) {
+                    float prob_thresh = p ? 0.3 : 0;
+                    nmsReference(bbox, klass, prob, want, num, 0.4, prob_thresh);
+                    nmsFilter(nms, bbox, klass, prob, keep, num, 0.4, prob_thresh);
+                    for (i = 0; i < num; i++)
+                         diff += keep[i] != want[i];
+               }
+          }
+          printf("nmsFilter %d boxes: %s\n", num, diff ? "FAIL" : "ok");
+          ret += diff != 0;
+          destroyNms(nms);
+          sdt_free(bbox);
+          sdt_free(klass);
+          sdt_free(prob);
+          sdt_free(keep);
+          sdt_free(want);
+     }
+     return ret;
+}
+
+int testIouHost()
+{
+     float bbox0[] = {0, 0, 10, 10};
+     float bbox1[] = {5, 0, 15, 10};
+     float got = computeIou(bbox0, bbox1), want = 50.0 / 150;
+     return check("computeIou", &got, &want, 1, 1e-6);
+}
+
+/* the input layout, the anchor grid and the result lines of detection.cpp */
+int testDetectionHost()
+{
+     int ret = 0;
+     unsigned char bgr[] = {1, 2, 3, 4, 5, 6};
+     float mean[] = {1, 1, 2};
+     float input[6], want_input[] = {0, 3, 1, 4, 1, 4};
+     packInput(input, bgr, 1, 2, mean);
+     ret += check("packInput", input, want_input, 6, 0);
+
+     float shape[] = {10, 20, 30, 40};
+     float want_anchors[] = {4, 3, 10, 20, 4, 3, 30, 40, 8, 3, 10, 20, 8, 3, 30, 40,
+                             4, 3, 10, 20, 4, 3, 30, 40, 8, 3, 10, 20, 8, 3, 30, 40};
+     float *anchors = prepareAnchors(shape, 12, 6, 2, 1, 2, 2);
+     ret += check("prepareAnchors", anchors, want_anchors, 32, 1e-6);
+     sdt_free(anchors);
+
+     const char *names[] = {"car", "pedestrian"};
+     float klass[] = {1, 0}, prob[] = {0.5, 0.25}, bbox[] = {1, 2, 3, 4, 5, 6, 7, 8};
+     int keep[] = {0, 1};
+     struct predictions preds = {klass, prob, bbox, keep, 2};
+     char line[128] = "";
+     FILE *fp = tmpfile();
+     fprintResult(fp, &preds, names);
+     rewind(fp);
+     if (!fgets(line, sizeof(line), fp))
+          line[0] = '\0';
+     fclose(fp);
+     if (strcmp(line, "car -1 -1 0.0 5.00 6.00 7.00 8.00 0.0 0.0 0.0 0.0 0.0 0.0 0.0 0.250\n")) {
+          printf("fprintResult: FAIL, %s", line);
+          ret++;
+     } else {
+          printf("fprintResult: ok\n");
+     }
+
+     /* one NMS context for the 64 detections of every image of a batch, reused */
+     int batch = 4, num = 64, diff = 0;
+     float bklass[4 * 64], bprob[4 * 64], bbbox[4 * 64 * 4];
+     int bkeep[4 * 64], want[64];
+     struct predictions batch_preds = {bklass, bprob, bbbox, bkeep, num};
+     for (int i = 0; i < batch * num; i++) {
+          bbbox[i*4] = rand() % 200;
+          bbbox[i*4+1] = rand() % 100;
+          bbbox[i*4+2] = bbbox[i*4] + 10 + rand() % 60;
+          bbbox[i*4+3] = bbbox[i*4+1] + 10 + rand() % 40;
+          bklass[i] = rand() % 3;
+          bprob[i] = 1 - (float)(i % num) / num;
+     }
+     NmsContext *nms = createNms(num, 3);
+     for (int b = 0; b < batch; b++) {
+          struct predictions image = imagePredictions(&batch_preds, b);
+          detectionFilter(nms, &image, 0.4, 0.3);
+          nmsReference(image.bbox, image.klass, image.prob, want, num, 0.4, 0.3);
+          for (int i = 0; i < num; i++)
+               diff += image.keep[i] != want[i];
+     }
+     destroyNms(nms);
+     printf("detectionFilter: %s\n", diff ? "FAIL" : "ok");
+     ret += diff != 0;
+     return ret;
+}
+
+/* cv::resize(INTER_LINEAR) in double, less the mean, to [3][h][w] */
+static void resizeReference(float *dst, const unsigned char *src, int sh, int sw, long step, int h, int w,
+                            const float *mean)
+{
+     for (int y = 0; y < h; y++) {
+          double fy = (y + 0.5) * sh / h - 0.5;
+          int y0 = (int)floor(fy);
+          fy -= y0;
+          if (y0 < 0)
+               y0 = 0, fy = 0;
+          if (y0 >= sh - 1)
+               y0 = sh - 1, fy = 0;
+          int y1 = y0 + 1 < sh ? y0 + 1 : sh - 1;
+          for (int x = 0; x < w; x++) {
+               double fx = (x + 0.5) * sw / w - 0.5;
+               int x0 = (int)floor(fx);
+               fx -= x0;
+               if (x0 < 0)
+                    x0 = 0, fx = 0;
+               if (x0 >= sw - 1)
+                    x0 = sw - 1, fx = 0;
+               int x1 = x0 + 1 < sw ? x0 + 1 : sw - 1;
+               for (int c = 0; c < 3; c++) {
+                    double top = src[y0 * step + x0 * 3 + c] * (1 - fx) + src[y0 * step + x1 * 3 + c] * fx;
+                    double bottom = src[y1 * step + x0 * 3 + c] * (1 - fx) + src[y1 * step + x1 * 3 + c] * fx;
+                    dst[(c * h + y) * w + x] = top * (1 - fy) + bottom * fy - mean[c];
+               }
+          }
+     }
+}
+
+/* the fused resize against the double one, up and down, with and without AVX2, and
+   the same size against packInput() */
+int testResizeInputHost()
+{
+     int ret = 0, sh = 23, sw = 37;
+     long step = sw * 3 + 5;
+     float mean[] = {100, 110, 120};
+     unsigned char *src = (unsigned char *)sdt_alloc(sh * step);
+     for (long i = 0; i < sh * step; i++)
+          src[i] = (i * 131 + 7) % 251;
+
+     int sizes[][2] = {{16, 50}, {40, 20}, {23, 37}};
+     for (int s = 0; s < 3; s++) {
+          int h = sizes[s][0], w = sizes[s][1];
+          float *got = (float *)sdt_alloc(sizeof(float) * 3 * h * w);
+          float *want = (float *)sdt_alloc(sizeof(float) * 3 * h * w);
+          resizeReference(want, src, sh, sw, step, h, w, mean);
+          resizeInput(got, src, sh, sw, step, h, w, mean, RESIZE_PARALLEL);
+          ret += check("resizeInput", got, want, 3 * h * w, 1e-3);
+          resizeInput(got, src, sh, sw, step, h, w, mean, RESIZE_SCALAR);
+          ret += check("resizeInput scalar", got, want, 3 * h * w, 1e-3);
+          sdt_free(got);
+          sdt_free(want);
+     }
+
+     unsigned char *packed = (unsigned char *)sdt_alloc(sh * sw * 3);
+     float *got = (float *)sdt_alloc(sizeof(float) * 3 * sh * sw);
+     float *want = (float *)sdt_alloc(sizeof(float) * 3 * sh * sw);
+     for (int y = 0; y < sh; y++)
+          memcpy(packed + y * sw * 3, src + y * step, sw * 3);
+     packInput(want, packed, sh, sw, mean);
+     resizeInput(got, src, sh, sw, step, sh, sw, mean, RESIZE_PARALLEL);
+     ret += check("resizeInput same size", got, want, 3 * sh * sw, 0);
+     sdt_free(packed);
+     sdt_free(got);
+     sdt_free(want);
+     sdt_free(src);
+     return ret;
+}
+
+static void writeFile(const char *path, const char *text)
+{
+     FILE *fp = fopen(path, "w");
+     fputs(text, fp);
+     fclose(fp);
+}
+
+/* an input cached by one run is found by the next, until its image changes or the
+   input size differs */
+int testInputCacheHost()
+{
+     int ret = 0, hits, added;
+     char dir[] = "/tmp/sqdtrt-test-XXXXXX", pack[64], img0[64], img1[64];
+     unsigned char pixels0[2 * 3 * 3], pixels1[2 * 3 * 3];
+     const unsigned char *got;
+     float w, h;
+
+     if (!mkdtemp(dir)) {
+          printf("inputCache: FAIL, no temporary directory\n");
+          return 1;
+     }
+     sprintf(pack, "%s/inputs.pack", dir);
+     sprintf(img0, "%s/0.png", dir);
+     sprintf(img1, "%s/1.png", dir);
+     writeFile(img0, "image 0");
+     writeFile(img1, "image 1");
+     for (int i = 0; i < 18; i++) {
+          pixels0[i] = i;
+          pixels1[i] = 100 + i;
+     }
+
+     InputCache *cache = openInputCache(pack, 2, 3);
+     if (inputCacheLookup(cache, img0, &w, &h))
+          ret++;
+     inputCacheInsert(cache, img0, pixels0, 1242, 375);
+     closeInputCache(cache, &hits, &added);
+     if (hits != 0 || added != 1)
+          ret++;
+
+     cache = openInputCache(pack, 2, 3);
+     got = inputCacheLookup(cache, img0, &w, &h);
+     if (!got || memcmp(got, pixels0, sizeof(pixels0)) || w != 1242 || h != 375)
+          ret++;
+     if (inputCacheLookup(cache, img1, &w, &h))
+          ret++;
+     inputCacheInsert(cache, img1, pixels1, 1224, 370);
+     closeInputCache(cache, &hits, &added);
+     if (hits != 1 || added != 1)
+          ret++;
+
+     // both kept, the changed image no longer found, nor those of another size
+     writeFile(img0, "image 0 changed");
+     cache = openInputCache(pack, 2, 3);
+     got = inputCacheLookup(cache, img1, &w, &h);
+     if (!got || memcmp(got, pixels1, sizeof(pixels1)) || w != 1224 || h != 370)
+          ret++;
+     if (inputCacheLookup(cache, img0, &w, &h))
+          ret++;
+     closeInputCache(cache, NULL, NULL);
+     cache = openInputCache(pack, 3, 2);
+     if (inputCacheLookup(cache, img1, &w, &h))
+          ret++;
+     closeInputCache(cache, NULL, NULL);
+
+     // a corrupted pack is ignored
+     writeFile(pack, "SQDI not a pack");
+     cache = openInputCache(pack, 2, 3);
+     if (inputCacheLookup(cache, img1, &w, &h))
+          ret++;
+     closeInputCache(cache, NULL, NULL);
+
+     unlink(pack);
+     unlink(img0);
+     unlink(img1);
+     rmdir(dir);
+     printf("inputCache: %s\n", ret ? "FAIL" : "ok");
+     return ret ? 1 : 0;
+}
+
+static char *readFile(const char *path, char *buf, size_t size)
+{
+     FILE *fp = fopen(path, "r");
+     size_t n = fp ? fread(buf, 1, size - 1, fp) : 0;
+     buf[n] = '\0';
+     if (fp)
+          fclose(fp);
+     return buf;
+}
+
+/* formatFixed() against printf, ties included, and both kinds of result writer against
+   fprintResult() */
+int testResultWriterHost()
+{
+     int ret = 0, bad = 0;
+     char got[64], want[64];
+     float ties[] = {0.125f, 0.375f, 2.5f, -0.005f, -0.0f, 1e-7f, -1e-7f, 1242.005f, 999.995f, 1e14f, 1e20f,
+                     -3e38f, INFINITY, -INFINITY, NAN};
+
+     for (int i = 0; i < 200000 + (int)(sizeof(ties) / sizeof(ties[0])); i++) {
+          float v = i < 200000 ? (rand() - RAND_MAX / 2) / (float)RAND_MAX * (i % 2 ? 3000 : 2) :
+               ties[i - 200000];
+          for (int d = 0; d <= 3; d++) {
+               *formatFixed(got, v, d) = '\0';
+               snprintf(want, sizeof(want), "%.*f", d, v);
+               if (strcmp(got, want) && bad++ < 5)
+                    printf("formatFixed: %s, want %s\n", got, want);
+          }
+     }
+     printf("formatFixed: %s\n", bad ? "FAIL" : "ok");
+     ret += bad != 0;
+
+     const char *names[] = {"car", "pedestrian", "cyclist"};
+     float klass[] = {0, 2, 1}, prob[] = {0.8765f, 0.3f, 0.4445f};
+     float bbox[] = {-1.005f, 2.5f, 1241.994f, 374.125f, 10, 20, 30, 40, 0.125f, 0.375f, 100.5f, 200.25f};
+     int keep[] = {1, 0, 1}, none[] = {0, 0, 0};
+     struct predictions preds = {klass, prob, bbox, keep, 3}, empty = {klass, prob, bbox, none, 3};
+     char dir[] = "/tmp/sqdtrt-test-XXXXXX", path[96], expect[1024], buf[4096];
+     if (!mkdtemp(dir)) {
+          printf("resultWriter: FAIL, no temporary directory\n");
+          return ret + 1;
+     }
+     FILE *fp = fmemopen(expect, sizeof(expect), "w");
+     fprintResult(fp, &preds, names);
+     fclose(fp);
+
+     ResultWriterStats stats;
+     ResultWriter *w = createResultWriter(dir, NULL, names);
+     resultWriterSubmit(w, "images/000001.png", &preds);
+     resultWriterSubmit(w, "images/000002.png", &empty);
+     closeResultWriter(w, &stats);
+     sprintf(path, "%s/000001.txt", dir);
+     int files_ok = !strcmp(readFile(path, buf, sizeof(buf)), expect);
+     unlink(path);
+     sprintf(path, "%s/000002.txt", dir);
+     files_ok = files_ok && access(path, F_OK) == 0 && !strcmp(readFile(path, buf, sizeof(buf)), "");
+     unlink(path);
+     files_ok = files_ok && stats.images == 2 && stats.files == 2 && stats.bytes == (long long)strlen(expect);
+     printf("resultWriter files: %s\n", files_ok ? "ok" : "FAIL");
+     ret += !files_ok;
+
+     sprintf(path, "%s/results.txt", dir);
+     w = createResultWriter(NULL, path, names);
+     for (int i = 0; i < 1000; i++)
+          resultWriterSubmit(w, i % 2 ? "000002.png" : "a/000001.png", i % 2 ? &empty : &preds);
+     closeResultWriter(w, &stats);
+     readFile(path, buf, sizeof(buf));
+     // the lines of both images, one after another
+     int stream_ok = stats.images == 1000 && stats.writes == 1 && !strncmp(buf, "000001\n", 7);
+     for (char *line = expect, *next; stream_ok && *line; line = next + 1) {
+          next = strchr(line, '\n');
+          char prefixed[256];
+          snprintf(prefixed, sizeof(prefixed), "000001 %.*s", (int)(next - line + 1), line);
+          stream_ok = strstr(buf, prefixed) != NULL;
+     }
+     stream_ok = stream_ok && strstr(buf, "\n000002\n000001\n") != NULL;
+     unlink(path);
+     rmdir(dir);
+     printf("resultWriter stream: %s\n", stream_ok ? "ok" : "FAIL");
+     ret += !stream_ok;
+     return ret;
+}
+
+/* buffers live at the same time must not share memory */
+static int checkArena(const char *name, const TensorArena *arena)
+{
+     for (int i = 0; i < arena->num; i++) {
+          const ArenaBuffer *a = &arena->buffers[i];
+          if (a->first < 0)
+               continue;
+          if (a->offset % ARENA_ALIGN || a->offset + a->size > arena->size) {
+               printf("%s: FAIL, %s at %zu is out of the arena\n", name, a->name, a->offset);
+               return 1;
+          }
+          for (int j = i + 1; j < arena->num; j++) {
+               const ArenaBuffer *b = &arena->buffers[j];
+               if (b->first < 0 || a->last < b->first || b->last < a->first)
+                    continue;
+               if (a->offset < b->offset + b->size && b->offset < a->offset + a->size) {
+                    printf("%s: FAIL, %s and %s overlap\n", name, a->name, b->name);
+                    return 1;
+               }
+          }
+     }
+     return 0;
+}
+
+int testArenaHost()
+{
+     int ret = 0;
+
+     for (int c = 0; c < 50; c++) {
+          for (int reuse = 0; reuse < 2; reuse++) {
+               TensorArena *arena = createArena(HOST, 20);
+               float *ptrs[20];
+               int dims[] = {1, 0};
+               srand(c);
+               arena->reuse = reuse;
+               for (int i = 0; i < 20; i++) {
+                    int first = rand() % 12 - 1, last = first + rand() % 4;
+                    if (i % 2) {
+                         arenaAdd(arena, "buffer", (void **)&ptrs[i], 1 + rand() % 5000, first, last);
+                    } else {
+                         dims[1] = 1 + rand() % 2000;
+                         arenaTensor(arena, "tensor", 2, dims, first, last);
+                    }
+               }
+               planArena(arena);
+               int bad = checkArena("planArena", arena);
+               if (!bad && (arena->size > arena->total || (!reuse && arena->size != arena->total))) {
+                    printf("planArena: FAIL, %zu bytes for %zu of buffers\n", arena->size, arena->total);
+                    bad = 1;
+               }
+               ret += bad;
+               destroyArena(arena);
+          }
+     }
+     printf("planArena: %s\n", ret ? "FAIL" : "ok");
+     return ret != 0;
+}
+
+/* the stages of sqdtrt's --pipeline on numbered items, with one slow to preprocess */
+struct PipelineTest {
+     pthread_mutex_t mutex;
+     long next_seq, nitems, slow, written, bad;
+     int batch, done;
+};
+
+static long itemSeq(const void *item)
+{
+     return *(const long *)item;
+}
+
+static int pipelineDecode(void *ctx, void **items, int n)
+{
+     PipelineTest *pt = (PipelineTest *)ctx;
+     int ret = 0;
+
+     pthread_mutex_lock(&pt->mutex);
+     if (pt->next_seq < pt->nitems)
+          *(long *)items[0] = pt->next_seq++;
+     else
+          ret = STAGE_END;
+     pthread_mutex_unlock(&pt->mutex);
+     return ret;
+}
+
+static int pipelinePreprocess(void *ctx, void **items, int n)
+{
+     if (*(long *)items[0] == ((PipelineTest *)ctx)->slow)
+          usleep(200000);
+     return 0;
+}
+
+static int pipelineInfer(void *ctx, void **items, int n)
+{
+     PipelineTest *pt = (PipelineTest *)ctx;
+     for (int i = 1; i < n; i++)
+          if (*(long *)items[i] != *(long *)items[0] + i)
+               pt->bad++;
+     return 0;
+}
+
+static int pipelinePass(void *ctx, void **items, int n)
+{
+     return 0;
+}
+
+static int pipelineWrite(void *ctx, void **items, int n)
+{
+     PipelineTest *pt = (PipelineTest *)ctx;
+     if (*(long *)items[0] != pt->written++)
+          pt->bad++;
+     return 0;
+}
+
+static void *pipelineRunner(void *arg)
+{
+     PipelineTest *pt = (PipelineTest *)arg;
+     int queue_size = 2 * pt->batch, nitems = 4 * queue_size + pt->batch;
+     long *items = (long *)sdt_alloc(sizeof(long) * nitems);
+     BoundedQueue *free_items = createQueue(nitems, NULL);
+     BoundedQueue *decoded = createQueue(queue_size, NULL);
+     BoundedQueue *prepared = createQueue(nitems, itemSeq);
+     BoundedQueue *inferred = createQueue(queue_size, NULL);
+     BoundedQueue *filtered = createQueue(nitems, itemSeq);
+     PipelineStage stages[] = {
+          {"decode", 2, 1, pipelineDecode, pt, free_items, decoded},
+          {"preprocess", 2, 1, pipelinePreprocess, pt, decoded, prepared},
+          {"infer", 1, pt->batch, pipelineInfer, pt, prepared, inferred},
+          {"postprocess", 2, 1, pipelinePass, pt, inferred, filtered},
+          {"write", 1, 1, pipelineWrite, pt, filtered, free_items},
+     };
+
+     for (int i = 0; i < nitems; i++)
+          queuePush(free_items, &items[i]);
+     runPipeline(stages, sizeof(stages) / sizeof(stages[0]));
+     destroyQueue(free_items);
+     destroyQueue(decoded);
+     destroyQueue(prepared);
+     destroyQueue(inferred);
+     destroyQueue(filtered);
+     sdt_free(items);
+     pthread_mutex_lock(&pt->mutex);
+     pt->done = 1;
+     pthread_mutex_unlock(&pt->mutex);
+     return NULL;
+}
+
+/* every item written in order, and no hang when one finishes long after the ones behind it */
+int testPipelineHost()
+{
+     int ret = 0;
+
+     for (int batch = 1; batch <= 4; batch++) {
+          PipelineTest pt;
+          pthread_t thread;
+          int done = 0;
+          memset(&pt, 0, sizeof(pt));
+          pthread_mutex_init(&pt.mutex, NULL);
+          pt.nitems = 41;
+          pt.slow = 1;
+          pt.batch = batch;
+          pthread_create(&thread, NULL, pipelineRunner, &pt);
+          for (int ms = 0; ms < 10000 && !done; ms += 10) {
+               usleep(10000);
+               pthread_mutex_lock(&pt.mutex);
+               done = pt.done;
+               pthread_mutex_unlock(&pt.mutex);
+          }
+          if (!done) {
+               // the workers can't be stopped, leave them to the exit
+               printf("pipeline: FAIL, batch %d hung after %ld of %ld items\n", batch, pt.written, pt.nitems);
+               return 1;
+          }
+          pthread_join(thread, NULL);
+          pthread_mutex_destroy(&pt.mutex);
+          if (pt.written != pt.nitems || pt.bad) {
+               printf("pipeline: FAIL, batch %d wrote %ld of %ld items, %ld out of order\n", batch, pt.written,
+                      pt.nitems, pt.bad);
+               ret = 1;
+          }
+     }
+     printf("pipeline: %s\n", ret ? "FAIL" : "ok");
+     return ret;
+}
+
+static void *traceWorker(void *arg)
+{
+     int stage = *(int *)arg;
+     for (int i = 1; i <= 1000; i++)
+          traceRecord(stage, 0, i * 1000LL);
+     return NULL;
+}
+
+/* percentiles of known spans from several threads, and a trace file of nested ones */
+int testTraceHost()
+{
+     int stage = traceStage("test"), ret = 0, i;
+     pthread_t threads[4];
+     TraceStats st;
+
+     for (i = 0; i < 4; i++)
+          pthread_create(&threads[i], NULL, traceWorker, &stage);
+     for (i = 0; i < 4; i++)
+          pthread_join(threads[i], NULL);
+     traceStats(stage, &st);
+     /* 1 to 1000 us, 4 times, within the 3% of a histogram bin */
+     if (st.count != 4000 || fabs(st.mean - 0.5005) > 1e-9 || fabs(st.max - 1) > 1e-9 ||
+         fabs(st.p50 - 0.5) > 0.015 || fabs(st.p90 - 0.9) > 0.027 || fabs(st.p99 - 0.99) > 0.03) {
+          printf("traceStats: FAIL, count %lld mean %f p50 %f p90 %f p99 %f max %f\n", st.count, st.mean,
+                 st.p50, st.p90, st.p99, st.max);
+          ret++;
+     } else {
+          printf("traceStats: ok\n");
+     }
+
+     char path[] = "/tmp/testtraceXXXXXX";
+     int fd = mkstemp(path);
+     close(fd);
+     traceOpen(path);
+     {
+          TRACE_SCOPE("outer");
+          TRACE_SCOPE("inner");
+     }
+     traceClose();
+     char buf[4096];
+     FILE *fp = fopen(path, "r");
+     size_t len = fread(buf, 1, sizeof(buf) - 1, fp);
+     buf[len] = '\0';
+     fclose(fp);
+     unlink(path);
+     if (!strstr(buf, "\"name\": \"outer\", \"ph\": \"X\"") || !strstr(buf, "\"depth\": 1}") ||
+         !strstr(buf, "\"name\": \"inner\", \"ph\": \"X\"") || strstr(buf, "\"name\": \"test\"") ||
+         strcmp(buf + len - 4, "\n]}\n")) {
+          printf("traceClose: FAIL\n%s", buf);
+          ret++;
+     } else {
+          printf("traceClose: ok\n");
+     }
+     return ret;
+}
+
+static void randomFloats(float *dst, long n, float lo, float hi)
+{
+     for (long i = 0; i < n; i++)
+          dst[i] = lo + (float)rand() / RAND_MAX * (hi - lo);
+}
+
+static float maxAbs(const float *a, long n)
+{
+     float m = 0;
+     for (long i = 0; i < n; i++)
+          m = fabsf(a[i]) > m ? fabsf(a[i]) : m;
+     return m;
+}
+
+/* like check(), with a tolerance relative to each wanted value */
+static int checkRelative(const char *name, const float *got, const float *want, int n, float tolerance)
+{
+     for (int i = 0; i < n; i++) {
+          if (fabsf(got[i] - want[i]) > tolerance * fabsf(want[i])) {
+               printf("%s: FAIL at %d, got %f, want %f\n", name, i, got[i], want[i]);
+               return 1;
+          }
+     }
+     printf("%s: ok\n", name);
+     return 0;
+}
+
+int testConv2dDirectHost()
+{
+     /* 1x3x3 input, two 3x3 kernels, stride 1, pad 1 */
+     float src[] = {1, 2, 3,
+                    4, 5, 6,
+                    7, 8, 9};
+     float kernel[] = {0, 0, 0, 0, 1, 0, 0, 0, 0, /* identity */
+                       1, 1, 1, 1, 1, 1, 1, 1, 1}; /* box sum */
+     float bias[] = {0, -20};
+     float dst[18];
+     /* [[1 2 3] [4 5 6] [7 8 9]] and relu([[12 21 16] [27 45 33] [24 39 28]] - 20) */
+     float want[] = {1, 2, 3, 4, 5, 6, 7, 8, 9,
+                     0, 1, 0, 7, 25, 13, 4, 19, 8};
+
+     conv2dDirect(src, dst, kernel, bias, 1, 3, 3, 2, 3, 1, 1, 1);
+     return check("conv2dDirect", dst, want, 18, 0);
+}
+
+/* 8 -> 16 channels of 11x13, neither side a multiple of the 4x4 output tile */
+int testConv2dWinogradHost()
+{
+     int c = 8, h = 11, w = 13, oc = 16, ret;
+     float *src = (float *)sdt_alloc(sizeof(float) * c * h * w);
+     float *kernel = (float *)sdt_alloc(sizeof(float) * oc * c * 9);
+     float *bias = (float *)sdt_alloc(sizeof(float) * oc);
+     float *ref = (float *)sdt_alloc(sizeof(float) * oc * h * w);
+     float *dst = (float *)sdt_alloc(sizeof(float) * oc * h * w);
+
+     randomFloats(src, c * h * w, -0.5, 0.5);
+     randomFloats(kernel, oc * c * 9, -0.5, 0.5);
+     randomFloats(bias, oc, -0.5, 0.5);
+     conv2dDirect(src, ref, kernel, bias, c, h, w, oc, 3, 1, 1, 0);
+     WinogradKernel *wk = createWinogradKernel(kernel, bias, c, oc);
+     conv2dWinograd(wk, src, dst, h, w, 0);
+     ret = check("conv2dWinograd", dst, ref, oc * h * w, 1e-4 * maxAbs(ref, oc * h * w));
+     destroyWinogradKernel(wk);
+     sdt_free(src);
+     sdt_free(kernel);
+     sdt_free(bias);
+     sdt_free(ref);
+     sdt_free(dst);
+     return ret;
+}
+
+/* 8 -> 10 channels of 11x13, a partial panel, partial tiles and a k of 72 = 18 groups */
+int testConv2dInt8Host()
+{
+     int c = 8, h = 11, w = 13, oc = 10, ret;
+     float *src = (float *)sdt_alloc(sizeof(float) * c * h * w);
+     float *kernel = (float *)sdt_alloc(sizeof(float) * oc * c * 9);
+     float *bias = (float *)sdt_alloc(sizeof(float) * oc);
+     float *ref = (float *)sdt_alloc(sizeof(float) * oc * h * w);
+     float *dst = (float *)sdt_alloc(sizeof(float) * oc * h * w);
+     char name[64];
+
+     /* the input of a quantized convolution comes out of a ReLU */
+     randomFloats(src, c * h * w, 0, 1);
+     randomFloats(kernel, oc * c * 9, -0.5, 0.5);
+     randomFloats(bias, oc, -0.5, 0.5);
+     conv2dDirect(src, ref, kernel, bias, c, h, w, oc, 3, 1, 1, 0);
+     Int8Matrix *q = quantizeMatrix(kernel, oc, c * 9, bias);
+     conv2dInt8(q, 1.0f / INT8_ACT_MAX, src, dst, c, h, w, 3, 1, 1, 0);
+     /* 8 bit activations and kernels, about 1e-2 of the largest output */
+     snprintf(name, sizeof(name), "conv2dInt8 (%s)", int8KernelName(int8Kernel()));
+     ret = check(name, dst, ref, oc * h * w, 2e-2 * maxAbs(ref, oc * h * w));
+     freeInt8Matrix(q);
+     sdt_free(src);
+     sdt_free(kernel);
+     sdt_free(bias);
+     sdt_free(ref);
+     sdt_free(dst);
+     return ret;
+}
+
+/* 1000 values, an F16C body and a scalar tail, within half an ulp of either format */
+int testStorageRoundTripHost()
+{
+     int n = 1000, ret = 0;
+     StorageType types[] = {STORAGE_FP16, STORAGE_BF16};
+     float tolerances[] = {1.0f / 2048, 1.0f / 256};
+     float *src = (float *)sdt_alloc(sizeof(float) * n);
+     float *dst = (float *)sdt_alloc(sizeof(float) * n);
+     uint16_t *half = (uint16_t *)sdt_alloc(sizeof(uint16_t) * n);
+     char name[64];
+
+     randomFloats(src, n, -500, 500);
+     for (int i = 0; i < 2; i++) {
+          storeFloats(src, half, types[i], n);
+          loadFloats(half, types[i], dst, n);
+          snprintf(name, sizeof(name), "storage %s", storageName(types[i]));
+          ret += checkRelative(name, dst, src, n, tolerances[i]);
+     }
+     sdt_free(src);
+     sdt_free(dst);
+     sdt_free(half);
+     return ret;
+}
+
+/* squeeze and expand widths of the fire modules of createCpuEngine() */
+static const struct {
+     const char *name;
+     int s1x1, e1x1, e3x3;
+} CPU_FIRES[] = {
+     {"fire2", 16, 64, 64}, {"fire3", 16, 64, 64}, {"fire4", 32, 128, 128}, {"fire5", 32, 128, 128},
+     {"fire6", 48, 192, 192}, {"fire7", 48, 192, 192}, {"fire8", 64, 256, 256}, {"fire9", 64, 256, 256},
+     {"fire10", 96, 384, 384}, {"fire11", 96, 384, 384}
+};
+
+/* kernels uniform within the He range of their fan in, so activations keep their scale */
+static void addRandomConv(WeightMap &weightMap, const std::string &prefix, const char *bias_suffix,
+                          int ic, int oc, int k)
+{
+     long count = (long)oc * ic * k * k;
+     float scale = sqrtf(6.0f / (ic * k * k));
+     float *kernel = (float *)sdt_alloc(sizeof(float) * count);
+     float *bias = (float *)sdt_alloc(sizeof(float) * oc);
+
+     randomFloats(kernel, count, -scale, scale);
+     randomFloats(bias, oc, -0.1, 0.1);
+     weightMap[prefix + "_kernels"] = HostWeights{WEIGHTS_FLOAT, kernel, count};
+     weightMap[prefix + bias_suffix] = HostWeights{WEIGHTS_FLOAT, bias, oc};
+}
+
+/* random weights of every convolution of createCpuEngine() for an input of c channels */
+static void randomCpuWeights(WeightMap &weightMap, int c)
+{
+     addRandomConv(weightMap, "conv1", "_bias", c, 64, 3);
+     c = 64;
+     for (size_t i = 0; i < sizeof(CPU_FIRES) / sizeof(CPU_FIRES[0]); i++) {
+          std::string prefix(CPU_FIRES[i].name);
+          addRandomConv(weightMap, prefix + "_squeeze1x1", "_biases", c, CPU_FIRES[i].s1x1, 1);
+          addRandomConv(weightMap, prefix + "_expand1x1", "_biases", CPU_FIRES[i].s1x1, CPU_FIRES[i].e1x1, 1);
+          addRandomConv(weightMap, prefix + "_expand3x3", "_biases", CPU_FIRES[i].s1x1, CPU_FIRES[i].e3x3, 3);
+          c = CPU_FIRES[i].e1x1 + CPU_FIRES[i].e3x3;
+     }
+     addRandomConv(weightMap, "conv12", "_biases", c, 72, 3);
+}
+
+static void referenceConv(const CpuConv *conv, const float *src, float *dst, int h, int w)
+{
+     conv2dDirect(src, dst, conv->kernel, conv->bias, conv->ic, h, w, conv->oc,
+                  conv->k, conv->stride, conv->pad, conv->relu);
+}
+
+/* output of layers[0, n) of an engine one after another, with the reference operators
+   whatever algorithms the engine picked, in a new buffer */
+static float *referenceLayers(const CpuLayer *layers, int n, const float *input)
+{
+     float *src = (float *)sdt_alloc(sizeof(float) * layers[0].c * layers[0].h * layers[0].w);
+     memcpy(src, input, sizeof(float) * layers[0].c * layers[0].h * layers[0].w);
+     for (int i = 0; i < n; i++) {
+          const CpuLayer *l = &layers[i];
+          long vol = (long)l->h * l->w;
+          float *dst = (float *)sdt_alloc(sizeof(float) * l->oc * l->oh * l->ow);
+          if (l->kind == CPU_LAYER_CONV) {
+               referenceConv(&l->conv, src, dst, l->h, l->w);
+          } else if (l->kind == CPU_LAYER_POOL) {
+               maxPool2d(src, dst, l->c, l->h, l->w, l->pool_k, l->pool_stride, l->pool_pad);
+          } else {
+               float *squeeze = (float *)sdt_alloc(sizeof(float) * l->squeeze.oc * vol);
+               referenceConv(&l->squeeze, src, squeeze, l->h, l->w);
+               referenceConv(&l->expand1x1, squeeze, dst, l->h, l->w);
+               referenceConv(&l->expand3x3, squeeze, dst + l->expand1x1.oc * vol, l->h, l->w);
+               sdt_free(squeeze);
+          }
+          sdt_free(src);
+          src = dst;
+     }
+     return src;
+}
+
+/* the whole cpu backend on random weights and a batch of 2 odd sized images, against
+   the reference operators layer by layer */
+int testCpuEngineHost()
+{
+     int c = 3, h = 37, w = 53, batch = 2, ret = 0;
+     WeightMap weightMap;
+
+     randomCpuWeights(weightMap, c);
+     CpuEngine *engine = createCpuEngine(weightMap, c, h, w);
+     freeWeights(weightMap);
+     long in_vol = (long)c * h * w, out_vol = (long)engine->oc * engine->oh * engine->ow;
+     float *input = (float *)sdt_alloc(sizeof(float) * in_vol * batch);
+     float *output = (float *)sdt_alloc(sizeof(float) * out_vol * batch);
+     float *want = (float *)sdt_alloc(sizeof(float) * out_vol * batch);
+
+     if (engine->oc != 72 || engine->oh != 3 || engine->ow != 4) {
+          printf("cpuEngine: FAIL, conv_out is %dx%dx%d, want 72x3x4\n", engine->oc, engine->oh, engine->ow);
+          ret++;
+     }
+     randomFloats(input, in_vol * batch, -1, 1);
+     for (int n = 0; n < batch; n++) {
+          float *ref = referenceLayers(engine->layers, engine->nlayers, input + n * in_vol);
+          memcpy(want + n * out_vol, ref, sizeof(float) * out_vol);
+          sdt_free(ref);
+     }
+     cpuEngineInfer(engine, input, output, batch);
+     ret += check("cpuEngine", output, want, out_vol * batch, 1e-3 * maxAbs(want, out_vol * batch));
+     destroyCpuEngine(engine);
+     sdt_free(input);
+     sdt_free(output);
+     sdt_free(want);
+     return ret;
+}
+
+/* the three fusions of the cpu backend give the same conv_out, on one thread and on
+   several, for an odd input size whose stripes don't divide the rows */
+int testCpuFusionHost()
+{
+     int c = 3, h = 75, w = 93, ret = 0;
+     int threads[] = {1, 4}, max_threads = omp_get_max_threads();
+     CpuFusion fusions[] = {CPU_FUSION_NONE, CPU_FUSION_FIRE, CPU_FUSION_GROUP};
+     const char *names[] = {"none", "fire", "group"};
+     WeightMap weightMap;
+     char name[64];
+
+     randomCpuWeights(weightMap, c);
+     CpuEngine *engine = createCpuEngine(weightMap, c, h, w);
+     freeWeights(weightMap);
+     long in_vol = (long)c * h * w, out_vol = (long)engine->oc * engine->oh * engine->ow;
+     float *input = (float *)sdt_alloc(sizeof(float) * in_vol);
+     float *want = (float *)sdt_alloc(sizeof(float) * out_vol);
+     float *output = (float *)sdt_alloc(sizeof(float) * out_vol);
+
+     randomFloats(input, in_vol, -1, 1);
+     engine->fusion = CPU_FUSION_NONE;
+     omp_set_num_threads(1);
+     cpuEngineInfer(engine, input, want, 1);
+     for (int t = 0; t < 2; t++) {
+          omp_set_num_threads(threads[t]);
+          for (int f = 0; f < 3; f++) {
+               engine->fusion = fusions[f];
+               cpuEngineInfer(engine, input, output, 1);
+               snprintf(name, sizeof(name), "cpuEngine fusion %s, %d thread%s", names[f], threads[t],
+                        threads[t] > 1 ? "s" : "");
+               ret += check(name, output, want, out_vol, 1e-4 * maxAbs(want, out_vol));
+          }
+     }
+     omp_set_num_threads(max_threads);
+     destroyCpuEngine(engine);
+     sdt_free(input);
+     sdt_free(want);
+     sdt_free(output);
+     return ret;
+}
+
+/* fireGroupFused() of 2 to 4 fire modules, with and without the max pooling after them,
+   against the modules layer by layer, on 61 rows that no stripe height divides */
+int testFireGroupHost()
+{
+     int c = 256, h = 61, w = 19, ret = 0, max_threads = omp_get_max_threads();
+     WeightMap weightMap;
+     char name[64];
+
+     randomCpuWeights(weightMap, 3);
+     CpuEngine *engine = createCpuFireEngine(weightMap, "fire6", "fire9", c, h, w);
+     freeWeights(weightMap);
+     float *input = (float *)sdt_alloc(sizeof(float) * c * h * w);
+     float *output = (float *)sdt_alloc(sizeof(float) * engine->oc * h * w);
+
+     randomFloats(input, (long)c * h * w, 0, 1);
+     omp_set_num_threads(4);
+     for (int n = 2; n <= 4; n++) {
+          const CpuLayer *last = &engine->layers[n - 1];
+          float *want = referenceLayers(engine->layers, n, input);
+          long vol = (long)last->oc * h * w;
+
+          snprintf(name, sizeof(name), "fireGroupFused %d", n);
+          fireGroupFused(engine->layers, n, NULL, input, STORAGE_FP32, output, STORAGE_FP32);
+          ret += check(name, output, want, vol, 1e-4 * maxAbs(want, vol));
+
+          CpuLayer pool;
+          memset(&pool, 0, sizeof(pool));
+          pool.kind = CPU_LAYER_POOL;
+          pool.c = pool.oc = last->oc;
+          pool.h = h;
+          pool.w = w;
+          pool.pool_k = 3;
+          pool.pool_stride = 2;
+          pool.pool_pad = 1;
+          pool.oh = convOutSize(h, 3, 2, 1);
+          pool.ow = convOutSize(w, 3, 2, 1);
+          long pool_vol = (long)pool.oc * pool.oh * pool.ow;
+          float *pooled = (float *)sdt_alloc(sizeof(float) * pool_vol);
+          maxPool2d(want, pooled, pool.c, h, w, 3, 2, 1);
+          snprintf(name, sizeof(name), "fireGroupFused %d pooled", n);
+          fireGroupFused(engine->layers, n, &pool, input, STORAGE_FP32, output, STORAGE_FP32);
+          ret += check(name, output, pooled, pool_vol, 1e-4 * maxAbs(pooled, pool_vol));
+          sdt_free(pooled);
+          sdt_free(want);
+     }
+     omp_set_num_threads(max_threads);
+     destroyCpuEngine(engine);
+     sdt_free(input);
+     sdt_free(output);
+     return ret;
+}
+
+/* storeFloats() to fp16, with F16C over blocks of 8, gives the same bits as floatToHalf():
+   every tie between two halves, subnormals, overflows, infinities and NaNs, and a sweep of
+   all floats. loadFloats() from fp16 gives the same bits as halfToFloat() for every half. */
+int testHalfConversionHost()
+{
+     int ret = 0;
+     long n = 0, i;
+     float *src = (float *)sdt_alloc(sizeof(float) * (1 << 18));
+     uint16_t *half = (uint16_t *)sdt_alloc(sizeof(uint16_t) * (1 << 18));
+     uint32_t x;
+
+     if (!__builtin_cpu_supports("avx") || !__builtin_cpu_supports("f16c")) {
+          printf("floatToHalf: skipped, no F16C\n");
+          sdt_free(src);
+          sdt_free(half);
+          return 0;
+     }
+     for (x = 0; x < 0x7c00; x++) {
+          /* half x and the float halfway to the next one, of both signs */
+          float a = halfToFloat(x), b = halfToFloat(x + 1);
+          src[n++] = a;
+          src[n++] = -(a + (b - a) / 2);
+     }
+     for (x = 0; x < 0x10000; x++) {
+          uint32_t bits = x << 16 | (x & 0x1fff);   /* every sign and exponent, and mantissas */
+          memcpy(&src[n++], &bits, sizeof(float));
+     }
+     src[n++] = 65519.99f;
+     src[n++] = 65520;
+     src[n++] = -1e-8f;
+     n -= n % 8;
+     storeFloats(src, half, STORAGE_FP16, n);
+     for (i = 0; i < n; i++) {
+          if (half[i] != floatToHalf(src[i])) {
+               memcpy(&x, &src[i], sizeof(x));
+               printf("floatToHalf: FAIL at 0x%08x, F16C 0x%04x, floatToHalf 0x%04x\n", x, half[i],
+                      floatToHalf(src[i]));
+               ret++;
+               break;
+          }
+     }
+     if (i == n)
+          printf("floatToHalf: ok\n");
+
+     for (x = 0; x < 0x10000; x++)
+          half[x] = x;
+     loadFloats(half, STORAGE_FP16, src, 0x10000);
+     for (x = 0; x < 0x10000; x++) {
+          float f = halfToFloat(x);
+          if (memcmp(&f, &src[x], sizeof(f))) {
+               printf("halfToFloat: FAIL at 0x%04x, got %g, F16C %g\n", x, f, src[x]);
+               ret++;
+               break;
+          }
+     }
+     if (x == 0x10000)
+          printf("halfToFloat: ok\n");
+     sdt_free(src);
+     sdt_free(half);
+     return ret;
+}
+
+/* activations stored in fp16 and bf16 between the steps, fused and unfused, against fp32 */
+int testCpuStorageHost()
+{
+     int c = 3, h = 75, w = 93, ret = 0;
+     StorageType types[] = {STORAGE_FP16, STORAGE_BF16};
+     float tolerances[] = {4e-3, 3e-2};  /* of the largest output, after 15 roundings */
+     CpuFusion fusions[] = {CPU_FUSION_NONE, CPU_FUSION_FIRE, CPU_FUSION_GROUP};
+     const char *names[] = {"none", "fire", "group"};
+     WeightMap weightMap;
+     char name[64];
+
+     randomCpuWeights(weightMap, c);
+     CpuEngine *engine = createCpuEngine(weightMap, c, h, w);
+     freeWeights(weightMap);
+     long in_vol = (long)c * h * w, out_vol = (long)engine->oc * engine->oh * engine->ow;
+     float *input = (float *)sdt_alloc(sizeof(float) * in_vol);
+     float *want = (float *)sdt_alloc(sizeof(float) * out_vol);
+     float *output = (float *)sdt_alloc(sizeof(float) * out_vol);
+
+     randomFloats(input, in_vol, -1, 1);
+     cpuEngineInfer(engine, input, want, 1);
+     for (int t = 0; t < 2; t++) {
+          setCpuStorage(engine, types[t]);
+          for (int f = 0; f < 3; f++) {
+               engine->fusion = fusions[f];
+               cpuEngineInfer(engine, input, output, 1);
+               snprintf(name, sizeof(name), "cpuEngine %s storage, fusion %s", storageName(types[t]), names[f]);
+               ret += check(name, output, want, out_vol, tolerances[t] * maxAbs(want, out_vol));
+          }
+     }
+     destroyCpuEngine(engine);
+     sdt_free(input);
+     sdt_free(want);
+     sdt_free(output);
+     return ret;
+}
+
+/* The text weights of wtsgen.pl -t 1 are loaded as WEIGHTS_HALF with the bits of floatToHalf(),
+   and a cpu engine of them computes the same as one of their float values. Runs the script
+   from test/, like make check. */
+int testHalfWeightsHost()
+{
+     const char *script = "../scripts/wtsgen.pl";
+     const char *suffixes[] = {"_squeeze1x1_kernels", "_squeeze1x1_biases", "_expand1x1_kernels",
+                               "_expand1x1_biases", "_expand3x3_kernels", "_expand3x3_biases"};
+     int c = 64, h = 13, w = 17, ret = 0;
+     char dir[] = "/tmp/testwtsXXXXXX";
+     std::string cmd;
+     WeightMap weightMap, rounded, loaded;
+
+     if (access(script, R_OK) || system("perl -e 1 2>/dev/null")) {
+          printf("wtsgen.pl half: skipped, no perl or %s\n", script);
+          return 0;
+     }
+     randomCpuWeights(weightMap, 3);
+     mkdtemp(dir);
+     cmd = std::string("perl ") + script + " -t 1 -o " + dir + "/fire2.wts";
+     for (int i = 0; i < 6; i++) {
+          std::string name = std::string("fire2") + suffixes[i];
+          std::string path = std::string(dir) + "/" + name + ":0";
+          const HostWeights &wt = weightMap[name];
+          const float *values = (const float *)wt.values;
+          float *r = (float *)sdt_alloc(sizeof(float) * wt.count);
+          FILE *fp = fopen(path.c_str(), "w");
+          for (long j = 0; j < wt.count; j++) {
+               fprintf(fp, "%.9g\n", values[j]);
+               r[j] = halfToFloat(floatToHalf(values[j]));
+          }
+          fclose(fp);
+          rounded[name] = HostWeights{WEIGHTS_FLOAT, r, wt.count};
+          cmd += " " + path;
+     }
+     cmd += " > /dev/null";
+     if (system(cmd.c_str())) {
+          printf("wtsgen.pl half: FAIL, %s\n", cmd.c_str());
+          freeWeights(weightMap);
+          freeWeights(rounded);
+          return 1;
+     }
+
+     loaded = loadWeights(std::string(dir) + "/fire2.wts");
+     for (auto &mem : rounded) {
+          auto it = loaded.find(mem.first);
+          const float *r = (const float *)mem.second.values;
+          long j = 0;
+          if (it != loaded.end() && it->second.type == WEIGHTS_HALF && it->second.count == mem.second.count)
+               for (const uint16_t *v = (const uint16_t *)it->second.values; j < mem.second.count; j++)
+                    if (v[j] != floatToHalf(r[j]))
+                         break;
+          if (j != mem.second.count) {
+               printf("wtsgen.pl half: FAIL, %s isn't the fp16 of its floats\n", mem.first.c_str());
+               ret++;
+          }
+     }
+     if (!ret)
+          printf("wtsgen.pl half: ok\n");
+
+     CpuEngine *half_engine = createCpuFireEngine(loaded, "fire2", "fire2", c, h, w);
+     CpuEngine *float_engine = createCpuFireEngine(rounded, "fire2", "fire2", c, h, w);
+     long out_vol = (long)float_engine->oc * h * w;
+     float *input = (float *)sdt_alloc(sizeof(float) * c * h * w);
+     float *output = (float *)sdt_alloc(sizeof(float) * out_vol);
+     float *want = (float *)sdt_alloc(sizeof(float) * out_vol);
+     randomFloats(input, (long)c * h * w, 0, 1);
+     cpuEngineInfer(half_engine, input, output, 1);
+     cpuEngineInfer(float_engine, input, want, 1);
+     ret += check("cpuEngine half weights", output, want, out_vol, 0);
+
+     for (int i = 0; i < 6; i++)
+          unlink((std::string(dir) + "/fire2" + suffixes[i] + ":0").c_str());
+     unlink((std::string(dir) + "/fire2.wts").c_str());
+     rmdir(dir);
+     destroyCpuEngine(half_engine);
+     destroyCpuEngine(float_engine);
+     freeWeights(weightMap);
+     freeWeights(rounded);
+     freeWeights(loaded);
+     sdt_free(input);
+     sdt_free(output);
+     sdt_free(want);
+     return ret;
+}
+
+int main(int argc, char *argv[])
+{
+     int failures = 0;
+
+     t = createTensor(data, ndim, dims);
+     failures += testSliceTensorHost();
+     failures += testReduceArgMaxHost();
+     failures += testMultiplyElementHost();
+     failures += testTransposeTensorHost();
+     failures += testTransposeTensorHostLarge();
+     failures += testTransposeTensorHostAll();
+     failures += testTransformBboxSQDHost();
+     failures += testInterpretConvoutHost();
+     failures += testViewsHost();
+     failures += testSortHost();
+     failures += testTopKHost();
+     failures += testPickElementsHost();
+     failures += testIouHost();
+     failures += testNmsHost();
+     failures += testDetectionHost();
+     failures += testResizeInputHost();
+     failures += testArenaHost();
+     failures += testInputCacheHost();
+     failures += testResultWriterHost();
+     failures += testPipelineHost();
+     failures += testTraceHost();
+     failures += testConv2dDirectHost();
+     failures += testConv2dWinogradHost();
+     failures += testConv2dInt8Host();
+     failures += testStorageRoundTripHost();
+     failures += testCpuEngineHost();
+     failures += testCpuFusionHost();
+     failures += testFireGroupHost();
+     failures += testHalfConversionHost();
+     failures += testCpuStorageHost();
+     failures += testHalfWeightsHost();
+     printf("%d failed\n", failures);
+     return failures;
+}
@@ -0,0 +1,309 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <time.h>
+#include <pthread.h>
+#include <err.h>
+#include "trace.h"
+#include "sdt_alloc.h"
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+/* Histogram bins of span durations in ns: one per ns under HIST_EXACT, then HIST_SUB
+   per power of 2, so a percentile is within 3% of the exact one. The last bin is
+   at about 78 hours. */
+#define HIST_EXACT 64
+#define HIST_EXACT_LOG 6
+#define HIST_SUB 32
+#define HIST_SUB_LOG 5
+#define HIST_OCTAVES 42
+#define HIST_BINS (HIST_EXACT + HIST_SUB * HIST_OCTAVES)
+
+typedef struct {
+     long long count, sum, max;
+     unsigned *bins;            /* [HIST_BINS], allocated by the first span */
+} StageHist;
+
+typedef struct {
+     int stage, depth;
+     long long begin, end;
+} TraceEvent;
+
+/* the spans of one thread, only it writes them */
+typedef struct TraceThread {
+     int tid;
+     char name[32];
+     int depth;                 /* of the spans open */
+     StageHist hist[TRACE_MAX_STAGES];
+     TraceEvent *events;
+     int nevents, capacity;
+     long dropped;
+     struct TraceThread *next;
+} TraceThread;
+
+int traceSync;
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static const char *stageNames[TRACE_MAX_STAGES];
+static int stageDepth[TRACE_MAX_STAGES]; /* of its first span, to indent the stats */
+static int nstages;
+static TraceThread *threads;
+static int nthreads;
+static FILE *traceFile;
+static volatile int recording;
+static long long traceStart;
+
+static __thread TraceThread *self;
+
+static TraceThread *traceThread(void)
+{
+     if (self)
+          return self;
+     self = (TraceThread *)sdt_alloc(sizeof(TraceThread));
+     memset(self, 0, sizeof(TraceThread));
+     pthread_mutex_lock(&mutex);
+     self->tid = ++nthreads;
+     snprintf(self->name, sizeof(self->name), "thread %d", self->tid);
+     self->next = threads;
+     threads = self;
+     pthread_mutex_unlock(&mutex);
+     return self;
+}
+
+/* the id of the stage called name, the same string literal for every span of it */
+int traceStage(const char *name)
+{
+     assert(name);
+     int depth = traceThread()->depth, i;
+
+     pthread_mutex_lock(&mutex);
+     for (i = 0; i < nstages; i++)
+          if (!strcmp(stageNames[i], name))
+               break;
+     if (i == nstages) {
+          if (nstages == TRACE_MAX_STAGES)
+               errx(EXIT_FAILURE, "more than %d trace stages", TRACE_MAX_STAGES);
+          stageNames[i] = name;
+          stageDepth[i] = depth;
+          nstages++;
+     }
+     pthread_mutex_unlock(&mutex);
+     return i;
+}
+
+/* ns of the monotonic clock */
+long long traceNow(void)
+{
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+long long traceBegin(void)
+{
+     traceThread()->depth++;
+     return traceNow();
+}
+
+/* ends the span begun at begin, and returns its ms */
+double traceEnd(int stage, long long begin)
+{
+     long long end = traceNow();
+
+     traceThread()->depth--;
+     traceRecord(stage, begin, end);
+     return (end - begin) * 1e-6;
+}
+
+static int histBin(long long ns)
+{
+     if (ns < HIST_EXACT)
+          return ns < 0 ? 0 : (int)ns;
+     int octave = 63 - __builtin_clzll(ns);
+     int bin = HIST_EXACT + (octave - HIST_EXACT_LOG) * HIST_SUB +
+          (int)((ns >> (octave - HIST_SUB_LOG)) & (HIST_SUB - 1));
+     return min(bin, HIST_BINS - 1);
+}
+
+/* the middle of the ns of bin */
+static double binValue(int bin)
+{
+     if (bin < HIST_EXACT)
+          return bin;
+     int octave = (bin - HIST_EXACT) / HIST_SUB + HIST_EXACT_LOG, sub = (bin - HIST_EXACT) % HIST_SUB;
+     double width = (double)(1LL << (octave - HIST_SUB_LOG));
+     return (double)(1LL << octave) + (sub + 0.5) * width;
+}
+
+/* a span of stage from begin to end ns, such as one timed by the device */
+void traceRecord(int stage, long long begin, long long end)
+{
+     assert(stage >= 0 && stage < nstages);
+     TraceThread *t = traceThread();
+     StageHist *h = &t->hist[stage];
+     long long ns = end - begin;
+
+     if (!h->bins) {
+          h->bins = (unsigned *)sdt_alloc(sizeof(unsigned) * HIST_BINS);
+          memset(h->bins, 0, sizeof(unsigned) * HIST_BINS);
+     }
+     h->bins[histBin(ns)]++;
+     h->count++;
+     h->sum += ns;
+     h->max = max(h->max, ns);
+     if (!recording)
+          return;
+     if (t->nevents == t->capacity) {
+          if (t->capacity == TRACE_MAX_EVENTS) {
+               t->dropped++;
+               return;
+          }
+          t->capacity = t->capacity ? min(t->capacity * 2, TRACE_MAX_EVENTS) : 4096;
+          t->events = (TraceEvent *)realloc(t->events, sizeof(TraceEvent) * t->capacity);
+          if (!t->events)
+               err(EXIT_FAILURE, "trace events");
+     }
+     TraceEvent *e = &t->events[t->nevents++];
+     e->stage = stage;
+     e->depth = t->depth;
+     e->begin = begin;
+     e->end = end;
+}
+
+/* names the thread in the trace file */
+void traceThreadName(const char *name)
+{
+     assert(name);
+     TraceThread *t = traceThread();
+     snprintf(t->name, sizeof(t->name), "%s", name);
+}
+
+/* records the spans from here on for traceClose() to write to path, returns 0 if
+   it can't be written */
+int traceOpen(const char *path)
+{
+     assert(path && !traceFile);
+     if (!(traceFile = fopen(path, "w")))
+          return 0;
+     traceStart = traceNow();
+     recording = 1;
+     return 1;
+}
+
+/* Writes the spans recorded since traceOpen() as Chrome trace events, in us from
+   traceOpen(). The threads recording them must be done. */
+void traceClose(void)
+{
+     if (!traceFile)
+          return;
+     const char *sep = "";
+     long dropped = 0;
+
+     recording = 0;
+     fprintf(traceFile, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+     pthread_mutex_lock(&mutex);
+     for (TraceThread *t = threads; t; t = t->next) {
+          fprintf(traceFile, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+                  "\"args\": {\"name\": \"%s\"}}", sep, t->tid, t->name);
+          sep = ",\n";
+          for (int i = 0; i < t->nevents; i++) {
+               const TraceEvent *e = &t->events[i];
+               fprintf(traceFile, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+                       "\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"depth\": %d}}", stageNames[e->stage], t->tid,
+                       (e->begin - traceStart) * 1e-3, (e->end - e->begin) * 1e-3, e->depth);
+          }
+          dropped += t->dropped;
+          sdt_free(t->events);
+          t->events = NULL;
+          t->nevents = t->capacity = 0;
+          t->dropped = 0;
+     }
+     pthread_mutex_unlock(&mutex);
+     fprintf(traceFile, "\n]}\n");
+     fclose(traceFile);
+     traceFile = NULL;
+     if (dropped)
+          fprintf(stderr, "trace: %ld spans dropped, more than %d in a thread\n", dropped, TRACE_MAX_EVENTS);
+}
+
+/* ms at or under which fraction p of the count spans of bins are */
+static double percentile(const unsigned *bins, long long count, long long maxNs, double p)
+{
+     long long rank = (long long)(p * count + 0.999999), seen = 0;
+
+     for (int i = 0; i < HIST_BINS; i++) {
+          seen += bins[i];
+          if (seen >= max(rank, 1LL))
+               return min(binValue(i), (double)maxNs) * 1e-6;
+     }
+     return maxNs * 1e-6;
+}
+
+/* The stats of the spans of stage in all threads, returns their count. The threads
+   recording them must be done. */
+int traceStats(int stage, TraceStats *stats)
+{
+     assert(stage >= 0 && stage < TRACE_MAX_STAGES && stats);
+     unsigned *bins = (unsigned *)sdt_alloc(sizeof(unsigned) * HIST_BINS);
+     long long count = 0, sum = 0, maxNs = 0;
+
+     memset(bins, 0, sizeof(unsigned) * HIST_BINS);
+     pthread_mutex_lock(&mutex);
+     for (TraceThread *t = threads; t; t = t->next) {
+          const StageHist *h = &t->hist[stage];
+          if (!h->count)
+               continue;
+          count += h->count;
+          sum += h->sum;
+          maxNs = max(maxNs, h->max);
+          for (int i = 0; i < HIST_BINS; i++)
+               bins[i] += h->bins[i];
+     }
+     pthread_mutex_unlock(&mutex);
+     stats->count = count;
+     stats->mean = count ? sum * 1e-6 / count : 0;
+     stats->p50 = count ? percentile(bins, count, maxNs, 0.5) : 0;
+     stats->p90 = count ? percentile(bins, count, maxNs, 0.9) : 0;
+     stats->p99 = count ? percentile(bins, count, maxNs, 0.99) : 0;
+     stats->max = maxNs * 1e-6;
+     sdt_free(bins);
+     return (int)min(count, (long long)INT32_MAX);
+}
+
+/* One line per stage with spans: their count, mean, percentiles and max in ms.
+   Stages are indented under the one they were first seen in. */
+void printTraceStats(FILE *fp)
+{
+     assert(fp);
+     TraceStats st;
+     char name[64];
+
+     fprintf(fp, "%-28s %8s %9s %9s %9s %9s %9s\n", "stage (ms)", "count", "mean", "p50", "p90", "p99", "max");
+     for (int s = 0; s < nstages; s++) {
+          if (!traceStats(s, &st))
+               continue;
+          snprintf(name, sizeof(name), "%*s%s", 2 * stageDepth[s], "", stageNames[s]);
+          fprintf(fp, "%-28s %8lld %9.3f %9.3f %9.3f %9.3f %9.3f\n", name, st.count, st.mean, st.p50, st.p90,
+                  st.p99, st.max);
+     }
+}
+
+/* forgets the spans so far, such as those of a warm-up */
+void traceReset(void)
+{
+     pthread_mutex_lock(&mutex);
+     for (TraceThread *t = threads; t; t = t->next) {
+          for (int s = 0; s < TRACE_MAX_STAGES; s++) {
+               StageHist *h = &t->hist[s];
+               h->count = h->sum = h->max = 0;
+               if (h->bins)
+                    memset(h->bins, 0, sizeof(unsigned) * HIST_BINS);
+          }
+          t->nevents = 0;
+          t->dropped = 0;
+     }
+     pthread_mutex_unlock(&mutex);
+}
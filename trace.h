@@ -0,0 +1,54 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdio.h>
+
+/* Spans of the stages of a detection, nested like the calls they time. Every span
+   goes into a histogram of its stage, which printTraceStats() turns into percentiles,
+   and with traceOpen() also into a Chrome trace-event file (chrome://tracing or
+   Perfetto) showing every thread's spans over time.
+
+   A span takes two clock_gettime() and a histogram increment, and the event of a
+   trace file a few more stores into a buffer of its thread, so tracing stays on. The
+   tensor operators launch their kernels asynchronously, their spans are the time of
+   the launch unless traceSync is set, which waits for the device at the end of
+   each of them. */
+
+#define TRACE_MAX_STAGES 64
+#define TRACE_MAX_EVENTS (1 << 20)  /* of a trace file, per thread, the later ones are dropped */
+
+typedef struct {
+     long long count;
+     double mean, p50, p90, p99, max; /* ms */
+} TraceStats;
+
+extern int traceSync;           /* spans of tensor operators wait for their kernels */
+
+int traceStage(const char *name);
+long long traceNow(void);
+long long traceBegin(void);
+double traceEnd(int stage, long long begin);
+void traceRecord(int stage, long long begin, long long end);
+void traceThreadName(const char *name);
+int traceOpen(const char *path);
+void traceClose(void);
+int traceStats(int stage, TraceStats *stats);
+void printTraceStats(FILE *fp);
+void traceReset(void);
+
+/* times the rest of the scope as a span of stage */
+struct TraceScope {
+     int stage;
+     long long begin;
+     explicit TraceScope(int stage) : stage(stage), begin(traceBegin()) {}
+     ~TraceScope() { traceEnd(stage, begin); }
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+/* the stage is looked up once per call site */
+#define TRACE_SCOPE(name)                                                 \
+     static const int TRACE_CONCAT(trace_stage_, __LINE__) = traceStage(name); \
+     TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(TRACE_CONCAT(trace_stage_, __LINE__))
+
+#endif  /* _TRACE_H_ */
@@ -5,8 +5,8 @@
 #include <err.h>
 #include <sys/stat.h>
 #include <opencv2/opencv.hpp>
-#include <fstream>
 #include "trtUtil.h"
+#include "trace.h"
 #include "sdt_alloc.h"
 
 #define IMG_NAME_SIZE_GUESS 1024
@@ -170,6 +170,7 @@ cv::Mat readImage(const std::string& filename, int width, int height, float *img
 void preprocessFrame(cv::Mat &frame, cv::Mat &frame_origin, int width, int height, float *img_width, float *img_height)
 {
      assert(!frame_origin.empty());
+     TRACE_SCOPE("resize");
 
      if (img_width && img_height) {
           *img_width = frame_origin.size().width;
@@ -177,41 +178,3 @@ void preprocessFrame(cv::Mat &frame, cv::Mat &frame_origin, int width, int heigh
      }
      cv::resize(frame_origin, frame, cv::Size(width, height));
 }
-
-// Our weight files are in a very simple space delimited format.
-// [type] [size] <data x size in hex>
-std::map<std::string, Weights> loadWeights(const std::string file)
-{
-    std::map<std::string, Weights> weightMap;
-	std::ifstream input(file);
-	assert(input.is_open() && "Unable to load weight file.");
-    int32_t count;
-    input >> count;
-    assert(count > 0 && "Invalid weight map file.");
-    while(count--) {
-        Weights wt{DataType::kFLOAT, nullptr, 0};
-        uint32_t type, size;
-        std::string name;
-        input >> name >> std::dec >> type >> size;
-        wt.type = static_cast<DataType>(type);
-        if (wt.type == DataType::kFLOAT) {
-            uint32_t *val = reinterpret_cast<uint32_t*>(sdt_alloc(sizeof(val) * size)); // TODO: wrong sizeof oprand
-            for (uint32_t x = 0, y = size; x < y; ++x)
-            {
-                input >> std::hex >> val[x];
-
-            }
-            wt.values = val;
-        } else if (wt.type == DataType::kHALF) {
-            uint16_t *val = reinterpret_cast<uint16_t*>(sdt_alloc(sizeof(val) * size)); // wrong sizeof oprand
-            for (uint32_t x = 0, y = size; x < y; ++x)
-            {
-                input >> std::hex >> val[x];
-            }
-            wt.values = val;
-        }
-        wt.count = size;
-        weightMap[name] = wt;
-    }
-    return weightMap;
-}
@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <err.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <vector>
+#include "weightsFile.h"
+#include "sdt_alloc.h"
+
+typedef struct {
+     char *addr;
+     size_t size;
+} Mapping;
+
+/* files mapped by loadWeightsMapped, released by freeWeights */
+static std::vector<Mapping> mappings;
+
+size_t weightsTypeSize(WeightsType type)
+{
+     switch (type) {
+     case WEIGHTS_FLOAT:
+          return 4;
+     case WEIGHTS_HALF:
+          return 2;
+     case WEIGHTS_INT8:
+          return 1;
+     default:
+          return 4;
+     }
+}
+
+int isBinaryWeightsFile(const std::string file)
+{
+     char magic[4];
+     FILE *fp;
+     int ret;
+
+     if ((fp = fopen(file.c_str(), "rb")) == NULL)
+          err(EXIT_FAILURE, "%s", file.c_str());
+     ret = fread(magic, sizeof(magic), 1, fp) == 1 && !memcmp(magic, WTB_MAGIC, sizeof(magic));
+     fclose(fp);
+     return ret;
+}
+
+/* load either weights format, the binary one is detected by its magic number */
+WeightMap loadWeights(const std::string file)
+{
+     if (isBinaryWeightsFile(file))
+          return loadWeightsMapped(file);
+     return loadWeightsText(file);
+}
+
+// Our weight files are in a very simple space delimited format.
+// [type] [size] <data x size in hex>
+WeightMap loadWeightsText(const std::string file)
+{
+    WeightMap weightMap;
+	std::ifstream input(file);
+	assert(input.is_open() && "Unable to load weight file.");
+    int32_t count;
+    input >> count;
+    assert(count > 0 && "Invalid weight map file.");
+    while(count--) {
+        HostWeights wt{WEIGHTS_FLOAT, nullptr, 0};
+        uint32_t type, size;
+        std::string name;
+        input >> name >> std::dec >> type >> size;
+        wt.type = static_cast<WeightsType>(type);
+        if (wt.type == WEIGHTS_FLOAT) {
+            uint32_t *val = reinterpret_cast<uint32_t*>(sdt_alloc(sizeof(*val) * size));
+            for (uint32_t x = 0, y = size; x < y; ++x)
+            {
+                input >> std::hex >> val[x];
+
+            }
+            wt.values = val;
+        } else if (wt.type == WEIGHTS_HALF) {
+            uint16_t *val = reinterpret_cast<uint16_t*>(sdt_alloc(sizeof(*val) * size));
+            for (uint32_t x = 0, y = size; x < y; ++x)
+            {
+                input >> std::hex >> val[x];
+            }
+            wt.values = val;
+        }
+        wt.count = size;
+        weightMap[name] = wt;
+    }
+    return weightMap;
+}
+
+/* map a .wtb file read-only, HostWeights::values point into the mapping, nothing is copied */
+WeightMap loadWeightsMapped(const std::string file)
+{
+     WeightMap weightMap;
+     const char *path = file.c_str();
+     struct stat st;
+     const WtbHeader *header;
+     const WtbEntry *entries;
+     const char *names;
+     char *addr;
+     size_t size;
+     uint32_t i;
+     int fd;
+
+     if ((fd = open(path, O_RDONLY)) == -1)
+          err(EXIT_FAILURE, "%s", path);
+     if (fstat(fd, &st) == -1)
+          err(EXIT_FAILURE, "%s", path);
+     size = st.st_size;
+     if (size < sizeof(WtbHeader))
+          errx(EXIT_FAILURE, "%s: truncated weights file", path);
+     addr = (char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+     if (addr == MAP_FAILED)
+          err(EXIT_FAILURE, "mmap %s", path);
+     close(fd);
+     madvise(addr, size, MADV_WILLNEED);
+
+     header = (const WtbHeader *)addr;
+     if (memcmp(header->magic, WTB_MAGIC, sizeof(header->magic)) ||
+         header->version != WTB_VERSION || header->alignment != WTB_ALIGNMENT ||
+         header->file_size != size ||
+         header->entries_offset + (uint64_t)header->count * sizeof(WtbEntry) > size ||
+         header->names_offset + header->names_size > size ||
+         header->names_size == 0 || addr[header->names_offset + header->names_size - 1] != '\0')
+          errx(EXIT_FAILURE, "%s: invalid weights file header", path);
+
+     entries = (const WtbEntry *)(addr + header->entries_offset);
+     names = addr + header->names_offset;
+     for (i = 0; i < header->count; i++) {
+          const WtbEntry *e = &entries[i];
+          WeightsType type = static_cast<WeightsType>(e->type);
+          if (e->name_offset >= header->names_size ||
+              e->offset % WTB_ALIGNMENT != 0 ||
+              e->offset + e->count * weightsTypeSize(type) > size)
+               errx(EXIT_FAILURE, "%s: invalid weights entry %u", path, i);
+          HostWeights wt{type, addr + e->offset, (int64_t)e->count};
+          weightMap[std::string(names + e->name_offset)] = wt;
+     }
+
+     Mapping m = {addr, size};
+     mappings.push_back(m);
+     return weightMap;
+}
+
+/* release the weights from either loader, heap copies are freed and mappings unmapped */
+void freeWeights(WeightMap &weightMap)
+{
+     std::vector<int> used(mappings.size(), 0);
+     size_t i;
+
+     for (auto &mem : weightMap) {
+          const char *p = (const char *)mem.second.values;
+          for (i = 0; i < mappings.size(); i++)
+               if (p >= mappings[i].addr && p < mappings[i].addr + mappings[i].size)
+                    break;
+          if (i < mappings.size())
+               used[i] = 1;
+          else
+               sdt_free((void *)p);
+     }
+     for (i = mappings.size(); i-- > 0;) {
+          if (!used[i])
+               continue;
+          munmap(mappings[i].addr, mappings[i].size);
+          mappings.erase(mappings.begin() + i);
+     }
+     weightMap.clear();
+}
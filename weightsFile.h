@@ -0,0 +1,60 @@
+#ifndef _WEIGHTS_FILE_H_
+#define _WEIGHTS_FILE_H_
+
+#include <stdint.h>
+#include <map>
+#include <string>
+
+/* The element type of weights, with the values of nvinfer1::DataType, so the weights
+   load without TensorRT and sqdtrt.cpp hands them to it as they are. */
+typedef enum {
+     WEIGHTS_FLOAT = 0,
+     WEIGHTS_HALF = 1,
+     WEIGHTS_INT8 = 2
+} WeightsType;
+
+/* the fields of nvinfer1::Weights */
+typedef struct {
+     WeightsType type;
+     const void *values;
+     int64_t count;             /* number of elements */
+} HostWeights;
+
+typedef std::map<std::string, HostWeights> WeightMap;
+
+/* Binary weights container (.wtb), all fields little-endian:
+   header | entry table (count entries) | name table | tensor payloads.
+   Every payload starts at a multiple of WTB_ALIGNMENT bytes from the file beginning,
+   so the mmap'ed payloads can be handed to TensorRT or the SIMD kernels as they are. */
+#define WTB_MAGIC "SQDW"
+#define WTB_VERSION 1
+#define WTB_ALIGNMENT 64
+
+typedef struct {
+     char magic[4];
+     uint32_t version;
+     uint32_t count;            /* number of tensors */
+     uint32_t alignment;        /* payload alignment, WTB_ALIGNMENT */
+     uint64_t entries_offset;
+     uint64_t names_offset;
+     uint64_t names_size;
+     uint64_t file_size;
+     uint64_t reserved[2];
+} WtbHeader;                    /* 64 bytes */
+
+typedef struct {
+     uint32_t name_offset;      /* relative to names_offset, names are NUL-terminated */
+     uint32_t type;             /* WeightsType */
+     uint64_t count;            /* number of elements */
+     uint64_t offset;           /* payload offset from the file beginning */
+     uint64_t reserved;
+} WtbEntry;                     /* 32 bytes */
+
+int isBinaryWeightsFile(const std::string file);
+WeightMap loadWeights(const std::string file);
+WeightMap loadWeightsText(const std::string file);
+WeightMap loadWeightsMapped(const std::string file);
+void freeWeights(WeightMap &weightMap);
+size_t weightsTypeSize(WeightsType type);
+
+#endif  /* _WEIGHTS_FILE_H_ */